@@ -4,12 +4,24 @@
 #include "xwift/Basic/LLVM.h"
 #include "xwift/Lexer/Token.h"
 #include "xwift/AST/Type.h"
+#include "xwift/Basic/StringCell.h"
+#include "xwift/Basic/StringInterner.h"
+#include <atomic>
 #include <memory>
 #include <vector>
 #include <map>
 
 namespace xwift {
 
+class FuncDecl;
+class VarDeclStmt;
+class ClassDecl;
+class StructDecl;
+class PropertyDecl;
+class MethodDecl;
+class ConstructorDecl;
+class ImportDecl;
+
 class ASTNode {
 public:
   virtual ~ASTNode() = default;
@@ -19,13 +31,35 @@ using ASTNodePtr = std::unique_ptr<ASTNode>;
 
 class Stmt : public ASTNode {
 public:
+  // Whether running the node can suspend a task's coroutine, worked out by
+  // the interpreter the first time a task reaches it
+  enum class Suspension : uint8_t {
+    Unknown,
+    Never,
+    May,
+  };
+  
+  // Index into the TypeProfile; 0 when the node is not a profiled site
+  uint32_t ProfileSite = 0;
+  std::atomic<Suspension> Suspends{Suspension::Unknown};
   virtual ~Stmt() = default;
 };
 using StmtPtr = std::unique_ptr<Stmt>;
 
 class Expr : public Stmt {
 public:
+  // Runtime representation proven by Sema, resolved lazily from ExprType
+  enum class EvalKind : uint8_t {
+    Unresolved,
+    Int64,
+    Double,
+    Bool,
+    Generic,
+  };
+  
   std::shared_ptr<Type> ExprType;
+  // Atomic because async tasks evaluate the same tree on several threads
+  std::atomic<EvalKind> Kind{EvalKind::Unresolved};
   virtual ~Expr() = default;
 };
 using ExprPtr = std::unique_ptr<Expr>;
@@ -90,8 +124,11 @@ public:
 class StringLiteralExpr : public Expr {
 public:
   std::string Value;
+  // Shared with every Value this literal evaluates to
+  StringCell Cell;
   SourceLocation Loc;
-  StringLiteralExpr(const std::string& val, SourceLocation loc = SourceLocation()) : Value(val), Loc(loc) {}
+  StringLiteralExpr(const std::string& val, SourceLocation loc = SourceLocation())
+    : Value(val), Cell(val), Loc(loc) {}
 };
 
 class ArrayLiteralExpr : public Expr {
@@ -104,9 +141,9 @@ public:
 
 class IdentifierExpr : public Expr {
 public:
-  std::string Name;
+  Atom Name;
   SourceLocation Loc;
-  IdentifierExpr(const std::string& name, SourceLocation loc = SourceLocation()) : Name(name), Loc(loc) {}
+  IdentifierExpr(Atom name, SourceLocation loc = SourceLocation()) : Name(name), Loc(loc) {}
 };
 
 class AssignExpr : public Expr {
@@ -121,6 +158,8 @@ public:
   std::string Op;
   ExprPtr LHS, RHS;
   SourceLocation Loc;
+  // Operand kind seen in the profile; guarded, dropped to Generic on a miss
+  std::atomic<EvalKind> SpeculatedKind{EvalKind::Unresolved};
   BinaryExpr(const std::string& op, ExprPtr lhs, ExprPtr rhs, SourceLocation loc = SourceLocation())
     : Op(op), LHS(std::move(lhs)), RHS(std::move(rhs)), Loc(loc) {}
 };
@@ -144,29 +183,62 @@ public:
 class OptionalChainExpr : public Expr {
 public:
   ExprPtr Target;
-  std::string MemberName;
+  Atom MemberName;
   std::vector<ExprPtr> CallArgs;
   SourceLocation Loc;
-  OptionalChainExpr(ExprPtr target, const std::string& member, 
+  OptionalChainExpr(ExprPtr target, Atom member, 
                     std::vector<ExprPtr> args = {}, SourceLocation loc = SourceLocation())
     : Target(std::move(target)), MemberName(member), CallArgs(std::move(args)), Loc(loc) {}
 };
 
+// `async f(args)`: starts a user function call as a task
+class AsyncExpr : public Expr {
+public:
+  ExprPtr Call;
+  SourceLocation Loc;
+  AsyncExpr(ExprPtr call, SourceLocation loc = SourceLocation())
+    : Call(std::move(call)), Loc(loc) {}
+};
+
+// `await task`: waits for a task and yields its result
+class AwaitExpr : public Expr {
+public:
+  ExprPtr Task;
+  SourceLocation Loc;
+  AwaitExpr(ExprPtr task, SourceLocation loc = SourceLocation())
+    : Task(std::move(task)), Loc(loc) {}
+};
+
+// `actor f(initial)`: creates an actor whose state starts as initial and
+// becomes f(state, message) for each message sent to it
+class ActorExpr : public Expr {
+public:
+  ExprPtr Call;
+  SourceLocation Loc;
+  ActorExpr(ExprPtr call, SourceLocation loc = SourceLocation())
+    : Call(std::move(call)), Loc(loc) {}
+};
+
 class CallExpr : public Expr {
 public:
-  std::string Callee;
+  Atom Callee;
   std::vector<ExprPtr> Args;
-  CallExpr(const std::string& callee, std::vector<ExprPtr> args)
+  // Inline cache for the user function this site calls, valid while
+  // CachedEpoch matches the interpreter's function table epoch. The epoch
+  // is published after the target, so a reader that sees it sees the target.
+  std::atomic<FuncDecl*> CachedTarget{nullptr};
+  std::atomic<uint64_t> CachedEpoch{0};
+  CallExpr(Atom callee, std::vector<ExprPtr> args)
     : Callee(callee), Args(std::move(args)) {}
 };
 
 class VarDeclStmt : public Decl {
 public:
-  std::string Name;
+  Atom Name;
   std::string Type;
   ExprPtr Init;
   bool IsMutable;
-  VarDeclStmt(const std::string& name, const std::string& type, ExprPtr init, bool mut)
+  VarDeclStmt(Atom name, const std::string& type, ExprPtr init, bool mut)
     : Name(name), Type(type), Init(std::move(init)), IsMutable(mut) {}
   
   void accept(DeclVisitor& visitor) override {
@@ -191,11 +263,11 @@ public:
 
 class IfLetStmt : public Stmt {
 public:
-  std::string VarName;
+  Atom VarName;
   ExprPtr OptionalExpr;
   StmtPtr ThenBranch;
   StmtPtr ElseBranch;
-  IfLetStmt(const std::string& varName, ExprPtr optionalExpr, 
+  IfLetStmt(Atom varName, ExprPtr optionalExpr, 
             StmtPtr thenBranch, StmtPtr elseBranch = nullptr)
     : VarName(varName), OptionalExpr(std::move(optionalExpr)), 
       ThenBranch(std::move(thenBranch)), ElseBranch(std::move(elseBranch)) {}
@@ -203,10 +275,10 @@ public:
 
 class GuardStmt : public Stmt {
 public:
-  std::string VarName;
+  Atom VarName;
   ExprPtr OptionalExpr;
   StmtPtr ElseBranch;
-  GuardStmt(const std::string& varName, ExprPtr optionalExpr, StmtPtr elseBranch)
+  GuardStmt(Atom varName, ExprPtr optionalExpr, StmtPtr elseBranch)
     : VarName(varName), OptionalExpr(std::move(optionalExpr)), 
       ElseBranch(std::move(elseBranch)) {}
 };
@@ -221,16 +293,26 @@ public:
 
 class ForStmt : public Stmt {
 public:
-  std::string VarName;
+  Atom VarName;
   ExprPtr Start;
   ExprPtr End;
   ExprPtr Step;
   StmtPtr Body;
-  ForStmt(const std::string& var, ExprPtr start, ExprPtr end, ExprPtr step, StmtPtr body)
+  ForStmt(Atom var, ExprPtr start, ExprPtr end, ExprPtr step, StmtPtr body)
     : VarName(var), Start(std::move(start)), End(std::move(end)), 
       Step(std::move(step)), Body(std::move(body)) {}
 };
 
+// taskGroup { ... } or taskGroup (timeoutMs) { ... }: tasks started inside
+// the body are joined when it ends and cancelled together
+class TaskGroupStmt : public Stmt {
+public:
+  ExprPtr Timeout;
+  StmtPtr Body;
+  TaskGroupStmt(ExprPtr timeout, StmtPtr body)
+    : Timeout(std::move(timeout)), Body(std::move(body)) {}
+};
+
 class SwitchStmt : public Stmt {
 public:
   ExprPtr Condition;
@@ -249,13 +331,13 @@ public:
 
 class FuncDecl : public Decl {
 public:
-  std::string Name;
+  Atom Name;
   std::string ReturnType;
-  std::vector<std::pair<std::string, std::string>> Params;
+  std::vector<std::pair<Atom, std::string>> Params;
   StmtPtr Body;
-  FuncDecl(const std::string& name, const std::string& retType, StmtPtr body)
+  FuncDecl(Atom name, const std::string& retType, StmtPtr body)
     : Name(name), ReturnType(retType), Body(std::move(body)) {}
-  void addParam(const std::string& name, const std::string& type) {
+  void addParam(Atom name, const std::string& type) {
     Params.push_back({name, type});
   }
   
@@ -309,14 +391,14 @@ class MethodDecl : public Decl {
 public:
   std::string Name;
   std::string ReturnType;
-  std::vector<std::pair<std::string, std::string>> Params;
+  std::vector<std::pair<Atom, std::string>> Params;
   StmtPtr Body;
   bool IsVirtual;
   bool IsOverride;
   MethodDecl(const std::string& name, const std::string& retType, StmtPtr body)
     : Name(name), ReturnType(retType), Body(std::move(body)), 
       IsVirtual(false), IsOverride(false) {}
-  void addParam(const std::string& name, const std::string& type) {
+  void addParam(Atom name, const std::string& type) {
     Params.push_back({name, type});
   }
   
@@ -327,10 +409,10 @@ public:
 
 class ConstructorDecl : public Decl {
 public:
-  std::vector<std::pair<std::string, std::string>> Params;
+  std::vector<std::pair<Atom, std::string>> Params;
   StmtPtr Body;
   ConstructorDecl(StmtPtr body) : Body(std::move(body)) {}
-  void addParam(const std::string& name, const std::string& type) {
+  void addParam(Atom name, const std::string& type) {
     Params.push_back({name, type});
   }
   
@@ -342,9 +424,9 @@ public:
 class MemberAccessExpr : public Expr {
 public:
   ExprPtr Object;
-  std::string MemberName;
+  Atom MemberName;
   SourceLocation Loc;
-  MemberAccessExpr(ExprPtr obj, const std::string& member, SourceLocation loc = SourceLocation())
+  MemberAccessExpr(ExprPtr obj, Atom member, SourceLocation loc = SourceLocation())
     : Object(std::move(obj)), MemberName(member), Loc(loc) {}
 };
 
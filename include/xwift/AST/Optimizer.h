@@ -3,6 +3,7 @@
 
 #include "xwift/AST/Nodes.h"
 #include "xwift/AST/Type.h"
+#include "xwift/AST/TypeProfile.h"
 #include <memory>
 #include <vector>
 
@@ -14,6 +15,9 @@ public:
     
     void optimize(Program* program);
     
+    // Pre-specialize hot sites from a previous run's type feedback
+    void applyProfile(Program* program, const TypeProfile& profile);
+    
 private:
     void optimizeDecl(Decl* decl);
     void optimizeStmt(Stmt* stmt);
@@ -0,0 +1,85 @@
+#ifndef XWIFT_AST_TYPEPROFILE_H
+#define XWIFT_AST_TYPEPROFILE_H
+
+#include "xwift/Basic/LLVM.h"
+#include <string>
+#include <vector>
+
+namespace xwift {
+
+class Program;
+class Stmt;
+
+// Operand kinds seen at each binary operator. Saved next to the script as
+// a .xwprofile file and reloaded on the next run, so hot arithmetic and
+// comparisons start out specialized.
+class TypeProfile {
+public:
+  // One bit per Value alternative, in variant order
+  enum KindBits : uint16_t {
+    KindNil = 1 << 0,
+    KindInt = 1 << 1,
+    KindDouble = 1 << 2,
+    KindString = 1 << 3,
+    KindBool = 1 << 4,
+    KindArray = 1 << 5,
+    KindObject = 1 << 6,
+    KindTask = 1 << 7,
+    KindActor = 1 << 8,
+    KindChannel = 1 << 9,
+  };
+
+  struct Site {
+    uint64_t Count = 0;
+    uint16_t LHSKinds = 0;
+    uint16_t RHSKinds = 0;
+
+    static bool isMonomorphic(uint16_t kinds) {
+      return kinds != 0 && (kinds & (kinds - 1)) == 0;
+    }
+  };
+
+  static const unsigned FormatVersion = 2;
+  static const uint64_t HotThreshold = 16;
+
+  // Assigns ProfileSite ids in a fixed pre-order walk and returns the nodes
+  // indexed by id. Id 0 is reserved for "not profiled".
+  static std::vector<Stmt*> numberSites(Program* program);
+  static uint64_t hashSource(const std::string& source);
+  static std::string pathFor(const std::string& sourceFile);
+
+  void reset(size_t siteCount);
+  bool load(const std::string& path, uint64_t sourceHash);
+  bool save(const std::string& path, uint64_t sourceHash) const;
+
+  void recordOperands(uint32_t site, uint16_t lhsKind, uint16_t rhsKind) {
+    if (Site* s = at(site)) {
+      s->Count++;
+      s->LHSKinds |= lhsKind;
+      s->RHSKinds |= rhsKind;
+    }
+  }
+
+  const Site* lookup(uint32_t site) const {
+    if (site == 0 || site >= Sites.size()) {
+      return nullptr;
+    }
+    return &Sites[site];
+  }
+
+  size_t size() const { return Sites.size(); }
+
+private:
+  Site* at(uint32_t site) {
+    if (site == 0 || site >= Sites.size()) {
+      return nullptr;
+    }
+    return &Sites[site];
+  }
+
+  std::vector<Site> Sites;
+};
+
+}
+
+#endif
@@ -263,10 +263,10 @@ public:
                 break;
         }
         
-        std::cout << error.format();
+        *output << error.format();
         
         if (error.Level == DiagLevel::Fatal) {
-            std::cout << formatStackTrace();
+            *output << formatStackTrace();
         }
     }
     
@@ -327,6 +327,11 @@ public:
         return "";
     }
     
+    // Where diagnostics are printed; defaults to stdout
+    void setOutput(std::ostream& out) {
+        output = &out;
+    }
+    
     void setWarningAsError(bool enabled) {
         warningAsError = enabled;
     }
@@ -355,6 +360,10 @@ public:
         return warningCount;
     }
     
+    const std::vector<DiagnosticError>& getDiagnostics() const {
+        return diagnostics;
+    }
+    
     void clear() {
         diagnostics.clear();
         errorCount = 0;
@@ -364,14 +373,14 @@ public:
     
     void dumpAll() {
         for (const auto& diag : diagnostics) {
-            std::cout << diag.format();
+            *output << diag.format();
         }
     }
     
     void dumpErrors() {
         for (const auto& diag : diagnostics) {
             if (diag.Level == DiagLevel::Error || diag.Level == DiagLevel::Fatal) {
-                std::cout << diag.format();
+                *output << diag.format();
             }
         }
     }
@@ -379,7 +388,7 @@ public:
     void dumpWarnings() {
         for (const auto& diag : diagnostics) {
             if (diag.Level == DiagLevel::Warning) {
-                std::cout << diag.format();
+                *output << diag.format();
             }
         }
     }
@@ -393,6 +402,7 @@ private:
     std::string currentFilename;
     std::string sourceCode;
     std::vector<std::string> sourceLines;
+    std::ostream* output = &std::cout;
     bool warningAsError = false;
     bool ignoreWarnings = false;
     int maxErrors = 100;
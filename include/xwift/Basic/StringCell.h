@@ -0,0 +1,83 @@
+#ifndef XWIFT_BASIC_STRINGCELL_H
+#define XWIFT_BASIC_STRINGCELL_H
+
+#include "xwift/Basic/LLVM.h"
+#include <cstddef>
+#include <string_view>
+
+namespace xwift {
+
+// Shared immutable string storage. Copies share one buffer, so passing a
+// string Value around or evaluating a literal is a refcount bump.
+//
+// Concatenation appends in place only when the left operand is the last
+// cell holding its buffer, since no one else can see the change; otherwise
+// it copies into a buffer with room to grow. The interpreter hands over
+// the old value for `s = s + piece`, so such a loop is amortized O(1) per
+// append.
+class StringCell {
+public:
+  StringCell() : Buf(emptyBuffer()) {}
+  StringCell(const std::string& str) : Buf(std::make_shared<std::string>(str)) {}
+  StringCell(std::string&& str) : Buf(std::make_shared<std::string>(std::move(str))) {}
+
+  static StringCell concat(StringCell lhs, const StringCell& rhs) {
+    if (rhs.empty()) {
+      return lhs;
+    }
+    if (lhs.empty()) {
+      return rhs;
+    }
+
+    if (lhs.Buf.use_count() == 1) {
+      lhs.Buf->append(*rhs.Buf);
+      return lhs;
+    }
+
+    std::string data;
+    data.reserve((lhs.size() + rhs.size()) * 2);
+    data.append(*lhs.Buf);
+    data.append(*rhs.Buf);
+    return StringCell(std::move(data));
+  }
+
+  // Stays valid while this cell or a copy of it is alive
+  const std::string& str() const { return *Buf; }
+  std::string_view view() const { return *Buf; }
+
+  size_t size() const { return Buf->size(); }
+  bool empty() const { return Buf->empty(); }
+  // Whether other is a copy of this cell rather than equal contents
+  bool shares(const StringCell& other) const { return Buf == other.Buf; }
+
+  bool operator==(const StringCell& other) const { return Buf == other.Buf || *Buf == *other.Buf; }
+  bool operator!=(const StringCell& other) const { return !(*this == other); }
+
+private:
+  static const std::shared_ptr<std::string>& emptyBuffer() {
+    static const std::shared_ptr<std::string> empty = std::make_shared<std::string>();
+    return empty;
+  }
+
+  std::shared_ptr<std::string> Buf;
+};
+
+// A string Value's contents, read-only. It holds a copy of the cell, so the
+// buffer stays shared and nothing appends to it while the string is in use.
+class PinnedString {
+public:
+  PinnedString(std::nullptr_t) {}
+  explicit PinnedString(const StringCell& cell) : Cell(cell), Valid(true) {}
+
+  explicit operator bool() const { return Valid; }
+  const std::string& operator*() const { return Cell.str(); }
+  const std::string* operator->() const { return &Cell.str(); }
+
+private:
+  StringCell Cell;
+  bool Valid = false;
+};
+
+}
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef XWIFT_BASIC_STRINGINTERNER_H
+#define XWIFT_BASIC_STRINGINTERNER_H
+
+#include "xwift/Basic/LLVM.h"
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <shared_mutex>
+#include <unordered_set>
+
+namespace xwift {
+
+// Process-wide table of unique strings. Interned strings are never freed,
+// so the returned pointers stay valid for the lifetime of the program.
+// Lookups of already-interned names only take a shared lock, so isolates
+// on different threads don't serialize on it.
+class StringInterner {
+public:
+  static StringInterner& getInstance();
+
+  const std::string* intern(const std::string& str);
+  size_t size() const;
+
+private:
+  StringInterner() = default;
+
+  StringInterner(const StringInterner&) = delete;
+  StringInterner& operator=(const StringInterner&) = delete;
+
+  mutable std::shared_mutex mutex;
+  std::unordered_set<std::string> strings;
+};
+
+// Interned name. Equal atoms share one string, so comparing, ordering and
+// hashing them only touches the pointer. The order is stable for the run
+// but not alphabetical. Building one from a string takes the interner's
+// lock, so that is explicit; names are interned once, by the lexer.
+class Atom {
+public:
+  Atom() : Str(emptyString()) {}
+  explicit Atom(const std::string& str) : Str(StringInterner::getInstance().intern(str)) {}
+  explicit Atom(const char* str) : Atom(std::string(str)) {}
+
+  const std::string& str() const { return *Str; }
+  const char* c_str() const { return Str->c_str(); }
+  size_t size() const { return Str->size(); }
+  bool empty() const { return Str->empty(); }
+  const std::string* get() const { return Str; }
+
+  operator const std::string&() const { return *Str; }
+
+  bool operator==(const Atom& other) const { return Str == other.Str; }
+  bool operator!=(const Atom& other) const { return Str != other.Str; }
+  bool operator<(const Atom& other) const { return std::less<const std::string*>()(Str, other.Str); }
+
+  friend bool operator==(const Atom& lhs, const std::string& rhs) { return *lhs.Str == rhs; }
+  friend bool operator==(const Atom& lhs, const char* rhs) { return *lhs.Str == rhs; }
+  friend bool operator!=(const Atom& lhs, const std::string& rhs) { return *lhs.Str != rhs; }
+  friend bool operator!=(const Atom& lhs, const char* rhs) { return *lhs.Str != rhs; }
+
+  friend std::string operator+(const Atom& lhs, const std::string& rhs) { return *lhs.Str + rhs; }
+  friend std::string operator+(const std::string& lhs, const Atom& rhs) { return lhs + *rhs.Str; }
+  friend std::string operator+(const Atom& lhs, const char* rhs) { return *lhs.Str + rhs; }
+  friend std::string operator+(const char* lhs, const Atom& rhs) { return lhs + *rhs.Str; }
+
+  friend std::ostream& operator<<(std::ostream& os, const Atom& atom) { return os << *atom.Str; }
+
+private:
+  static const std::string* emptyString() {
+    static const std::string* empty = StringInterner::getInstance().intern(std::string());
+    return empty;
+  }
+
+  const std::string* Str;
+};
+
+}
+
+namespace std {
+
+template<>
+struct hash<xwift::Atom> {
+  size_t operator()(const xwift::Atom& atom) const noexcept {
+    return std::hash<const std::string*>()(atom.get());
+  }
+};
+
+}
+
+#endif
@@ -6,61 +6,284 @@
 #include "xwift/Lexer/Lexer.h"
 #include "xwift/Parser/SyntaxParser.h"
 #include "xwift/stdlib/HTTP/HTTP.h"
+#ifndef _WIN32
+#include "xwift/stdlib/HTTP/AsyncHTTP.h"
+#endif
+#include "xwift/stdlib/HTTP/HTTPCache.h"
+#include "xwift/stdlib/HTTP/HTTPMetrics.h"
+#include "xwift/stdlib/HTTP/HTTPServer.h"
 #include "xwift/stdlib/JSON/JSON.h"
 #include "xwift/stdlib/Terminal/Terminal.h"
 #include "xwift/AST/Module.h"
+#include "xwift/AST/TypeProfile.h"
 #include "xwift/Filesystem/Filesystem.h"
 #include "xwift/Logging/Logger.h"
+#include "xwift/stdlib/Concurrency/Async.h"
+#include "xwift/stdlib/Concurrency/Channel.h"
+#include "xwift/stdlib/Concurrency/Coroutine.h"
+#include "xwift/stdlib/Concurrency/EventLoop.h"
+#include "xwift/stdlib/Concurrency/TaskGroup.h"
+#include "xwift/stdlib/Net/Socket.h"
+#include <algorithm>
 #include <map>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 #include <iostream>
 #include <sstream>
 #include <fstream>
 #include <variant>
 #include <vector>
 #include <set>
+#include <cmath>
+#include <cstdint>
 #include <cstdio>
 #include <thread>
 #include <chrono>
+#include <random>
+#include <optional>
+#include <atomic>
+#include <future>
 
 namespace xwift {
 
-class ObjectValue {
-public:
+class Value;
+class ObjectHeap;
+class ScriptTask;
+class ScriptActor;
+class ScriptChannel;
+class ScriptServer;
+class ForkPool;
+
+// Heap cell for a class or struct instance. ObjectValue handles share one
+// cell and keep it alive through RefCount.
+struct ObjectData {
   std::string ClassName;
-  std::map<std::string, Value> Properties;
-  std::map<std::string, std::function<Value(std::vector<Value>)>> Methods;
+  std::map<Atom, Value> Properties;
+  std::map<Atom, std::function<Value(std::vector<Value>)>> Methods;
   bool IsStruct;
-  
+  size_t RefCount = 0;
+  ObjectHeap* Heap;
+  // Scratch state for ObjectHeap::collectCycles
+  size_t GCRefs = 0;
+  bool GCReachable = false;
+
+  ObjectData(const std::string& className, bool isStruct);
+  ObjectData(const ObjectData& other);
+  ~ObjectData();
+};
+
+// Class instances have reference semantics: copying the handle shares the
+// instance. Struct instances share their cell until one copy is written to,
+// which then clones it (shallow, copy-on-write).
+class ObjectValue {
+public:
   ObjectValue(const std::string& className, bool isStruct = false)
-    : ClassName(className), IsStruct(isStruct) {}
+    : Data(new ObjectData(className, isStruct)) {
+    Data->RefCount++;
+  }
+  
+  ObjectValue(const ObjectValue& other) : Data(other.Data) {
+    retain();
+  }
   
-  ObjectValue(const ObjectValue& other)
-    : ClassName(other.ClassName), Properties(other.Properties), 
-      Methods(other.Methods), IsStruct(other.IsStruct) {}
+  ObjectValue(ObjectValue&& other) noexcept : Data(other.Data) {
+    other.Data = nullptr;
+  }
   
   ObjectValue& operator=(const ObjectValue& other) {
+    if (Data != other.Data) {
+      ObjectData* old = Data;
+      Data = other.Data;
+      retain();
+      release(old);
+    }
+    return *this;
+  }
+  
+  ObjectValue& operator=(ObjectValue&& other) noexcept {
     if (this != &other) {
-      ClassName = other.ClassName;
-      Properties = other.Properties;
-      Methods = other.Methods;
-      IsStruct = other.IsStruct;
+      ObjectData* old = Data;
+      Data = other.Data;
+      other.Data = nullptr;
+      release(old);
     }
     return *this;
   }
+  
+  ~ObjectValue() {
+    release(Data);
+  }
+  
+  const ObjectData* operator->() const { return Data; }
+  const ObjectData* get() const { return Data; }
+  
+  // Cell to write through; clones a struct that is still shared
+  ObjectData* mutate();
+  
+  bool isSameInstance(const ObjectValue& other) const { return Data == other.Data; }
+  
+  bool operator==(const ObjectValue& other) const;
+  
+private:
+  friend class Value;
+  
+  void retain() {
+    if (Data) {
+      Data->RefCount++;
+    }
+  }
+  
+  static void release(ObjectData* data) {
+    if (data && --data->RefCount == 0) {
+      delete data;
+    }
+  }
+  
+  ObjectData* Data;
+};
+
+// Registry of live object cells. Refcounting frees acyclic garbage as soon
+// as the last handle goes away; collectCycles is the backup for instances
+// that only keep each other alive.
+//
+// Each interpreter owns a heap and installs it as the thread's current heap
+// while it runs, so isolates on different threads never walk each other's
+// objects. Cells created outside any interpreter go to a process-wide heap.
+class ObjectHeap {
+public:
+  ObjectHeap() = default;
+  
+  ~ObjectHeap() {
+    // Values that escaped the owning interpreter stay valid; they just stop
+    // being tracked
+    for (auto* data : Objects) {
+      data->Heap = nullptr;
+    }
+  }
+  
+  class Scope {
+  public:
+    explicit Scope(ObjectHeap& heap) : Saved(Active) { Active = &heap; }
+    ~Scope() { Active = Saved; }
+    
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+    
+  private:
+    ObjectHeap* Saved;
+  };
+  
+  static ObjectHeap& current() {
+    if (Active) {
+      return *Active;
+    }
+    static ObjectHeap global;
+    return global;
+  }
+  
+  void track(ObjectData* data) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Objects.insert(data);
+  }
+  
+  void untrack(ObjectData* data) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Objects.erase(data);
+  }
+  
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return Objects.size();
+  }
+  
+  bool shouldCollect() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return Objects.size() >= NextCollection;
+  }
+  
+  // Frees every cell that is unreachable from outside the heap and returns
+  // how many were freed
+  size_t collectCycles();
+  
+private:
+  ObjectHeap(const ObjectHeap&) = delete;
+  ObjectHeap& operator=(const ObjectHeap&) = delete;
+  
+  template<typename Fn>
+  static void forEachChild(const Value& value, Fn&& fn);
+  
+  mutable std::mutex mutex;
+  std::unordered_set<ObjectData*> Objects;
+  size_t NextCollection = 1024;
+  
+  static inline thread_local ObjectHeap* Active = nullptr;
+};
+
+// Handle to a call started with `async`. Copies share the task.
+class TaskValue {
+public:
+  explicit TaskValue(std::shared_ptr<ScriptTask> task) : Task(std::move(task)) {}
+  
+  ScriptTask* get() const { return Task.get(); }
+  
+  bool operator==(const TaskValue& other) const { return Task == other.Task; }
+  
+private:
+  std::shared_ptr<ScriptTask> Task;
+};
+
+// Handle to an actor created with `actor`. Copies share the actor.
+class ActorValue {
+public:
+  explicit ActorValue(std::shared_ptr<ScriptActor> actor) : Actor(std::move(actor)) {}
+  
+  ScriptActor* get() const { return Actor.get(); }
+  
+  bool operator==(const ActorValue& other) const { return Actor == other.Actor; }
+  
+private:
+  std::shared_ptr<ScriptActor> Actor;
+};
+
+// Handle to a channel made with channel(capacity). Copies share the channel,
+// including copies sent to other tasks.
+class ChannelValue {
+public:
+  explicit ChannelValue(std::shared_ptr<ScriptChannel> channel) : Channel(std::move(channel)) {}
+  
+  ScriptChannel* get() const { return Channel.get(); }
+  const std::shared_ptr<ScriptChannel>& shared() const { return Channel; }
+  
+  bool operator==(const ChannelValue& other) const { return Channel == other.Channel; }
+  
+private:
+  std::shared_ptr<ScriptChannel> Channel;
 };
 
 class Value {
 private:
-  std::variant<std::monostate, int64_t, double, std::string, bool, std::vector<Value>, ObjectValue> data;
+  // Strings are held in a shared immutable cell; get<std::string>() hands
+  // out a PinnedString, which reads the cell without exposing its buffer
+  std::variant<std::monostate, int64_t, double, StringCell, bool, std::vector<Value>, ObjectValue,
+               TaskValue, ActorValue, ChannelValue> data;
   
 public:
   Value() : data(std::monostate()) {}
   Value(int64_t val) : data(val) {}
   Value(double val) : data(val) {}
-  Value(const std::string& val) : data(val) {}
+  Value(const std::string& val) : data(StringCell(val)) {}
+  Value(std::string&& val) : data(StringCell(std::move(val))) {}
+  Value(const char* val) : data(StringCell(std::string(val))) {}
+  Value(const StringCell& val) : data(val) {}
   Value(bool val) : data(val) {}
   Value(const std::vector<Value>& val) : data(val) {}
+  Value(std::vector<Value>&& val) : data(std::move(val)) {}
   Value(const ObjectValue& val) : data(val) {}
+  Value(ObjectValue&& val) : data(std::move(val)) {}
+  Value(const TaskValue& val) : data(val) {}
+  Value(const ActorValue& val) : data(val) {}
+  Value(const ChannelValue& val) : data(val) {}
   
   bool isNil() const {
     return std::holds_alternative<std::monostate>(data);
@@ -71,19 +294,39 @@ public:
   }
   
   template<typename T>
-  T* get() {
-    return std::get_if<T>(&data);
+  auto get() {
+    if constexpr (std::is_same_v<T, std::string>) {
+      auto cell = std::get_if<StringCell>(&data);
+      return cell ? PinnedString(*cell) : PinnedString(nullptr);
+    } else {
+      return std::get_if<T>(&data);
+    }
   }
   
   template<typename T>
-  const T* get() const {
-    return std::get_if<T>(&data);
+  auto get() const {
+    if constexpr (std::is_same_v<T, std::string>) {
+      auto cell = std::get_if<StringCell>(&data);
+      return cell ? PinnedString(*cell) : PinnedString(nullptr);
+    } else {
+      return std::get_if<T>(&data);
+    }
   }
   
   const auto& getData() const {
     return data;
   }
   
+  // Deep copy whose strings, arrays and objects share no storage with this
+  // value, for handing it to an interpreter on another thread. Objects are
+  // created in the current ObjectHeap; aliasing and cycles are preserved.
+  Value sendableCopy() const;
+  
+private:
+  Value sendableCopy(std::unordered_map<const ObjectData*, ObjectValue>& copies) const;
+  
+public:
+  
   bool operator==(const Value& other) const {
     return data == other.data;
   }
@@ -93,15 +336,317 @@ public:
   }
 };
 
-std::string httpGet(const std::string& url);
-std::string httpPost(const std::string& url, const std::string& data);
-std::string httpPostJSON(const std::string& url, const std::string& json);
-std::string httpPostForm(const std::string& url, const std::map<std::string, std::string>& params);
-std::string httpPut(const std::string& url, const std::string& data);
-std::string httpDelete(const std::string& url);
-int httpStatusCode(const std::string& url);
-bool httpIsSuccess(const std::string& url);
-std::string httpGetHeader(const std::string& url, const std::string& header);
+inline ObjectData::ObjectData(const std::string& className, bool isStruct)
+  : ClassName(className), IsStruct(isStruct), Heap(&ObjectHeap::current()) {
+  Heap->track(this);
+}
+
+inline ObjectData::ObjectData(const ObjectData& other)
+  : ClassName(other.ClassName), Properties(other.Properties),
+    Methods(other.Methods), IsStruct(other.IsStruct), Heap(&ObjectHeap::current()) {
+  Heap->track(this);
+}
+
+inline ObjectData::~ObjectData() {
+  if (Heap) {
+    Heap->untrack(this);
+  }
+}
+
+inline ObjectData* ObjectValue::mutate() {
+  if (Data->IsStruct && Data->RefCount > 1) {
+    ObjectData* copy = new ObjectData(*Data);
+    copy->RefCount++;
+    release(Data);
+    Data = copy;
+  }
+  return Data;
+}
+
+inline bool ObjectValue::operator==(const ObjectValue& other) const {
+  if (Data == other.Data) {
+    return true;
+  }
+  if (!Data || !other.Data || !Data->IsStruct || !other.Data->IsStruct) {
+    return false;
+  }
+  return Data->ClassName == other.Data->ClassName && Data->Properties == other.Data->Properties;
+}
+
+inline Value Value::sendableCopy() const {
+  std::unordered_map<const ObjectData*, ObjectValue> copies;
+  return sendableCopy(copies);
+}
+
+inline Value Value::sendableCopy(std::unordered_map<const ObjectData*, ObjectValue>& copies) const {
+  if (auto cell = std::get_if<StringCell>(&data)) {
+    return Value(std::string(cell->view()));
+  }
+  if (auto arr = std::get_if<std::vector<Value>>(&data)) {
+    std::vector<Value> elements;
+    elements.reserve(arr->size());
+    for (const auto& elem : *arr) {
+      elements.push_back(elem.sendableCopy(copies));
+    }
+    return Value(std::move(elements));
+  }
+  if (auto obj = std::get_if<ObjectValue>(&data)) {
+    const ObjectData* source = obj->get();
+    if (!source) {
+      return *this;
+    }
+    auto it = copies.find(source);
+    if (it != copies.end()) {
+      return Value(it->second);
+    }
+    ObjectValue copy(source->ClassName, source->IsStruct);
+    ObjectData* target = copy.Data;
+    copies.emplace(source, copy);
+    target->Methods = source->Methods;
+    for (const auto& prop : source->Properties) {
+      target->Properties.emplace(prop.first, prop.second.sendableCopy(copies));
+    }
+    return Value(std::move(copy));
+  }
+  // Scalars are copied by value; tasks, actors and channels are meant to be
+  // shared
+  return *this;
+}
+
+template<typename Fn>
+void ObjectHeap::forEachChild(const Value& value, Fn&& fn) {
+  if (auto obj = value.get<ObjectValue>()) {
+    if (obj->get()) {
+      fn(const_cast<ObjectData*>(obj->get()));
+    }
+  } else if (auto arr = value.get<std::vector<Value>>()) {
+    for (const auto& elem : *arr) {
+      forEachChild(elem, fn);
+    }
+  }
+}
+
+// Trial deletion: references held by other tracked cells are subtracted
+// from each cell's count. Whatever still has references left is held from
+// outside (scopes, temporaries, natives); everything not reachable from
+// those cells is cyclic garbage.
+inline size_t ObjectHeap::collectCycles() {
+  std::vector<ObjectData*> objects;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    objects.assign(Objects.begin(), Objects.end());
+  }
+  
+  for (auto* obj : objects) {
+    obj->GCRefs = obj->RefCount;
+    obj->GCReachable = false;
+  }
+  for (auto* obj : objects) {
+    for (const auto& prop : obj->Properties) {
+      forEachChild(prop.second, [](ObjectData* child) { child->GCRefs--; });
+    }
+  }
+  
+  std::vector<ObjectData*> worklist;
+  for (auto* obj : objects) {
+    if (obj->GCRefs > 0) {
+      obj->GCReachable = true;
+      worklist.push_back(obj);
+    }
+  }
+  while (!worklist.empty()) {
+    ObjectData* obj = worklist.back();
+    worklist.pop_back();
+    for (const auto& prop : obj->Properties) {
+      forEachChild(prop.second, [&worklist](ObjectData* child) {
+        if (!child->GCReachable) {
+          child->GCReachable = true;
+          worklist.push_back(child);
+        }
+      });
+    }
+  }
+  
+  std::vector<ObjectData*> garbage;
+  for (auto* obj : objects) {
+    if (!obj->GCReachable) {
+      // Pin while the cycle is being cut so no cell is freed mid-walk
+      obj->RefCount++;
+      garbage.push_back(obj);
+    }
+  }
+  for (auto* obj : garbage) {
+    std::map<Atom, Value> props;
+    props.swap(obj->Properties);
+    obj->Methods.clear();
+  }
+  for (auto* obj : garbage) {
+    if (--obj->RefCount == 0) {
+      delete obj;
+    }
+  }
+  
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    NextCollection = std::max<size_t>(1024, Objects.size() * 2);
+  }
+  return garbage.size();
+}
+
+// Channel<Value> shared between interpreters. Like actor messages, items are
+// copied into InFlight by the sender and out of it into the receiver's
+// current heap, so no object is reachable from two heaps at once.
+class ScriptChannel {
+public:
+  explicit ScriptChannel(size_t capacity) : Queue(capacity) {}
+  
+  bool send(const Value& value, const CancellationToken* token) {
+    return Queue.send(stage(value), token);
+  }
+  
+  bool trySend(const Value& value) {
+    Value item = stage(value);
+    return Queue.trySend(item) == ChannelStatus::Ok;
+  }
+  
+  std::optional<Value> receive(const CancellationToken* token) {
+    auto item = Queue.receive(token);
+    if (!item) {
+      return std::nullopt;
+    }
+    return item->sendableCopy();
+  }
+  
+  std::optional<Value> tryReceive() {
+    Value item;
+    if (Queue.tryReceive(item) != ChannelStatus::Ok) {
+      return std::nullopt;
+    }
+    return item.sendableCopy();
+  }
+  
+  // Hands the next item to done without holding a thread while it waits:
+  // at once if one is queued, else on the thread that sends it. nullopt once
+  // the channel is closed and drained. The item is left in the channel's
+  // heap, so whoever keeps it must keep the channel too.
+  static void receiveLater(const std::shared_ptr<ScriptChannel>& channel,
+                           std::function<void(std::optional<Value>)> done) {
+    while (true) {
+      Value item;
+      ChannelStatus status = channel->Queue.tryReceive(item);
+      if (status == ChannelStatus::Ok) {
+        done(std::move(item));
+        return;
+      }
+      if (status == ChannelStatus::Closed) {
+        done(std::nullopt);
+        return;
+      }
+      if (channel->Queue.whenReadable([channel, done] { receiveLater(channel, done); })) {
+        return;
+      }
+    }
+  }
+  
+  void close() { Queue.close(); }
+  
+  Channel<Value>& queue() { return Queue; }
+  
+private:
+  Value stage(const Value& value) {
+    ObjectHeap::Scope heapScope(InFlight);
+    return value.sendableCopy();
+  }
+  
+  // Declared first so queued items are destroyed before the heap they were
+  // copied into
+  ObjectHeap InFlight;
+  Channel<Value> Queue;
+};
+
+// Sockets opened by the tcp* and udp* builtins, which scripts hold as Int
+// handles. Shared by an interpreter and its forks, so a task can serve a
+// connection another task accepted. socketClose drops a socket from here.
+class ScriptSockets {
+public:
+  using Socket = std::variant<std::shared_ptr<net::TCPStream>, std::shared_ptr<net::TCPListener>,
+                              std::shared_ptr<net::UDPSocket>>;
+  
+  int64_t add(Socket socket) {
+    std::lock_guard<std::mutex> lock(Mutex);
+    int64_t handle = Next++;
+    Open.emplace(handle, std::move(socket));
+    return handle;
+  }
+  
+  std::optional<Socket> get(const Value& handle) {
+    auto id = handle.get<int64_t>();
+    std::lock_guard<std::mutex> lock(Mutex);
+    auto it = id ? Open.find(*id) : Open.end();
+    if (it == Open.end()) {
+      return std::nullopt;
+    }
+    return it->second;
+  }
+  
+  // nullptr unless handle names an open socket of kind T
+  template <typename T>
+  std::shared_ptr<T> find(const Value& handle) {
+    auto socket = get(handle);
+    auto* kind = socket ? std::get_if<std::shared_ptr<T>>(&*socket) : nullptr;
+    return kind ? *kind : nullptr;
+  }
+  
+  std::optional<Socket> remove(const Value& handle) {
+    auto id = handle.get<int64_t>();
+    std::lock_guard<std::mutex> lock(Mutex);
+    auto it = id ? Open.find(*id) : Open.end();
+    if (it == Open.end()) {
+      return std::nullopt;
+    }
+    Socket socket = std::move(it->second);
+    Open.erase(it);
+    return socket;
+  }
+  
+private:
+  std::mutex Mutex;
+  std::unordered_map<int64_t, Socket> Open;
+  int64_t Next = 1;
+};
+
+// What the *Async builtins run on: one event loop for an interpreter and
+// all of its forks, with the HTTP client, stdin reader and sockets that use
+// it. Members are destroyed in reverse order, so all go before the loop.
+struct AsyncIO {
+  EventLoop Loop;
+#ifndef _WIN32
+  http::AsyncHTTPClient HTTP{Loop};
+#endif
+  std::shared_ptr<LineReader> Stdin = std::make_shared<LineReader>(Loop, 0);
+  // Shared with connects and accepts still in flight, which add to it
+  std::shared_ptr<ScriptSockets> Sockets = std::make_shared<ScriptSockets>();
+};
+
+std::string httpGet(const std::string& url, int timeoutMs = 0);
+std::string httpPost(const std::string& url, const std::string& data, int timeoutMs = 0);
+std::string httpPostJSON(const std::string& url, const std::string& json, int timeoutMs = 0);
+std::string httpPostForm(const std::string& url, const std::map<std::string, std::string>& params, int timeoutMs = 0);
+std::string httpPut(const std::string& url, const std::string& data, int timeoutMs = 0);
+std::string httpDelete(const std::string& url, int timeoutMs = 0);
+int httpStatusCode(const std::string& url, int timeoutMs = 0);
+bool httpIsSuccess(const std::string& url, int timeoutMs = 0);
+std::string httpGetHeader(const std::string& url, const std::string& header, int timeoutMs = 0);
+Result<http::Response> httpSend(const http::Request& request, int timeoutMs = 0);
+std::vector<Result<http::Response>> httpSendAll(const std::vector<http::Request>& requests,
+                                                size_t maxConcurrent, int timeoutMs = 0);
+Result<http::Response> httpDownload(const std::string& url, const std::string& path, int timeoutMs = 0);
+Result<http::Response> httpUpload(const std::string& method, const std::string& url,
+                                  const std::string& path, int timeoutMs = 0);
+Result<http::Response> httpPostMultipart(const std::string& url,
+                                         const std::vector<std::pair<std::string, std::string>>& fields,
+                                         const std::vector<std::pair<std::string, std::string>>& files,
+                                         int timeoutMs = 0);
 std::string urlEncode(const std::string& str);
 std::string urlDecode(const std::string& str);
 std::string jsonParse(const std::string& jsonStr);
@@ -110,10 +655,12 @@ std::string jsonGet(const std::string& jsonStr, const std::string& key);
 
 class Interpreter {
 public:
+  // Declared first so it outlives every value below that points into it
+  ObjectHeap Heap;
   DiagnosticEngine& Diags;
-  std::vector<std::map<std::string, Value>> ScopeStack;
-  std::map<std::string, std::function<Value(std::vector<Value>)>> Functions;
-  std::map<std::string, FuncDecl*> UserFunctions;
+  std::vector<std::unordered_map<Atom, Value>> ScopeStack;
+  std::unordered_map<Atom, std::function<Value(std::vector<Value>)>> Functions;
+  std::unordered_map<Atom, FuncDecl*> UserFunctions;
   std::map<std::string, ClassDecl*> Classes;
   std::map<std::string, StructDecl*> Structs;
   std::map<std::string, PropertyDecl*> Properties;
@@ -128,13 +675,74 @@ public:
   Value ReturnValue;
   std::string currentFilename = "";
   ObjectValue* CurrentObject = nullptr;
+  TypeProfile* Profile = nullptr;
+  uint64_t FunctionEpoch = 1;
+  // Per-isolate state so interpreters on different threads share nothing
+  // mutable: script output, the logSetLevel threshold and the randomInt
+  // generator. Log entries still go to the shared logger's appenders. The
+  // generator is 5KB, so it is only made on first use rather than in every
+  // task's fork.
+  std::ostream* Output = &std::cout;
+  logging::LogLevel LogLevel = logging::LogLevel::Info;
+  std::unique_ptr<std::mt19937> Rng;
+  // Shared with forked task interpreters, which print to the same Output
+  std::shared_ptr<std::mutex> OutputMutex = std::make_shared<std::mutex>();
+  // Tasks and actors started by this interpreter, joined before run()
+  // returns
+  std::vector<std::shared_ptr<ScriptTask>> Tasks;
+  std::vector<std::shared_ptr<ScriptActor>> Actors;
+  // Servers made by httpServer, stopped when this interpreter goes
+  std::vector<std::shared_ptr<ScriptServer>> Servers;
+  size_t TaskPruneThreshold = 64;
+  // Set in forks; cancelled when the task's group is cancelled or its
+  // deadline passes
+  std::shared_ptr<CancellationToken> Cancellation;
+  // taskGroup blocks this interpreter is inside, innermost last. Tasks
+  // started in a block belong to it rather than to Tasks.
+  struct TaskGroupScope {
+    std::shared_ptr<CancellationToken> Token;
+    std::vector<std::shared_ptr<ScriptTask>> Tasks;
+  };
+  std::vector<TaskGroupScope> Groups;
+  // Created on first use, and by the first fork so that it shares the loop
+  mutable std::shared_ptr<AsyncIO> IO;
+  // Set in forks whose task runs as a coroutine; suspended calls are
+  // resumed through it
+  ScriptTask* RunningTask = nullptr;
+  // Statements maySuspend is working out right now, to stop it recursing
+  // through recursive functions, and the lowest index among them that a
+  // guess was made for (SIZE_MAX if none since it last finished)
+  std::vector<Stmt*> SuspensionQueries;
+  size_t SuspensionGuess = SIZE_MAX;
+  // Finished task forks, shared by an interpreter and all of its forks
+  mutable std::shared_ptr<ForkPool> Forks;
   
   void setFilename(const std::string& filename) {
     currentFilename = filename;
   }
   
+  // Record type feedback into profile while running; pass nullptr to stop
+  void setProfile(TypeProfile* profile) {
+    Profile = profile;
+  }
+  
+  void setOutput(std::ostream& out) {
+    Output = &out;
+  }
+  
+  void logMessage(logging::LogLevel level, const std::string& message) {
+    if (level < LogLevel || LogLevel == logging::LogLevel::Off) {
+      return;
+    }
+    logging::LogEntry entry;
+    entry.level = level;
+    entry.message = message;
+    entry.file = currentFilename;
+    logging::Logger::getInstance().write(entry);
+  }
+  
   void enterScope() {
-    ScopeStack.push_back(std::map<std::string, Value>());
+    ScopeStack.emplace_back();
   }
   
   void exitScope() {
@@ -143,7 +751,7 @@ public:
     }
   }
   
-  void setVariable(const std::string& name, const Value& value) {
+  void setVariable(Atom name, const Value& value) {
     for (auto it = ScopeStack.rbegin(); it != ScopeStack.rend(); ++it) {
       auto varIt = it->find(name);
       if (varIt != it->end()) {
@@ -156,7 +764,14 @@ public:
     }
   }
   
-  Value* getVariable(const std::string& name) {
+  // Binds name in the innermost scope, shadowing any outer binding
+  void declareVariable(Atom name, const Value& value) {
+    if (!ScopeStack.empty()) {
+      ScopeStack.back()[name] = value;
+    }
+  }
+  
+  Value* getVariable(Atom name) {
     for (auto it = ScopeStack.rbegin(); it != ScopeStack.rend(); ++it) {
       auto varIt = it->find(name);
       if (varIt != it->end()) {
@@ -166,16 +781,78 @@ public:
     return nullptr;
   }
   
+  // Fork for an async task: the parent's program and output, with fresh
+  // scopes, heap and random state
+  Interpreter(DiagnosticEngine& diag, const Interpreter& parent) : Interpreter(diag) {
+    FunctionEpoch = 0;
+    inherit(parent);
+  }
+  
+  // What a fork takes from its parent. Called again when a pooled fork is
+  // reused, so the declarations are only copied if the parent has
+  // registered functions since.
+  void inherit(const Interpreter& parent) {
+    if (FunctionEpoch != parent.FunctionEpoch) {
+      UserFunctions = parent.UserFunctions;
+      Classes = parent.Classes;
+      Structs = parent.Structs;
+      Properties = parent.Properties;
+      Methods = parent.Methods;
+      Constructors = parent.Constructors;
+      FunctionEpoch = parent.FunctionEpoch;
+    }
+    BasePath = parent.BasePath;
+    MaxSteps = parent.MaxSteps;
+    Cancellation = parent.Cancellation;
+    IO = parent.asyncIO();
+    currentFilename = parent.currentFilename;
+    Output = parent.Output;
+    OutputMutex = parent.OutputMutex;
+    LogLevel = parent.LogLevel;
+    Forks = parent.forkPool();
+  }
+  
+  // Clears what the last task left in this fork so it can run another.
+  // False if the task left behind something only this fork can stop, or
+  // objects that are still referenced.
+  bool resetFork() {
+    if (!Tasks.empty() || !Actors.empty() || !Servers.empty() || !Groups.empty() ||
+        !LoadedPrograms.empty()) {
+      return false;
+    }
+    ScopeStack.clear();
+    Heap.collectCycles();
+    if (Heap.size() != 0) {
+      return false;
+    }
+    CurrentStep = 0;
+    HasReturn = false;
+    ReturnValue = Value();
+    CurrentObject = nullptr;
+    RunningTask = nullptr;
+    SuspensionQueries.clear();
+    SuspensionGuess = SIZE_MAX;
+    Rng.reset();
+    Cancellation.reset();
+    IO.reset();
+    // An idle fork must not keep its pool alive
+    Forks.reset();
+    return true;
+  }
+  
+  ~Interpreter();
+  
   Interpreter(DiagnosticEngine& diag) : Diags(diag) {
-    Functions["setCursor"] = [](std::vector<Value> args) -> Value {
+    Functions[Atom("setCursor")] = [](std::vector<Value> args) -> Value {
       return Value(int64_t(0));
     };
     
-    Functions["clearLine"] = [](std::vector<Value> args) -> Value {
+    Functions[Atom("clearLine")] = [](std::vector<Value> args) -> Value {
       return Value(int64_t(0));
     };
     
-    Functions["print"] = [](std::vector<Value> args) -> Value {
+    Functions[Atom("print")] = [this](std::vector<Value> args) -> Value {
+      std::lock_guard<std::mutex> lock(*OutputMutex);
       for (size_t i = 0; i < args.size(); i++) {
         std::string output;
         if (auto val = args[i].get<std::string>()) {
@@ -206,52 +883,53 @@ public:
         }
         if (i < args.size() - 1) output += " ";
         
-        std::cout << output << std::flush;
+        *Output << output << std::flush;
       }
       return Value(int64_t(0));
     };
     
-    Functions["println"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("println")] = [this](std::vector<Value> args) -> Value {
+      std::lock_guard<std::mutex> lock(*OutputMutex);
       for (size_t i = 0; i < args.size(); i++) {
         if (auto val = args[i].get<std::string>()) {
-          std::cout << *val;
+          *Output << *val;
         } else if (auto val = args[i].get<int64_t>()) {
-          std::cout << *val;
+          *Output << *val;
         } else if (auto val = args[i].get<double>()) {
-          std::cout << *val;
+          *Output << *val;
         } else if (auto val = args[i].get<bool>()) {
-          std::cout << (*val ? "true" : "false");
+          *Output << (*val ? "true" : "false");
         } else if (auto arr = args[i].get<std::vector<Value>>()) {
-          std::cout << "[";
+          *Output << "[";
           for (size_t j = 0; j < arr->size(); j++) {
             if (auto v = (*arr)[j].get<std::string>()) {
-              std::cout << "\"" << *v << "\"";
+              *Output << "\"" << *v << "\"";
             } else if (auto v = (*arr)[j].get<int64_t>()) {
-              std::cout << *v;
+              *Output << *v;
             } else if (auto v = (*arr)[j].get<double>()) {
-              std::cout << *v;
+              *Output << *v;
             } else if (auto v = (*arr)[j].get<bool>()) {
-              std::cout << (*v ? "true" : "false");
+              *Output << (*v ? "true" : "false");
             } else if (auto v = (*arr)[j].get<std::vector<Value>>()) {
-              std::cout << "[...]";
+              *Output << "[...]";
             }
-            if (j < arr->size() - 1) std::cout << ", ";
+            if (j < arr->size() - 1) *Output << ", ";
           }
-          std::cout << "]";
+          *Output << "]";
         }
-        if (i < args.size() - 1) std::cout << " ";
+        if (i < args.size() - 1) *Output << " ";
       }
-      std::cout << std::endl;
+      *Output << std::endl;
       return Value(int64_t(0));
     };
     
-    Functions["read"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("read")] = [this](std::vector<Value> args) -> Value {
       std::string input;
       std::getline(std::cin, input);
       return Value(input);
     };
     
-    Functions["readInt"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("readInt")] = [this](std::vector<Value> args) -> Value {
       std::string input;
       std::getline(std::cin, input);
       try {
@@ -261,69 +939,78 @@ public:
       }
     };
     
-    Functions["sleep"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("sleep")] = [this](std::vector<Value> args) -> Value {
       if (args.empty()) return Value(int64_t(0));
       if (auto ms = args[0].get<int64_t>()) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(*ms));
+        sleepFor(*ms);
       }
       return Value(int64_t(0));
     };
     
-    Functions["httpGet"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("httpGet")] = [this](std::vector<Value> args) -> Value {
+      checkCancelled();
       if (args.empty()) return Value("");
       if (auto url = args[0].get<std::string>()) {
-        return Value(httpGet(*url));
+        return Value(httpGet(*url, requestTimeoutMs()));
       }
       return Value("");
     };
     
-    Functions["httpPost"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("httpPost")] = [this](std::vector<Value> args) -> Value {
+      checkCancelled();
       if (args.size() < 2) return Value("");
       if (auto url = args[0].get<std::string>()) {
         if (auto data = args[1].get<std::string>()) {
-          return Value(httpPost(*url, *data));
+          return Value(httpPost(*url, *data, requestTimeoutMs()));
         }
       }
       return Value("");
     };
     
-    Functions["httpPut"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("httpPut")] = [this](std::vector<Value> args) -> Value {
+      checkCancelled();
       if (args.size() < 2) return Value("");
       if (auto url = args[0].get<std::string>()) {
         if (auto data = args[1].get<std::string>()) {
-          return Value(httpPut(*url, *data));
+          return Value(httpPut(*url, *data, requestTimeoutMs()));
         }
       }
       return Value("");
     };
     
-    Functions["httpDelete"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("httpDelete")] = [this](std::vector<Value> args) -> Value {
+      checkCancelled();
       if (args.empty()) return Value("");
       if (auto url = args[0].get<std::string>()) {
-        return Value(httpDelete(*url));
+        return Value(httpDelete(*url, requestTimeoutMs()));
       }
       return Value("");
     };
     
-    Functions["httpStatusCode"] = [this](std::vector<Value> args) -> Value {
+    // Takes a response from httpRequest, or a URL to GET; -1 if the request
+    // failed
+    Functions[Atom("httpStatusCode")] = [this](std::vector<Value> args) -> Value {
+      checkCancelled();
       if (args.empty()) return Value(int64_t(0));
-      if (auto url = args[0].get<std::string>()) {
-        return Value(int64_t(httpStatusCode(*url)));
+      if (auto response = responseArgument(args[0])) {
+        return responseProperty(*response, "status");
       }
       return Value(int64_t(0));
     };
     
-    Functions["httpPostJSON"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("httpPostJSON")] = [this](std::vector<Value> args) -> Value {
+      checkCancelled();
       if (args.size() < 2) return Value("");
       if (auto url = args[0].get<std::string>()) {
         if (auto json = args[1].get<std::string>()) {
-          return Value(httpPostJSON(*url, *json));
+          return Value(httpPostJSON(*url, *json, requestTimeoutMs()));
         }
       }
       return Value("");
     };
     
-    Functions["httpPostForm"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("httpPostForm")] = [this](std::vector<Value> args) -> Value {
+      checkCancelled();
       if (args.size() < 2) return Value("");
       if (auto url = args[0].get<std::string>()) {
         if (auto params = args[1].get<std::vector<Value>>()) {
@@ -337,83 +1024,310 @@ public:
               }
             }
           }
-          return Value(httpPostForm(*url, paramMap));
+          return Value(httpPostForm(*url, paramMap, requestTimeoutMs()));
         }
       }
       return Value("");
     };
     
-    Functions["httpIsSuccess"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("httpIsSuccess")] = [this](std::vector<Value> args) -> Value {
+      checkCancelled();
       if (args.empty()) return Value(false);
-      if (auto url = args[0].get<std::string>()) {
-        return Value(httpIsSuccess(*url));
+      if (auto response = responseArgument(args[0])) {
+        return responseProperty(*response, "ok");
       }
       return Value(false);
     };
     
-    Functions["httpGetHeader"] = [this](std::vector<Value> args) -> Value {
+    // Header names are matched ignoring case
+    Functions[Atom("httpGetHeader")] = [this](std::vector<Value> args) -> Value {
+      checkCancelled();
       if (args.size() < 2) return Value("");
-      if (auto url = args[0].get<std::string>()) {
-        if (auto header = args[1].get<std::string>()) {
-          return Value(httpGetHeader(*url, *header));
+      if (auto header = args[1].get<std::string>()) {
+        if (auto response = responseArgument(args[0])) {
+          return Value(responseHeader(*response, *header));
         }
       }
       return Value("");
     };
     
-    Functions["urlEncode"] = [this](std::vector<Value> args) -> Value {
-      if (args.empty()) return Value("");
-      if (auto str = args[0].get<std::string>()) {
-        return Value(http::urlEncode(*str));
+    // httpRequest(method, url[, body[, headers]]) sends one request and
+    // returns everything about its response at once, as an HTTPResponse
+    // with status, ok, body, headers, error and timeMs. Headers go both ways
+    // as flat name, value pairs, like httpPostForm's parameters. A failed
+    // request has status -1 and the reason in error.
+    Functions[Atom("httpRequest")] = [this](std::vector<Value> args) -> Value {
+      checkCancelled();
+      http::Request request;
+      if (args.size() >= 2) {
+        if (auto method = args[0].get<std::string>()) {
+          request.method = *method;
+        }
+        if (auto url = args[1].get<std::string>()) {
+          request.url = *url;
+        }
       }
-      return Value("");
-    };
-    
-    Functions["urlDecode"] = [this](std::vector<Value> args) -> Value {
-      if (args.empty()) return Value("");
-      if (auto str = args[0].get<std::string>()) {
-        return Value(http::urlDecode(*str));
+      if (args.size() >= 3) {
+        if (auto body = args[2].get<std::string>()) {
+          request.body = *body;
+        }
       }
-      return Value("");
+      if (args.size() >= 4) {
+        if (auto pairs = args[3].get<std::vector<Value>>()) {
+          for (size_t i = 0; i + 1 < pairs->size(); i += 2) {
+            auto name = (*pairs)[i].get<std::string>();
+            auto value = (*pairs)[i + 1].get<std::string>();
+            if (name && value) {
+              request.headers[*name] = *value;
+            }
+          }
+        }
+      }
+      return responseValue(httpSend(request, requestTimeoutMs()));
     };
     
-    Functions["len"] = [this](std::vector<Value> args) -> Value {
-      if (args.empty()) return Value(int64_t(0));
-      if (auto s = args[0].get<std::string>()) {
-        return Value(int64_t(s->length()));
-      }
-      if (auto arr = args[0].get<std::vector<Value>>()) {
-        return Value(int64_t(arr->size()));
+    // httpDownload(url, path) saves the body of a GET to path as it arrives
+    // instead of holding it in memory, and returns the HTTPResponse with an
+    // empty body and the length written in bytes
+    Functions[Atom("httpDownload")] = [this](std::vector<Value> args) -> Value {
+      checkCancelled();
+      auto url = args.size() >= 2 ? args[0].get<std::string>() : nullptr;
+      auto path = args.size() >= 2 ? args[1].get<std::string>() : nullptr;
+      if (!url || !path) {
+        return responseValue(Result<http::Response>::err(Error::http("httpDownload expects a URL and a path")));
       }
-      return Value(int64_t(0));
+      return responseValue(httpDownload(*url, *path, requestTimeoutMs()));
     };
     
-    Functions["append"] = [this](std::vector<Value> args) -> Value {
-      if (args.size() < 2) return Value(int64_t(0));
-      if (auto arr = args[0].get<std::vector<Value>>()) {
-        std::vector<Value> newArr = *arr;
-        newArr.push_back(args[1]);
-        return Value(newArr);
+    // httpUpload(method, url, path) sends the file at path as the body,
+    // read as it goes out
+    Functions[Atom("httpUpload")] = [this](std::vector<Value> args) -> Value {
+      checkCancelled();
+      auto method = args.size() >= 3 ? args[0].get<std::string>() : nullptr;
+      auto url = args.size() >= 3 ? args[1].get<std::string>() : nullptr;
+      auto path = args.size() >= 3 ? args[2].get<std::string>() : nullptr;
+      if (!method || !url || !path) {
+        return responseValue(Result<http::Response>::err(Error::http("httpUpload expects a method, a URL and a path")));
       }
-      return Value(int64_t(0));
+      return responseValue(httpUpload(*method, *url, *path, requestTimeoutMs()));
     };
     
-    Functions["remove"] = [this](std::vector<Value> args) -> Value {
-      if (args.size() < 2) return Value(int64_t(0));
-      if (auto arr = args[0].get<std::vector<Value>>()) {
-        std::vector<Value> newArr = *arr;
-        if (auto idx = args[1].get<int64_t>()) {
-          if (*idx >= 0 && *idx < (int64_t)newArr.size()) {
-            newArr.erase(newArr.begin() + *idx);
+    // httpPostMultipart(url, fields, files) posts a multipart/form-data
+    // body. fields alternates names and values, files names and paths; each
+    // file is read as it goes out, so its size does not matter.
+    Functions[Atom("httpPostMultipart")] = [this](std::vector<Value> args) -> Value {
+      checkCancelled();
+      auto url = args.size() >= 3 ? args[0].get<std::string>() : nullptr;
+      auto fields = args.size() >= 3 ? args[1].get<std::vector<Value>>() : nullptr;
+      auto files = args.size() >= 3 ? args[2].get<std::vector<Value>>() : nullptr;
+      if (!url || !fields || !files) {
+        return responseValue(Result<http::Response>::err(
+          Error::http("httpPostMultipart expects a URL, an array of fields and an array of files")));
+      }
+      auto pairs = [](const std::vector<Value>& flat) {
+        std::vector<std::pair<std::string, std::string>> out;
+        for (size_t i = 0; i + 1 < flat.size(); i += 2) {
+          auto name = flat[i].get<std::string>();
+          auto value = flat[i + 1].get<std::string>();
+          if (name && value) {
+            out.emplace_back(*name, *value);
           }
         }
-        return Value(newArr);
-      }
-      return Value(int64_t(0));
+        return out;
+      };
+      return responseValue(httpPostMultipart(*url, pairs(*fields), pairs(*files), requestTimeoutMs()));
     };
     
-    Functions["get"] = [this](std::vector<Value> args) -> Value {
-      if (args.size() < 2) return Value(int64_t(0));
+    // Counters of the cache every blocking request goes through, as an
+    // HTTPCacheStats with hits, misses, revalidations, entries and bytes
+    Functions[Atom("httpCacheStats")] = [](std::vector<Value> args) -> Value {
+      http::HTTPCacheStats stats = http::CachingHTTPBackend::sharedStats();
+      ObjectValue object("HTTPCacheStats", true);
+      auto& props = object.mutate()->Properties;
+      props[Atom("hits")] = Value(int64_t(stats.hits));
+      props[Atom("misses")] = Value(int64_t(stats.misses));
+      props[Atom("revalidations")] = Value(int64_t(stats.revalidations));
+      props[Atom("entries")] = Value(int64_t(stats.entries));
+      props[Atom("bytes")] = Value(int64_t(stats.bytes));
+      return Value(std::move(object));
+    };
+    
+    // One HTTPHostStats per host requests went to over the network, with
+    // counts, bytes, total latency percentiles and the mean of each phase
+    Functions[Atom("httpHostStats")] = [](std::vector<Value> args) -> Value {
+      std::vector<Value> hosts;
+      for (const auto& [host, metrics] : http::HTTPMetrics::shared().snapshot()) {
+        ObjectValue object("HTTPHostStats", true);
+        auto& props = object.mutate()->Properties;
+        props[Atom("host")] = Value(host);
+        props[Atom("requests")] = Value(int64_t(metrics.requests));
+        props[Atom("failures")] = Value(int64_t(metrics.failures));
+        props[Atom("newConnections")] = Value(int64_t(metrics.newConnections));
+        props[Atom("bytesSent")] = Value(int64_t(metrics.bytesSent));
+        props[Atom("bytesReceived")] = Value(int64_t(metrics.bytesReceived));
+        props[Atom("meanMs")] = Value(metrics.total.meanMs());
+        props[Atom("p50Ms")] = Value(metrics.total.percentileMs(0.5));
+        props[Atom("p95Ms")] = Value(metrics.total.percentileMs(0.95));
+        props[Atom("p99Ms")] = Value(metrics.total.percentileMs(0.99));
+        props[Atom("maxMs")] = Value(metrics.total.maxMs());
+        props[Atom("dnsMs")] = Value(metrics.nameLookup.meanMs());
+        props[Atom("connectMs")] = Value(metrics.connect.meanMs());
+        props[Atom("tlsMs")] = Value(metrics.tls.meanMs());
+        props[Atom("firstByteMs")] = Value(metrics.firstByte.meanMs());
+        hosts.push_back(Value(std::move(object)));
+      }
+      return Value(std::move(hosts));
+    };
+    
+    // httpServer(port) makes an HTTP/1.1 server for port, 0 for any free
+    // one, and returns its handle; nothing listens until httpServerStart
+    Functions[Atom("httpServer")] = [this](std::vector<Value> args) -> Value {
+      return createServer(args);
+    };
+    
+    // httpRoute(server, method, pattern, handler) sends requests matching
+    // pattern, such as "/users/:id" or "/files/*path", to the function named
+    // handler. method "*" takes any method.
+    Functions[Atom("httpRoute")] = [this](std::vector<Value> args) -> Value {
+      return addRoute(args);
+    };
+    
+    // httpResponse(status, body[, headers]) builds the reply a handler
+    // returns when a plain String for a 200 will not do
+    Functions[Atom("httpResponse")] = [](std::vector<Value> args) -> Value {
+      ObjectValue object("HTTPResponse", true);
+      auto& props = object.mutate()->Properties;
+      props[Atom("status")] = args.size() >= 1 ? args[0] : Value(int64_t(200));
+      props[Atom("body")] = args.size() >= 2 ? args[1] : Value("");
+      props[Atom("headers")] = args.size() >= 3 ? args[2] : Value(std::vector<Value>());
+      return Value(std::move(object));
+    };
+    
+    // Starts listening and returns the port, or -1 if it could not
+    Functions[Atom("httpServerStart")] = [this](std::vector<Value> args) -> Value {
+      return startServer(args);
+    };
+    
+    // Blocks until a handler or another task calls httpServerStop
+    Functions[Atom("httpServerWait")] = [this](std::vector<Value> args) -> Value {
+      return waitServer(args);
+    };
+    
+    Functions[Atom("httpServerStop")] = [this](std::vector<Value> args) -> Value {
+      return stopServer(args);
+    };
+    
+    // Bodies in URL order, "" for a request that failed
+    Functions[Atom("httpGetAll")] = [this](std::vector<Value> args) -> Value {
+      checkCancelled();
+      std::vector<http::Request> requests;
+      if (!args.empty()) {
+        if (auto urls = args[0].get<std::vector<Value>>()) {
+          for (const auto& url : *urls) {
+            requests.emplace_back();
+            if (auto text = url.get<std::string>()) {
+              requests.back().url = *text;
+            }
+          }
+        }
+      }
+      std::vector<Value> bodies;
+      for (auto& result : httpSendAll(requests, batchConcurrency(args), requestTimeoutMs())) {
+        bodies.push_back(Value(result.is_ok() ? std::move(result.unwrap().body) : std::string()));
+      }
+      return Value(std::move(bodies));
+    };
+    
+    // Requests come flat, as method, url, body triples in the way
+    // httpPostForm takes pairs; each result is [status, body, error], with
+    // error "" on success
+    Functions[Atom("httpBatch")] = [this](std::vector<Value> args) -> Value {
+      checkCancelled();
+      std::vector<http::Request> requests;
+      if (!args.empty()) {
+        if (auto fields = args[0].get<std::vector<Value>>()) {
+          for (size_t i = 0; i + 2 < fields->size(); i += 3) {
+            requests.emplace_back();
+            http::Request& request = requests.back();
+            if (auto method = (*fields)[i].get<std::string>()) {
+              request.method = *method;
+            }
+            if (auto url = (*fields)[i + 1].get<std::string>()) {
+              request.url = *url;
+            }
+            if (auto body = (*fields)[i + 2].get<std::string>()) {
+              request.body = *body;
+            }
+          }
+        }
+      }
+      std::vector<Value> results;
+      for (auto& result : httpSendAll(requests, batchConcurrency(args), requestTimeoutMs())) {
+        if (result.is_ok()) {
+          http::Response& response = result.unwrap();
+          results.push_back(Value(std::vector<Value>{
+            Value(int64_t(response.statusCode)), Value(std::move(response.body)), Value("")}));
+        } else {
+          results.push_back(Value(std::vector<Value>{
+            Value(int64_t(0)), Value(""), Value(result.error().getMessage())}));
+        }
+      }
+      return Value(std::move(results));
+    };
+    
+    Functions[Atom("urlEncode")] = [this](std::vector<Value> args) -> Value {
+      if (args.empty()) return Value("");
+      if (auto str = args[0].get<std::string>()) {
+        return Value(http::urlEncode(*str));
+      }
+      return Value("");
+    };
+    
+    Functions[Atom("urlDecode")] = [this](std::vector<Value> args) -> Value {
+      if (args.empty()) return Value("");
+      if (auto str = args[0].get<std::string>()) {
+        return Value(http::urlDecode(*str));
+      }
+      return Value("");
+    };
+    
+    Functions[Atom("len")] = [this](std::vector<Value> args) -> Value {
+      if (args.empty()) return Value(int64_t(0));
+      if (auto s = args[0].get<std::string>()) {
+        return Value(int64_t(s->length()));
+      }
+      if (auto arr = args[0].get<std::vector<Value>>()) {
+        return Value(int64_t(arr->size()));
+      }
+      return Value(int64_t(0));
+    };
+    
+    Functions[Atom("append")] = [this](std::vector<Value> args) -> Value {
+      if (args.size() < 2) return Value(int64_t(0));
+      if (auto arr = args[0].get<std::vector<Value>>()) {
+        std::vector<Value> newArr = *arr;
+        newArr.push_back(args[1]);
+        return Value(newArr);
+      }
+      return Value(int64_t(0));
+    };
+    
+    Functions[Atom("remove")] = [this](std::vector<Value> args) -> Value {
+      if (args.size() < 2) return Value(int64_t(0));
+      if (auto arr = args[0].get<std::vector<Value>>()) {
+        std::vector<Value> newArr = *arr;
+        if (auto idx = args[1].get<int64_t>()) {
+          if (*idx >= 0 && *idx < (int64_t)newArr.size()) {
+            newArr.erase(newArr.begin() + *idx);
+          }
+        }
+        return Value(newArr);
+      }
+      return Value(int64_t(0));
+    };
+    
+    Functions[Atom("get")] = [this](std::vector<Value> args) -> Value {
+      if (args.size() < 2) return Value(int64_t(0));
       if (auto arr = args[0].get<std::vector<Value>>()) {
         if (auto idx = args[1].get<int64_t>()) {
           if (*idx >= 0 && *idx < (int64_t)arr->size()) {
@@ -424,7 +1338,7 @@ public:
       return Value(int64_t(0));
     };
     
-    Functions["set"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("set")] = [this](std::vector<Value> args) -> Value {
       if (args.size() < 3) return Value(int64_t(0));
       if (auto arr = args[0].get<std::vector<Value>>()) {
         std::vector<Value> newArr = *arr;
@@ -438,7 +1352,7 @@ public:
       return Value(int64_t(0));
     };
     
-    Functions["contains"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("contains")] = [this](std::vector<Value> args) -> Value {
       if (args.size() < 2) return Value(false);
       if (auto arr = args[0].get<std::vector<Value>>()) {
         for (const auto& item : *arr) {
@@ -464,7 +1378,7 @@ public:
       return Value(false);
     };
     
-    Functions["indexOf"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("indexOf")] = [this](std::vector<Value> args) -> Value {
       if (args.size() < 2) return Value(int64_t(-1));
       if (auto arr = args[0].get<std::vector<Value>>()) {
         int64_t index = 0;
@@ -492,7 +1406,7 @@ public:
       return Value(int64_t(-1));
     };
     
-    Functions["toString"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("toString")] = [this](std::vector<Value> args) -> Value {
       if (args.empty()) return Value(std::string(""));
       if (auto i = args[0].get<int64_t>()) {
         return Value(std::to_string(*i));
@@ -506,7 +1420,7 @@ public:
       return Value(std::string(""));
     };
     
-    Functions["toInt"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("toInt")] = [this](std::vector<Value> args) -> Value {
       if (args.empty()) return Value(int64_t(0));
       if (auto s = args[0].get<std::string>()) {
         try {
@@ -518,7 +1432,7 @@ public:
       return Value(int64_t(0));
     };
     
-    Functions["find"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("find")] = [this](std::vector<Value> args) -> Value {
       if (args.size() < 2) return Value(int64_t(-1));
       if (auto str = args[0].get<std::string>()) {
         if (auto substr = args[1].get<std::string>()) {
@@ -540,7 +1454,7 @@ public:
       return Value(int64_t(-1));
     };
     
-    Functions["substring"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("substring")] = [this](std::vector<Value> args) -> Value {
       if (args.size() < 2) return Value("");
       if (auto str = args[0].get<std::string>()) {
         if (auto start = args[1].get<int64_t>()) {
@@ -560,7 +1474,7 @@ public:
       return Value("");
     };
     
-    Functions["jsonParse"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("jsonParse")] = [this](std::vector<Value> args) -> Value {
       if (args.empty()) return Value("");
       if (auto jsonStr = args[0].get<std::string>()) {
         json::JSONParser parser;
@@ -573,7 +1487,7 @@ public:
       return Value("");
     };
     
-    Functions["jsonGet"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("jsonGet")] = [this](std::vector<Value> args) -> Value {
       if (args.size() < 2) return Value("");
       if (auto jsonStr = args[0].get<std::string>()) {
         if (auto key = args[1].get<std::string>()) {
@@ -596,7 +1510,7 @@ public:
       return Value("");
     };
     
-    Functions["jsonHasKey"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("jsonHasKey")] = [this](std::vector<Value> args) -> Value {
       if (args.size() < 2) return Value(false);
       if (auto jsonStr = args[0].get<std::string>()) {
         if (auto key = args[1].get<std::string>()) {
@@ -611,7 +1525,7 @@ public:
       return Value(false);
     };
     
-    Functions["jsonPretty"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("jsonPretty")] = [this](std::vector<Value> args) -> Value {
       if (args.empty()) return Value("");
       if (auto jsonStr = args[0].get<std::string>()) {
         json::JSONParser parser;
@@ -624,7 +1538,7 @@ public:
       return Value("");
     };
     
-    Functions["jsonGetArray"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("jsonGetArray")] = [this](std::vector<Value> args) -> Value {
       if (args.empty()) return Value(std::vector<Value>());
       if (auto jsonStr = args[0].get<std::string>()) {
         json::JSONParser parser;
@@ -643,7 +1557,7 @@ public:
       return Value(std::vector<Value>());
     };
     
-    Functions["jsonGetObject"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("jsonGetObject")] = [this](std::vector<Value> args) -> Value {
       if (args.empty()) return Value(std::vector<Value>());
       if (auto jsonStr = args[0].get<std::string>()) {
         json::JSONParser parser;
@@ -663,7 +1577,7 @@ public:
       return Value(std::vector<Value>());
     };
     
-    Functions["jsonSerialize"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("jsonSerialize")] = [this](std::vector<Value> args) -> Value {
       if (args.size() < 2) return Value("");
       if (auto typeName = args[0].get<std::string>()) {
         if (auto fields = args[1].get<std::vector<Value>>()) {
@@ -688,7 +1602,7 @@ public:
       return Value("");
     };
     
-    Functions["fileExists"] = [](std::vector<Value> args) -> Value {
+    Functions[Atom("fileExists")] = [](std::vector<Value> args) -> Value {
       if (args.empty()) return Value(false);
       if (auto path = args[0].get<std::string>()) {
         return Value(fs::FileSystem::exists(*path));
@@ -696,7 +1610,8 @@ public:
       return Value(false);
     };
     
-    Functions["fileRead"] = [](std::vector<Value> args) -> Value {
+    Functions[Atom("fileRead")] = [this](std::vector<Value> args) -> Value {
+      checkCancelled();
       if (args.empty()) return Value("");
       if (auto path = args[0].get<std::string>()) {
         std::string content;
@@ -708,7 +1623,8 @@ public:
       return Value("");
     };
     
-    Functions["fileWrite"] = [](std::vector<Value> args) -> Value {
+    Functions[Atom("fileWrite")] = [this](std::vector<Value> args) -> Value {
+      checkCancelled();
       if (args.size() < 2) return Value(int64_t(0));
       if (auto path = args[0].get<std::string>()) {
         if (auto content = args[1].get<std::string>()) {
@@ -719,7 +1635,8 @@ public:
       return Value(int64_t(0));
     };
     
-    Functions["fileAppend"] = [](std::vector<Value> args) -> Value {
+    Functions[Atom("fileAppend")] = [this](std::vector<Value> args) -> Value {
+      checkCancelled();
       if (args.size() < 2) return Value(int64_t(0));
       if (auto path = args[0].get<std::string>()) {
         if (auto content = args[1].get<std::string>()) {
@@ -730,7 +1647,7 @@ public:
       return Value(int64_t(0));
     };
     
-    Functions["fileDelete"] = [](std::vector<Value> args) -> Value {
+    Functions[Atom("fileDelete")] = [](std::vector<Value> args) -> Value {
       if (args.empty()) return Value(int64_t(0));
       if (auto path = args[0].get<std::string>()) {
         auto result = fs::FileSystem::deleteFile(*path);
@@ -739,7 +1656,7 @@ public:
       return Value(int64_t(0));
     };
     
-    Functions["fileSize"] = [](std::vector<Value> args) -> Value {
+    Functions[Atom("fileSize")] = [](std::vector<Value> args) -> Value {
       if (args.empty()) return Value(int64_t(0));
       if (auto path = args[0].get<std::string>()) {
         return Value(int64_t(fs::FileSystem::getFileSize(*path)));
@@ -747,7 +1664,8 @@ public:
       return Value(int64_t(0));
     };
     
-    Functions["fileList"] = [](std::vector<Value> args) -> Value {
+    Functions[Atom("fileList")] = [this](std::vector<Value> args) -> Value {
+      checkCancelled();
       if (args.empty()) return Value(std::vector<Value>());
       if (auto path = args[0].get<std::string>()) {
         auto files = fs::FileSystem::listFiles(*path);
@@ -760,7 +1678,7 @@ public:
       return Value(std::vector<Value>());
     };
     
-    Functions["fileNormalize"] = [](std::vector<Value> args) -> Value {
+    Functions[Atom("fileNormalize")] = [](std::vector<Value> args) -> Value {
       if (args.empty()) return Value("");
       if (auto path = args[0].get<std::string>()) {
         return Value(fs::FileSystem::normalizePath(*path));
@@ -768,7 +1686,7 @@ public:
       return Value("");
     };
     
-    Functions["fileGetDir"] = [](std::vector<Value> args) -> Value {
+    Functions[Atom("fileGetDir")] = [](std::vector<Value> args) -> Value {
       if (args.empty()) return Value("");
       if (auto path = args[0].get<std::string>()) {
         return Value(fs::FileSystem::getDirectoryName(*path));
@@ -776,7 +1694,7 @@ public:
       return Value("");
     };
     
-    Functions["fileGetName"] = [](std::vector<Value> args) -> Value {
+    Functions[Atom("fileGetName")] = [](std::vector<Value> args) -> Value {
       if (args.empty()) return Value("");
       if (auto path = args[0].get<std::string>()) {
         return Value(fs::FileSystem::getFileName(*path));
@@ -784,7 +1702,7 @@ public:
       return Value("");
     };
     
-    Functions["fileGetExt"] = [](std::vector<Value> args) -> Value {
+    Functions[Atom("fileGetExt")] = [](std::vector<Value> args) -> Value {
       if (args.empty()) return Value("");
       if (auto path = args[0].get<std::string>()) {
         return Value(fs::FileSystem::getFileExtension(*path));
@@ -792,83 +1710,82 @@ public:
       return Value("");
     };
     
-    Functions["logTrace"] = [](std::vector<Value> args) -> Value {
+    Functions[Atom("logTrace")] = [this](std::vector<Value> args) -> Value {
       if (args.empty()) return Value(int64_t(0));
       if (auto msg = args[0].get<std::string>()) {
-        LOG_TRACE(*msg);
+        logMessage(logging::LogLevel::Trace, *msg);
       }
       return Value(int64_t(0));
     };
     
-    Functions["logDebug"] = [](std::vector<Value> args) -> Value {
+    Functions[Atom("logDebug")] = [this](std::vector<Value> args) -> Value {
       if (args.empty()) return Value(int64_t(0));
       if (auto msg = args[0].get<std::string>()) {
-        LOG_DEBUG(*msg);
+        logMessage(logging::LogLevel::Debug, *msg);
       }
       return Value(int64_t(0));
     };
     
-    Functions["logInfo"] = [](std::vector<Value> args) -> Value {
+    Functions[Atom("logInfo")] = [this](std::vector<Value> args) -> Value {
       if (args.empty()) return Value(int64_t(0));
       if (auto msg = args[0].get<std::string>()) {
-        LOG_INFO(*msg);
+        logMessage(logging::LogLevel::Info, *msg);
       }
       return Value(int64_t(0));
     };
     
-    Functions["logWarning"] = [](std::vector<Value> args) -> Value {
+    Functions[Atom("logWarning")] = [this](std::vector<Value> args) -> Value {
       if (args.empty()) return Value(int64_t(0));
       if (auto msg = args[0].get<std::string>()) {
-        LOG_WARNING(*msg);
+        logMessage(logging::LogLevel::Warning, *msg);
       }
       return Value(int64_t(0));
     };
     
-    Functions["logError"] = [](std::vector<Value> args) -> Value {
+    Functions[Atom("logError")] = [this](std::vector<Value> args) -> Value {
       if (args.empty()) return Value(int64_t(0));
       if (auto msg = args[0].get<std::string>()) {
-        LOG_ERROR(*msg);
+        logMessage(logging::LogLevel::Error, *msg);
       }
       return Value(int64_t(0));
     };
     
-    Functions["logFatal"] = [](std::vector<Value> args) -> Value {
+    Functions[Atom("logFatal")] = [this](std::vector<Value> args) -> Value {
       if (args.empty()) return Value(int64_t(0));
       if (auto msg = args[0].get<std::string>()) {
-        LOG_FATAL(*msg);
+        logMessage(logging::LogLevel::Fatal, *msg);
       }
       return Value(int64_t(0));
     };
     
-    Functions["logSetLevel"] = [](std::vector<Value> args) -> Value {
+    Functions[Atom("logSetLevel")] = [this](std::vector<Value> args) -> Value {
       if (args.empty()) return Value(int64_t(0));
       if (auto level = args[0].get<std::string>()) {
-        auto& logger = logging::Logger::getInstance();
         if (*level == "trace") {
-          logger.setLevel(logging::LogLevel::Trace);
+          LogLevel = logging::LogLevel::Trace;
         } else if (*level == "debug") {
-          logger.setLevel(logging::LogLevel::Debug);
+          LogLevel = logging::LogLevel::Debug;
         } else if (*level == "info") {
-          logger.setLevel(logging::LogLevel::Info);
+          LogLevel = logging::LogLevel::Info;
         } else if (*level == "warning") {
-          logger.setLevel(logging::LogLevel::Warning);
+          LogLevel = logging::LogLevel::Warning;
         } else if (*level == "error") {
-          logger.setLevel(logging::LogLevel::Error);
+          LogLevel = logging::LogLevel::Error;
         } else if (*level == "fatal") {
-          logger.setLevel(logging::LogLevel::Fatal);
+          LogLevel = logging::LogLevel::Fatal;
         } else if (*level == "off") {
-          logger.setLevel(logging::LogLevel::Off);
+          LogLevel = logging::LogLevel::Off;
         }
       }
       return Value(int64_t(0));
     };
     
-    Functions["logFlush"] = [](std::vector<Value> args) -> Value {
+    Functions[Atom("logFlush")] = [](std::vector<Value> args) -> Value {
       logging::Logger::getInstance().flush();
       return Value(int64_t(0));
     };
     
-    Functions["split"] = [](std::vector<Value> args) -> Value {
+    Functions[Atom("split")] = [](std::vector<Value> args) -> Value {
       if (args.size() < 2) return Value(std::vector<Value>());
       if (auto str = args[0].get<std::string>()) {
         if (auto separator = args[1].get<std::string>()) {
@@ -889,7 +1806,7 @@ public:
       return Value(std::vector<Value>());
     };
     
-    Functions["trim"] = [](std::vector<Value> args) -> Value {
+    Functions[Atom("trim")] = [](std::vector<Value> args) -> Value {
       if (args.size() < 1) return Value("");
       if (auto str = args[0].get<std::string>()) {
         size_t start = str->find_first_not_of(" \t\n\r");
@@ -900,7 +1817,7 @@ public:
       return Value("");
     };
     
-    Functions["set"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("set")] = [this](std::vector<Value> args) -> Value {
       if (args.size() < 3) return Value(int64_t(0));
       if (auto arr = args[0].get<std::vector<Value>>()) {
         std::vector<Value> newArr = *arr;
@@ -914,7 +1831,7 @@ public:
       return Value(int64_t(0));
     };
     
-    Functions["insert"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("insert")] = [this](std::vector<Value> args) -> Value {
       if (args.size() < 3) return Value(int64_t(0));
       if (auto arr = args[0].get<std::vector<Value>>()) {
         std::vector<Value> newArr = *arr;
@@ -928,7 +1845,7 @@ public:
       return Value(int64_t(0));
     };
     
-    Functions["contains"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("contains")] = [this](std::vector<Value> args) -> Value {
       if (args.size() < 2) return Value(false);
       if (auto arr = args[0].get<std::vector<Value>>()) {
         for (const auto& item : *arr) {
@@ -940,7 +1857,7 @@ public:
       return Value(false);
     };
     
-    Functions["removeFirst"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("removeFirst")] = [this](std::vector<Value> args) -> Value {
       if (args.empty()) return Value(int64_t(0));
       if (auto arr = args[0].get<std::vector<Value>>()) {
         std::vector<Value> newArr = *arr;
@@ -952,7 +1869,7 @@ public:
       return Value(int64_t(0));
     };
     
-    Functions["removeLast"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("removeLast")] = [this](std::vector<Value> args) -> Value {
       if (args.empty()) return Value(int64_t(0));
       if (auto arr = args[0].get<std::vector<Value>>()) {
         std::vector<Value> newArr = *arr;
@@ -964,7 +1881,7 @@ public:
       return Value(int64_t(0));
     };
     
-    Functions["first"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("first")] = [this](std::vector<Value> args) -> Value {
       if (args.empty()) return Value(int64_t(0));
       if (auto arr = args[0].get<std::vector<Value>>()) {
         if (!arr->empty()) {
@@ -974,7 +1891,7 @@ public:
       return Value(int64_t(0));
     };
     
-    Functions["last"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("last")] = [this](std::vector<Value> args) -> Value {
       if (args.empty()) return Value(int64_t(0));
       if (auto arr = args[0].get<std::vector<Value>>()) {
         if (!arr->empty()) {
@@ -984,7 +1901,7 @@ public:
       return Value(int64_t(0));
     };
     
-    Functions["reverse"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("reverse")] = [this](std::vector<Value> args) -> Value {
       if (args.empty()) return Value(int64_t(0));
       if (auto arr = args[0].get<std::vector<Value>>()) {
         std::vector<Value> newArr = *arr;
@@ -994,7 +1911,7 @@ public:
       return Value(int64_t(0));
     };
     
-    Functions["slice"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("slice")] = [this](std::vector<Value> args) -> Value {
       if (args.size() < 2) return Value(int64_t(0));
       if (auto arr = args[0].get<std::vector<Value>>()) {
         if (auto start = args[1].get<int64_t>()) {
@@ -1017,7 +1934,7 @@ public:
       return Value(int64_t(0));
     };
     
-    Functions["indexOf"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("indexOf")] = [this](std::vector<Value> args) -> Value {
       if (args.size() < 2) return Value(int64_t(-1));
       if (auto arr = args[0].get<std::vector<Value>>()) {
         int64_t index = 0;
@@ -1031,7 +1948,7 @@ public:
       return Value(int64_t(-1));
     };
     
-    Functions["sum"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("sum")] = [this](std::vector<Value> args) -> Value {
       if (args.empty()) return Value(int64_t(0));
       if (auto arr = args[0].get<std::vector<Value>>()) {
         int64_t total = 0;
@@ -1045,7 +1962,7 @@ public:
       return Value(int64_t(0));
     };
     
-    Functions["average"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("average")] = [this](std::vector<Value> args) -> Value {
       if (args.empty()) return Value(0.0);
       if (auto arr = args[0].get<std::vector<Value>>()) {
         if (arr->empty()) return Value(0.0);
@@ -1060,7 +1977,7 @@ public:
       return Value(0.0);
     };
     
-    Functions["max"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("max")] = [this](std::vector<Value> args) -> Value {
       if (args.empty()) return Value(int64_t(0));
       if (auto arr = args[0].get<std::vector<Value>>()) {
         if (arr->empty()) return Value(int64_t(0));
@@ -1077,7 +1994,7 @@ public:
       return Value(int64_t(0));
     };
     
-    Functions["min"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("min")] = [this](std::vector<Value> args) -> Value {
       if (args.empty()) return Value(int64_t(0));
       if (auto arr = args[0].get<std::vector<Value>>()) {
         if (arr->empty()) return Value(int64_t(0));
@@ -1094,7 +2011,7 @@ public:
       return Value(int64_t(0));
     };
     
-    Functions["range"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("range")] = [this](std::vector<Value> args) -> Value {
       if (args.empty()) return Value(int64_t(0));
       int64_t start = 0;
       int64_t end = 0;
@@ -1128,7 +2045,7 @@ public:
       return Value(newArr);
     };
     
-    Functions["repeat"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("repeat")] = [this](std::vector<Value> args) -> Value {
       if (args.size() < 2) return Value(int64_t(0));
       if (auto val = args[0].get<std::vector<Value>>()) {
         if (auto count = args[1].get<int64_t>()) {
@@ -1144,7 +2061,7 @@ public:
       return Value(int64_t(0));
     };
     
-    Functions["join"] = [](std::vector<Value> args) -> Value {
+    Functions[Atom("join")] = [](std::vector<Value> args) -> Value {
       if (args.size() < 2) return Value("");
       if (auto arr = args[0].get<std::vector<Value>>()) {
         if (auto separator = args[1].get<std::string>()) {
@@ -1163,7 +2080,7 @@ public:
       return Value("");
     };
     
-    Functions["clearScreen"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("clearScreen")] = [this](std::vector<Value> args) -> Value {
       terminal::Terminal term;
       term.init();
       term.clearScreen();
@@ -1171,7 +2088,7 @@ public:
       return Value(int64_t(0));
     };
     
-    Functions["moveCursor"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("moveCursor")] = [this](std::vector<Value> args) -> Value {
       if (args.size() < 2) return Value(int64_t(0));
       if (auto row = args[0].get<int64_t>()) {
         if (auto col = args[1].get<int64_t>()) {
@@ -1184,7 +2101,7 @@ public:
       return Value(int64_t(0));
     };
     
-    Functions["hideCursor"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("hideCursor")] = [this](std::vector<Value> args) -> Value {
       terminal::Terminal term;
       term.init();
       term.hideCursor();
@@ -1192,7 +2109,7 @@ public:
       return Value(int64_t(0));
     };
     
-    Functions["showCursor"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("showCursor")] = [this](std::vector<Value> args) -> Value {
       terminal::Terminal term;
       term.init();
       term.showCursor();
@@ -1200,7 +2117,7 @@ public:
       return Value(int64_t(0));
     };
     
-    Functions["setColor"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("setColor")] = [this](std::vector<Value> args) -> Value {
       if (args.size() < 1) return Value(int64_t(0));
       if (auto fg = args[0].get<int64_t>()) {
         int bg = -1;
@@ -1217,7 +2134,7 @@ public:
       return Value(int64_t(0));
     };
     
-    Functions["resetColor"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("resetColor")] = [this](std::vector<Value> args) -> Value {
       terminal::Terminal term;
       term.init();
       term.resetColor();
@@ -1225,7 +2142,7 @@ public:
       return Value(int64_t(0));
     };
     
-    Functions["getTerminalWidth"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("getTerminalWidth")] = [this](std::vector<Value> args) -> Value {
       terminal::Terminal term;
       term.init();
       int width = term.getTerminalWidth();
@@ -1233,7 +2150,7 @@ public:
       return Value(int64_t(width));
     };
     
-    Functions["getTerminalHeight"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("getTerminalHeight")] = [this](std::vector<Value> args) -> Value {
       terminal::Terminal term;
       term.init();
       int height = term.getTerminalHeight();
@@ -1241,7 +2158,7 @@ public:
       return Value(int64_t(height));
     };
     
-    Functions["hasInput"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("hasInput")] = [this](std::vector<Value> args) -> Value {
       terminal::Terminal term;
       term.init();
       bool has = term.hasInput();
@@ -1249,7 +2166,7 @@ public:
       return Value(has);
     };
     
-    Functions["getKey"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("getKey")] = [this](std::vector<Value> args) -> Value {
       terminal::Terminal term;
       term.init();
       terminal::KeyEvent event = term.getKey();
@@ -1278,15 +2195,198 @@ public:
       return Value(keyStr);
     };
     
-    Functions["sleepMs"] = [this](std::vector<Value> args) -> Value {
+    Functions[Atom("sleepMs")] = [this](std::vector<Value> args) -> Value {
       if (args.size() < 1) return Value(int64_t(0));
       if (auto ms = args[0].get<int64_t>()) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(*ms));
+        sleepFor(*ms);
       }
       return Value(int64_t(0));
     };
     
-    Functions["randomInt"] = [this](std::vector<Value> args) -> Value {
+    // The *Async builtins return a task at once and the event loop finishes
+    // it, so one script can keep thousands of them in flight
+    Functions[Atom("sleepAsync")] = [this](std::vector<Value> args) -> Value {
+      int64_t ms = 0;
+      if (!args.empty()) {
+        if (auto value = args[0].get<int64_t>()) {
+          ms = std::max<int64_t>(0, *value);
+        }
+      }
+      return startIO([&](IOCompletion complete) {
+        asyncIO()->Loop.addTimer(std::chrono::milliseconds(ms), [complete]() {
+          complete(Value(int64_t(0)));
+        });
+      });
+    };
+    
+    Functions[Atom("readFileAsync")] = [this](std::vector<Value> args) -> Value {
+      std::string path;
+      if (!args.empty()) {
+        if (auto value = args[0].get<std::string>()) {
+          path = *value;
+        }
+      }
+      return startIO([&](IOCompletion complete) {
+        xwift::readFileAsync(asyncIO()->Loop, path, [complete](std::optional<std::string> content) {
+          complete(Value(content ? std::move(*content) : std::string()));
+        });
+      });
+    };
+    
+    // nil once stdin is at end of input
+    Functions[Atom("readLineAsync")] = [this](std::vector<Value> args) -> Value {
+      return startIO([&](IOCompletion complete) {
+        asyncIO()->Stdin->readLine([complete](std::optional<std::string> line) {
+          complete(line ? Value(std::move(*line)) : Value());
+        });
+      });
+    };
+    
+    Functions[Atom("httpGetAsync")] = [this](std::vector<Value> args) -> Value {
+      std::string url;
+      if (!args.empty()) {
+        if (auto value = args[0].get<std::string>()) {
+          url = *value;
+        }
+      }
+      return startIO([&](IOCompletion complete) {
+#ifndef _WIN32
+        asyncIO()->HTTP.get(url, requestTimeoutMs(), [complete](Result<http::Response> result) {
+          complete(Value(result.is_ok() ? std::move(result.unwrap().body) : std::string()));
+        });
+#else
+        // No curl multi handle to run it on, so it completes before returning
+        complete(Value(httpGet(url, requestTimeoutMs())));
+#endif
+      });
+    };
+    
+    Functions[Atom("httpPostAsync")] = [this](std::vector<Value> args) -> Value {
+      std::string url;
+      std::string data;
+      if (args.size() >= 2) {
+        if (auto value = args[0].get<std::string>()) {
+          url = *value;
+        }
+        if (auto value = args[1].get<std::string>()) {
+          data = *value;
+        }
+      }
+      return startIO([&](IOCompletion complete) {
+#ifndef _WIN32
+        asyncIO()->HTTP.post(url, data, requestTimeoutMs(), [complete](Result<http::Response> result) {
+          complete(Value(result.is_ok() ? std::move(result.unwrap().body) : std::string()));
+        });
+#else
+        complete(Value(httpPost(url, data, requestTimeoutMs())));
+#endif
+      });
+    };
+    
+    // Sockets are Int handles, -1 when opening one failed. Reads give nil
+    // at the end of the stream or on an error, writes the bytes sent or -1.
+    // Each blocking builtin awaits its *Async twin.
+    Functions[Atom("tcpConnect")] = [this](std::vector<Value> args) -> Value {
+      return awaitIO(startConnect(args));
+    };
+    
+    Functions[Atom("tcpConnectAsync")] = [this](std::vector<Value> args) -> Value {
+      return startConnect(args);
+    };
+    
+    // tcpListen(host, port) listens at once; port 0 picks a free one, which
+    // socketPort tells
+    Functions[Atom("tcpListen")] = [this](std::vector<Value> args) -> Value {
+      return listenTCP(args);
+    };
+    
+    Functions[Atom("tcpAccept")] = [this](std::vector<Value> args) -> Value {
+      return awaitIO(startAccept(args));
+    };
+    
+    Functions[Atom("tcpAcceptAsync")] = [this](std::vector<Value> args) -> Value {
+      return startAccept(args);
+    };
+    
+    Functions[Atom("socketSend")] = [this](std::vector<Value> args) -> Value {
+      return awaitIO(startSocketWrite(false, args));
+    };
+    
+    // Sends data after its length as 4 big-endian bytes, for socketReadFrame
+    Functions[Atom("socketSendFrame")] = [this](std::vector<Value> args) -> Value {
+      return awaitIO(startSocketWrite(true, args));
+    };
+    
+    // socketRecv(socket, maxBytes) gives what has arrived, up to maxBytes
+    Functions[Atom("socketRecv")] = [this](std::vector<Value> args) -> Value {
+      return awaitIO(startSocketRead(SocketRead::Raw, args));
+    };
+    
+    Functions[Atom("socketRecvAsync")] = [this](std::vector<Value> args) -> Value {
+      return startSocketRead(SocketRead::Raw, args);
+    };
+    
+    Functions[Atom("socketReadLine")] = [this](std::vector<Value> args) -> Value {
+      return awaitIO(startSocketRead(SocketRead::Line, args));
+    };
+    
+    Functions[Atom("socketReadLineAsync")] = [this](std::vector<Value> args) -> Value {
+      return startSocketRead(SocketRead::Line, args);
+    };
+    
+    Functions[Atom("socketReadFrame")] = [this](std::vector<Value> args) -> Value {
+      return awaitIO(startSocketRead(SocketRead::Frame, args));
+    };
+    
+    Functions[Atom("socketReadFrameAsync")] = [this](std::vector<Value> args) -> Value {
+      return startSocketRead(SocketRead::Frame, args);
+    };
+    
+    // The local port of any socket, -1 for a closed one
+    Functions[Atom("socketPort")] = [this](std::vector<Value> args) -> Value {
+      auto socket = args.empty() ? std::nullopt : asyncIO()->Sockets->get(args[0]);
+      if (!socket) {
+        return Value(int64_t(-1));
+      }
+      return Value(int64_t(std::visit([](const auto& open) { return open->localPort(); }, *socket)));
+    };
+    
+    Functions[Atom("socketClose")] = [this](std::vector<Value> args) -> Value {
+      auto socket = args.empty() ? std::nullopt : asyncIO()->Sockets->remove(args[0]);
+      if (!socket) {
+        return Value(false);
+      }
+      std::visit([](const auto& open) { open->close(); }, *socket);
+      return Value(true);
+    };
+    
+    Functions[Atom("udpBind")] = [this](std::vector<Value> args) -> Value {
+      return bindUDP(args);
+    };
+    
+    // udpSendTo(socket, host, port, data) sends one datagram
+    Functions[Atom("udpSendTo")] = [this](std::vector<Value> args) -> Value {
+      return sendDatagrams(false, args);
+    };
+    
+    // udpSendBatch(socket, host, port, payloads) sends each String in
+    // payloads as a datagram, many to a system call, and returns how many
+    // went out
+    Functions[Atom("udpSendBatch")] = [this](std::vector<Value> args) -> Value {
+      return sendDatagrams(true, args);
+    };
+    
+    // udpRecvBatch(socket, max) waits for a datagram and returns up to max
+    // of those that have arrived, as Datagrams with data, host and port
+    Functions[Atom("udpRecvBatch")] = [this](std::vector<Value> args) -> Value {
+      return awaitIO(startReceiveDatagrams(args));
+    };
+    
+    Functions[Atom("udpRecvBatchAsync")] = [this](std::vector<Value> args) -> Value {
+      return startReceiveDatagrams(args);
+    };
+    
+    Functions[Atom("randomInt")] = [this](std::vector<Value> args) -> Value {
       int min = 0;
       int max = 100;
       
@@ -1302,13 +2402,142 @@ public:
         }
       }
       
-      int range = max - min + 1;
-      int result = min + (rand() % range);
-      return Value(int64_t(result));
+      if (max < min) {
+        return Value(int64_t(min));
+      }
+      if (!Rng) {
+        Rng = std::make_unique<std::mt19937>(std::random_device{}());
+      }
+      std::uniform_int_distribution<int> dist(min, max);
+      return Value(int64_t(dist(*Rng)));
+    };
+    
+    Functions[Atom("send")] = [this](std::vector<Value> args) -> Value {
+      return sendMessage(args);
+    };
+    
+    Functions[Atom("channel")] = [this](std::vector<Value> args) -> Value {
+      int64_t capacity = 16;
+      if (!args.empty()) {
+        if (auto val = args[0].get<int64_t>()) {
+          capacity = std::max<int64_t>(1, *val);
+        }
+      }
+      return Value(ChannelValue(std::make_shared<ScriptChannel>(static_cast<size_t>(capacity))));
+    };
+    
+    Functions[Atom("trySend")] = [this](std::vector<Value> args) -> Value {
+      if (args.size() < 2) return Value(false);
+      if (auto handle = args[0].get<ChannelValue>()) {
+        return Value(handle->get()->trySend(args[1]));
+      }
+      return Value(false);
+    };
+    
+    // nil once the channel is closed and drained
+    Functions[Atom("receive")] = [this](std::vector<Value> args) -> Value {
+      if (args.empty()) return Value();
+      if (auto handle = args[0].get<ChannelValue>()) {
+        if (auto item = handle->get()->receive(Cancellation.get())) {
+          return *item;
+        }
+      }
+      return Value();
+    };
+    
+    // Task for the next item, nil once the channel is closed and drained.
+    // A task that awaits it is suspended rather than holding a worker.
+    Functions[Atom("receiveAsync")] = [this](std::vector<Value> args) -> Value {
+      std::shared_ptr<ScriptChannel> channel;
+      if (!args.empty()) {
+        if (auto handle = args[0].get<ChannelValue>()) {
+          channel = handle->shared();
+        }
+      }
+      return startIO([&](IOCompletion complete) {
+        if (!channel) {
+          complete(Value());
+          return;
+        }
+        ScriptChannel::receiveLater(channel, [complete](std::optional<Value> item) {
+          complete(item ? std::move(*item) : Value());
+        });
+      }, channel);
+    };
+    
+    Functions[Atom("tryReceive")] = [this](std::vector<Value> args) -> Value {
+      if (args.empty()) return Value();
+      if (auto handle = args[0].get<ChannelValue>()) {
+        if (auto item = handle->get()->tryReceive()) {
+          return *item;
+        }
+      }
+      return Value();
+    };
+    
+    Functions[Atom("close")] = [this](std::vector<Value> args) -> Value {
+      if (!args.empty()) {
+        if (auto handle = args[0].get<ChannelValue>()) {
+          handle->get()->close();
+        }
+      }
+      return Value();
+    };
+    
+    // select([a, b, ...]) receives from whichever channel is ready first and
+    // returns [index, item], or [-1, nil] once all are closed and drained
+    Functions[Atom("select")] = [this](std::vector<Value> args) -> Value {
+      std::vector<Channel<Value>*> queues;
+      if (!args.empty()) {
+        if (auto arr = args[0].get<std::vector<Value>>()) {
+          for (const auto& elem : *arr) {
+            if (auto handle = elem.get<ChannelValue>()) {
+              queues.push_back(&handle->get()->queue());
+            }
+          }
+        }
+      }
+      auto ready = selectReceive(queues, true, Cancellation.get());
+      if (!ready) {
+        return Value(std::vector<Value>{Value(int64_t(-1)), Value()});
+      }
+      Value item = ready->second.sendableCopy();
+      return Value(std::vector<Value>{Value(int64_t(ready->first)), item});
+    };
+    
+    Functions[Atom("pipeline")] = [this](std::vector<Value> args) -> Value {
+      return runPipeline(args);
+    };
+    
+    Functions[Atom("isCancelled")] = [this](std::vector<Value> args) -> Value {
+      auto token = currentCancellation();
+      return Value(token && token->isCancelled());
+    };
+    
+    // Cancels the innermost task group: the caller's own group in a
+    // taskGroup block, else the group the calling task belongs to
+    Functions[Atom("cancelGroup")] = [this](std::vector<Value> args) -> Value {
+      if (auto token = currentCancellation()) {
+        token->cancel();
+      }
+      return Value();
+    };
+    
+    Functions[Atom("parallelMap")] = [this](std::vector<Value> args) -> Value {
+      return parallelApply(ParallelOp::Map, args);
+    };
+    
+    Functions[Atom("parallelFilter")] = [this](std::vector<Value> args) -> Value {
+      return parallelApply(ParallelOp::Filter, args);
+    };
+    
+    Functions[Atom("parallelReduce")] = [this](std::vector<Value> args) -> Value {
+      return parallelApply(ParallelOp::Reduce, args);
     };
   }
   
   void run(Program* program, const std::string& basePath = ".") {
+    ObjectHeap::Scope heapScope(Heap);
     BasePath = basePath;
     CurrentStep = 0;
     enterScope();
@@ -1316,10 +2545,63 @@ public:
       runDecl(decl.get());
       CurrentStep++;
       if (CurrentStep > MaxSteps) {
+        joinTasks();
         throw std::runtime_error("Execution timeout: infinite loop detected");
       }
     }
     exitScope();
+    joinTasks();
+    Heap.collectCycles();
+  }
+  
+  // Calls a user function with already evaluated arguments, for tasks,
+  // actors and builtins that take a function
+  Value callFunction(FuncDecl* func, const std::vector<Value>& args) {
+    ObjectHeap::Scope heapScope(Heap);
+    Value retVal(int64_t(0));
+    auto* block = func->Body ? dynamic_cast<BlockStmt*>(func->Body.get()) : nullptr;
+    if (block) {
+      bool savedHasReturn = HasReturn;
+      HasReturn = false;
+      enterScope();
+      Diags.pushStackFrame(func->Name, currentFilename);
+      for (size_t i = 0; i < func->Params.size() && i < args.size(); i++) {
+        declareVariable(func->Params[i].first, args[i]);
+      }
+      runBlock(block, &retVal);
+      HasReturn = savedHasReturn;
+      exitScope();
+      Diags.popStackFrame();
+    }
+    return retVal;
+  }
+  
+  // callFunction as a coroutine, for the function a task runs. Where a
+  // statement in it awaits a task that is not ready yet, the call suspends
+  // instead of blocking its worker (see maySuspend). Whoever resumes it sets
+  // the heap scope.
+  Coroutine<Value> callSuspendable(FuncDecl* func, std::vector<Value> args, CallExpr* call = nullptr);
+  
+  // Waits for every task this interpreter started and every message sent to
+  // its actors, and reports what they reported, including errors from tasks
+  // that were never awaited
+  void joinTasks();
+  
+  // joinTasks for a task's coroutine, which suspends until its tasks are done
+  Coroutine<void> joinTasksSuspendable();
+  
+  const std::shared_ptr<ForkPool>& forkPool() const;
+  
+  const std::shared_ptr<AsyncIO>& asyncIO() const {
+    if (!IO) {
+      IO = std::make_shared<AsyncIO>();
+    }
+    return IO;
+  }
+  
+  // Token that isCancelled() and cancelGroup() act on
+  std::shared_ptr<CancellationToken> currentCancellation() const {
+    return Groups.empty() ? Cancellation : Groups.back().Token;
   }
   
   void setBasePath(const std::string& path) { BasePath = path; }
@@ -1330,6 +2612,7 @@ private:
       loadModule(importDecl->ModuleName);
     } else if (auto funcDecl = dynamic_cast<FuncDecl*>(decl)) {
       UserFunctions[funcDecl->Name] = funcDecl;
+      FunctionEpoch++;
       if (funcDecl->Name == "main") {
         if (funcDecl->Body) {
           auto* block = dynamic_cast<BlockStmt*>(funcDecl->Body.get());
@@ -1421,25 +2704,15 @@ private:
     if (auto varDecl = dynamic_cast<VarDeclStmt*>(stmt)) {
       if (varDecl->Init) {
         Value val = evaluate(varDecl->Init.get());
-        setVariable(varDecl->Name, val);
+        declareVariable(varDecl->Name, val);
       }
       return;
     }
     
     if (auto ifStmt = dynamic_cast<IfStmt*>(stmt)) {
-      Value cond = evaluate(ifStmt->Condition.get());
-      bool condBool = false;
-      if (auto boolVal = cond.get<bool>()) {
-        condBool = *boolVal;
-      } else if (auto intVal = cond.get<int64_t>()) {
-        condBool = *intVal != 0;
-      } else if (auto doubleVal = cond.get<double>()) {
-        condBool = *doubleVal != 0.0;
-      } else if (auto strVal = cond.get<std::string>()) {
-        condBool = !strVal->empty();
-      }
+      bool taken = evaluateBool(ifStmt->Condition.get());
       
-      if (condBool) {
+      if (taken) {
         if (ifStmt->ThenBranch) {
           runStmt(ifStmt->ThenBranch.get(), retVal);
         }
@@ -1486,20 +2759,10 @@ private:
         if (CurrentStep > MaxSteps) {
           throw std::runtime_error("Execution timeout: infinite loop detected");
         }
+        checkCancelled();
         
-        Value cond = evaluate(whileStmt->Condition.get());
-        bool condBool = false;
-        if (auto boolVal = cond.get<bool>()) {
-          condBool = *boolVal;
-        } else if (auto intVal = cond.get<int64_t>()) {
-          condBool = *intVal != 0;
-        } else if (auto doubleVal = cond.get<double>()) {
-          condBool = *doubleVal != 0.0;
-        } else if (auto strVal = cond.get<std::string>()) {
-          condBool = !strVal->empty();
-        }
-        
-        if (!condBool) break;
+        bool taken = evaluateBool(whileStmt->Condition.get());
+        if (!taken) break;
         
         if (whileStmt->Body) {
           runStmt(whileStmt->Body.get(), retVal);
@@ -1508,20 +2771,15 @@ private:
       return;
     }
     
+    if (auto groupStmt = dynamic_cast<TaskGroupStmt*>(stmt)) {
+      runTaskGroup(groupStmt, retVal);
+      return;
+    }
+    
     if (auto forStmt = dynamic_cast<ForStmt*>(stmt)) {
-      Value startVal = evaluate(forStmt->Start.get());
-      Value endVal = evaluate(forStmt->End.get());
-      Value stepVal = evaluate(forStmt->Step.get());
-      
-      auto getInt = [](const Value& v) -> int64_t {
-        if (auto i = v.get<int64_t>()) return *i;
-        if (auto d = v.get<double>()) return (int64_t)*d;
-        return 0;
-      };
-      
-      int64_t start = getInt(startVal);
-      int64_t end = getInt(endVal);
-      int64_t step = getInt(stepVal);
+      int64_t start = evaluateInt(forStmt->Start.get());
+      int64_t end = evaluateInt(forStmt->End.get());
+      int64_t step = evaluateInt(forStmt->Step.get());
       
       if (step == 0) {
         DiagnosticError error;
@@ -1545,6 +2803,7 @@ private:
           Diags.report(error);
           return;
         }
+        checkCancelled();
         
         setVariable(forStmt->VarName, Value(i));
         if (forStmt->Body) {
@@ -1597,6 +2856,47 @@ private:
     }
   }
   
+  Value assignTo(AssignExpr* assign, const Value& rhs) {
+    if (auto id = dynamic_cast<IdentifierExpr*>(assign->Target.get())) {
+      setVariable(id->Name, rhs);
+    } else if (auto member = dynamic_cast<MemberAccessExpr*>(assign->Target.get())) {
+      Value temporary;
+      if (ObjectValue* obj = resolveObject(member->Object.get(), temporary)) {
+        obj->mutate()->Properties[member->MemberName] = rhs;
+      }
+    }
+    return rhs;
+  }
+  
+  // `s = s + piece` on a string variable. The variable lets go of its old
+  // value before the concatenation, so the buffer is appended to in place
+  // rather than copied each time round a loop.
+  bool evaluateAppend(AssignExpr* assign, Value& result) {
+    auto id = dynamic_cast<IdentifierExpr*>(assign->Target.get());
+    auto binary = dynamic_cast<BinaryExpr*>(assign->Value.get());
+    if (!id || !binary || binary->Op != "+") {
+      return false;
+    }
+    auto operand = dynamic_cast<IdentifierExpr*>(binary->LHS.get());
+    Value* var = operand && operand->Name == id->Name ? getVariable(id->Name) : nullptr;
+    if (!var || !std::holds_alternative<StringCell>(var->getData())) {
+      return false;
+    }
+    
+    Value lhs = *var;
+    Value rhs = evaluate(binary->RHS.get());
+    // Evaluating the piece may have reassigned the variable or added
+    // scopes, so look it up again; it only gives up the value read above
+    var = getVariable(id->Name);
+    if (auto held = var ? std::get_if<StringCell>(&var->getData()) : nullptr) {
+      if (held->shares(std::get<StringCell>(lhs.getData()))) {
+        *var = Value();
+      }
+    }
+    result = assignTo(assign, applyBinary(binary, std::move(lhs), rhs));
+    return true;
+  }
+  
   Value evaluate(Expr* expr) {
     if (!expr) return Value();
     
@@ -1617,7 +2917,7 @@ private:
     }
     
     if (auto str = dynamic_cast<StringLiteralExpr*>(expr)) {
-      return Value(str->Value);
+      return Value(str->Cell);
     }
     
     if (auto arr = dynamic_cast<ArrayLiteralExpr*>(expr)) {
@@ -1701,209 +3001,2209 @@ private:
     }
     
     if (auto assign = dynamic_cast<AssignExpr*>(expr)) {
-      Value rhs = evaluate(assign->Value.get());
-      
-      if (auto id = dynamic_cast<IdentifierExpr*>(assign->Target.get())) {
-        setVariable(id->Name, rhs);
+      Value appended;
+      if (evaluateAppend(assign, appended)) {
+        return appended;
       }
-      
-      return rhs;
+      return assignTo(assign, evaluate(assign->Value.get()));
     }
     
     if (auto binary = dynamic_cast<BinaryExpr*>(expr)) {
-      Value lhs = evaluate(binary->LHS.get());
-      Value rhs = evaluate(binary->RHS.get());
-      
-      if (binary->Op == "+") {
-        if (auto l = lhs.get<std::string>()) {
-          if (auto r = rhs.get<std::string>()) {
-            return Value(*l + *r);
-          }
-        }
-        if (auto l = lhs.get<int64_t>()) {
-          if (auto r = rhs.get<int64_t>()) {
-            return Value(*l + *r);
-          }
-        }
-      }
-      if (binary->Op == "-") {
-        if (auto l = lhs.get<int64_t>()) {
-          if (auto r = rhs.get<int64_t>()) {
-            return Value(*l - *r);
-          }
-        }
+      switch (resolveKind(binary)) {
+        case Expr::EvalKind::Int64:
+          return Value(evaluateInt(binary));
+        case Expr::EvalKind::Double:
+          return Value(evaluateDouble(binary));
+        case Expr::EvalKind::Bool:
+          return Value(evaluateBool(binary));
+        default:
+          return evaluateBinary(binary);
       }
-      if (binary->Op == "*") {
-        if (auto l = lhs.get<int64_t>()) {
-          if (auto r = rhs.get<int64_t>()) {
-            return Value(*l * *r);
+    }
+    
+    if (auto call = dynamic_cast<CallExpr*>(expr)) {
+      FuncDecl* func = resolveCallTarget(call);
+      if (!func) {
+        auto it = Functions.find(call->Callee);
+        if (it != Functions.end()) {
+          std::vector<Value> args;
+          for (auto& arg : call->Args) {
+            args.push_back(evaluate(arg.get()));
           }
+          return it->second(args);
         }
       }
-      if (binary->Op == "/") {
-        if (auto l = lhs.get<int64_t>()) {
-          if (auto r = rhs.get<int64_t>()) {
-            return Value(*r != 0 ? *l / *r : 0);
-          }
-          if (auto l = lhs.get<double>()) {
-            if (auto r = rhs.get<double>()) {
-              if (*r == 0.0) {
-                DiagnosticError error;
-                error.Level = DiagLevel::Fatal;
-                error.Category = ErrorCategory::Runtime;
-                error.Message = "division by zero";
-                error.ErrorID = ErrorCodes::Runtime::DivisionByZero;
-                error.Line = binary->Loc.Line;
-                error.Column = binary->Loc.Col;
-                error.FileName = currentFilename;
-                Diags.report(error);
-                return Value();
-              }
-              return Value(*l / *r);
+      
+      if (func) {
+        if (func->Body) {
+          auto* block = dynamic_cast<BlockStmt*>(func->Body.get());
+          if (block) {
+            // Arguments are evaluated in the caller's scope before any
+            // parameter is bound
+            std::vector<Value> args;
+            args.reserve(call->Args.size());
+            for (auto& arg : call->Args) {
+              args.push_back(evaluate(arg.get()));
             }
+            bool savedHasReturn = HasReturn;
+            HasReturn = false;
+            enterScope();
+            Diags.pushStackFrame(func->Name, currentFilename, call->Loc.Line, call->Loc.Col);
+            for (size_t i = 0; i < func->Params.size() && i < args.size(); i++) {
+              declareVariable(func->Params[i].first, args[i]);
+            }
+            Value retVal(int64_t(0));
+            runBlock(block, &retVal);
+            HasReturn = savedHasReturn;
+            exitScope();
+            Diags.popStackFrame();
+            return retVal;
+          }
+        }
+        return Value(int64_t(0));
+      }
+    }
+    
+    if (auto asyncExpr = dynamic_cast<AsyncExpr*>(expr)) {
+      return startTask(asyncExpr);
+    }
+    
+    if (auto actorExpr = dynamic_cast<ActorExpr*>(expr)) {
+      return startActor(actorExpr);
+    }
+    
+    if (auto awaitExpr = dynamic_cast<AwaitExpr*>(expr)) {
+      Value task = evaluate(awaitExpr->Task.get());
+      if (auto handle = task.get<TaskValue>()) {
+        return awaitTask(*handle);
+      }
+      if (auto handle = task.get<ActorValue>()) {
+        return awaitActor(*handle);
+      }
+      // Awaiting a plain value yields it unchanged
+      return task;
+    }
+    
+    if (auto memberAccess = dynamic_cast<MemberAccessExpr*>(expr)) {
+      Value obj = evaluate(memberAccess->Object.get());
+      if (auto objVal = obj.get<ObjectValue>()) {
+        const ObjectData* data = objVal->get();
+        auto it = data->Properties.find(memberAccess->MemberName);
+        if (it != data->Properties.end()) {
+          return it->second;
+        }
+      }
+      return Value();
+    }
+    
+    if (auto ctorCall = dynamic_cast<ConstructorCallExpr*>(expr)) {
+      if (Heap.shouldCollect()) {
+        Heap.collectCycles();
+      }
+      
+      ObjectValue obj(ctorCall->ClassName, Structs.find(ctorCall->ClassName) != Structs.end());
+      
+      auto ctorIt = Constructors.find(ctorCall->ClassName);
+      if (ctorIt != Constructors.end()) {
+        auto* ctor = ctorIt->second;
+        std::vector<Value> args;
+        args.reserve(ctorCall->Args.size());
+        for (auto& arg : ctorCall->Args) {
+          args.push_back(evaluate(arg.get()));
+        }
+        enterScope();
+        for (size_t i = 0; i < ctor->Params.size() && i < args.size(); i++) {
+          declareVariable(ctor->Params[i].first, args[i]);
+        }
+        ObjectValue* savedObject = CurrentObject;
+        CurrentObject = &obj;
+        if (ctor->Body) {
+          auto* block = dynamic_cast<BlockStmt*>(ctor->Body.get());
+          if (block) {
+            runBlock(block);
+          }
+        }
+        CurrentObject = savedObject;
+        exitScope();
+      }
+      
+      return Value(std::move(obj));
+    }
+    
+    if (auto superExpr = dynamic_cast<SuperExpr*>(expr)) {
+      if (CurrentObject) {
+        auto classIt = Classes.find((*CurrentObject)->ClassName);
+        if (classIt != Classes.end() && !classIt->second->SuperClass.empty()) {
+          ObjectValue superObj(classIt->second->SuperClass, false);
+          return Value(superObj);
+        }
+      }
+      return Value();
+    }
+    
+    if (auto thisExpr = dynamic_cast<ThisExpr*>(expr)) {
+      if (CurrentObject) {
+        return Value(*CurrentObject);
+      }
+      return Value();
+    }
+    
+    return Value(int64_t(0));
+  }
+  
+  // Finds the handle an assignment through a member should write to, so a
+  // struct held in a variable is copied on write in place rather than in a
+  // temporary. Class instances are shared, so any handle will do. For a
+  // chain like a.b.c each struct on the way is made unique and the handle
+  // returned is the one stored in its parent, so the write lands in a.
+  ObjectValue* resolveObject(Expr* expr, Value& temporary) {
+    if (dynamic_cast<ThisExpr*>(expr)) {
+      return CurrentObject;
+    }
+    if (auto id = dynamic_cast<IdentifierExpr*>(expr)) {
+      if (Value* var = getVariable(id->Name)) {
+        return var->get<ObjectValue>();
+      }
+      return nullptr;
+    }
+    if (auto member = dynamic_cast<MemberAccessExpr*>(expr)) {
+      ObjectValue* parent = resolveObject(member->Object.get(), temporary);
+      if (!parent) {
+        return nullptr;
+      }
+      auto& props = parent->mutate()->Properties;
+      auto it = props.find(member->MemberName);
+      return it != props.end() ? it->second.get<ObjectValue>() : nullptr;
+    }
+    temporary = evaluate(expr);
+    return temporary.get<ObjectValue>();
+  }
+  
+  // Generic binary evaluation for Any-typed operands
+  Value evaluateBinary(BinaryExpr* binary) {
+    if (binary->Op == "&&") {
+      return Value(isTruthy(evaluate(binary->LHS.get())) && isTruthy(evaluate(binary->RHS.get())));
+    }
+    if (binary->Op == "||") {
+      return Value(isTruthy(evaluate(binary->LHS.get())) || isTruthy(evaluate(binary->RHS.get())));
+    }
+    
+    Value lhs = evaluate(binary->LHS.get());
+    Value rhs = evaluate(binary->RHS.get());
+    return applyBinary(binary, std::move(lhs), rhs);
+  }
+  
+  Value applyBinary(BinaryExpr* binary, Value lhs, const Value& rhs) {
+    if (Profile) {
+      Profile->recordOperands(binary->ProfileSite, kindBit(lhs), kindBit(rhs));
+    }
+    
+    // Speculation covers the arithmetic with an unboxed form and comparisons
+    bool speculable = hasUnboxedForm(binary->Op) || isComparison(binary->Op);
+    if (speculable && binary->SpeculatedKind == Expr::EvalKind::Int64) {
+      auto l = lhs.get<int64_t>();
+      auto r = rhs.get<int64_t>();
+      if (l && r) {
+        if (binary->Op == "+") return Value(*l + *r);
+        if (binary->Op == "-") return Value(*l - *r);
+        if (binary->Op == "*") return Value(*l * *r);
+        if (binary->Op == "/") return Value(*r != 0 ? *l / *r : int64_t(0));
+        return Value(compareScalars(binary->Op, *l, *r));
+      }
+      binary->SpeculatedKind = Expr::EvalKind::Generic;
+    } else if (speculable && binary->SpeculatedKind == Expr::EvalKind::Double) {
+      auto l = lhs.get<double>();
+      auto r = rhs.get<double>();
+      if (l && r && (binary->Op != "/" || *r != 0.0)) {
+        if (binary->Op == "+") return Value(*l + *r);
+        if (binary->Op == "-") return Value(*l - *r);
+        if (binary->Op == "*") return Value(*l * *r);
+        if (binary->Op == "/") return Value(*l / *r);
+        return Value(compareScalars(binary->Op, *l, *r));
+      }
+      binary->SpeculatedKind = Expr::EvalKind::Generic;
+    }
+    
+    if (binary->Op == "+") {
+      if (auto l = lhs.get<StringCell>()) {
+        if (auto r = std::get_if<StringCell>(&rhs.getData())) {
+          return Value(StringCell::concat(std::move(*l), *r));
+        }
+      }
+      if (auto l = lhs.get<int64_t>()) {
+        if (auto r = rhs.get<int64_t>()) {
+          return Value(*l + *r);
+        }
+      }
+    }
+    if (binary->Op == "-") {
+      if (auto l = lhs.get<int64_t>()) {
+        if (auto r = rhs.get<int64_t>()) {
+          return Value(*l - *r);
+        }
+      }
+    }
+    if (binary->Op == "*") {
+      if (auto l = lhs.get<int64_t>()) {
+        if (auto r = rhs.get<int64_t>()) {
+          return Value(*l * *r);
+        }
+      }
+    }
+    if (binary->Op == "/") {
+      if (auto l = lhs.get<int64_t>()) {
+        if (auto r = rhs.get<int64_t>()) {
+          return Value(*r != 0 ? *l / *r : 0);
+        }
+        if (auto l = lhs.get<double>()) {
+          if (auto r = rhs.get<double>()) {
+            if (*r == 0.0) {
+              DiagnosticError error;
+              error.Level = DiagLevel::Fatal;
+              error.Category = ErrorCategory::Runtime;
+              error.Message = "division by zero";
+              error.ErrorID = ErrorCodes::Runtime::DivisionByZero;
+              error.Line = binary->Loc.Line;
+              error.Column = binary->Loc.Col;
+              error.FileName = currentFilename;
+              Diags.report(error);
+              return Value();
+            }
+            return Value(*l / *r);
+          }
+        }
+      }
+    }
+    if (binary->Op == "%") {
+      if (auto l = lhs.get<int64_t>()) {
+        if (auto r = rhs.get<int64_t>()) {
+          return Value(*r != 0 ? *l % *r : int64_t(0));
+        }
+      }
+      if (auto l = lhs.get<double>()) {
+        if (auto r = rhs.get<double>()) {
+          return Value(std::fmod(*l, *r));
+        }
+      }
+    }
+    if (binary->Op == "==") {
+      return Value(lhs == rhs);
+    }
+    if (binary->Op == "!=") {
+      return Value(lhs != rhs);
+    }
+    if (binary->Op == "<") {
+      if (auto l = lhs.get<int64_t>()) {
+        if (auto r = rhs.get<int64_t>()) {
+          return Value(*l < *r);
+        }
+      }
+    }
+    if (binary->Op == ">") {
+      if (auto l = lhs.get<int64_t>()) {
+        if (auto r = rhs.get<int64_t>()) {
+          return Value(*l > *r);
+        }
+      }
+    }
+    if (binary->Op == "<=") {
+      if (auto l = lhs.get<int64_t>()) {
+        if (auto r = rhs.get<int64_t>()) {
+          return Value(*l <= *r);
+        }
+      }
+    }
+    if (binary->Op == ">=") {
+      if (auto l = lhs.get<int64_t>()) {
+        if (auto r = rhs.get<int64_t>()) {
+          return Value(*l >= *r);
+        }
+      }
+    }
+    
+    return Value(int64_t(0));
+  }
+  
+  // Monomorphic inline cache for user function calls, revalidated whenever
+  // a function is registered, which bumps FunctionEpoch. A site that calls
+  // a builtin caches nullptr, so it costs only the caller's Functions.find.
+  FuncDecl* resolveCallTarget(CallExpr* call) {
+    if (call->CachedEpoch.load(std::memory_order_acquire) == FunctionEpoch) {
+      return call->CachedTarget.load(std::memory_order_relaxed);
+    }
+    FuncDecl* target = nullptr;
+    if (Functions.find(call->Callee) == Functions.end()) {
+      auto userIt = UserFunctions.find(call->Callee);
+      if (userIt != UserFunctions.end()) {
+        target = userIt->second;
+      }
+    }
+    call->CachedTarget.store(target, std::memory_order_relaxed);
+    call->CachedEpoch.store(FunctionEpoch, std::memory_order_release);
+    return target;
+  }
+  
+  // Statement-level suspension points: a statement may suspend if it is
+  // `await x`, `var v = await x`, `v = await x` or `return await x`, a call
+  // of a user function that may suspend in one of those places, or an if,
+  // while, for or block around one. An expression or condition that awaits
+  // variables and has no other side effects, such as `total + await t`,
+  // suspends until those tasks are ready before it is evaluated. Any other
+  // await runs on the plain walker and blocks as before. Worked out once per
+  // node and cached on it.
+  bool maySuspend(Stmt* stmt);
+  static bool collectAwaitedVariables(Expr* expr, std::vector<IdentifierExpr*>& awaited);
+  static bool awaitsVariables(Expr* expr);
+  std::vector<TaskValue> pendingAwaitedTasks(Expr* expr);
+  Coroutine<void> runBlockSuspendable(BlockStmt* block, Value* retVal);
+  Coroutine<void> runStmtSuspendable(Stmt* stmt, Value* retVal);
+  Coroutine<Value> evaluateSuspendable(Expr* expr);
+  
+  Value startTask(AsyncExpr* asyncExpr);
+  using IOCompletion = std::function<void(Value)>;
+  Value startIO(const std::function<void(IOCompletion)>& begin, std::shared_ptr<void> keepAlive = nullptr);
+  void runTaskGroup(TaskGroupStmt* groupStmt, Value* retVal);
+  Value awaitTask(const TaskValue& handle);
+  Value startActor(ActorExpr* actorExpr);
+  Value awaitActor(const ActorValue& handle);
+  Value sendMessage(const std::vector<Value>& args);
+  Value runPipeline(const std::vector<Value>& args);
+  Value createServer(const std::vector<Value>& args);
+  Value addRoute(const std::vector<Value>& args);
+  Value startServer(const std::vector<Value>& args);
+  Value waitServer(const std::vector<Value>& args);
+  Value stopServer(const std::vector<Value>& args);
+  
+  enum class SocketRead { Raw, Line, Frame };
+  
+  Value awaitIO(const Value& task);
+  Value startConnect(const std::vector<Value>& args);
+  Value listenTCP(const std::vector<Value>& args);
+  Value startAccept(const std::vector<Value>& args);
+  Value startSocketRead(SocketRead how, const std::vector<Value>& args);
+  Value startSocketWrite(bool framed, const std::vector<Value>& args);
+  Value bindUDP(const std::vector<Value>& args);
+  Value sendDatagrams(bool batch, const std::vector<Value>& args);
+  Value startReceiveDatagrams(const std::vector<Value>& args);
+  
+  enum class ParallelOp { Map, Filter, Reduce };
+  
+  // Arrays shorter than this run on the calling thread, and no chunk is
+  // smaller, so forking an interpreter is paid for by the work it does
+  static constexpr size_t MinParallelGrain = 16;
+  
+  Value parallelApply(ParallelOp op, const std::vector<Value>& args);
+  Value applyChunk(ParallelOp op, FuncDecl* func, const std::vector<Value>& items);
+  
+  // Unwinds a cancelled task with CancelledError. Polled at loop back-edges
+  // and by the I/O builtins, so abandoned work stops at the next one.
+  void checkCancelled() const {
+    if (Cancellation) {
+      Cancellation->throwIfCancelled();
+    }
+  }
+  
+  // Time left before the task's deadline for HTTP requests, or 0 for the
+  // client's default timeout
+  // The optional second argument of the batch HTTP builtins
+  static Value responseValue(Result<http::Response> result) {
+    ObjectValue object("HTTPResponse", true);
+    auto& props = object.mutate()->Properties;
+    if (result.is_ok()) {
+      http::Response& response = result.unwrap();
+      std::vector<Value> headers;
+      headers.reserve(response.headers.size() * 2);
+      for (const auto& header : response.headers) {
+        headers.push_back(Value(header.first));
+        headers.push_back(Value(header.second));
+      }
+      props[Atom("status")] = Value(int64_t(response.statusCode));
+      props[Atom("ok")] = Value(response.isSuccess());
+      props[Atom("body")] = Value(std::move(response.body));
+      props[Atom("headers")] = Value(std::move(headers));
+      props[Atom("error")] = Value("");
+      props[Atom("timeMs")] = Value(response.totalTimeMs);
+      props[Atom("bytes")] = Value(int64_t(response.streamedBytes));
+      props[Atom("dnsMs")] = Value(response.timing.nameLookupMs);
+      props[Atom("connectMs")] = Value(response.timing.connectMs);
+      props[Atom("tlsMs")] = Value(response.timing.tlsMs);
+      props[Atom("firstByteMs")] = Value(response.timing.firstByteMs);
+      props[Atom("bytesSent")] = Value(int64_t(response.bytesSent));
+      props[Atom("bytesReceived")] = Value(int64_t(response.bytesReceived));
+    } else {
+      props[Atom("status")] = Value(int64_t(-1));
+      props[Atom("ok")] = Value(false);
+      props[Atom("body")] = Value("");
+      props[Atom("headers")] = Value(std::vector<Value>());
+      props[Atom("error")] = Value(result.error().getMessage());
+      props[Atom("timeMs")] = Value(0.0);
+      props[Atom("bytes")] = Value(int64_t(0));
+      props[Atom("dnsMs")] = Value(0.0);
+      props[Atom("connectMs")] = Value(0.0);
+      props[Atom("tlsMs")] = Value(0.0);
+      props[Atom("firstByteMs")] = Value(0.0);
+      props[Atom("bytesSent")] = Value(int64_t(0));
+      props[Atom("bytesReceived")] = Value(int64_t(0));
+    }
+    return Value(std::move(object));
+  }
+  
+  // What the legacy helpers read from: a response passed in, or one GET of
+  // a URL passed in, so reading several things off a response costs one
+  // request
+  std::optional<ObjectValue> responseArgument(const Value& arg) {
+    if (auto object = arg.get<ObjectValue>()) {
+      if ((*object)->ClassName == "HTTPResponse") {
+        return *object;
+      }
+    } else if (auto url = arg.get<std::string>()) {
+      http::Request request;
+      request.url = *url;
+      Value response = responseValue(httpSend(request, requestTimeoutMs()));
+      return *response.get<ObjectValue>();
+    }
+    return std::nullopt;
+  }
+  
+  static Value responseProperty(const ObjectValue& response, const char* name) {
+    auto it = response->Properties.find(Atom(name));
+    return it != response->Properties.end() ? it->second : Value();
+  }
+  
+  static std::string responseHeader(const ObjectValue& response, const std::string& name) {
+    auto lower = [](std::string text) {
+      std::transform(text.begin(), text.end(), text.begin(),
+                     [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+      return text;
+    };
+    Value headers = responseProperty(response, "headers");
+    if (auto pairs = headers.get<std::vector<Value>>()) {
+      std::string wanted = lower(name);
+      for (size_t i = 0; i + 1 < pairs->size(); i += 2) {
+        auto key = (*pairs)[i].get<std::string>();
+        auto value = (*pairs)[i + 1].get<std::string>();
+        if (key && value && lower(*key) == wanted) {
+          return *value;
+        }
+      }
+    }
+    return "";
+  }
+  
+  static size_t batchConcurrency(const std::vector<Value>& args) {
+    if (args.size() > 1) {
+      if (auto limit = args[1].get<int64_t>()) {
+        if (*limit > 0) {
+          return static_cast<size_t>(*limit);
+        }
+      }
+    }
+    return http::HTTPClient::DefaultBatchConcurrency;
+  }
+  
+  int requestTimeoutMs() const {
+    if (Cancellation) {
+      if (auto left = Cancellation->remaining()) {
+        return static_cast<int>(std::clamp<int64_t>(left->count(), 1, INT32_MAX));
+      }
+    }
+    return 0;
+  }
+  
+  void sleepFor(int64_t ms) {
+    if (!Cancellation) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    } else if (!Cancellation->sleepFor(std::chrono::milliseconds(ms))) {
+      throw CancelledError();
+    }
+  }
+  
+  static uint16_t kindBit(const Value& val) {
+    return static_cast<uint16_t>(1u << val.getData().index());
+  }
+  
+  Expr::EvalKind resolveKind(Expr* expr) {
+    if (!expr) {
+      return Expr::EvalKind::Generic;
+    }
+    if (expr->Kind != Expr::EvalKind::Unresolved) {
+      return expr->Kind;
+    }
+    
+    Expr::EvalKind kind = Expr::EvalKind::Generic;
+    if (auto builtin = dynamic_cast<BuiltinType*>(expr->ExprType.get())) {
+      if (builtin->isInteger()) {
+        kind = Expr::EvalKind::Int64;
+      } else if (builtin->isFloat()) {
+        kind = Expr::EvalKind::Double;
+      } else if (builtin->TyKind == BuiltinType::Bool) {
+        kind = Expr::EvalKind::Bool;
+      }
+    }
+    expr->Kind = kind;
+    return kind;
+  }
+  
+  static bool isTruthy(const Value& val) {
+    if (auto b = val.get<bool>()) return *b;
+    if (auto i = val.get<int64_t>()) return *i != 0;
+    if (auto d = val.get<double>()) return *d != 0.0;
+    if (auto str = val.get<std::string>()) return !str->empty();
+    return false;
+  }
+  
+  static int64_t toInt64(const Value& val) {
+    if (auto i = val.get<int64_t>()) return *i;
+    if (auto d = val.get<double>()) return (int64_t)*d;
+    if (auto b = val.get<bool>()) return *b ? 1 : 0;
+    return 0;
+  }
+  
+  static double toDouble(const Value& val) {
+    if (auto d = val.get<double>()) return *d;
+    if (auto i = val.get<int64_t>()) return (double)*i;
+    return 0.0;
+  }
+  
+  // Typed evaluators: subtrees Sema proved Int64/Double/Bool are computed
+  // on unboxed scalars; only leaves that load a Value are checked.
+  int64_t evaluateInt(Expr* expr) {
+    if (auto lit = dynamic_cast<IntegerLiteralExpr*>(expr)) {
+      return lit->Value;
+    }
+    
+    auto binary = dynamic_cast<BinaryExpr*>(expr);
+    if (!binary || resolveKind(binary) != Expr::EvalKind::Int64) {
+      return toInt64(evaluate(expr));
+    }
+    if (resolveKind(binary->LHS.get()) != Expr::EvalKind::Int64 ||
+        resolveKind(binary->RHS.get()) != Expr::EvalKind::Int64) {
+      return toInt64(evaluateBinary(binary));
+    }
+    
+    if (!hasUnboxedForm(binary->Op)) {
+      return toInt64(evaluateBinary(binary));
+    }
+    
+    int64_t lhs = evaluateInt(binary->LHS.get());
+    int64_t rhs = evaluateInt(binary->RHS.get());
+    if (binary->Op == "+") return lhs + rhs;
+    if (binary->Op == "-") return lhs - rhs;
+    if (binary->Op == "*") return lhs * rhs;
+    return rhs != 0 ? lhs / rhs : 0;
+  }
+  
+  double evaluateDouble(Expr* expr) {
+    if (auto flt = dynamic_cast<FloatLiteralExpr*>(expr)) {
+      return flt->Value;
+    }
+    
+    auto binary = dynamic_cast<BinaryExpr*>(expr);
+    if (!binary || resolveKind(binary) != Expr::EvalKind::Double) {
+      switch (resolveKind(expr)) {
+        case Expr::EvalKind::Int64:
+          return (double)evaluateInt(expr);
+        default:
+          return toDouble(evaluate(expr));
+      }
+    }
+    if (!isNumericKind(resolveKind(binary->LHS.get())) ||
+        !isNumericKind(resolveKind(binary->RHS.get())) || !hasUnboxedForm(binary->Op)) {
+      return toDouble(evaluateBinary(binary));
+    }
+    
+    double lhs = evaluateDouble(binary->LHS.get());
+    double rhs = evaluateDouble(binary->RHS.get());
+    if (binary->Op == "+") return lhs + rhs;
+    if (binary->Op == "-") return lhs - rhs;
+    if (binary->Op == "*") return lhs * rhs;
+    if (rhs == 0.0) {
+      DiagnosticError error;
+      error.Level = DiagLevel::Fatal;
+      error.Category = ErrorCategory::Runtime;
+      error.Message = "division by zero";
+      error.ErrorID = ErrorCodes::Runtime::DivisionByZero;
+      error.Line = binary->Loc.Line;
+      error.Column = binary->Loc.Col;
+      error.FileName = currentFilename;
+      Diags.report(error);
+      return 0.0;
+    }
+    return lhs / rhs;
+  }
+  
+  bool evaluateBool(Expr* expr) {
+    if (auto bl = dynamic_cast<BoolLiteralExpr*>(expr)) {
+      return bl->Value;
+    }
+    
+    auto binary = dynamic_cast<BinaryExpr*>(expr);
+    if (!binary || resolveKind(binary) != Expr::EvalKind::Bool) {
+      switch (resolveKind(expr)) {
+        case Expr::EvalKind::Int64:
+          return evaluateInt(expr) != 0;
+        case Expr::EvalKind::Double:
+          return evaluateDouble(expr) != 0.0;
+        default:
+          return isTruthy(evaluate(expr));
+      }
+    }
+    
+    const std::string& op = binary->Op;
+    if (op == "&&") {
+      return evaluateBool(binary->LHS.get()) && evaluateBool(binary->RHS.get());
+    }
+    if (op == "||") {
+      return evaluateBool(binary->LHS.get()) || evaluateBool(binary->RHS.get());
+    }
+    
+    Expr::EvalKind lhsKind = resolveKind(binary->LHS.get());
+    Expr::EvalKind rhsKind = resolveKind(binary->RHS.get());
+    if (lhsKind == Expr::EvalKind::Int64 && rhsKind == Expr::EvalKind::Int64) {
+      return compareScalars(op, evaluateInt(binary->LHS.get()), evaluateInt(binary->RHS.get()));
+    }
+    if (lhsKind == Expr::EvalKind::Double && rhsKind == Expr::EvalKind::Double) {
+      return compareScalars(op, evaluateDouble(binary->LHS.get()), evaluateDouble(binary->RHS.get()));
+    }
+    if (lhsKind == Expr::EvalKind::Bool && rhsKind == Expr::EvalKind::Bool && (op == "==" || op == "!=")) {
+      bool lhs = evaluateBool(binary->LHS.get());
+      bool rhs = evaluateBool(binary->RHS.get());
+      return op == "==" ? lhs == rhs : lhs != rhs;
+    }
+    return isTruthy(evaluateBinary(binary));
+  }
+  
+  // The arithmetic the typed evaluators compute themselves; anything else,
+  // such as %, goes through evaluateBinary
+  static bool hasUnboxedForm(const std::string& op) {
+    return op == "+" || op == "-" || op == "*" || op == "/";
+  }
+  
+  static bool isComparison(const std::string& op) {
+    return op == "==" || op == "!=" || op == "<" || op == ">" || op == "<=" || op == ">=";
+  }
+  
+  static bool isNumericKind(Expr::EvalKind kind) {
+    return kind == Expr::EvalKind::Int64 || kind == Expr::EvalKind::Double;
+  }
+  
+  template<typename T>
+  static bool compareScalars(const std::string& op, T lhs, T rhs) {
+    if (op == "==") return lhs == rhs;
+    if (op == "!=") return lhs != rhs;
+    if (op == "<") return lhs < rhs;
+    if (op == ">") return lhs > rhs;
+    if (op == "<=") return lhs <= rhs;
+    if (op == ">=") return lhs >= rhs;
+    return false;
+  }
+};
+
+// A forked interpreter together with the diagnostics it reports to
+struct InterpreterFork {
+  DiagnosticEngine Diags;
+  std::ostringstream DiagOutput;
+  Interpreter Child;
+  
+  explicit InterpreterFork(const Interpreter& parent) : Child(Diags, parent) {
+    Diags.setOutput(DiagOutput);
+  }
+};
+
+// Forks whose task has finished, kept for the next `async` call. Making a
+// fork registers every builtin again, which costs more than most task
+// bodies; reusing one only resets what the last task left in it.
+class ForkPool {
+public:
+  std::unique_ptr<InterpreterFork> acquire(const Interpreter& parent) {
+    std::unique_ptr<InterpreterFork> fork;
+    {
+      std::lock_guard<std::mutex> lock(Mutex);
+      if (!Idle.empty()) {
+        fork = std::move(Idle.back());
+        Idle.pop_back();
+      }
+    }
+    if (!fork) {
+      return std::make_unique<InterpreterFork>(parent);
+    }
+    fork->Child.inherit(parent);
+    return fork;
+  }
+  
+  // Keeps fork for reuse if its task left nothing behind, else drops it
+  void release(std::unique_ptr<InterpreterFork> fork) {
+    if (!fork->Diags.getDiagnostics().empty() || !fork->Child.resetFork()) {
+      return;
+    }
+    fork->Diags.clearStack();
+    std::lock_guard<std::mutex> lock(Mutex);
+    if (Idle.size() < MaxIdle) {
+      Idle.push_back(std::move(fork));
+    }
+  }
+  
+private:
+  static constexpr size_t MaxIdle = 64;
+  
+  std::mutex Mutex;
+  std::vector<std::unique_ptr<InterpreterFork>> Idle;
+};
+
+inline const std::shared_ptr<ForkPool>& Interpreter::forkPool() const {
+  if (!Forks) {
+    Forks = std::make_shared<ForkPool>();
+  }
+  return Forks;
+}
+
+// A user function call started by `async`. It runs on the shared Scheduler
+// in a forked interpreter with its own heap and diagnostics, taken from the
+// ForkPool and handed back once the task is gone. Arguments are
+// deep-copied into the fork before it starts and the result is deep-copied
+// out by whoever awaits it, so no Value is shared between threads.
+//
+// The function runs as a coroutine: where it awaits a task that is not
+// ready, its frames are parked on that task and the rest of it continues
+// as a new job once the task completes, on whichever worker picks it up.
+class ScriptTask : public std::enable_shared_from_this<ScriptTask> {
+public:
+  explicit ScriptTask(const Interpreter& parent) : ScriptTask() {
+    Fork = parent.forkPool()->acquire(parent);
+    Child = &Fork->Child;
+    if (!parent.Groups.empty()) {
+      Group = parent.Groups.back().Token;
+      Child->Cancellation = Group;
+    }
+  }
+  
+  // A task that already holds its result, for `async` on a builtin
+  explicit ScriptTask(Value result) : Result(std::move(result)), Ready(true) {}
+  
+  // A task finished from outside by complete(), for the *Async builtins
+  ScriptTask() {
+    Job.emplace(Promise.get_future().share());
+  }
+  
+  ~ScriptTask() {
+    if (!Fork) {
+      return;
+    }
+    // The coroutine, the result and the arguments live in the fork's heap,
+    // so they go before the fork is handed back
+    Frame.reset();
+    Job.reset();
+    Promise = std::promise<Value>();
+    Result = Value();
+    Args.clear();
+    if (std::shared_ptr<ForkPool> pool = Child->Forks) {
+      pool->release(std::move(Fork));
+    }
+  }
+  
+  using Body = std::function<Value(Interpreter&, const std::vector<Value>&)>;
+  
+  void start(FuncDecl* func, const std::vector<Value>& args) {
+    copyArgs(args);
+    Child->RunningTask = this;
+    Frame.emplace(run(func, std::move(Args)));
+    Scheduler::getInstance().spawn([self = shared_from_this()]() {
+      ObjectHeap::Scope heapScope(self->Child->Heap);
+      self->Frame->resume();
+    });
+  }
+  
+  // Runs body in the fork with args copied into its heap. The body cannot
+  // suspend, so it holds its worker until it returns.
+  void start(Body body, const std::vector<Value>& args) {
+    copyArgs(args);
+    auto self = shared_from_this();
+    Scheduler::getInstance().spawn([self, body = std::move(body)]() {
+      std::vector<Value> args = std::move(self->Args);
+      try {
+        Value result = body(*self->Child, args);
+        self->Child->joinTasks();
+        if (self->Fork->Diags.hasErrors()) {
+          self->cancelGroup();
+        }
+        self->complete(std::move(result));
+      } catch (const CancelledError&) {
+        // A cancelled task quietly finishes with nil
+        self->Child->joinTasks();
+        self->complete(Value());
+      } catch (...) {
+        self->cancelGroup();
+        self->fail(std::current_exception());
+      }
+    });
+  }
+  
+  void complete(Value result) {
+    Promise.set_value(std::move(result));
+    notifyReady();
+  }
+  
+  void fail(std::exception_ptr error) {
+    Promise.set_exception(std::move(error));
+    notifyReady();
+  }
+  
+  // Keeps owner alive as long as the task, for results whose objects live
+  // in owner's heap
+  void keepAlive(std::shared_ptr<void> owner) {
+    KeepAlive = std::move(owner);
+  }
+  
+  bool isReady() const {
+    return Ready.load(std::memory_order_acquire);
+  }
+  
+  // Calls waiter once the task is ready, on the thread that finishes it.
+  // Returns false, without keeping waiter, if it already is.
+  bool whenReady(std::function<void()> waiter) {
+    std::lock_guard<std::mutex> lock(WaitMutex);
+    if (Ready.load(std::memory_order_relaxed)) {
+      return false;
+    }
+    Waiters.push_back(std::move(waiter));
+    return true;
+  }
+  
+  // co_await in the coroutine of owner suspends it until this task is ready
+  auto readiness(ScriptTask& owner) {
+    struct Awaiter {
+      ScriptTask& Target;
+      ScriptTask& Owner;
+      
+      bool await_ready() const { return Target.isReady(); }
+      
+      bool await_suspend(std::coroutine_handle<> frame) {
+        return Target.whenReady([owner = Owner.shared_from_this(), frame] {
+          owner->resume(frame);
+        });
+      }
+      
+      void await_resume() const {}
+    };
+    return Awaiter{*this, owner};
+  }
+  
+  // Result copied into the caller's current heap. Rethrows what the task
+  // threw.
+  Value await(DiagnosticEngine& diags) {
+    Awaited = true;
+    const Value& result = Job ? Job->get() : Result;
+    forwardDiagnostics(diags);
+    return result.sendableCopy();
+  }
+  
+  void join(DiagnosticEngine& diags) {
+    if (Job && !Awaited) {
+      try {
+        Job->get();
+      } catch (const std::exception& e) {
+        // Nobody awaited the task, so this is the only place its error shows up
+        (Fork ? Fork->Diags : diags).report(DiagLevel::Error, std::string("async task failed: ") + e.what());
+      }
+    }
+    forwardDiagnostics(diags);
+  }
+  
+  void wait() {
+    if (Job) {
+      Job->wait();
+    }
+  }
+  
+private:
+  Coroutine<void> run(FuncDecl* func, std::vector<Value> args) {
+    Value result;
+    std::exception_ptr error;
+    bool cancelled = false;
+    try {
+      result = co_await Child->callSuspendable(func, std::move(args));
+    } catch (const CancelledError&) {
+      // A cancelled task quietly finishes with nil
+      cancelled = true;
+    } catch (...) {
+      error = std::current_exception();
+    }
+    if (error) {
+      cancelGroup();
+      fail(error);
+      co_return;
+    }
+    co_await Child->joinTasksSuspendable();
+    if (!cancelled && Fork->Diags.hasErrors()) {
+      cancelGroup();
+    }
+    complete(std::move(result));
+  }
+  
+  // Continues the coroutine suspended at frame as a job on the pool
+  void resume(std::coroutine_handle<> frame) {
+    Scheduler::getInstance().spawn([self = shared_from_this(), frame]() {
+      ObjectHeap::Scope heapScope(self->Child->Heap);
+      frame.resume();
+    });
+  }
+  
+  void copyArgs(const std::vector<Value>& args) {
+    ObjectHeap::Scope heapScope(Child->Heap);
+    for (const auto& arg : args) {
+      Args.push_back(arg.sendableCopy());
+    }
+  }
+  
+  void notifyReady() {
+    std::vector<std::function<void()>> waiters;
+    {
+      std::lock_guard<std::mutex> lock(WaitMutex);
+      Ready.store(true, std::memory_order_release);
+      waiters.swap(Waiters);
+    }
+    for (auto& waiter : waiters) {
+      waiter();
+    }
+  }
+  
+  // The first task in a group to fail cancels its siblings
+  void cancelGroup() {
+    if (Group) {
+      Group->cancel();
+    }
+  }
+  
+  void forwardDiagnostics(DiagnosticEngine& diags) {
+    if (!Fork || Forwarded.exchange(true)) {
+      return;
+    }
+    for (const auto& diag : Fork->Diags.getDiagnostics()) {
+      diags.report(diag);
+    }
+  }
+  
+  // Destroyed in reverse order: the coroutine and the result before the
+  // fork whose heap they live in
+  std::shared_ptr<void> KeepAlive;
+  std::unique_ptr<InterpreterFork> Fork;
+  Interpreter* Child = nullptr;
+  std::shared_ptr<CancellationToken> Group;
+  std::vector<Value> Args;
+  Value Result;
+  std::promise<Value> Promise;
+  std::optional<Task<Value>> Job;
+  std::optional<Coroutine<void>> Frame;
+  std::mutex WaitMutex;
+  std::vector<std::function<void()>> Waiters;
+  std::atomic<bool> Ready{false};
+  std::atomic<bool> Awaited{false};
+  std::atomic<bool> Forwarded{false};
+};
+
+inline Value Interpreter::startTask(AsyncExpr* asyncExpr) {
+  auto* call = dynamic_cast<CallExpr*>(asyncExpr->Call.get());
+  FuncDecl* func = call ? resolveCallTarget(call) : nullptr;
+  if (!func) {
+    // Builtins run synchronously and hand back a finished task
+    return Value(TaskValue(std::make_shared<ScriptTask>(evaluate(asyncExpr->Call.get()))));
+  }
+  
+  std::vector<Value> args;
+  args.reserve(call->Args.size());
+  for (auto& arg : call->Args) {
+    args.push_back(evaluate(arg.get()));
+  }
+  
+  auto task = std::make_shared<ScriptTask>(*this);
+  task->start(func, args);
+  
+  if (!Groups.empty()) {
+    Groups.back().Tasks.push_back(task);
+    return Value(TaskValue(task));
+  }
+  
+  // Finished tasks are joined in batches so a long loop of fire-and-forget
+  // tasks does not keep every fork alive
+  if (Tasks.size() >= TaskPruneThreshold) {
+    auto finished = std::stable_partition(Tasks.begin(), Tasks.end(),
+      [](const std::shared_ptr<ScriptTask>& t) { return !t->isReady(); });
+    for (auto it = finished; it != Tasks.end(); ++it) {
+      (*it)->join(Diags);
+    }
+    Tasks.erase(finished, Tasks.end());
+    TaskPruneThreshold = std::max<size_t>(64, Tasks.size() * 2);
+  }
+  Tasks.push_back(task);
+  return Value(TaskValue(task));
+}
+
+// Starts an operation on the event loop and hands back a task for it at
+// once. The completion may run on the loop thread, so it only ever
+// receives values that own no heap objects, or whose heap keepAlive owns.
+inline Value Interpreter::startIO(const std::function<void(IOCompletion)>& begin,
+                                  std::shared_ptr<void> keepAlive) {
+  checkCancelled();
+  auto task = std::make_shared<ScriptTask>();
+  task->keepAlive(std::move(keepAlive));
+  begin([task](Value result) { task->complete(std::move(result)); });
+  return Value(TaskValue(task));
+}
+
+inline Value Interpreter::awaitTask(const TaskValue& handle) {
+  return handle.get()->await(Diags);
+}
+
+inline Coroutine<Value> Interpreter::callSuspendable(FuncDecl* func, std::vector<Value> args,
+                                                     CallExpr* call) {
+  Value retVal(int64_t(0));
+  auto* block = func->Body ? dynamic_cast<BlockStmt*>(func->Body.get()) : nullptr;
+  if (block) {
+    bool savedHasReturn = HasReturn;
+    HasReturn = false;
+    enterScope();
+    if (call) {
+      Diags.pushStackFrame(func->Name, currentFilename, call->Loc.Line, call->Loc.Col);
+    } else {
+      Diags.pushStackFrame(func->Name, currentFilename);
+    }
+    for (size_t i = 0; i < func->Params.size() && i < args.size(); i++) {
+      declareVariable(func->Params[i].first, args[i]);
+    }
+    if (maySuspend(block)) {
+      co_await runBlockSuspendable(block, &retVal);
+    } else {
+      runBlock(block, &retVal);
+    }
+    HasReturn = savedHasReturn;
+    exitScope();
+    Diags.popStackFrame();
+  }
+  co_return retVal;
+}
+
+inline Coroutine<void> Interpreter::joinTasksSuspendable() {
+  // Nothing else runs in this fork while it waits, so Tasks stays put
+  for (size_t i = 0; i < Tasks.size(); i++) {
+    co_await Tasks[i]->readiness(*RunningTask);
+  }
+  joinTasks();
+}
+
+inline bool Interpreter::maySuspend(Stmt* stmt) {
+  if (!stmt) {
+    return false;
+  }
+  Stmt::Suspension cached = stmt->Suspends.load(std::memory_order_relaxed);
+  if (cached != Stmt::Suspension::Unknown) {
+    return cached == Stmt::Suspension::May;
+  }
+  // A statement met again while working it out counts as never, so a
+  // recursive call finds an answer instead of recursing. The AST is shared
+  // by every fork, so that guess is kept here rather than on the node. A
+  // wrong never is harmless: that statement just blocks.
+  auto inProgress = std::find(SuspensionQueries.begin(), SuspensionQueries.end(), stmt);
+  if (inProgress != SuspensionQueries.end()) {
+    SuspensionGuess = std::min(SuspensionGuess, static_cast<size_t>(inProgress - SuspensionQueries.begin()));
+    return false;
+  }
+  size_t depth = SuspensionQueries.size();
+  SuspensionQueries.push_back(stmt);
+  
+  bool result = false;
+  if (dynamic_cast<AwaitExpr*>(stmt)) {
+    result = true;
+  } else if (auto ret = dynamic_cast<ReturnStmt*>(stmt)) {
+    result = maySuspend(ret->Value.get());
+  } else if (auto varDecl = dynamic_cast<VarDeclStmt*>(stmt)) {
+    result = maySuspend(varDecl->Init.get());
+  } else if (auto assign = dynamic_cast<AssignExpr*>(stmt)) {
+    result = maySuspend(assign->Value.get());
+  } else if (auto call = dynamic_cast<CallExpr*>(stmt)) {
+    FuncDecl* func = resolveCallTarget(call);
+    result = (func && maySuspend(func->Body.get())) || awaitsVariables(call);
+  } else if (auto ifStmt = dynamic_cast<IfStmt*>(stmt)) {
+    result = awaitsVariables(ifStmt->Condition.get()) ||
+             maySuspend(ifStmt->ThenBranch.get()) || maySuspend(ifStmt->ElseBranch.get());
+  } else if (auto whileStmt = dynamic_cast<WhileStmt*>(stmt)) {
+    result = awaitsVariables(whileStmt->Condition.get()) || maySuspend(whileStmt->Body.get());
+  } else if (auto forStmt = dynamic_cast<ForStmt*>(stmt)) {
+    result = maySuspend(forStmt->Body.get());
+  } else if (auto block = dynamic_cast<BlockStmt*>(stmt)) {
+    for (auto& inner : block->Statements) {
+      if (maySuspend(inner.get())) {
+        result = true;
+        break;
+      }
+    }
+  } else if (auto expr = dynamic_cast<Expr*>(stmt)) {
+    result = awaitsVariables(expr);
+  }
+  
+  SuspensionQueries.pop_back();
+  // May is certain even if a guess went into it, since a guess only ever
+  // says never. Never is only certain if every guess was for this statement
+  // or one below it; one for an enclosing query may be wrong, so it is
+  // left to be worked out again once that query has its answer.
+  bool guessedAbove = SuspensionGuess < depth;
+  if (!guessedAbove) {
+    SuspensionGuess = SIZE_MAX;
+  }
+  if (result || !guessedAbove) {
+    stmt->Suspends.store(result ? Stmt::Suspension::May : Stmt::Suspension::Never,
+                         std::memory_order_relaxed);
+  }
+  return result;
+}
+
+// Collects the `await name` operands in expr and returns whether everything
+// else in it is free of side effects, in which case waiting for those tasks
+// before evaluating expr cannot be told apart from waiting where the awaits
+// are. A call counts only as the outermost node, since its arguments are
+// evaluated before it runs.
+inline bool Interpreter::collectAwaitedVariables(Expr* expr, std::vector<IdentifierExpr*>& awaited) {
+  if (!expr) {
+    return true;
+  }
+  if (auto awaitExpr = dynamic_cast<AwaitExpr*>(expr)) {
+    auto id = dynamic_cast<IdentifierExpr*>(awaitExpr->Task.get());
+    if (id) {
+      awaited.push_back(id);
+    }
+    return id != nullptr;
+  }
+  if (auto binary = dynamic_cast<BinaryExpr*>(expr)) {
+    if (binary->Op == "&&" || binary->Op == "||") {
+      // The right side may never run, so it must not be waited for
+      std::vector<IdentifierExpr*> conditional;
+      return collectAwaitedVariables(binary->LHS.get(), awaited) &&
+             collectAwaitedVariables(binary->RHS.get(), conditional) && conditional.empty();
+    }
+    return collectAwaitedVariables(binary->LHS.get(), awaited) &&
+           collectAwaitedVariables(binary->RHS.get(), awaited);
+  }
+  if (auto array = dynamic_cast<ArrayLiteralExpr*>(expr)) {
+    for (auto& element : array->Elements) {
+      if (!collectAwaitedVariables(element.get(), awaited)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  if (auto index = dynamic_cast<ArrayIndexExpr*>(expr)) {
+    return collectAwaitedVariables(index->Array.get(), awaited) &&
+           collectAwaitedVariables(index->Index.get(), awaited);
+  }
+  if (auto member = dynamic_cast<MemberAccessExpr*>(expr)) {
+    return collectAwaitedVariables(member->Object.get(), awaited);
+  }
+  return dynamic_cast<IdentifierExpr*>(expr) || dynamic_cast<IntegerLiteralExpr*>(expr) ||
+         dynamic_cast<FloatLiteralExpr*>(expr) || dynamic_cast<BoolLiteralExpr*>(expr) ||
+         dynamic_cast<NilLiteralExpr*>(expr) || dynamic_cast<StringLiteralExpr*>(expr);
+}
+
+inline bool Interpreter::awaitsVariables(Expr* expr) {
+  std::vector<IdentifierExpr*> awaited;
+  if (auto call = dynamic_cast<CallExpr*>(expr)) {
+    for (auto& arg : call->Args) {
+      if (!collectAwaitedVariables(arg.get(), awaited)) {
+        return false;
+      }
+    }
+  } else if (!collectAwaitedVariables(expr, awaited)) {
+    return false;
+  }
+  return !awaited.empty();
+}
+
+// The tasks expr awaits that are not ready yet, when awaitsVariables(expr)
+inline std::vector<TaskValue> Interpreter::pendingAwaitedTasks(Expr* expr) {
+  std::vector<TaskValue> pending;
+  if (!awaitsVariables(expr)) {
+    return pending;
+  }
+  std::vector<IdentifierExpr*> awaited;
+  if (auto call = dynamic_cast<CallExpr*>(expr)) {
+    for (auto& arg : call->Args) {
+      collectAwaitedVariables(arg.get(), awaited);
+    }
+  } else {
+    collectAwaitedVariables(expr, awaited);
+  }
+  for (IdentifierExpr* id : awaited) {
+    Value* variable = getVariable(id->Name);
+    auto handle = variable ? variable->get<TaskValue>() : nullptr;
+    if (handle && !handle->get()->isReady()) {
+      pending.push_back(*handle);
+    }
+  }
+  return pending;
+}
+
+// The suspendable walker mirrors runBlock, runStmt and evaluate for the
+// statements maySuspend accepts, and hands every statement it rejects to
+// them, so a task pays for coroutine frames only on the path to an await
+inline Coroutine<void> Interpreter::runBlockSuspendable(BlockStmt* block, Value* retVal) {
+  enterScope();
+  for (auto& stmt : block->Statements) {
+    if (!stmt) continue;
+    
+    if (auto ret = dynamic_cast<ReturnStmt*>(stmt.get())) {
+      if (retVal && ret->Value) {
+        if (maySuspend(ret->Value.get())) {
+          *retVal = co_await evaluateSuspendable(ret->Value.get());
+        } else {
+          *retVal = evaluate(ret->Value.get());
+        }
+      }
+      HasReturn = true;
+      exitScope();
+      co_return;
+    }
+    if (maySuspend(stmt.get())) {
+      co_await runStmtSuspendable(stmt.get(), retVal);
+    } else {
+      runStmt(stmt.get(), retVal);
+    }
+    if (HasReturn) {
+      exitScope();
+      co_return;
+    }
+  }
+  exitScope();
+}
+
+inline Coroutine<void> Interpreter::runStmtSuspendable(Stmt* stmt, Value* retVal) {
+  CurrentStep++;
+  if (CurrentStep > MaxSteps) {
+    throw std::runtime_error("Execution timeout: infinite loop detected");
+  }
+  
+  if (auto varDecl = dynamic_cast<VarDeclStmt*>(stmt)) {
+    Value val = co_await evaluateSuspendable(varDecl->Init.get());
+    declareVariable(varDecl->Name, val);
+    co_return;
+  }
+  
+  if (auto ifStmt = dynamic_cast<IfStmt*>(stmt)) {
+    for (TaskValue& task : pendingAwaitedTasks(ifStmt->Condition.get())) {
+      co_await task.get()->readiness(*RunningTask);
+    }
+    bool taken = evaluateBool(ifStmt->Condition.get());
+    
+    Stmt* branch = taken ? ifStmt->ThenBranch.get() : ifStmt->ElseBranch.get();
+    if (maySuspend(branch)) {
+      co_await runStmtSuspendable(branch, retVal);
+    } else if (branch) {
+      runStmt(branch, retVal);
+    }
+    co_return;
+  }
+  
+  if (auto whileStmt = dynamic_cast<WhileStmt*>(stmt)) {
+    while (true) {
+      CurrentStep++;
+      if (CurrentStep > MaxSteps) {
+        throw std::runtime_error("Execution timeout: infinite loop detected");
+      }
+      checkCancelled();
+      
+      for (TaskValue& task : pendingAwaitedTasks(whileStmt->Condition.get())) {
+        co_await task.get()->readiness(*RunningTask);
+      }
+      bool taken = evaluateBool(whileStmt->Condition.get());
+      if (!taken) break;
+      
+      if (maySuspend(whileStmt->Body.get())) {
+        co_await runStmtSuspendable(whileStmt->Body.get(), retVal);
+      } else {
+        runStmt(whileStmt->Body.get(), retVal);
+      }
+    }
+    co_return;
+  }
+  
+  if (auto forStmt = dynamic_cast<ForStmt*>(stmt)) {
+    int64_t start = evaluateInt(forStmt->Start.get());
+    int64_t end = evaluateInt(forStmt->End.get());
+    int64_t step = evaluateInt(forStmt->Step.get());
+    
+    if (step == 0) {
+      DiagnosticError error;
+      error.Level = DiagLevel::Fatal;
+      error.Category = ErrorCategory::Runtime;
+      error.Message = "for loop step cannot be zero";
+      error.ErrorID = ErrorCodes::Runtime::DivisionByZero;
+      Diags.report(error);
+      co_return;
+    }
+    
+    enterScope();
+    for (int64_t i = start; (step > 0 ? i < end : i > end); i += step) {
+      CurrentStep++;
+      if (CurrentStep > MaxSteps) {
+        DiagnosticError error;
+        error.Level = DiagLevel::Fatal;
+        error.Category = ErrorCategory::Runtime;
+        error.Message = "execution timeout: infinite loop detected";
+        error.ErrorID = ErrorCodes::Runtime::StackOverflow;
+        Diags.report(error);
+        co_return;
+      }
+      checkCancelled();
+      
+      setVariable(forStmt->VarName, Value(i));
+      co_await runStmtSuspendable(forStmt->Body.get(), retVal);
+    }
+    exitScope();
+    co_return;
+  }
+  
+  if (auto block = dynamic_cast<BlockStmt*>(stmt)) {
+    co_await runBlockSuspendable(block, retVal);
+    co_return;
+  }
+  
+  if (auto expr = dynamic_cast<Expr*>(stmt)) {
+    co_await evaluateSuspendable(expr);
+    co_return;
+  }
+  
+  // A bare return, which only runBlockSuspendable acts on
+}
+
+inline Coroutine<Value> Interpreter::evaluateSuspendable(Expr* expr) {
+  if (auto awaitExpr = dynamic_cast<AwaitExpr*>(expr)) {
+    Value task;
+    if (maySuspend(awaitExpr->Task.get())) {
+      task = co_await evaluateSuspendable(awaitExpr->Task.get());
+    } else {
+      task = evaluate(awaitExpr->Task.get());
+    }
+    if (auto handle = task.get<TaskValue>()) {
+      co_await handle->get()->readiness(*RunningTask);
+      co_return awaitTask(*handle);
+    }
+    if (auto handle = task.get<ActorValue>()) {
+      co_return awaitActor(*handle);
+    }
+    // Awaiting a plain value yields it unchanged
+    co_return task;
+  }
+  
+  if (auto assign = dynamic_cast<AssignExpr*>(expr)) {
+    Value rhs = co_await evaluateSuspendable(assign->Value.get());
+    co_return assignTo(assign, rhs);
+  }
+  
+  if (auto call = dynamic_cast<CallExpr*>(expr)) {
+    if (FuncDecl* func = resolveCallTarget(call)) {
+      for (TaskValue& task : pendingAwaitedTasks(call)) {
+        co_await task.get()->readiness(*RunningTask);
+      }
+      std::vector<Value> args;
+      args.reserve(call->Args.size());
+      for (auto& arg : call->Args) {
+        args.push_back(evaluate(arg.get()));
+      }
+      co_return co_await callSuspendable(func, std::move(args), call);
+    }
+  }
+  
+  for (TaskValue& task : pendingAwaitedTasks(expr)) {
+    co_await task.get()->readiness(*RunningTask);
+  }
+  co_return evaluate(expr);
+}
+
+// Runs the body of a taskGroup block, then joins every task started in it.
+// Leaving the block by an error cancels those tasks before joining them.
+inline void Interpreter::runTaskGroup(TaskGroupStmt* groupStmt, Value* retVal) {
+  auto token = std::make_shared<CancellationToken>(Cancellation);
+  if (groupStmt->Timeout) {
+    token->setTimeout(std::chrono::milliseconds(evaluateInt(groupStmt->Timeout.get())));
+  }
+  Groups.push_back({token, {}});
+  
+  auto join = [this]() {
+    std::vector<std::shared_ptr<ScriptTask>> tasks = std::move(Groups.back().Tasks);
+    Groups.pop_back();
+    for (auto& task : tasks) {
+      task->join(Diags);
+    }
+  };
+  
+  try {
+    runStmt(groupStmt->Body.get(), retVal);
+  } catch (...) {
+    token->cancel();
+    join();
+    throw;
+  }
+  join();
+}
+
+// Actor created by `actor f(initial)`. Its state lives in a forked
+// interpreter; each message replaces it with f(state, message). Messages run
+// one at a time through a pooled Actor mailbox.
+//
+// A message is copied twice: into InFlight on the sending thread, then into
+// the fork's heap during the actor's turn. Copying straight into the fork
+// would race with a cycle collection the fork might be running.
+class ScriptActor {
+public:
+  ScriptActor(const Interpreter& parent, FuncDecl* behavior, const Value& initial)
+    : Behavior(behavior) {
+    Diags.setOutput(DiagOutput);
+    Child = std::make_unique<Interpreter>(Diags, parent);
+    ObjectHeap::Scope heapScope(Child->Heap);
+    Mailbox = std::make_unique<Actor<Value>>(initial.sendableCopy());
+  }
+  
+  ~ScriptActor() {
+    Mailbox->waitIdle();
+    // Drop the state while the fork's heap still exists
+    ObjectHeap::Scope heapScope(Child->Heap);
+    Mailbox->modifyState([](const Value&) { return Value(); });
+  }
+  
+  void send(const Value& message) {
+    Value copy;
+    {
+      ObjectHeap::Scope heapScope(InFlight);
+      copy = message.sendableCopy();
+    }
+    // Moved, not copied: object refcounts are not atomic, so once sent only
+    // the actor's thread may touch the copy
+    Mailbox->send([this, copy = std::move(copy)]() {
+      try {
+        Mailbox->modifyState([&](const Value& state) {
+          Value received;
+          {
+            ObjectHeap::Scope heapScope(Child->Heap);
+            received = copy.sendableCopy();
+          }
+          Value next = Child->callFunction(Behavior, {state, received});
+          Child->joinTasks();
+          return next;
+        });
+      } catch (const CancelledError&) {
+        // The state is left as it was; the task that owns the actor is
+        // being cancelled
+      } catch (const std::exception& e) {
+        Diags.report(DiagLevel::Error, std::string("actor message failed: ") + e.what());
+      }
+    });
+  }
+  
+  // State once every message sent so far has run, copied into the caller's
+  // current heap
+  Value await(DiagnosticEngine& diags) {
+    join(diags);
+    return Mailbox->getState().sendableCopy();
+  }
+  
+  void join(DiagnosticEngine& diags) {
+    Mailbox->waitIdle();
+    std::lock_guard<std::mutex> lock(ForwardMutex);
+    const auto& reported = Diags.getDiagnostics();
+    for (; Forwarded < reported.size(); Forwarded++) {
+      diags.report(reported[Forwarded]);
+    }
+  }
+  
+private:
+  DiagnosticEngine Diags;
+  std::ostringstream DiagOutput;
+  std::unique_ptr<Interpreter> Child;
+  FuncDecl* Behavior;
+  std::mutex ForwardMutex;
+  size_t Forwarded = 0;
+  ObjectHeap InFlight;
+  std::unique_ptr<Actor<Value>> Mailbox;
+};
+
+inline Value Interpreter::startActor(ActorExpr* actorExpr) {
+  auto* call = dynamic_cast<CallExpr*>(actorExpr->Call.get());
+  FuncDecl* behavior = call ? resolveCallTarget(call) : nullptr;
+  if (!behavior || call->Args.empty()) {
+    return Value();
+  }
+  
+  Value initial = evaluate(call->Args[0].get());
+  auto actor = std::make_shared<ScriptActor>(*this, behavior, initial);
+  Actors.push_back(actor);
+  return Value(ActorValue(actor));
+}
+
+inline Value Interpreter::awaitActor(const ActorValue& handle) {
+  return handle.get()->await(Diags);
+}
+
+// send(actor, message) queues the message; send(channel, item) blocks while
+// the channel is full and returns false if it was closed
+inline Value Interpreter::sendMessage(const std::vector<Value>& args) {
+  if (args.size() == 2) {
+    if (auto handle = args[0].get<ActorValue>()) {
+      handle->get()->send(args[1]);
+    } else if (auto channel = args[0].get<ChannelValue>()) {
+      return Value(channel->get()->send(args[1], Cancellation.get()));
+    }
+  }
+  return Value();
+}
+
+// pipeline(items, ["stage1", "stage2", ...], capacity) passes every item
+// through each stage function in turn. Stages run as tasks in their own
+// forks, joined by channels of the given capacity (default 64), so stages
+// overlap and a slow stage holds back the ones before it. Results keep the
+// input order.
+inline Value Interpreter::runPipeline(const std::vector<Value>& args) {
+  if (args.size() < 2) {
+    return Value();
+  }
+  auto items = args[0].get<std::vector<Value>>();
+  auto names = args[1].get<std::vector<Value>>();
+  if (!items || !names) {
+    return Value();
+  }
+  size_t capacity = 64;
+  if (args.size() > 2) {
+    if (auto val = args[2].get<int64_t>()) {
+      capacity = static_cast<size_t>(std::max<int64_t>(1, *val));
+    }
+  }
+  
+  std::vector<FuncDecl*> stages;
+  for (const auto& name : *names) {
+    auto str = name.get<std::string>();
+    auto funcIt = str ? UserFunctions.find(Atom(*str)) : UserFunctions.end();
+    if (funcIt == UserFunctions.end()) {
+      Diags.report(DiagLevel::Error, "pipeline stage is not a function: " + (str ? *str : std::string("?")));
+      return Value();
+    }
+    stages.push_back(funcIt->second);
+  }
+  
+  // The source holds every item up front, so feeding it never blocks
+  std::vector<std::shared_ptr<ScriptChannel>> links;
+  links.push_back(std::make_shared<ScriptChannel>(std::max<size_t>(1, items->size())));
+  for (size_t i = 0; i < stages.size(); i++) {
+    links.push_back(std::make_shared<ScriptChannel>(capacity));
+  }
+  for (const auto& item : *items) {
+    links.front()->send(item, nullptr);
+  }
+  links.front()->close();
+  
+  std::vector<std::shared_ptr<ScriptTask>> tasks;
+  for (size_t i = 0; i < stages.size(); i++) {
+    auto task = std::make_shared<ScriptTask>(*this);
+    auto in = links[i];
+    auto out = links[i + 1];
+    FuncDecl* func = stages[i];
+    task->start([in, out, func](Interpreter& fork, const std::vector<Value>&) {
+      ObjectHeap::Scope heapScope(fork.Heap);
+      try {
+        while (auto item = in->receive(fork.Cancellation.get())) {
+          if (!out->send(fork.callFunction(func, {*item}), fork.Cancellation.get())) {
+            break;
           }
         }
+      } catch (...) {
+        // Unblock both neighbours before the failure is reported
+        in->close();
+        out->close();
+        throw;
       }
-      if (binary->Op == "==") {
-        return Value(lhs == rhs);
-      }
-      if (binary->Op == "!=") {
-        return Value(lhs != rhs);
+      in->close();
+      out->close();
+      return Value();
+    }, {});
+    tasks.push_back(task);
+  }
+  
+  std::vector<Value> results;
+  results.reserve(items->size());
+  while (auto item = links.back()->receive(Cancellation.get())) {
+    results.push_back(*item);
+  }
+  for (size_t i = 0; i < tasks.size(); i++) {
+    try {
+      tasks[i]->await(Diags);
+    } catch (...) {
+      for (size_t j = i + 1; j < tasks.size(); j++) {
+        tasks[j]->join(Diags);
       }
-      if (binary->Op == "<") {
-        if (auto l = lhs.get<int64_t>()) {
-          if (auto r = rhs.get<int64_t>()) {
-            return Value(*l < *r);
-          }
-        }
+      throw;
+    }
+  }
+  return Value(std::move(results));
+}
+
+// Server made by httpServer. Each reactor thread of the http::HTTPServer
+// runs handlers in a fork of its own, so requests on different cores never
+// share a heap. A handler gets an HTTPRequest with method, path, query and
+// body; headers and params as flat name, value pairs; and server, the
+// handle it came through. It returns a String to answer 200, an Int
+// status, or an httpResponse with status, body and headers.
+//
+// Handles are looked up in a process-wide registry rather than on the
+// interpreter, so a handler running in a fork can stop its own server.
+class ScriptServer {
+public:
+  ScriptServer(const Interpreter& parent, int port) : Parent(parent) {
+    http::ServerOptions options;
+    options.port = port;
+    Server = std::make_unique<http::HTTPServer>(options);
+  }
+  
+  ~ScriptServer() {
+    Server.reset();
+    // Drop fork values while their heaps still exist
+    Reactors.clear();
+  }
+  
+  static int64_t add(const std::shared_ptr<ScriptServer>& server) {
+    std::lock_guard<std::mutex> lock(RegistryMutex);
+    int64_t handle = NextHandle++;
+    Registry[handle] = server;
+    server->Handle = handle;
+    return handle;
+  }
+  
+  static std::shared_ptr<ScriptServer> find(const Value& handle) {
+    auto id = handle.get<int64_t>();
+    std::lock_guard<std::mutex> lock(RegistryMutex);
+    auto it = id ? Registry.find(*id) : Registry.end();
+    if (it == Registry.end()) {
+      return nullptr;
+    }
+    auto server = it->second.lock();
+    if (!server) {
+      Registry.erase(it);
+    }
+    return server;
+  }
+  
+  Result<bool> route(const std::string& method, const std::string& pattern, FuncDecl* handler) {
+    return Server->route(method, pattern, [this, handler](const http::ServerRequest& request,
+                                                         http::ServerResponse& response) {
+      handle(handler, request, response);
+    });
+  }
+  
+  Result<int> start() {
+    if (Server->running()) {
+      return Server->port();
+    }
+    Reactors.clear();
+    for (size_t i = 0; i < Server->threads(); i++) {
+      Reactors.push_back(std::make_unique<Reactor>(Parent));
+    }
+    return Server->start();
+  }
+  
+  void wait(DiagnosticEngine& diags) {
+    Server->wait();
+    forward(diags);
+  }
+  
+  // From a handler this only asks the server to stop; the httpServerWait
+  // that is blocked on it finishes the job
+  void stop(DiagnosticEngine& diags) {
+    Server->stop();
+    if (!Server->running()) {
+      forward(diags);
+    }
+  }
+  
+private:
+  struct Reactor {
+    DiagnosticEngine Diags;
+    std::ostringstream DiagOutput;
+    std::unique_ptr<Interpreter> Child;
+    size_t Forwarded = 0;
+    
+    explicit Reactor(const Interpreter& parent) {
+      Diags.setOutput(DiagOutput);
+      Child = std::make_unique<Interpreter>(Diags, parent);
+    }
+  };
+  
+  void handle(FuncDecl* handler, const http::ServerRequest& request, http::ServerResponse& response) {
+    Reactor& reactor = *Reactors[request.reactor];
+    Interpreter& fork = *reactor.Child;
+    ObjectHeap::Scope heapScope(fork.Heap);
+    auto pairs = [](const std::vector<std::pair<std::string, std::string>>& fields) {
+      std::vector<Value> flat;
+      flat.reserve(fields.size() * 2);
+      for (const auto& [name, value] : fields) {
+        flat.push_back(Value(name));
+        flat.push_back(Value(value));
       }
-      if (binary->Op == ">") {
-        if (auto l = lhs.get<int64_t>()) {
-          if (auto r = rhs.get<int64_t>()) {
-            return Value(*l > *r);
-          }
+      return Value(std::move(flat));
+    };
+    ObjectValue object("HTTPRequest", true);
+    auto& props = object.mutate()->Properties;
+    props[Atom("method")] = Value(request.method);
+    props[Atom("path")] = Value(request.path);
+    props[Atom("query")] = Value(request.query);
+    props[Atom("body")] = Value(request.body);
+    props[Atom("headers")] = pairs(request.headers);
+    props[Atom("params")] = pairs(request.params);
+    props[Atom("server")] = Value(Handle);
+    
+    Value result;
+    try {
+      // Every request gets the step budget of a whole script
+      fork.CurrentStep = 0;
+      result = fork.callFunction(handler, {Value(std::move(object))});
+      fork.joinTasks();
+    } catch (const std::exception& e) {
+      reactor.Diags.report(DiagLevel::Error, std::string("http handler failed: ") + e.what());
+      response.status = 500;
+      response.body = "Internal Server Error\n";
+      return;
+    }
+    
+    if (auto text = result.get<std::string>()) {
+      response.body = *text;
+    } else if (auto status = result.get<int64_t>()) {
+      response.status = static_cast<int>(*status);
+    } else if (auto reply = result.get<ObjectValue>()) {
+      const auto& fields = (*reply)->Properties;
+      auto it = fields.find(Atom("status"));
+      if (it != fields.end()) {
+        if (auto status = it->second.get<int64_t>()) {
+          response.status = static_cast<int>(*status);
         }
       }
-      if (binary->Op == "<=") {
-        if (auto l = lhs.get<int64_t>()) {
-          if (auto r = rhs.get<int64_t>()) {
-            return Value(*l <= *r);
-          }
+      it = fields.find(Atom("body"));
+      if (it != fields.end()) {
+        if (auto body = it->second.get<std::string>()) {
+          response.body = *body;
         }
       }
-      if (binary->Op == ">=") {
-        if (auto l = lhs.get<int64_t>()) {
-          if (auto r = rhs.get<int64_t>()) {
-            return Value(*l >= *r);
+      it = fields.find(Atom("headers"));
+      if (it != fields.end()) {
+        if (auto headers = it->second.get<std::vector<Value>>()) {
+          for (size_t i = 0; i + 1 < headers->size(); i += 2) {
+            auto name = (*headers)[i].get<std::string>();
+            auto value = (*headers)[i + 1].get<std::string>();
+            if (!name || !value) {
+              continue;
+            }
+            std::string lower = *name;
+            std::transform(lower.begin(), lower.end(), lower.begin(),
+                           [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            if (lower == "content-type") {
+              response.contentType = *value;
+            } else {
+              response.headers.emplace_back(*name, *value);
+            }
           }
         }
       }
-      if (binary->Op == "&&") {
-        return Value(lhs.getData().index() == 3 && rhs.getData().index() == 3 && std::get<bool>(lhs.getData()) && std::get<bool>(rhs.getData()));
-      }
-      if (binary->Op == "||") {
-        return Value(lhs.getData().index() == 3 && rhs.getData().index() == 3 && (std::get<bool>(lhs.getData()) || std::get<bool>(rhs.getData())));
-      }
-      
-      return Value(int64_t(0));
     }
-    
-    if (auto call = dynamic_cast<CallExpr*>(expr)) {
-      auto it = Functions.find(call->Callee);
-      if (it != Functions.end()) {
-        std::vector<Value> args;
-        for (auto& arg : call->Args) {
-          args.push_back(evaluate(arg.get()));
-        }
-        return it->second(args);
+  }
+  
+  void forward(DiagnosticEngine& diags) {
+    for (auto& reactor : Reactors) {
+      const auto& reported = reactor->Diags.getDiagnostics();
+      for (; reactor->Forwarded < reported.size(); reactor->Forwarded++) {
+        diags.report(reported[reactor->Forwarded]);
       }
-      
-      auto userIt = UserFunctions.find(call->Callee);
-      if (userIt != UserFunctions.end()) {
-        FuncDecl* func = userIt->second;
-        if (func->Body) {
-          auto* block = dynamic_cast<BlockStmt*>(func->Body.get());
-          if (block) {
-            bool savedHasReturn = HasReturn;
-            HasReturn = false;
-            enterScope();
-            Diags.pushStackFrame(func->Name, currentFilename, call->Loc.Line, call->Loc.Col);
-            for (size_t i = 0; i < func->Params.size() && i < call->Args.size(); i++) {
-              setVariable(func->Params[i].first, evaluate(call->Args[i].get()));
-            }
-            Value retVal(int64_t(0));
-            runBlock(block, &retVal);
-            HasReturn = savedHasReturn;
-            exitScope();
-            Diags.popStackFrame();
-            return retVal;
-          }
-        }
-        return Value(int64_t(0));
+    }
+  }
+  
+  static inline std::mutex RegistryMutex;
+  static inline std::map<int64_t, std::weak_ptr<ScriptServer>> Registry;
+  static inline int64_t NextHandle = 1;
+  
+  const Interpreter& Parent;
+  int64_t Handle = 0;
+  std::vector<std::unique_ptr<Reactor>> Reactors;
+  std::unique_ptr<http::HTTPServer> Server;
+};
+
+inline Value Interpreter::createServer(const std::vector<Value>& args) {
+  int64_t port = 0;
+  if (!args.empty()) {
+    if (auto val = args[0].get<int64_t>()) {
+      port = *val;
+    }
+  }
+  auto server = std::make_shared<ScriptServer>(*this, static_cast<int>(port));
+  Servers.push_back(server);
+  return Value(ScriptServer::add(server));
+}
+
+inline Value Interpreter::addRoute(const std::vector<Value>& args) {
+  auto server = args.size() == 4 ? ScriptServer::find(args[0]) : nullptr;
+  auto method = args.size() == 4 ? args[1].get<std::string>() : nullptr;
+  auto pattern = args.size() == 4 ? args[2].get<std::string>() : nullptr;
+  auto name = args.size() == 4 ? args[3].get<std::string>() : nullptr;
+  if (!server || !method || !pattern || !name) {
+    return Value(false);
+  }
+  auto funcIt = UserFunctions.find(Atom(*name));
+  if (funcIt == UserFunctions.end()) {
+    Diags.report(DiagLevel::Error, "http handler is not a function: " + *name);
+    return Value(false);
+  }
+  auto added = server->route(*method, *pattern, funcIt->second);
+  if (added.is_error()) {
+    Diags.report(DiagLevel::Error, "httpRoute: " + added.error().getMessage());
+    return Value(false);
+  }
+  return Value(true);
+}
+
+inline Value Interpreter::startServer(const std::vector<Value>& args) {
+  auto server = args.empty() ? nullptr : ScriptServer::find(args[0]);
+  if (!server) {
+    return Value(int64_t(-1));
+  }
+  auto port = server->start();
+  if (port.is_error()) {
+    Diags.report(DiagLevel::Error, "httpServerStart: " + port.error().getMessage());
+    return Value(int64_t(-1));
+  }
+  return Value(int64_t(port.unwrap()));
+}
+
+inline Value Interpreter::waitServer(const std::vector<Value>& args) {
+  if (auto server = args.empty() ? nullptr : ScriptServer::find(args[0])) {
+    server->wait(Diags);
+  }
+  return Value();
+}
+
+inline Value Interpreter::stopServer(const std::vector<Value>& args) {
+  if (auto server = args.empty() ? nullptr : ScriptServer::find(args[0])) {
+    server->stop(Diags);
+  }
+  return Value();
+}
+
+// Blocks on a task from startIO; a plain value comes back as it is
+inline Value Interpreter::awaitIO(const Value& task) {
+  if (auto handle = task.get<TaskValue>()) {
+    return awaitTask(*handle);
+  }
+  return task;
+}
+
+inline Value Interpreter::startConnect(const std::vector<Value>& args) {
+  auto host = args.size() == 2 ? args[0].get<std::string>() : nullptr;
+  auto port = args.size() == 2 ? args[1].get<int64_t>() : nullptr;
+  std::string target = host ? *host : std::string();
+  int portNumber = port ? static_cast<int>(*port) : -1;
+  auto sockets = asyncIO()->Sockets;
+  return startIO([&](IOCompletion complete) {
+    net::TCPStream::connect(asyncIO()->Loop, target, portNumber,
+                            [sockets, complete](Result<std::shared_ptr<net::TCPStream>> result) {
+      complete(Value(result.is_ok() ? sockets->add(result.unwrap()) : int64_t(-1)));
+    });
+  });
+}
+
+inline Value Interpreter::listenTCP(const std::vector<Value>& args) {
+  checkCancelled();
+  auto host = args.size() == 2 ? args[0].get<std::string>() : nullptr;
+  auto port = args.size() == 2 ? args[1].get<int64_t>() : nullptr;
+  if (!host || !port) {
+    return Value(int64_t(-1));
+  }
+  auto listener = net::TCPListener::listen(asyncIO()->Loop, *host, static_cast<int>(*port));
+  if (listener.is_error()) {
+    return Value(int64_t(-1));
+  }
+  return Value(asyncIO()->Sockets->add(listener.unwrap()));
+}
+
+inline Value Interpreter::startAccept(const std::vector<Value>& args) {
+  auto sockets = asyncIO()->Sockets;
+  auto listener = args.empty() ? nullptr : sockets->find<net::TCPListener>(args[0]);
+  return startIO([&](IOCompletion complete) {
+    if (!listener) {
+      complete(Value(int64_t(-1)));
+      return;
+    }
+    listener->accept([sockets, complete](Result<std::shared_ptr<net::TCPStream>> result) {
+      complete(Value(result.is_ok() ? sockets->add(result.unwrap()) : int64_t(-1)));
+    });
+  });
+}
+
+inline Value Interpreter::startSocketRead(SocketRead how, const std::vector<Value>& args) {
+  auto stream = args.empty() ? nullptr : asyncIO()->Sockets->find<net::TCPStream>(args[0]);
+  int64_t maxBytes = 65536;
+  if (how == SocketRead::Raw && args.size() >= 2) {
+    if (auto value = args[1].get<int64_t>()) {
+      maxBytes = std::max<int64_t>(1, *value);
+    }
+  }
+  return startIO([&](IOCompletion complete) {
+    if (!stream) {
+      complete(Value());
+      return;
+    }
+    auto done = [complete](Result<std::optional<std::string>> result) {
+      bool got = result.is_ok() && result.unwrap();
+      complete(got ? Value(std::move(*result.unwrap())) : Value());
+    };
+    switch (how) {
+      case SocketRead::Raw:
+        stream->read(static_cast<size_t>(maxBytes), done);
+        break;
+      case SocketRead::Line:
+        stream->readLine(done);
+        break;
+      case SocketRead::Frame:
+        stream->readFrame(done);
+        break;
+    }
+  });
+}
+
+inline Value Interpreter::startSocketWrite(bool framed, const std::vector<Value>& args) {
+  auto stream = args.size() == 2 ? asyncIO()->Sockets->find<net::TCPStream>(args[0]) : nullptr;
+  auto data = args.size() == 2 ? args[1].get<std::string>() : nullptr;
+  return startIO([&](IOCompletion complete) {
+    if (!stream || !data) {
+      complete(Value(int64_t(-1)));
+      return;
+    }
+    auto done = [complete](Result<size_t> result) {
+      complete(Value(result.is_ok() ? int64_t(result.unwrap()) : int64_t(-1)));
+    };
+    if (framed) {
+      stream->writeFrame(*data, done);
+    } else {
+      stream->write(*data, done);
+    }
+  });
+}
+
+inline Value Interpreter::bindUDP(const std::vector<Value>& args) {
+  checkCancelled();
+  auto host = args.size() == 2 ? args[0].get<std::string>() : nullptr;
+  auto port = args.size() == 2 ? args[1].get<int64_t>() : nullptr;
+  if (!host || !port) {
+    return Value(int64_t(-1));
+  }
+  auto socket = net::UDPSocket::bind(asyncIO()->Loop, *host, static_cast<int>(*port));
+  if (socket.is_error()) {
+    return Value(int64_t(-1));
+  }
+  return Value(asyncIO()->Sockets->add(socket.unwrap()));
+}
+
+inline Value Interpreter::sendDatagrams(bool batch, const std::vector<Value>& args) {
+  checkCancelled();
+  auto socket = args.size() == 4 ? asyncIO()->Sockets->find<net::UDPSocket>(args[0]) : nullptr;
+  auto host = args.size() == 4 ? args[1].get<std::string>() : nullptr;
+  auto port = args.size() == 4 ? args[2].get<int64_t>() : nullptr;
+  if (!socket || !host || !port) {
+    return Value(int64_t(-1));
+  }
+  net::Endpoint peer{*host, static_cast<int>(*port)};
+  Result<size_t> sent = Result<size_t>::ok(0);
+  if (batch) {
+    auto payloads = args[3].get<std::vector<Value>>();
+    if (!payloads) {
+      return Value(int64_t(-1));
+    }
+    std::vector<net::Datagram> datagrams;
+    datagrams.reserve(payloads->size());
+    for (const auto& payload : *payloads) {
+      if (auto text = payload.get<std::string>()) {
+        datagrams.push_back(net::Datagram{*text, peer});
       }
     }
-    
-    if (auto memberAccess = dynamic_cast<MemberAccessExpr*>(expr)) {
-      Value obj = evaluate(memberAccess->Object.get());
-      if (auto objVal = obj.get<ObjectValue>()) {
-        auto it = objVal->Properties.find(memberAccess->MemberName);
-        if (it != objVal->Properties.end()) {
-          return it->second;
+    sent = socket->sendBatch(datagrams);
+  } else {
+    auto data = args[3].get<std::string>();
+    if (!data) {
+      return Value(int64_t(-1));
+    }
+    sent = socket->sendTo(*data, peer);
+  }
+  return Value(sent.is_ok() ? int64_t(sent.unwrap()) : int64_t(-1));
+}
+
+inline Value Interpreter::startReceiveDatagrams(const std::vector<Value>& args) {
+  auto socket = args.size() == 2 ? asyncIO()->Sockets->find<net::UDPSocket>(args[0]) : nullptr;
+  int64_t max = 1;
+  if (args.size() == 2) {
+    if (auto value = args[1].get<int64_t>()) {
+      max = std::max<int64_t>(1, *value);
+    }
+  }
+  // The datagrams become objects on the loop thread, in a heap the task
+  // keeps alive; awaiting copies them into the awaiting interpreter's heap
+  auto staging = std::make_shared<ObjectHeap>();
+  return startIO([&](IOCompletion complete) {
+    if (!socket) {
+      complete(Value(std::vector<Value>()));
+      return;
+    }
+    socket->receive(static_cast<size_t>(max), [staging, complete](Result<std::vector<net::Datagram>> result) {
+      ObjectHeap::Scope heapScope(*staging);
+      std::vector<Value> datagrams;
+      if (result.is_ok()) {
+        for (auto& datagram : result.unwrap()) {
+          ObjectValue object("Datagram", true);
+          auto& props = object.mutate()->Properties;
+          props[Atom("data")] = Value(std::move(datagram.data));
+          props[Atom("host")] = Value(std::move(datagram.peer.host));
+          props[Atom("port")] = Value(int64_t(datagram.peer.port));
+          datagrams.push_back(Value(std::move(object)));
         }
       }
-      return Value();
+      complete(Value(std::move(datagrams)));
+    });
+  }, staging);
+}
+
+// parallelMap(items, "f"), parallelFilter(items, "f") and
+// parallelReduce(items, "f", initial) split items into chunks that each run
+// as a ScriptTask in its own fork. Chunks are awaited in order, so results
+// keep the input order. parallelReduce folds each chunk and then folds the
+// chunk results into initial on the caller, which matches a sequential fold
+// only when f is associative.
+inline Value Interpreter::parallelApply(ParallelOp op, const std::vector<Value>& args) {
+  size_t expected = op == ParallelOp::Reduce ? 3 : 2;
+  if (args.size() != expected) {
+    return Value();
+  }
+  auto items = args[0].get<std::vector<Value>>();
+  auto name = args[1].get<std::string>();
+  if (!items || !name) {
+    return Value();
+  }
+  auto funcIt = UserFunctions.find(Atom(*name));
+  if (funcIt == UserFunctions.end()) {
+    Diags.report(DiagLevel::Error, "parallel builtin called with unknown function '" + *name + "'");
+    return Value();
+  }
+  FuncDecl* func = funcIt->second;
+  
+  // About four chunks per worker leaves room for stealing to even out
+  // uneven items
+  size_t workers = Scheduler::getInstance().workerCount();
+  size_t count = items->size();
+  size_t grain = std::max(MinParallelGrain, (count + workers * 4 - 1) / (workers * 4));
+  
+  std::vector<Value> partials;
+  if (workers == 1 || count <= grain) {
+    partials.push_back(applyChunk(op, func, *items));
+  } else {
+    std::vector<std::shared_ptr<ScriptTask>> chunks;
+    for (size_t begin = 0; begin < count; begin += grain) {
+      size_t end = std::min(count, begin + grain);
+      std::vector<Value> slice(items->begin() + begin, items->begin() + end);
+      auto chunk = std::make_shared<ScriptTask>(*this);
+      chunk->start([op, func](Interpreter& fork, const std::vector<Value>& forkItems) {
+        return fork.applyChunk(op, func, forkItems);
+      }, slice);
+      chunks.push_back(chunk);
     }
-    
-    if (auto ctorCall = dynamic_cast<ConstructorCallExpr*>(expr)) {
-      ObjectValue obj(ctorCall->ClassName, Structs.find(ctorCall->ClassName) != Structs.end());
-      
-      auto ctorIt = Constructors.find(ctorCall->ClassName);
-      if (ctorIt != Constructors.end()) {
-        auto* ctor = ctorIt->second;
-        enterScope();
-        for (size_t i = 0; i < ctor->Params.size() && i < ctorCall->Args.size(); i++) {
-          setVariable(ctor->Params[i].first, evaluate(ctorCall->Args[i].get()));
-        }
-        Value savedObj = Value(obj);
-        CurrentObject = &obj;
-        if (ctor->Body) {
-          auto* block = dynamic_cast<BlockStmt*>(ctor->Body.get());
-          if (block) {
-            runBlock(block);
-          }
+    for (size_t i = 0; i < chunks.size(); i++) {
+      try {
+        partials.push_back(chunks[i]->await(Diags));
+      } catch (...) {
+        // Let the remaining chunks finish before their forks go away
+        for (size_t j = i + 1; j < chunks.size(); j++) {
+          chunks[j]->join(Diags);
         }
-        CurrentObject = nullptr;
-        exitScope();
-        return savedObj;
+        throw;
       }
-      
-      return Value(obj);
     }
-    
-    if (auto superExpr = dynamic_cast<SuperExpr*>(expr)) {
-      if (CurrentObject) {
-        auto classIt = Classes.find(CurrentObject->ClassName);
-        if (classIt != Classes.end() && !classIt->second->SuperClass.empty()) {
-          ObjectValue superObj(classIt->second->SuperClass, false);
-          return Value(superObj);
-        }
+  }
+  
+  if (op == ParallelOp::Reduce) {
+    Value acc = args[2];
+    for (const auto& partial : partials) {
+      auto folded = partial.get<std::vector<Value>>();
+      if (folded && !folded->empty()) {
+        acc = callFunction(func, {acc, folded->front()});
       }
-      return Value();
     }
-    
-    if (auto thisExpr = dynamic_cast<ThisExpr*>(expr)) {
-      if (CurrentObject) {
-        return Value(*CurrentObject);
+    return acc;
+  }
+  
+  std::vector<Value> result;
+  result.reserve(op == ParallelOp::Map ? count : 0);
+  for (const auto& partial : partials) {
+    if (auto part = partial.get<std::vector<Value>>()) {
+      result.insert(result.end(), part->begin(), part->end());
+    }
+  }
+  return Value(std::move(result));
+}
+
+// Map and filter return the chunk's results; reduce returns the chunk
+// folded from its first item, wrapped in an array that is empty for an
+// empty chunk
+inline Value Interpreter::applyChunk(ParallelOp op, FuncDecl* func,
+                                     const std::vector<Value>& items) {
+  std::vector<Value> out;
+  if (op == ParallelOp::Reduce) {
+    if (!items.empty()) {
+      Value acc = items.front();
+      for (size_t i = 1; i < items.size(); i++) {
+        acc = callFunction(func, {acc, items[i]});
       }
-      return Value();
+      out.push_back(acc);
     }
-    
-    return Value(int64_t(0));
+    return Value(std::move(out));
   }
-};
+  
+  out.reserve(op == ParallelOp::Map ? items.size() : 0);
+  for (const auto& item : items) {
+    Value result = callFunction(func, {item});
+    if (op == ParallelOp::Map) {
+      out.push_back(result);
+    } else if (isTruthy(result)) {
+      out.push_back(item);
+    }
+  }
+  return Value(std::move(out));
+}
+
+inline Interpreter::~Interpreter() {
+  // Handlers run in forks of this interpreter
+  Servers.clear();
+  // Forks may still be reading this interpreter's program if run() was
+  // left by an exception
+  for (auto& task : Tasks) {
+    task->wait();
+  }
+  Actors.clear();
+}
+
+inline void Interpreter::joinTasks() {
+  std::vector<std::shared_ptr<ScriptTask>> tasks;
+  tasks.swap(Tasks);
+  for (auto& task : tasks) {
+    task->join(Diags);
+  }
+  TaskPruneThreshold = 64;
+  
+  // Actors stay alive for handles that escape, so they are only drained
+  for (auto& actor : Actors) {
+    actor->join(Diags);
+  }
+}
 
-std::string httpGet(const std::string& url) {
+std::string httpGet(const std::string& url, int timeoutMs) {
   http::HTTPClient client;
+  if (timeoutMs > 0) {
+    client.setTimeout(timeoutMs);
+  }
   auto result = client.get(url);
   if (result.isErr()) {
     return "";
@@ -1911,8 +5211,11 @@ std::string httpGet(const std::string& url) {
   return result.unwrap().body;
 }
 
-std::string httpPost(const std::string& url, const std::string& data) {
+std::string httpPost(const std::string& url, const std::string& data, int timeoutMs) {
   http::HTTPClient client;
+  if (timeoutMs > 0) {
+    client.setTimeout(timeoutMs);
+  }
   auto result = client.post(url, data);
   if (result.isErr()) {
     return "";
@@ -1920,8 +5223,11 @@ std::string httpPost(const std::string& url, const std::string& data) {
   return result.unwrap().body;
 }
 
-std::string httpPostJSON(const std::string& url, const std::string& json) {
+std::string httpPostJSON(const std::string& url, const std::string& json, int timeoutMs) {
   http::HTTPClient client;
+  if (timeoutMs > 0) {
+    client.setTimeout(timeoutMs);
+  }
   auto result = client.postJSON(url, json);
   if (result.isErr()) {
     return "";
@@ -1929,8 +5235,11 @@ std::string httpPostJSON(const std::string& url, const std::string& json) {
   return result.unwrap().body;
 }
 
-std::string httpPostForm(const std::string& url, const std::map<std::string, std::string>& params) {
+std::string httpPostForm(const std::string& url, const std::map<std::string, std::string>& params, int timeoutMs) {
   http::HTTPClient client;
+  if (timeoutMs > 0) {
+    client.setTimeout(timeoutMs);
+  }
   auto result = client.postForm(url, params);
   if (result.isErr()) {
     return "";
@@ -1938,8 +5247,11 @@ std::string httpPostForm(const std::string& url, const std::map<std::string, std
   return result.unwrap().body;
 }
 
-std::string httpPut(const std::string& url, const std::string& data) {
+std::string httpPut(const std::string& url, const std::string& data, int timeoutMs) {
   http::HTTPClient client;
+  if (timeoutMs > 0) {
+    client.setTimeout(timeoutMs);
+  }
   auto result = client.put(url, data);
   if (result.isErr()) {
     return "";
@@ -1947,8 +5259,11 @@ std::string httpPut(const std::string& url, const std::string& data) {
   return result.unwrap().body;
 }
 
-std::string httpDelete(const std::string& url) {
+std::string httpDelete(const std::string& url, int timeoutMs) {
   http::HTTPClient client;
+  if (timeoutMs > 0) {
+    client.setTimeout(timeoutMs);
+  }
   auto result = client.deleteRequest(url);
   if (result.isErr()) {
     return "";
@@ -1956,8 +5271,11 @@ std::string httpDelete(const std::string& url) {
   return result.unwrap().body;
 }
 
-int httpStatusCode(const std::string& url) {
+int httpStatusCode(const std::string& url, int timeoutMs) {
   http::HTTPClient client;
+  if (timeoutMs > 0) {
+    client.setTimeout(timeoutMs);
+  }
   auto result = client.get(url);
   if (result.isErr()) {
     return -1;
@@ -1965,8 +5283,11 @@ int httpStatusCode(const std::string& url) {
   return result.unwrap().statusCode;
 }
 
-bool httpIsSuccess(const std::string& url) {
+bool httpIsSuccess(const std::string& url, int timeoutMs) {
   http::HTTPClient client;
+  if (timeoutMs > 0) {
+    client.setTimeout(timeoutMs);
+  }
   auto result = client.get(url);
   if (result.isErr()) {
     return false;
@@ -1974,8 +5295,11 @@ bool httpIsSuccess(const std::string& url) {
   return result.unwrap().isSuccess();
 }
 
-std::string httpGetHeader(const std::string& url, const std::string& header) {
+std::string httpGetHeader(const std::string& url, const std::string& header, int timeoutMs) {
   http::HTTPClient client;
+  if (timeoutMs > 0) {
+    client.setTimeout(timeoutMs);
+  }
   auto result = client.get(url);
   if (result.isErr()) {
     return "";
@@ -1983,6 +5307,61 @@ std::string httpGetHeader(const std::string& url, const std::string& header) {
   return result.unwrap().getHeader(header);
 }
 
+inline Result<http::Response> httpSend(const http::Request& request, int timeoutMs) {
+  http::HTTPClient client;
+  if (timeoutMs > 0) {
+    client.setTimeout(timeoutMs);
+  }
+  return client.send(request);
+}
+
+inline std::vector<Result<http::Response>> httpSendAll(const std::vector<http::Request>& requests,
+                                                       size_t maxConcurrent, int timeoutMs) {
+  http::HTTPClient client;
+  if (timeoutMs > 0) {
+    client.setTimeout(timeoutMs);
+  }
+  return client.sendAll(requests, maxConcurrent);
+}
+
+inline Result<http::Response> httpDownload(const std::string& url, const std::string& path, int timeoutMs) {
+  http::HTTPClient client;
+  if (timeoutMs > 0) {
+    client.setTimeout(timeoutMs);
+  }
+  return client.download(url, path);
+}
+
+inline Result<http::Response> httpUpload(const std::string& method, const std::string& url,
+                                         const std::string& path, int timeoutMs) {
+  http::HTTPClient client;
+  if (timeoutMs > 0) {
+    client.setTimeout(timeoutMs);
+  }
+  return client.upload(method, url, path);
+}
+
+inline Result<http::Response> httpPostMultipart(const std::string& url,
+                                                const std::vector<std::pair<std::string, std::string>>& fields,
+                                                const std::vector<std::pair<std::string, std::string>>& files,
+                                                int timeoutMs) {
+  auto body = std::make_shared<http::MultipartBody>();
+  for (const auto& field : fields) {
+    body->addField(field.first, field.second);
+  }
+  for (const auto& file : files) {
+    auto added = body->addFile(file.first, file.second);
+    if (added.is_error()) {
+      return Result<http::Response>::err(added.error());
+    }
+  }
+  http::HTTPClient client;
+  if (timeoutMs > 0) {
+    client.setTimeout(timeoutMs);
+  }
+  return client.postMultipart(url, std::move(body));
+}
+
 std::string urlEncode(const std::string& str) {
   return http::urlEncode(str);
 }
@@ -0,0 +1,67 @@
+#ifndef XWIFT_INTERPRETER_ISOLATE_H
+#define XWIFT_INTERPRETER_ISOLATE_H
+
+#include "xwift/Basic/LLVM.h"
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace xwift {
+
+struct IsolateResult {
+  bool Success = false;
+  std::string Output;
+  std::string Diagnostics;
+};
+
+// Runs one script through Lexer -> SyntaxParser -> Sema -> Optimizer ->
+// Interpreter with its own diagnostics, AST, object heap and output buffer.
+// The only state shared between isolates is immutable (lexer tables) or
+// internally synchronized (string interner, logger appenders), so separate
+// isolates can run on separate threads at the same time.
+class Isolate {
+public:
+  explicit Isolate(const std::string& name = "<isolate>") : Name(name) {}
+
+  IsolateResult run(const std::string& source);
+
+  const std::string& getName() const { return Name; }
+
+private:
+  std::string Name;
+};
+
+// Fixed set of worker threads that each run whole isolates
+class IsolatePool {
+public:
+  explicit IsolatePool(size_t threadCount = 0);
+  ~IsolatePool();
+
+  IsolatePool(const IsolatePool&) = delete;
+  IsolatePool& operator=(const IsolatePool&) = delete;
+
+  std::future<IsolateResult> submit(const std::string& source,
+                                    const std::string& name = "<isolate>");
+
+  // Runs every script and returns the results in input order
+  std::vector<IsolateResult> runAll(const std::vector<std::string>& sources);
+
+  size_t size() const { return Workers.size(); }
+
+private:
+  void workerLoop();
+
+  std::vector<std::thread> Workers;
+  std::queue<std::function<void()>> Jobs;
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool Stopping = false;
+};
+
+}
+
+#endif
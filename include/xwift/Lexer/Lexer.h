@@ -29,11 +29,10 @@ private:
   Token curToken;
   bool hasPeeked;
   
-  static std::unordered_map<std::string, TokenKind> Keywords;
-  static std::unordered_map<std::string, TokenKind> Operators;
-  static bool IsInitialized;
-  
-  static void initKeywords();
+  // Built once on first use and read-only afterwards, so lexers on
+  // different threads can share them
+  static const std::unordered_map<std::string, TokenKind>& getKeywords();
+  static const std::unordered_map<std::string, TokenKind>& getOperators();
   
   char peekChar() const;
   char getChar();
@@ -2,6 +2,7 @@
 #define XWIFT_LEXER_TOKEN_H
 
 #include "xwift/Basic/LLVM.h"
+#include "xwift/Basic/StringInterner.h"
 
 namespace xwift {
 
@@ -92,6 +93,7 @@ enum class TokenKind {
   kw_get,
   kw_set,
   kw_actor,
+  kw_taskGroup,
   kw_nonisolated,
   kw_isolated,
   kw_macro,
@@ -192,6 +194,9 @@ public:
   SourceLocation Loc;
   unsigned Length;
   StringRef Text;
+  // Text interned, for identifiers only, so the nodes built from them
+  // share one name instead of interning it again
+  Atom Name;
   
   Token() : Kind(TokenKind::Unknown), Length(0) {}
   Token(TokenKind kind, SourceLocation loc, unsigned len, StringRef text = "")
@@ -4,6 +4,7 @@
 #include <string>
 #include <sstream>
 #include <fstream>
+#include <atomic>
 #include <mutex>
 #include <memory>
 #include <queue>
@@ -131,6 +132,10 @@ public:
            const std::string& file = "", int line = 0,
            const std::string& function = "");
   
+  // Hands entry to the appenders without checking the logger's level, for
+  // callers that filter on their own (e.g. per-isolate script log levels)
+  void write(const LogEntry& entry);
+  
   void trace(const std::string& message, const std::string& file = "",
              int line = 0, const std::string& function = "");
   void debug(const std::string& message, const std::string& file = "",
@@ -153,7 +158,7 @@ private:
   Logger(const Logger&) = delete;
   Logger& operator=(const Logger&) = delete;
   
-  LogLevel level;
+  std::atomic<LogLevel> level;
   std::vector<std::unique_ptr<LogAppender>> appenders;
   std::mutex mutex;
   
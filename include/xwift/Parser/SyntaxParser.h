@@ -63,6 +63,7 @@ private:
   std::unique_ptr<Stmt> parseIfLetStatement();
   std::unique_ptr<Stmt> parseGuardStatement();
   std::unique_ptr<Stmt> parseWhileStatement();
+  std::unique_ptr<Stmt> parseTaskGroupStatement();
   std::unique_ptr<Stmt> parseForStatement();
   std::unique_ptr<Stmt> parseSwitchStatement();
   std::unique_ptr<BlockStmt> parseBlock();
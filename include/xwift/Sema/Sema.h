@@ -30,6 +30,7 @@ public:
   bool visit(ReturnStmt* ret);
   bool visit(IfStmt* ifStmt);
   bool visit(WhileStmt* whileStmt);
+  bool visit(TaskGroupStmt* groupStmt);
   bool visit(ForStmt* forStmt);
   bool visit(SwitchStmt* switchStmt);
   bool visit(BlockStmt* block);
@@ -46,6 +47,10 @@ public:
   bool visit(NilLiteralExpr* lit);
   bool visit(OptionalUnwrapExpr* expr);
   bool visit(OptionalChainExpr* expr);
+  bool visit(MemberAccessExpr* expr);
+  bool visit(AsyncExpr* expr);
+  bool visit(AwaitExpr* expr);
+  bool visit(ActorExpr* expr);
   bool visit(IfLetStmt* stmt);
   bool visit(GuardStmt* stmt);
   bool visit(ClassDecl* cls) override;
@@ -3,6 +3,8 @@
 
 #include "xwift/AST/Type.h"
 #include "xwift/Basic/LLVM.h"
+#include "xwift/stdlib/Concurrency/Scheduler.h"
+#include <atomic>
 #include <memory>
 #include <functional>
 #include <future>
@@ -13,95 +15,222 @@
 
 namespace xwift {
 
-// Task type for async operations
+// Task type for async operations. The function runs as a job on the
+// work-stealing Scheduler; await() on a worker thread keeps running other
+// jobs until the result is ready, and on any other thread blocks on the
+// result.
 template<typename T>
 class Task {
 private:
-    std::future<T> future;
+    std::shared_future<T> future;
+    Scheduler* scheduler;
     
 public:
-    Task(std::function<T()> func) {
-        std::packaged_task<T> task(func);
-        future = task.get_future();
+    Task(std::function<T()> func, Scheduler& pool = Scheduler::getInstance())
+        : scheduler(&pool) {
+        auto task = std::make_shared<std::packaged_task<T()>>(std::move(func));
+        future = task->get_future().share();
+        pool.spawn([task]() { (*task)(); });
     }
+
+    // Wraps a result produced outside the pool, such as I/O completed by an
+    // EventLoop
+    Task(std::shared_future<T> pending, Scheduler& pool = Scheduler::getInstance())
+        : future(std::move(pending)), scheduler(&pool) {}
     
     Task(const Task&) = delete;
     Task& operator=(const Task&) = delete;
+    Task(Task&&) = default;
+    Task& operator=(Task&&) = default;
     
-    T await() {
+    void wait() {
+        if (isReady()) {
+            return;
+        }
+        if (scheduler->onWorkerThread()) {
+            scheduler->waitUntil([this] { return isReady(); });
+        } else {
+            future.wait();
+        }
+    }
+    
+    // Result by reference, for callers that must not copy it on this thread
+    const T& get() {
+        wait();
         return future.get();
     }
     
+    T await() {
+        return get();
+    }
+    
     bool isReady() const {
         return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
     }
 };
 
-// Actor class for concurrent operations
+// Intrusive multi-producer single-consumer queue (Vyukov). push is a single
+// atomic exchange from any thread; pop belongs to the one consumer. A push
+// that is still in flight can make pop report empty for a moment, so callers
+// track the message count separately.
+class Mailbox {
+public:
+    struct Node {
+        std::atomic<Node*> Next{nullptr};
+        std::function<void()> Message;
+    };
+
+    Mailbox() : Head(&Stub), Tail(&Stub) {}
+
+    ~Mailbox() {
+        while (Node* node = pop()) {
+            delete node;
+        }
+    }
+
+    Mailbox(const Mailbox&) = delete;
+    Mailbox& operator=(const Mailbox&) = delete;
+
+    void push(Node* node) {
+        node->Next.store(nullptr, std::memory_order_relaxed);
+        Node* prev = Head.exchange(node, std::memory_order_acq_rel);
+        prev->Next.store(node, std::memory_order_release);
+    }
+
+    Node* pop() {
+        Node* tail = Tail;
+        Node* next = tail->Next.load(std::memory_order_acquire);
+        if (tail == &Stub) {
+            if (!next) {
+                return nullptr;
+            }
+            Tail = next;
+            tail = next;
+            next = next->Next.load(std::memory_order_acquire);
+        }
+        if (next) {
+            Tail = next;
+            return tail;
+        }
+        if (tail != Head.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        push(&Stub);
+        next = tail->Next.load(std::memory_order_acquire);
+        if (next) {
+            Tail = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+private:
+    std::atomic<Node*> Head;
+    Node* Tail;
+    Node Stub;
+};
+
+// Actor class for concurrent operations. Actors own no thread: a send that
+// finds the actor idle schedules it on the shared Scheduler, where it runs
+// at most Quantum messages per turn before going to the back of the queue.
+// Messages to one actor never run concurrently, so they may touch its state
+// without locking.
 template<typename T>
 class Actor {
 private:
-    T state;
-    std::queue<std::function<void()>> messageQueue;
-    std::mutex queueMutex;
-    std::condition_variable condition;
-    std::thread actorThread;
-    bool running;
-    
-    void processMessages() {
-        while (running) {
-            std::unique_lock<std::mutex> lock(queueMutex);
-            condition.wait(lock, [this] { return !messageQueue.empty() || !running; });
-            
-            if (!running && messageQueue.empty()) {
+    struct Core {
+        T state;
+        Mailbox mailbox;
+        Scheduler& pool;
+        // Sent but not yet finished; zero means the actor is idle
+        std::atomic<size_t> pending{0};
+        std::atomic<bool> scheduled{false};
+
+        Core(const T& initialState, Scheduler& scheduler)
+            : state(initialState), pool(scheduler) {}
+    };
+
+    std::shared_ptr<Core> core;
+
+    static void schedule(const std::shared_ptr<Core>& target, bool fair) {
+        auto job = [target]() { drain(target); };
+        if (fair) {
+            target->pool.spawnFair(job);
+        } else {
+            target->pool.spawn(job);
+        }
+    }
+
+    static void drain(const std::shared_ptr<Core>& target) {
+        for (size_t i = 0; i < Quantum; i++) {
+            Mailbox::Node* node = target->mailbox.pop();
+            if (!node) {
                 break;
             }
-            
-            auto message = messageQueue.front();
-            messageQueue.pop();
-            lock.unlock();
-            
-            message();
+            node->Message();
+            delete node;
+            target->pending.fetch_sub(1, std::memory_order_acq_rel);
+        }
+
+        if (target->pending.load() > 0) {
+            // Quantum used up, or a send is still landing: keep the turn
+            // but let everything already queued run first
+            schedule(target, true);
+            return;
+        }
+        target->scheduled.store(false);
+        if (target->pending.load() > 0 && !target->scheduled.exchange(true)) {
+            schedule(target, true);
         }
     }
     
 public:
-    Actor(const T& initialState) : state(initialState), running(true) {
-        actorThread = std::thread(&Actor::processMessages, this);
-    }
+    static constexpr size_t Quantum = 64;
+
+    Actor(const T& initialState, Scheduler& pool = Scheduler::getInstance())
+        : core(std::make_shared<Core>(initialState, pool)) {}
     
+    // Runs every message already sent before the actor goes away
     ~Actor() {
-        {
-            std::unique_lock<std::mutex> lock(queueMutex);
-            running = false;
-            condition.notify_all();
-        }
-        
-        if (actorThread.joinable()) {
-            actorThread.join();
-        }
+        waitIdle();
     }
+
+    Actor(const Actor&) = delete;
+    Actor& operator=(const Actor&) = delete;
     
     void send(std::function<void()> message) {
-        {
-            std::unique_lock<std::mutex> lock(queueMutex);
-            messageQueue.push(message);
+        auto* node = new Mailbox::Node();
+        node->Message = std::move(message);
+        core->pending.fetch_add(1);
+        core->mailbox.push(node);
+        if (!core->scheduled.exchange(true)) {
+            schedule(core, false);
         }
-        condition.notify_one();
     }
     
     template<typename F>
     void send(F&& message) {
         send(std::function<void()>(std::forward<F>(message)));
     }
+
+    bool isIdle() const {
+        return core->pending.load() == 0;
+    }
+
+    void waitIdle() {
+        if (!isIdle()) {
+            core->pool.waitUntil([this] { return isIdle(); });
+        }
+    }
     
+    // Only safe from inside a message, or once the actor is idle
     const T& getState() const {
-        return state;
+        return core->state;
     }
     
     template<typename F>
     void modifyState(F&& modifier) {
-        state = modifier(state);
+        core->state = modifier(core->state);
     }
 };
 
@@ -0,0 +1,418 @@
+#ifndef XWIFT_STDLIB_CONCURRENCY_CHANNEL_H
+#define XWIFT_STDLIB_CONCURRENCY_CHANNEL_H
+
+#include "xwift/stdlib/Concurrency/Scheduler.h"
+#include "xwift/stdlib/Concurrency/TaskGroup.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace xwift {
+
+enum class ChannelStatus {
+    Ok,
+    WouldBlock,
+    Closed
+};
+
+// Bounded multi-producer multi-consumer channel over Vyukov's ring buffer:
+// each cell carries a sequence number that tells producers and consumers
+// whose turn it is, so the fast path is one CAS on the shared position and
+// no locks. Blocking operations spin briefly and then park on a condition
+// variable; a parked worker hands its slot to another thread first (see
+// Scheduler::blockInPlace), so a pipeline of tasks cannot starve the pool.
+//
+// After close() sends fail, and receives drain what is left and then report
+// Closed.
+template<typename T>
+class Channel {
+public:
+    explicit Channel(size_t capacity, Scheduler& pool = Scheduler::getInstance())
+        : Pool(&pool) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        Capacity = std::max<size_t>(capacity, 1);
+        Mask = size - 1;
+        Cells.reset(new Cell[size]);
+        for (size_t i = 0; i < size; i++) {
+            Cells[i].Sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    Channel(const Channel&) = delete;
+    Channel& operator=(const Channel&) = delete;
+
+    // Moves from item only when it returns Ok
+    ChannelStatus trySend(T& item) {
+        Senders.fetch_add(1);
+        if (Closed.load()) {
+            Senders.fetch_sub(1);
+            return ChannelStatus::Closed;
+        }
+        bool pushed = enqueue(item);
+        Senders.fetch_sub(1, std::memory_order_release);
+        if (!pushed) {
+            return ChannelStatus::WouldBlock;
+        }
+        wakeReceivers(false);
+        return ChannelStatus::Ok;
+    }
+
+    ChannelStatus tryReceive(T& item) {
+        if (dequeue(item)) {
+            wake(NotFull, SendWaiters);
+            return ChannelStatus::Ok;
+        }
+        // A sender that saw the channel open may still be writing its item
+        if (Closed.load() && Senders.load() == 0) {
+            return dequeue(item) ? ChannelStatus::Ok : ChannelStatus::Closed;
+        }
+        return ChannelStatus::WouldBlock;
+    }
+
+    // Blocks while the channel is full. Returns false if it is closed. A
+    // cancelled token stops the wait with CancelledError.
+    bool send(T item, const CancellationToken* token = nullptr) {
+        for (unsigned attempt = 0;; attempt++) {
+            ChannelStatus status = trySend(item);
+            if (status != ChannelStatus::WouldBlock) {
+                return status == ChannelStatus::Ok;
+            }
+            if (token) {
+                token->throwIfCancelled();
+            }
+            if (attempt < SpinLimit) {
+                std::this_thread::yield();
+                continue;
+            }
+            park(NotFull, SendWaiters, [this] { return size() < Capacity || isClosed(); });
+        }
+    }
+
+    // Blocks while the channel is empty. Returns nullopt once it is closed
+    // and drained.
+    std::optional<T> receive(const CancellationToken* token = nullptr) {
+        T item;
+        for (unsigned attempt = 0;; attempt++) {
+            ChannelStatus status = tryReceive(item);
+            if (status == ChannelStatus::Ok) {
+                return std::optional<T>(std::move(item));
+            }
+            if (status == ChannelStatus::Closed) {
+                return std::nullopt;
+            }
+            if (token) {
+                token->throwIfCancelled();
+            }
+            if (attempt < SpinLimit) {
+                std::this_thread::yield();
+                continue;
+            }
+            park(NotEmpty, RecvWaiters, [this] { return size() > 0 || isClosed(); });
+        }
+    }
+
+    void close() {
+        Closed.store(true);
+        wakeReceivers(true);
+        wake(NotFull, SendWaiters);
+    }
+
+    // Calls callback once, when an item has arrived or the channel has
+    // closed, so a receiver can wait without holding a thread. Each send
+    // wakes one such receiver and close() wakes them all; a woken receiver
+    // still has to race for the item with tryReceive. The callback runs on
+    // the sending or closing thread and must not block. Returns false,
+    // without keeping callback, if there is already something to receive.
+    bool whenReadable(std::function<void()> callback) {
+        uint64_t ticket;
+        {
+            std::lock_guard<std::mutex> lock(WaitMutex);
+            ticket = NextWatcher++;
+            ReadWatchers.emplace_back(ticket, std::move(callback));
+            RecvWaiters.fetch_add(1);
+        }
+        // Pairs with the fence in wakeReceivers: either the sender sees this
+        // watcher, or this check sees the sender's item
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!hasPublishedItem() && !isClosed()) {
+            return true;
+        }
+        std::lock_guard<std::mutex> lock(WaitMutex);
+        for (auto it = ReadWatchers.rbegin(); it != ReadWatchers.rend(); ++it) {
+            if (it->first == ticket) {
+                ReadWatchers.erase(std::next(it).base());
+                RecvWaiters.fetch_sub(1);
+                return false;
+            }
+        }
+        // Already taken by a sender, which runs it
+        return true;
+    }
+
+    bool isClosed() const { return Closed.load(std::memory_order_acquire); }
+    size_t capacity() const { return Capacity; }
+
+    // Items queued right now; exact only while nobody else is using the
+    // channel
+    size_t size() const {
+        size_t tail = EnqueuePos.load(std::memory_order_relaxed);
+        size_t head = DequeuePos.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+    Scheduler& getScheduler() const { return *Pool; }
+
+private:
+    struct Cell {
+        std::atomic<size_t> Sequence;
+        T Data;
+    };
+
+    bool enqueue(T& item) {
+        size_t pos = EnqueuePos.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            // Logically full before the ring is, when capacity is not a power
+            // of two. Checked against the position about to be claimed, since
+            // another sender may have taken the one read before. A pos already
+            // behind DequeuePos is stale and fails the claim below.
+            size_t head = DequeuePos.load(std::memory_order_acquire);
+            if (static_cast<intptr_t>(pos - head) >= static_cast<intptr_t>(Capacity)) {
+                return false;
+            }
+            cell = &Cells[pos & Mask];
+            size_t seq = cell->Sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (EnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = EnqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->Data = std::move(item);
+        cell->Sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool dequeue(T& item) {
+        size_t pos = DequeuePos.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &Cells[pos & Mask];
+            size_t seq = cell->Sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (DequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = DequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        item = std::move(cell->Data);
+        cell->Data = T();
+        cell->Sequence.store(pos + Mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // The timed wait bounds the cost of a wakeup lost between the waiter
+    // registering and the other side checking for waiters
+    template<typename Ready>
+    void park(std::condition_variable& condition, std::atomic<int>& waiters, Ready ready) {
+        Pool->blockInPlace([&] {
+            std::unique_lock<std::mutex> lock(WaitMutex);
+            waiters.fetch_add(1);
+            condition.wait_for(lock, std::chrono::milliseconds(1), ready);
+            waiters.fetch_sub(1);
+        });
+    }
+
+    void wake(std::condition_variable& condition, std::atomic<int>& waiters) {
+        if (waiters.load() > 0) {
+            { std::lock_guard<std::mutex> lock(WaitMutex); }
+            condition.notify_all();
+        }
+    }
+
+    // Wakes parked receivers and one watcher, or every watcher
+    void wakeReceivers(bool all) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (RecvWaiters.load() == 0) {
+            return;
+        }
+        std::vector<std::function<void()>> ready;
+        {
+            std::lock_guard<std::mutex> lock(WaitMutex);
+            while (!ReadWatchers.empty() && (all || ready.empty())) {
+                ready.push_back(std::move(ReadWatchers.front().second));
+                ReadWatchers.pop_front();
+                RecvWaiters.fetch_sub(1);
+            }
+        }
+        NotEmpty.notify_all();
+        for (auto& callback : ready) {
+            callback();
+        }
+    }
+
+    // Whether the next dequeue would find a finished send
+    bool hasPublishedItem() const {
+        size_t pos = DequeuePos.load(std::memory_order_relaxed);
+        const Cell& cell = Cells[pos & Mask];
+        return cell.Sequence.load(std::memory_order_acquire) == pos + 1;
+    }
+
+    static constexpr unsigned SpinLimit = 64;
+
+    std::unique_ptr<Cell[]> Cells;
+    size_t Mask = 0;
+    size_t Capacity = 0;
+    Scheduler* Pool;
+
+    alignas(64) std::atomic<size_t> EnqueuePos{0};
+    alignas(64) std::atomic<size_t> DequeuePos{0};
+    alignas(64) std::atomic<int> Senders{0};
+    std::atomic<bool> Closed{false};
+
+    std::mutex WaitMutex;
+    std::condition_variable NotFull;
+    std::condition_variable NotEmpty;
+    std::atomic<int> SendWaiters{0};
+    // Parked receivers plus ReadWatchers
+    std::atomic<int> RecvWaiters{0};
+    std::deque<std::pair<uint64_t, std::function<void()>>> ReadWatchers;
+    uint64_t NextWatcher = 0;
+};
+
+// Receives from whichever channel has an item first, scanning from a
+// rotating start so no channel is starved. Returns the channel's index and
+// the item, or nullopt once every channel is closed and drained.
+template<typename T>
+std::optional<std::pair<size_t, T>> selectReceive(const std::vector<Channel<T>*>& channels,
+                                                  bool block = true,
+                                                  const CancellationToken* token = nullptr) {
+    if (channels.empty()) {
+        return std::nullopt;
+    }
+    static thread_local size_t rotation = 0;
+    auto delay = std::chrono::microseconds(10);
+    T item;
+    for (unsigned attempt = 0;; attempt++) {
+        size_t start = rotation++;
+        size_t closed = 0;
+        for (size_t i = 0; i < channels.size(); i++) {
+            size_t index = (start + i) % channels.size();
+            ChannelStatus status = channels[index]->tryReceive(item);
+            if (status == ChannelStatus::Ok) {
+                return std::make_pair(index, std::move(item));
+            }
+            if (status == ChannelStatus::Closed) {
+                closed++;
+            }
+        }
+        if (closed == channels.size() || !block) {
+            return std::nullopt;
+        }
+        if (token) {
+            token->throwIfCancelled();
+        }
+        if (attempt < 64) {
+            std::this_thread::yield();
+            continue;
+        }
+        // No single condition variable covers every channel, so poll with
+        // backoff once spinning has not helped
+        channels.front()->getScheduler().blockInPlace([&] {
+            std::this_thread::sleep_for(delay);
+        });
+        delay = std::min(delay * 2, std::chrono::microseconds(1000));
+    }
+}
+
+// Chain of stages joined by bounded channels. Each stage runs as one job
+// that receives, transforms and sends on, so items stay in order and a slow
+// stage makes the ones before it wait instead of buffering without limit.
+template<typename T>
+class Pipeline {
+public:
+    explicit Pipeline(size_t capacity = 64, Scheduler& pool = Scheduler::getInstance())
+        : Capacity(capacity), Pool(&pool) {}
+
+    Pipeline& stage(std::function<T(T)> func) {
+        Stages.push_back(std::move(func));
+        return *this;
+    }
+
+    std::vector<T> run(std::vector<T> input) {
+        std::vector<std::shared_ptr<Channel<T>>> links;
+        for (size_t i = 0; i <= Stages.size(); i++) {
+            links.push_back(std::make_shared<Channel<T>>(Capacity, *Pool));
+        }
+
+        std::vector<Task<bool>> jobs;
+        jobs.emplace_back([source = links.front(), items = std::move(input)]() mutable {
+            for (auto& item : items) {
+                if (!source->send(std::move(item))) {
+                    break;
+                }
+            }
+            source->close();
+            return true;
+        }, *Pool);
+        for (size_t i = 0; i < Stages.size(); i++) {
+            jobs.emplace_back([in = links[i], out = links[i + 1], func = Stages[i]]() {
+                try {
+                    while (auto item = in->receive()) {
+                        if (!out->send(func(std::move(*item)))) {
+                            break;
+                        }
+                    }
+                } catch (...) {
+                    // Unblock both neighbours before reporting the failure
+                    in->close();
+                    out->close();
+                    throw;
+                }
+                in->close();
+                out->close();
+                return true;
+            }, *Pool);
+        }
+
+        std::vector<T> results;
+        while (auto item = links.back()->receive()) {
+            results.push_back(std::move(*item));
+        }
+        // Rethrows the first stage that failed
+        for (auto& job : jobs) {
+            job.get();
+        }
+        return results;
+    }
+
+private:
+    size_t Capacity;
+    Scheduler* Pool;
+    std::vector<std::function<T(T)>> Stages;
+};
+
+}
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef XWIFT_STDLIB_CONCURRENCY_COROUTINE_H
+#define XWIFT_STDLIB_CONCURRENCY_COROUTINE_H
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace xwift {
+
+template<typename T>
+class Coroutine;
+
+// State shared by every Coroutine promise: who to continue when the body
+// finishes, and what it threw
+class CoroutinePromiseBase {
+public:
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    // The awaiter and the end of the body race to set Finished: whichever
+    // comes second continues the caller. A body that finishes before its
+    // first suspension is therefore continued by the awaiter returning, not
+    // by a nested resume, so a loop of such calls runs in constant stack
+    // even where the compiler does not turn symmetric transfer into a tail
+    // call.
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> frame) noexcept {
+            CoroutinePromiseBase& promise = frame.promise();
+            if (promise.Finished.exchange(true, std::memory_order_acq_rel)) {
+                return promise.Continuation;
+            }
+            return std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() { Error = std::current_exception(); }
+
+protected:
+    void rethrowIfFailed() {
+        if (Error) {
+            std::rethrow_exception(Error);
+        }
+    }
+
+private:
+    template<typename T>
+    friend class Coroutine;
+
+    std::coroutine_handle<> Continuation;
+    std::exception_ptr Error;
+    std::atomic<bool> Finished{false};
+};
+
+template<typename T>
+class CoroutinePromise : public CoroutinePromiseBase {
+public:
+    template<typename U>
+    void return_value(U&& value) {
+        Result.emplace(std::forward<U>(value));
+    }
+
+    T take() {
+        rethrowIfFailed();
+        return std::move(*Result);
+    }
+
+private:
+    std::optional<T> Result;
+};
+
+template<>
+class CoroutinePromise<void> : public CoroutinePromiseBase {
+public:
+    void return_void() {}
+
+    void take() { rethrowIfFailed(); }
+};
+
+// Lazily started, stackless coroutine producing T. co_await on one starts
+// it on the awaiting thread; if it suspends, the awaiting coroutine stays
+// suspended too and is continued from wherever the inner one finishes. Only
+// the frames of the calls in progress are kept while suspended, so a
+// suspended chain costs a few hundred bytes per level instead of a thread
+// stack.
+//
+// A coroutine nobody awaits is started with resume() and must be finished
+// before the Coroutine object, which owns its frame, goes away.
+template<typename T>
+class Coroutine {
+public:
+    struct promise_type : CoroutinePromise<T> {
+        Coroutine get_return_object() {
+            return Coroutine(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+    };
+
+    Coroutine(Coroutine&& other) noexcept : Frame(std::exchange(other.Frame, {})) {}
+
+    Coroutine& operator=(Coroutine&& other) noexcept {
+        if (this != &other) {
+            destroy();
+            Frame = std::exchange(other.Frame, {});
+        }
+        return *this;
+    }
+
+    Coroutine(const Coroutine&) = delete;
+    Coroutine& operator=(const Coroutine&) = delete;
+
+    ~Coroutine() { destroy(); }
+
+    void resume() { Frame.resume(); }
+    bool done() const { return Frame.done(); }
+
+    auto operator co_await() && noexcept {
+        struct Awaiter {
+            std::coroutine_handle<promise_type> Callee;
+
+            bool await_ready() noexcept { return false; }
+
+            bool await_suspend(std::coroutine_handle<> caller) noexcept {
+                promise_type& promise = Callee.promise();
+                promise.Continuation = caller;
+                Callee.resume();
+                // Suspend only if the callee is still running somewhere
+                return !promise.Finished.exchange(true, std::memory_order_acq_rel);
+            }
+
+            T await_resume() { return Callee.promise().take(); }
+        };
+        return Awaiter{Frame};
+    }
+
+private:
+    explicit Coroutine(std::coroutine_handle<promise_type> frame) : Frame(frame) {}
+
+    void destroy() {
+        if (Frame) {
+            Frame.destroy();
+        }
+    }
+
+    std::coroutine_handle<promise_type> Frame;
+};
+
+}
+
+#endif
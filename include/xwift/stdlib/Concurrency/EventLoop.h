@@ -0,0 +1,115 @@
+#ifndef XWIFT_STDLIB_CONCURRENCY_EVENTLOOP_H
+#define XWIFT_STDLIB_CONCURRENCY_EVENTLOOP_H
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace xwift {
+
+// Single-threaded reactor for timers and file descriptor readiness. On
+// Linux it waits in epoll, with a timerfd armed for the earliest timer and
+// an eventfd that wakes it when work is posted from another thread.
+// Elsewhere only timers and posted callbacks are supported, and watch()
+// reports Failed.
+//
+// Every callback runs on the loop's thread and must not block; anything
+// slow belongs on the Scheduler. Methods may be called from any thread:
+// they queue their change and the loop applies it on its next turn. The
+// thread and its descriptors are created on first use, so an idle loop
+// costs nothing.
+class EventLoop {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Callback = std::function<void()>;
+    using TimerId = uint64_t;
+
+    // Readiness bits handed to watch callbacks
+    enum IoEvent : uint32_t {
+        Readable = 1,
+        Writable = 2,
+        Failed = 4
+    };
+    using IoCallback = std::function<void(uint32_t events)>;
+
+    EventLoop();
+    // Stops the thread. Timers and watches still pending are dropped
+    // without running. Dropping the last owner from one of the loop's own
+    // callbacks is allowed: the loop's state lives on until that callback
+    // returns, and the thread then exits by itself.
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // Runs callback on the loop thread, after everything posted before it
+    void post(Callback callback);
+
+    // Runs callback on the loop thread and waits for it to finish
+    void runSync(const Callback& callback);
+
+    TimerId addTimer(Clock::duration delay, Callback callback);
+    void cancelTimer(TimerId id);
+
+    // Calls callback whenever fd is ready for any of events (level
+    // triggered) until unwatch(fd). Watching an fd again replaces its events
+    // and callback. An fd that cannot be polled, such as a regular file, gets
+    // a single Failed callback.
+    void watch(int fd, uint32_t events, IoCallback callback);
+    void unwatch(int fd);
+
+    bool onLoopThread() const;
+
+    // Timers and watches currently registered
+    size_t pendingCount() const;
+
+private:
+    struct Core;
+
+    // Shared with the loop thread
+    std::shared_ptr<Core> State;
+};
+
+// Reads the whole file at path on the loop and hands the contents to done,
+// or nullopt if it cannot be read. Regular files are never "not ready" to
+// epoll, so they are read in bounded chunks, one per loop turn, to keep
+// timers and sockets serviced while a large file streams in; pipes and FIFOs
+// are read as data arrives.
+void readFileAsync(EventLoop& loop, const std::string& path,
+                   std::function<void(std::optional<std::string>)> done);
+
+// Splits the bytes arriving on fd into lines for any number of queued
+// readers, in order. A line is handed over without its newline; once the
+// fd reaches end of input every remaining reader gets nullopt. The reader
+// must outlive the loop's use of it, so it is always held by shared_ptr.
+class LineReader : public std::enable_shared_from_this<LineReader> {
+public:
+    using LineCallback = std::function<void(std::optional<std::string>)>;
+
+    LineReader(EventLoop& loop, int fd) : Loop(&loop), Fd(fd) {}
+
+    void readLine(LineCallback done);
+
+private:
+    void pump();
+    void deliver();
+    void readSome();
+
+    EventLoop* Loop;
+    int Fd;
+    // Loop thread only
+    std::string Buffer;
+    std::deque<LineCallback> Readers;
+    bool Watching = false;
+    // False once epoll refused the fd; it is then read a chunk per turn
+    bool Pollable = true;
+    bool AtEnd = false;
+};
+
+}
+
+#endif
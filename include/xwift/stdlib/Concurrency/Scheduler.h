@@ -0,0 +1,212 @@
+#ifndef XWIFT_STDLIB_CONCURRENCY_SCHEDULER_H
+#define XWIFT_STDLIB_CONCURRENCY_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace xwift {
+
+// Chase-Lev work-stealing deque, in the formulation for weak memory models
+// by Le, Pop, Cohen and Zappa Nardelli. The owning worker pushes and pops
+// at the bottom; any other thread may steal from the top.
+template<typename T>
+class WorkStealingDeque {
+public:
+    explicit WorkStealingDeque(size_t capacity = 256) {
+        auto array = std::make_unique<Array>(capacity);
+        Buffer.store(array.get(), std::memory_order_relaxed);
+        Arrays.push_back(std::move(array));
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // Owner only
+    void push(T item) {
+        int64_t b = Bottom.load(std::memory_order_relaxed);
+        int64_t t = Top.load(std::memory_order_acquire);
+        Array* array = Buffer.load(std::memory_order_relaxed);
+        if (b - t > static_cast<int64_t>(array->Capacity) - 1) {
+            array = grow(array, t, b);
+        }
+        array->put(b, item);
+        // Release store rather than the paper's fence + relaxed store: same
+        // cost on x86, and visible to race detectors
+        Bottom.store(b + 1, std::memory_order_release);
+    }
+
+    // Owner only
+    bool pop(T& item) {
+        int64_t b = Bottom.load(std::memory_order_relaxed) - 1;
+        Array* array = Buffer.load(std::memory_order_relaxed);
+        Bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = Top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            Bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        item = array->get(b);
+        if (t == b) {
+            // Last element: race the thieves for it
+            bool won = Top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                                   std::memory_order_relaxed);
+            Bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // Any thread
+    bool steal(T& item) {
+        int64_t t = Top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = Bottom.load(std::memory_order_acquire);
+        if (t >= b) {
+            return false;
+        }
+
+        Array* array = Buffer.load(std::memory_order_acquire);
+        item = array->get(t);
+        return Top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                           std::memory_order_relaxed);
+    }
+
+    size_t sizeHint() const {
+        int64_t b = Bottom.load(std::memory_order_relaxed);
+        int64_t t = Top.load(std::memory_order_relaxed);
+        return b > t ? static_cast<size_t>(b - t) : 0;
+    }
+
+private:
+    struct Array {
+        size_t Capacity;
+        std::unique_ptr<std::atomic<T>[]> Slots;
+
+        explicit Array(size_t capacity)
+            : Capacity(capacity), Slots(new std::atomic<T>[capacity]) {}
+
+        T get(int64_t i) const {
+            return Slots[static_cast<size_t>(i) & (Capacity - 1)].load(std::memory_order_relaxed);
+        }
+
+        void put(int64_t i, T item) {
+            Slots[static_cast<size_t>(i) & (Capacity - 1)].store(item, std::memory_order_relaxed);
+        }
+    };
+
+    Array* grow(Array* old, int64_t top, int64_t bottom) {
+        auto array = std::make_unique<Array>(old->Capacity * 2);
+        for (int64_t i = top; i < bottom; i++) {
+            array->put(i, old->get(i));
+        }
+        Array* raw = array.get();
+        // Thieves may still be reading the old array, so it is only freed
+        // together with the deque
+        Arrays.push_back(std::move(array));
+        Buffer.store(raw, std::memory_order_release);
+        return raw;
+    }
+
+    std::atomic<int64_t> Top{0};
+    std::atomic<int64_t> Bottom{0};
+    std::atomic<Array*> Buffer{nullptr};
+    std::vector<std::unique_ptr<Array>> Arrays;
+};
+
+// Work-stealing thread pool. Jobs spawned from a worker go to the bottom of
+// that worker's own deque (LIFO, cache-warm); a worker that runs dry takes
+// from the shared injection queue and then steals from the top of randomly
+// chosen victims. Jobs spawned from any other thread go through the
+// injection queue.
+class Scheduler {
+public:
+    using Job = std::function<void()>;
+
+    // Process-wide pool sized by defaultWorkerCount()
+    static Scheduler& getInstance();
+
+    // XWIFT_WORKERS if set to a positive number, else the core count
+    static size_t defaultWorkerCount();
+
+    explicit Scheduler(size_t workerCount);
+    ~Scheduler();
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    void spawn(Job job);
+
+    // Queues job behind everything already waiting, for jobs that give up
+    // their turn and must not jump ahead of other work on this worker
+    void spawnFair(Job job);
+
+    // Blocks until done() returns true. On one of this pool's workers the
+    // wait runs other queued jobs instead of idling, so tasks that await
+    // their own children cannot starve the pool.
+    void waitUntil(const std::function<bool()>& done);
+
+    // Runs wait() for a job that blocks on something only another job can
+    // release, such as a full channel. On a worker, the worker's slot and
+    // deque are first handed to another thread so the pool keeps its size:
+    // a spare left over from an earlier blocking call if one is idle, else a
+    // new one. This thread finishes the current job as an ordinary thread
+    // and then waits as a spare itself.
+    void blockInPlace(const std::function<void()>& wait);
+
+    bool onWorkerThread() const { return CurrentScheduler == this; }
+    size_t workerCount() const { return Workers.size(); }
+    // Threads started so far, spares waiting after blockInPlace included
+    size_t threadCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return Threads.size();
+    }
+
+private:
+    struct Worker {
+        WorkStealingDeque<Job*> Deque;
+        std::mt19937 Rng;
+    };
+
+    void inject(Job* job);
+    // Serves slot index, then whichever slots it is handed after giving one
+    // up, until the pool stops
+    void threadMain(size_t index);
+    // Returns once the pool stops or this thread gave its slot away
+    void workerLoop(size_t index);
+    Job* findJob(size_t self, std::mt19937& rng);
+    void runJob(Job* job);
+
+    std::vector<std::unique_ptr<Worker>> Workers;
+    // Every thread the pool started, workers and spares alike; guarded by
+    // mutex, which the destructor also takes to join them
+    std::vector<std::thread> Threads;
+    // Slots given up in blockInPlace and not yet taken, and how many spares
+    // are waiting for one that nobody has claimed
+    std::deque<size_t> FreeSlots;
+    size_t IdleSpares = 0;
+    std::deque<Job*> Injected;
+    mutable std::mutex mutex;
+    std::condition_variable condition;
+    std::condition_variable spareCondition;
+    std::atomic<size_t> Queued{0};
+    std::atomic<size_t> Sleeping{0};
+    bool Stopping = false;
+
+    static thread_local Scheduler* CurrentScheduler;
+    static thread_local size_t CurrentWorker;
+};
+
+}
+
+#endif
@@ -0,0 +1,201 @@
+#ifndef XWIFT_STDLIB_CONCURRENCY_TASKGROUP_H
+#define XWIFT_STDLIB_CONCURRENCY_TASKGROUP_H
+
+#include "xwift/stdlib/Concurrency/Async.h"
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+namespace xwift {
+
+// Thrown by work that noticed its token was cancelled
+class CancelledError : public std::runtime_error {
+public:
+    CancelledError() : std::runtime_error("task cancelled") {}
+};
+
+// Cooperative cancellation flag with an optional deadline. A token is also
+// cancelled once its parent is, so cancelling a group reaches every group
+// nested inside it. Work polls isCancelled() at convenient points; nothing
+// is interrupted preemptively.
+class CancellationToken {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit CancellationToken(std::shared_ptr<const CancellationToken> parent = nullptr)
+        : Parent(std::move(parent)) {}
+
+    CancellationToken(const CancellationToken&) = delete;
+    CancellationToken& operator=(const CancellationToken&) = delete;
+
+    void cancel() {
+        Cancelled.store(true, std::memory_order_release);
+    }
+
+    // Deadlines only ever move earlier
+    void setDeadline(Clock::time_point deadline) {
+        Clock::rep ticks = deadline.time_since_epoch().count();
+        Clock::rep current = Deadline.load(std::memory_order_relaxed);
+        while (ticks < current &&
+               !Deadline.compare_exchange_weak(current, ticks, std::memory_order_relaxed)) {
+        }
+    }
+
+    void setTimeout(Clock::duration timeout) {
+        setDeadline(Clock::now() + timeout);
+    }
+
+    bool isCancelled() const {
+        if (Cancelled.load(std::memory_order_acquire)) {
+            return true;
+        }
+        Clock::rep ticks = Deadline.load(std::memory_order_relaxed);
+        if (ticks != NoDeadline && Clock::now().time_since_epoch().count() >= ticks) {
+            return true;
+        }
+        return Parent && Parent->isCancelled();
+    }
+
+    // Earliest deadline of this token and its parents
+    std::optional<Clock::time_point> deadline() const {
+        std::optional<Clock::time_point> inherited;
+        if (Parent) {
+            inherited = Parent->deadline();
+        }
+        Clock::rep ticks = Deadline.load(std::memory_order_relaxed);
+        if (ticks == NoDeadline) {
+            return inherited;
+        }
+        Clock::time_point own{Clock::duration(ticks)};
+        return inherited ? std::min(*inherited, own) : own;
+    }
+
+    // Time left before the deadline, clamped at zero; nullopt without one
+    std::optional<std::chrono::milliseconds> remaining() const {
+        auto until = deadline();
+        if (!until) {
+            return std::nullopt;
+        }
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(*until - Clock::now());
+        return std::max(left, std::chrono::milliseconds(0));
+    }
+
+    // Sleeps for up to duration, waking early on cancellation. Returns false
+    // if the token was cancelled.
+    bool sleepFor(Clock::duration duration) const {
+        auto wakeAt = Clock::now() + duration;
+        while (!isCancelled()) {
+            auto now = Clock::now();
+            if (now >= wakeAt) {
+                return true;
+            }
+            std::this_thread::sleep_for(std::min<Clock::duration>(wakeAt - now, PollInterval));
+        }
+        return false;
+    }
+
+    void throwIfCancelled() const {
+        if (isCancelled()) {
+            throw CancelledError();
+        }
+    }
+
+private:
+    static constexpr Clock::rep NoDeadline = std::numeric_limits<Clock::rep>::max();
+    static constexpr std::chrono::milliseconds PollInterval{5};
+
+    std::shared_ptr<const CancellationToken> Parent;
+    std::atomic<bool> Cancelled{false};
+    std::atomic<Clock::rep> Deadline{NoDeadline};
+};
+
+// Structured fan-out: children spawned into a group share its cancellation
+// token, the first child to fail cancels the others, and the group joins
+// every child before it goes away. Leaving the scope because of an
+// exception cancels the children first.
+template<typename T>
+class TaskGroup {
+public:
+    explicit TaskGroup(std::shared_ptr<const CancellationToken> parent = nullptr,
+                       Scheduler& pool = Scheduler::getInstance())
+        : Token(std::make_shared<CancellationToken>(std::move(parent))), Pool(&pool),
+          UncaughtOnEntry(std::uncaught_exceptions()) {}
+
+    ~TaskGroup() {
+        if (std::uncaught_exceptions() > UncaughtOnEntry) {
+            cancel();
+        }
+        for (auto& task : Tasks) {
+            task.wait();
+        }
+    }
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    void spawn(std::function<T(const CancellationToken&)> func) {
+        auto token = Token;
+        Tasks.emplace_back([func = std::move(func), token]() -> T {
+            token->throwIfCancelled();
+            try {
+                return func(*token);
+            } catch (...) {
+                token->cancel();
+                throw;
+            }
+        }, *Pool);
+    }
+
+    // Waits for every child and returns the results in spawn order. Rethrows
+    // the first real failure, or CancelledError if children were only
+    // cancelled.
+    std::vector<T> awaitAll() {
+        std::vector<T> results;
+        results.reserve(Tasks.size());
+        std::exception_ptr failure;
+        std::exception_ptr cancelled;
+        for (auto& task : Tasks) {
+            try {
+                results.push_back(task.get());
+            } catch (const CancelledError&) {
+                if (!cancelled) {
+                    cancelled = std::current_exception();
+                }
+            } catch (...) {
+                if (!failure) {
+                    failure = std::current_exception();
+                }
+            }
+        }
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+        if (cancelled) {
+            std::rethrow_exception(cancelled);
+        }
+        return results;
+    }
+
+    void cancel() { Token->cancel(); }
+    bool isCancelled() const { return Token->isCancelled(); }
+
+    void setDeadline(CancellationToken::Clock::time_point deadline) { Token->setDeadline(deadline); }
+    void setTimeout(CancellationToken::Clock::duration timeout) { Token->setTimeout(timeout); }
+
+    const std::shared_ptr<CancellationToken>& token() const { return Token; }
+    size_t size() const { return Tasks.size(); }
+
+private:
+    std::shared_ptr<CancellationToken> Token;
+    Scheduler* Pool;
+    std::vector<Task<T>> Tasks;
+    int UncaughtOnEntry;
+};
+
+}
+
+#endif
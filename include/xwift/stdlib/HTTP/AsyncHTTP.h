@@ -0,0 +1,74 @@
+#ifndef XWIFT_HTTP_ASYNCHTTP_H
+#define XWIFT_HTTP_ASYNCHTTP_H
+
+#include "xwift/Basic/Result.h"
+#include "xwift/stdlib/Concurrency/EventLoop.h"
+#include "xwift/stdlib/HTTP/HTTPBackend.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace xwift {
+namespace http {
+
+// Non-blocking HTTP client driven by an EventLoop. Requests go through
+// libcurl's multi socket interface: curl tells the loop which sockets and
+// timeouts it cares about, and the loop calls back into curl when one is
+// ready, so any number of requests share the loop's thread and none of them
+// holds a thread while waiting on the network.
+//
+// Completions run on the loop thread. The loop must outlive the client.
+class AsyncHTTPClient {
+public:
+  using Completion = std::function<void(Result<Response>)>;
+  using BatchCompletion = std::function<void(std::vector<Result<Response>>)>;
+  // Names a request for cancel(); never zero
+  using RequestId = uint64_t;
+
+  explicit AsyncHTTPClient(EventLoop& loop);
+  // Requests still in flight complete with an error first
+  ~AsyncHTTPClient();
+
+  AsyncHTTPClient(const AsyncHTTPClient&) = delete;
+  AsyncHTTPClient& operator=(const AsyncHTTPClient&) = delete;
+
+  // A timeoutMs of zero means DefaultTimeoutMs. A request's own timeoutMs,
+  // when set, wins over the one passed here.
+  RequestId request(const std::string& method, const std::string& url, const std::string& body,
+                    int timeoutMs, Completion done);
+  RequestId request(Request request, int timeoutMs, Completion done);
+  // Stops the request and completes it with an error, unless it has
+  // completed already. May be called from any thread, and on the loop
+  // thread from a completion.
+  void cancel(RequestId id);
+
+  // Runs every request, at most maxConcurrent at a time, and hands done
+  // their results in request order once the last one finishes. Each
+  // request fails or succeeds on its own.
+  void requestAll(std::vector<Request> requests, size_t maxConcurrent, int timeoutMs,
+                  BatchCompletion done);
+
+  void get(const std::string& url, int timeoutMs, Completion done) {
+    request("GET", url, "", timeoutMs, std::move(done));
+  }
+
+  void post(const std::string& url, const std::string& data, int timeoutMs, Completion done) {
+    request("POST", url, data, timeoutMs, std::move(done));
+  }
+
+  size_t inFlight() const;
+
+  static constexpr int DefaultTimeoutMs = 30000;
+
+private:
+  struct Transfer;
+  struct Driver;
+  std::unique_ptr<Driver> driver;
+};
+
+}
+}
+
+#endif
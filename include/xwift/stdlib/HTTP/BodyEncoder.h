@@ -1,8 +1,13 @@
 #ifndef XWIFT_HTTP_BODYENCODER_H
 #define XWIFT_HTTP_BODYENCODER_H
 
+#include "xwift/Basic/Result.h"
+#include "xwift/stdlib/HTTP/HTTPBackend.h"
+#include <cstdio>
 #include <string>
 #include <map>
+#include <optional>
+#include <vector>
 
 namespace xwift {
 namespace http {
@@ -20,14 +25,69 @@ public:
     static std::string encodeFormURLEncoded(const std::map<std::string, std::string>& params);
     static std::string encodeMultipartFormData(const std::map<std::string, std::string>& fields, const std::string& boundary);
     
+    // body as a gzip stream (RFC 1952), to send with Content-Encoding: gzip
+    static std::string encodeGzip(const std::string& body);
+    
     static std::string getContentTypeString(ContentType type);
     static std::string generateBoundary();
 };
 
+// A multipart/form-data body sent as it is read. Fields are kept in memory;
+// files are only sized when added and read straight into the transfer's
+// buffer as it goes out, one part after another, so an upload of any size
+// holds one chunk at a time. Give it to Request::bodySource with contentType()
+// as the Content-Type header.
+class MultipartBody : public BodySource {
+public:
+    explicit MultipartBody(std::string boundary = BodyEncoder::generateBoundary());
+    ~MultipartBody() override;
+    
+    MultipartBody(const MultipartBody&) = delete;
+    MultipartBody& operator=(const MultipartBody&) = delete;
+    
+    void addField(const std::string& name, const std::string& value);
+    // filename defaults to the last component of path. Fails if path is not
+    // a regular file.
+    Result<bool> addFile(const std::string& name, const std::string& path,
+                         const std::string& filename = "",
+                         const std::string& contentType = "application/octet-stream");
+    
+    const std::string& boundary() const { return Boundary; }
+    std::string contentType() const;
+    
+    // Fixed once the parts are added. A file that shrinks before it is sent
+    // fails the read; one that grows is cut at the size it had.
+    uint64_t size() const override;
+    std::ptrdiff_t read(char* buffer, size_t capacity) override;
+    bool rewind() override;
+    
+private:
+    // Delimiters, part headers and field values, or a file when Path is set
+    struct Segment {
+        std::string Text;
+        std::string Path;
+        uint64_t FileSize = 0;
+    };
+    
+    std::string Boundary;
+    std::vector<Segment> Segments;
+    // "--boundary--\r\n", sent after the last segment
+    std::string Closing;
+    // Where read() is: segment Segments.size() is Closing
+    size_t Index = 0;
+    uint64_t Offset = 0;
+    std::FILE* File = nullptr;
+    
+    void appendText(const std::string& text);
+};
+
 class BodyDecoder {
 public:
     static std::string decodeJSON(const std::string& body);
     static std::map<std::string, std::string> decodeFormURLEncoded(const std::string& body);
+    // Inflates a body sent with Content-Encoding gzip or deflate; nothing if
+    // the encoding is another one or the body is not valid for it
+    static std::optional<std::string> decodeContentEncoding(const std::string& body, const std::string& encoding);
 };
 
 }
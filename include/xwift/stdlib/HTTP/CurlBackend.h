@@ -0,0 +1,105 @@
+#ifndef XWIFT_HTTP_CURLBACKEND_H
+#define XWIFT_HTTP_CURLBACKEND_H
+
+#include "xwift/stdlib/HTTP/HTTPPlugin.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace xwift {
+namespace http {
+
+// Limits for the connections CurlHTTPBackend keeps open between requests.
+// The defaults can be overridden with XWIFT_HTTP_MAX_CONNECTIONS_PER_HOST
+// and XWIFT_HTTP_IDLE_TIMEOUT_MS.
+struct CurlPoolOptions {
+  // Requests to one host beyond this many wait for one of them to finish
+  size_t maxConnectionsPerHost = 8;
+  // A connection unused for this long is closed instead of reused; zero
+  // keeps nothing between requests
+  std::chrono::milliseconds idleTimeout{60000};
+
+  static CurlPoolOptions fromEnvironment();
+};
+
+struct CurlPoolStats {
+  // Easy handles created, and requests that reused an idle one
+  uint64_t handlesCreated = 0;
+  uint64_t handlesReused = 0;
+  // TCP connections opened, as reported by CURLINFO_NUM_CONNECTS
+  uint64_t connectionsOpened = 0;
+  // Handles waiting in the pool right now
+  size_t idleHandles = 0;
+};
+
+// Blocking libcurl backend. Easy handles are pooled per host and keep their
+// connections open between requests, so a request to a host seen recently
+// skips the TCP and TLS handshakes; every handle shares one CURLSH for DNS
+// and TLS sessions. Batches and hedged requests go through one
+// AsyncHTTPClient the backend keeps for its lifetime, so they overlap on a
+// single loop thread instead of taking a thread each. Safe to use from
+// several threads at once.
+class CurlHTTPBackend : public IHTTPBackend {
+public:
+  CurlHTTPBackend();
+  explicit CurlHTTPBackend(CurlPoolOptions options);
+  ~CurlHTTPBackend() override;
+
+  CurlHTTPBackend(const CurlHTTPBackend&) = delete;
+  CurlHTTPBackend& operator=(const CurlHTTPBackend&) = delete;
+
+  Result<Response> get(const std::string& url) override;
+  Result<Response> post(const std::string& url, const std::string& data) override;
+  Result<Response> put(const std::string& url, const std::string& data) override;
+  Result<Response> deleteRequest(const std::string& url) override;
+  Result<Response> send(const Request& request) override;
+  std::vector<Result<Response>> sendAll(const std::vector<Request>& requests,
+                                        size_t maxConcurrent) override;
+  Result<Response> sendHedged(const Request& request, int delayMs, HedgeOutcome& outcome) override;
+
+  void setHeader(const std::string& key, const std::string& value) override;
+  void setTimeout(int milliseconds) override;
+
+  std::string getName() const override { return "Curl"; }
+  std::string getVersion() const override { return "1.0.0"; }
+
+  // Applies to requests started afterwards. Idle handles over the new
+  // limits are dropped on their next use.
+  void setPoolOptions(const CurlPoolOptions& options);
+  CurlPoolStats poolStats() const;
+
+private:
+  struct Pool;
+  struct Async;
+
+  Result<Response> sendRequest(const Request& request);
+  Async& startAsync();
+  // request with the backend's headers under its own
+  Request withHeaders(const Request& request) const;
+
+  // For requests that carry no timeout of their own
+  std::atomic<int> timeout;
+  std::map<std::string, std::string> headers;
+  std::unique_ptr<Pool> pool;
+  // Started by the first batch or hedged request
+  std::once_flag asyncStarted;
+  std::unique_ptr<Async> async;
+};
+
+// Fills the phase timings, total time and byte counts of response from a
+// finished transfer on curl, a CURL easy handle, for both curl backends.
+// bodyFromFile says the body went out through a read callback.
+void readTransferInfo(void* curl, bool bodyFromFile, Response& response);
+// Has curl read the request body from source, and rewind it when the body
+// has to go out again
+void setBodySource(void* curl, BodySource* source);
+
+}
+}
+
+#endif
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <string>
 #include <map>
 #include <memory>
@@ -7,6 +10,10 @@
 namespace xwift {
 namespace http {
 
+// Content codings the curl and WinHTTP backends advertise in
+// Accept-Encoding and decode before a body reaches the caller
+constexpr const char* ContentEncodings = "gzip, deflate";
+
 enum class HTTPError {
   None,
   ConnectionFailed,
@@ -16,11 +23,32 @@ enum class HTTPError {
   Unknown
 };
 
+// Where a request's time went, phase by phase, in milliseconds. Phases a
+// reused connection skips, and TLS on plain HTTP, stay zero.
+struct TransferTiming {
+  double nameLookupMs = 0;
+  // TCP handshake, after the name was resolved
+  double connectMs = 0;
+  double tlsMs = 0;
+  // From the request being sent to the first byte of the response: the
+  // server's think time plus a round trip
+  double firstByteMs = 0;
+};
+
 struct Response {
   int statusCode;
   HTTPError error;
   std::string body;
   std::map<std::string, std::string> headers;
+  // Wall time from sending the request to the last byte of the body, or 0
+  // if the backend does not measure it
+  double totalTimeMs = 0;
+  TransferTiming timing;
+  // Bytes on the wire, headers included; a compressed body counts as sent
+  uint64_t bytesSent = 0;
+  uint64_t bytesReceived = 0;
+  // Body bytes handed to Request::onBodyChunk; body stays empty then
+  uint64_t streamedBytes = 0;
   
   Response() : statusCode(0), error(HTTPError::None) {}
   
@@ -49,5 +77,53 @@ struct Response {
   }
 };
 
+// Bytes moved so far; a total is 0 until it is known
+struct TransferProgress {
+  uint64_t downloaded = 0;
+  uint64_t downloadTotal = 0;
+  uint64_t uploaded = 0;
+  uint64_t uploadTotal = 0;
+};
+
+// A request body produced as it is sent, for bodies too large to hold in
+// memory. The size has to be known before the first byte goes out, since it
+// is sent as Content-Length.
+class BodySource {
+public:
+  virtual ~BodySource() = default;
+  virtual uint64_t size() const = 0;
+  // Copies the next bytes, at most capacity of them, into buffer. Returns
+  // how many, 0 once the body is complete, or -1 if it cannot be read.
+  virtual std::ptrdiff_t read(char* buffer, size_t capacity) = 0;
+  // Starts over from the first byte, for a request sent again after a
+  // redirect or a retry
+  virtual bool rewind() = 0;
+};
+
+// A request described up front, for APIs that take it whole or several at
+// once
+struct Request {
+  std::string method = "GET";
+  std::string url;
+  std::string body;
+  std::map<std::string, std::string> headers;
+  // Milliseconds the whole transfer may take; zero leaves it to the
+  // backend's setTimeout
+  int timeoutMs = 0;
+  
+  // Streaming: with onBodyChunk set, the response body is handed over piece
+  // by piece as it arrives instead of collected in Response::body, so memory
+  // stays at one buffer whatever the size. Returning false aborts the
+  // transfer. With uploadFile set, the request body is read from that file
+  // as it is sent, in place of body, and bodySource, when set, supplies it
+  // instead of either.
+  std::function<bool(const char* data, size_t size)> onBodyChunk;
+  std::string uploadFile;
+  std::shared_ptr<BodySource> bodySource;
+  std::function<void(const TransferProgress&)> onProgress;
+  
+  bool isStreaming() const { return onBodyChunk || !uploadFile.empty() || bodySource; }
+};
+
 }
 }
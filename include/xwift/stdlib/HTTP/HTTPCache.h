@@ -0,0 +1,106 @@
+#ifndef XWIFT_HTTP_HTTPCACHE_H
+#define XWIFT_HTTP_HTTPCACHE_H
+
+#include "xwift/stdlib/HTTP/HTTPPlugin.h"
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace xwift {
+namespace http {
+
+// Limits for CachingHTTPBackend. The defaults can be overridden with
+// XWIFT_HTTP_CACHE_BYTES and XWIFT_HTTP_CACHE_DIR.
+struct HTTPCacheOptions {
+  // Memory the cached responses may take, counting bodies as stored
+  // (compressed); zero keeps nothing in memory
+  size_t maxBytes = 32 * 1024 * 1024;
+  // Where responses are also written so they outlive the process; empty
+  // keeps them in memory only
+  std::string diskDirectory;
+  // Bodies at least this long are stored deflated when that saves space
+  size_t compressAbove = 1024;
+
+  static HTTPCacheOptions fromEnvironment();
+};
+
+struct HTTPCacheStats {
+  // Answered from the cache without touching the network
+  uint64_t hits = 0;
+  // Sent to the server because nothing usable was cached
+  uint64_t misses = 0;
+  // Stale entries the server confirmed with 304 Not Modified
+  uint64_t revalidations = 0;
+  // Entries and the memory they take right now
+  size_t entries = 0;
+  size_t bytes = 0;
+};
+
+// HTTP cache in front of another backend, after RFC 7234. GET responses
+// are kept in an LRU in memory and optionally on disk, and served while
+// fresh by Cache-Control max-age or Expires. Stale entries with an ETag or
+// Last-Modified are revalidated with If-None-Match or If-Modified-Since, so
+// an unchanged resource costs a 304 instead of its body. no-store responses
+// are never kept, no-cache ones are revalidated on every use, and POST, PUT
+// and DELETE drop what is cached for their URL. A response is served only
+// to requests sending the same values for the headers its Vary names.
+//
+// Every client in the process may share one cache, so it keeps nothing
+// meant for one of them: requests with Authorization or Cookie, set on
+// them or on the backend, bypass it, and private responses are not stored.
+// Safe to use from several threads at once.
+class CachingHTTPBackend : public IHTTPBackend {
+public:
+  CachingHTTPBackend(std::shared_ptr<IHTTPBackend> inner, HTTPCacheOptions options);
+  ~CachingHTTPBackend() override;
+
+  CachingHTTPBackend(const CachingHTTPBackend&) = delete;
+  CachingHTTPBackend& operator=(const CachingHTTPBackend&) = delete;
+
+  Result<Response> get(const std::string& url) override;
+  Result<Response> post(const std::string& url, const std::string& data) override;
+  Result<Response> put(const std::string& url, const std::string& data) override;
+  Result<Response> deleteRequest(const std::string& url) override;
+  Result<Response> send(const Request& request) override;
+  // Answers fresh hits from the cache and sends the rest to inner as one
+  // batch
+  std::vector<Result<Response>> sendAll(const std::vector<Request>& requests,
+                                        size_t maxConcurrent) override;
+  Result<Response> sendHedged(const Request& request, int delayMs, HedgeOutcome& outcome) override;
+
+  void setHeader(const std::string& key, const std::string& value) override;
+  void setTimeout(int milliseconds) override;
+
+  std::string getName() const override { return inner->getName(); }
+  std::string getVersion() const override { return inner->getVersion(); }
+
+  const std::shared_ptr<IHTTPBackend>& getInner() const { return inner; }
+  HTTPCacheStats stats() const;
+  // Forgets everything, on disk too
+  void clear();
+
+  // The cache every HTTPClient shares, in front of inner. Returns inner
+  // itself when the environment turns caching off.
+  static std::shared_ptr<IHTTPBackend> shared(std::shared_ptr<IHTTPBackend> inner);
+  // Counters of the shared cache; all zero before it is first used
+  static HTTPCacheStats sharedStats();
+
+private:
+  struct Store;
+  struct Pending;
+
+  // Answers request from the cache, or fills pending with what to send
+  std::optional<Result<Response>> begin(const Request& request, Pending& pending);
+  // Stores or revalidates from the response to what begin() said to send
+  Result<Response> complete(Pending& pending, Result<Response> result);
+
+  std::shared_ptr<IHTTPBackend> inner;
+  std::unique_ptr<Store> store;
+};
+
+}
+}
+
+#endif
@@ -3,12 +3,64 @@
 
 #include "xwift/Basic/Result.h"
 #include "xwift/stdlib/HTTP/HTTPBackend.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <string>
 #include <map>
+#include <vector>
 
 namespace xwift {
 namespace http {
 
+class MultipartBody;
+
+// When an HTTPClient sends a GET, HEAD, PUT, DELETE or OPTIONS again after
+// a network error or a 408, 429, 502, 503 or 504. Other methods, and
+// requests that stream their body, are sent once.
+struct RetryPolicy {
+  // Attempts per request, the first included; 1 never retries
+  int maxAttempts = 1;
+  // Backoff before retry n is drawn uniformly from [0, base * 2^n], capped
+  // at maxDelayMs, so clients that failed together do not retry together.
+  // A longer Retry-After from the server is honoured up to the cap.
+  int baseDelayMs = 50;
+  int maxDelayMs = 2000;
+  // Retry budget: every request earns budgetRatio of a retry and every
+  // retry spends one, holding at most budgetReserve. Retries stop when it
+  // runs dry, so an outage cannot multiply the load on the server.
+  double budgetRatio = 0.2;
+  double budgetReserve = 10;
+};
+
+// Hedging sends a second copy of a slow idempotent request and takes
+// whichever answers first; the other is cancelled. The copy goes out once
+// the first has taken longer than the client's recent latency percentile,
+// so only about the slowest 1 - percentile of requests cost double.
+// Hedged requests go through the cache and the backend like any other;
+// backends that cannot overlap requests send just the one copy.
+struct HedgePolicy {
+  bool enabled = false;
+  double percentile = 0.95;
+  // Delay used until minSamples latencies have been seen
+  int initialDelayMs = 100;
+  int minDelayMs = 10;
+  size_t minSamples = 20;
+};
+
+struct HTTPClientMetrics {
+  // Requests made through the client, however many attempts each took
+  uint64_t requests = 0;
+  uint64_t retries = 0;
+  // Retries skipped because the budget was spent
+  uint64_t retriesDenied = 0;
+  // Second copies sent, and how many of them answered first
+  uint64_t hedges = 0;
+  uint64_t hedgeWins = 0;
+  // How long a request may take before it is hedged right now
+  int hedgeDelayMs = 0;
+};
+
 class HTTPClient {
 public:
   HTTPClient();
@@ -20,12 +72,63 @@ public:
   Result<Response> postForm(const std::string& url, const std::map<std::string, std::string>& params);
   Result<Response> put(const std::string& url, const std::string& data);
   Result<Response> deleteRequest(const std::string& url);
+  // Any method; the request's headers apply to it alone
+  Result<Response> send(const Request& request);
   
+  // Writes the body of a GET to path as it arrives, so memory stays flat
+  // however large it is. The response comes back with an empty body and
+  // streamedBytes set. path is only replaced once the whole body is in and
+  // the status is 2xx; any other status comes back as is, path untouched.
+  Result<Response> download(const std::string& url, const std::string& path,
+                            std::function<void(const TransferProgress&)> onProgress = nullptr);
+  // Sends the file at path as the request body, read as it is sent
+  Result<Response> upload(const std::string& method, const std::string& url, const std::string& path);
+  // Posts body as multipart/form-data with its Content-Length, reading its
+  // files as they are sent
+  Result<Response> postMultipart(const std::string& url, std::shared_ptr<MultipartBody> body);
+  
+  // Sends every request at once, at most maxConcurrent in flight, and
+  // returns the results in request order, so the batch takes about as long
+  // as its slowest request. Each request fails or succeeds on its own.
+  // The batch goes through the same backend as send(), so headers set with
+  // setHeader, the cache and the per-host metrics all apply to it.
+  std::vector<Result<Response>> sendAll(const std::vector<Request>& requests,
+                                        size_t maxConcurrent = DefaultBatchConcurrency);
+  std::vector<Result<Response>> getAll(const std::vector<std::string>& urls,
+                                       size_t maxConcurrent = DefaultBatchConcurrency);
+  
+  // Sets the header on the backend, which every client in the process shares
   void setHeader(const std::string& key, const std::string& value);
+  // Applies to this client's requests only; each request carries it to the
+  // backend
   void setTimeout(int milliseconds);
+  // postJSON gzips bodies of at least this many bytes and sends them with
+  // Content-Encoding: gzip. Zero, the default unless XWIFT_HTTP_COMPRESS_ABOVE
+  // says otherwise, sends every body as is, since not every server takes
+  // compressed requests.
+  void setCompressRequestsAbove(size_t bytes) { compressAbove = bytes; }
+  
+  // Apply to every request the client sends, though only idempotent ones
+  // are retried or hedged. Copies of a client share their budget, latency
+  // samples and metrics.
+  void setRetryPolicy(const RetryPolicy& policy);
+  void setHedgePolicy(const HedgePolicy& policy);
+  HTTPClientMetrics metrics() const;
+  
+  static constexpr int DefaultTimeoutMs = 30000;
+  static constexpr size_t DefaultBatchConcurrency = 16;
   
 private:
+  struct Resilience;
+  
+  // Sends request through attempt, retrying and hedging as the policies say
+  Result<Response> execute(const Request& request, const std::function<Result<Response>()>& attempt);
+  Result<Response> hedged(const Request& request, int delayMs);
+  
   std::shared_ptr<IHTTPBackend> backend;
+  std::shared_ptr<Resilience> resilience;
+  int timeoutMs = DefaultTimeoutMs;
+  size_t compressAbove = 0;
 };
 
 }
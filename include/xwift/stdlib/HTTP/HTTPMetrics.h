@@ -0,0 +1,106 @@
+#ifndef XWIFT_HTTP_HTTPMETRICS_H
+#define XWIFT_HTTP_HTTPMETRICS_H
+
+#include "xwift/stdlib/HTTP/HTTPBackend.h"
+#include <array>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace xwift {
+namespace http {
+
+// Latencies counted into fixed buckets from half a millisecond to 30
+// seconds, growing roughly 1-2-5 per decade, so recording is a few compares
+// and percentiles are estimates good to within a bucket.
+class LatencyHistogram {
+public:
+  static constexpr size_t BucketCount = 16;
+  // Upper bound of each bucket but the last, which takes everything slower
+  static constexpr std::array<double, BucketCount - 1> Bounds = {
+    0.5, 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 30000
+  };
+
+  void record(double milliseconds);
+
+  uint64_t count() const { return Count; }
+  double meanMs() const { return Count ? SumMs / Count : 0; }
+  double maxMs() const { return MaxMs; }
+  // p from 0 to 1, interpolated within the bucket it falls in; 0 when empty
+  double percentileMs(double p) const;
+  const std::array<uint64_t, BucketCount>& buckets() const { return Buckets; }
+  // Adds other's samples, as if they had been recorded here
+  void merge(const LatencyHistogram& other);
+
+private:
+  std::array<uint64_t, BucketCount> Buckets{};
+  uint64_t Count = 0;
+  double SumMs = 0;
+  double MaxMs = 0;
+};
+
+struct HostMetrics {
+  // Requests that got a response, whatever its status, and ones that did not
+  uint64_t requests = 0;
+  uint64_t failures = 0;
+  // Responses that needed a new connection, rather than a pooled one
+  uint64_t newConnections = 0;
+  uint64_t bytesSent = 0;
+  uint64_t bytesReceived = 0;
+  LatencyHistogram total;
+  LatencyHistogram nameLookup;
+  LatencyHistogram connect;
+  LatencyHistogram tls;
+  LatencyHistogram firstByte;
+
+  void merge(const HostMetrics& other);
+};
+
+// Timings of every request the curl backends make, per host. Phases a
+// request skipped are not recorded, so connect and TLS describe the
+// handshakes that happened and requests minus newConnections is how often
+// the pool saved one. At most maxHosts hosts are kept apart; past that the
+// one least recently used is folded into OtherHosts, so a process talking
+// to many hosts keeps its memory bounded and its totals whole. Safe to use
+// from several threads at once.
+class HTTPMetrics {
+public:
+  static constexpr size_t DefaultMaxHosts = 256;
+  // The key hosts folded together are reported under
+  static constexpr const char* OtherHosts = "(other)";
+
+  explicit HTTPMetrics(size_t maxHosts = DefaultMaxHosts) : MaxHosts(maxHosts) {}
+
+  static HTTPMetrics& shared();
+
+  void record(const std::string& url, const Response& response);
+  void recordFailure(const std::string& url);
+
+  // Keyed by host, with the port when the URL names one
+  std::map<std::string, HostMetrics> snapshot() const;
+  void reset();
+
+  static std::string hostOf(const std::string& url);
+
+private:
+  using HostList = std::list<std::pair<std::string, HostMetrics>>;
+
+  // The metrics of host, made most recently used. Caller holds Mutex.
+  HostMetrics& touch(const std::string& host);
+
+  size_t MaxHosts;
+  mutable std::mutex Mutex;
+  // Most recently used first
+  HostList Hosts;
+  std::unordered_map<std::string, HostList::iterator> Index;
+  HostMetrics Others;
+  bool HasOthers = false;
+};
+
+}
+}
+
+#endif
@@ -3,11 +3,23 @@
 #include "xwift/Plugin/Plugin.h"
 #include "xwift/stdlib/HTTP/HTTP.h"
 #include "xwift/Basic/Result.h"
+#include "xwift/Basic/Error.h"
+#include <fstream>
+#include <iterator>
 #include <memory>
+#include <vector>
 
 namespace xwift {
 namespace http {
 
+// What IHTTPBackend::sendHedged did on the way to its answer
+struct HedgeOutcome {
+  // A second copy went out because the first was still unanswered
+  bool hedged = false;
+  // The second copy's answer was the one returned
+  bool hedgeWon = false;
+};
+
 class IHTTPBackend {
 public:
   virtual ~IHTTPBackend() = default;
@@ -16,6 +28,76 @@ public:
   virtual Result<Response> post(const std::string& url, const std::string& data) = 0;
   virtual Result<Response> put(const std::string& url, const std::string& data) = 0;
   virtual Result<Response> deleteRequest(const std::string& url) = 0;
+  // Any method, with headers and a timeout that apply to this request only.
+  // The default handles the four methods above and ignores the request's
+  // headers; it can only pass the timeout on through setTimeout, so it is
+  // not safe to share between threads with different timeouts. It buffers
+  // streamed bodies whole, so backends that can stream override it.
+  virtual Result<Response> send(const Request& request) {
+    if (request.timeoutMs > 0) {
+      setTimeout(request.timeoutMs);
+    }
+    std::string body = request.body;
+    if (request.bodySource) {
+      BodySource& source = *request.bodySource;
+      body.clear();
+      char buffer[16384];
+      std::ptrdiff_t read = source.rewind() ? 0 : -1;
+      while (read >= 0 && (read = source.read(buffer, sizeof(buffer))) > 0) {
+        body.append(buffer, static_cast<size_t>(read));
+      }
+      if (read < 0) {
+        return Result<Response>::err(Error::io("Failed to read request body"));
+      }
+    } else if (!request.uploadFile.empty()) {
+      std::ifstream file(request.uploadFile, std::ios::binary);
+      if (!file) {
+        return Result<Response>::err(Error::io("Cannot open upload file: " + request.uploadFile));
+      }
+      body.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    auto dispatch = [&]() {
+      if (request.method == "POST") {
+        return post(request.url, body);
+      } else if (request.method == "PUT") {
+        return put(request.url, body);
+      } else if (request.method == "DELETE") {
+        return deleteRequest(request.url);
+      }
+      return get(request.url);
+    };
+    Result<Response> result = dispatch();
+    if (result.is_ok() && request.onBodyChunk) {
+      Response& response = result.unwrap();
+      response.streamedBytes = response.body.size();
+      if (!request.onBodyChunk(response.body.data(), response.body.size())) {
+        return Result<Response>::err(Error::network("Download aborted"));
+      }
+      response.body.clear();
+    }
+    return result;
+  }
+  // Several requests, with at most maxConcurrent of them in flight; the
+  // results are in the order of requests. The default sends them one after
+  // another, so backends that can overlap transfers override it.
+  virtual std::vector<Result<Response>> sendAll(const std::vector<Request>& requests,
+                                                size_t maxConcurrent) {
+    (void)maxConcurrent;
+    std::vector<Result<Response>> results;
+    results.reserve(requests.size());
+    for (const Request& request : requests) {
+      results.push_back(send(request));
+    }
+    return results;
+  }
+  // Sends request, and a copy of it if no answer came within delayMs, and
+  // returns whichever answer comes first, cancelling the other copy. The
+  // default cannot overlap requests, so it sends the one copy.
+  virtual Result<Response> sendHedged(const Request& request, int delayMs, HedgeOutcome& outcome) {
+    (void)delayMs;
+    (void)outcome;
+    return send(request);
+  }
   virtual void setHeader(const std::string& key, const std::string& value) = 0;
   virtual void setTimeout(int milliseconds) = 0;
   
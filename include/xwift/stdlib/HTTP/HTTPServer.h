@@ -0,0 +1,150 @@
+#ifndef XWIFT_HTTP_HTTPSERVER_H
+#define XWIFT_HTTP_HTTPSERVER_H
+
+#include "xwift/Basic/Result.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace xwift {
+namespace http {
+
+struct ServerRequest {
+  std::string method;
+  // Path without the query, as sent (not percent-decoded)
+  std::string path;
+  std::string query;
+  std::vector<std::pair<std::string, std::string>> headers;
+  std::string body;
+  // Values of the route's :name and *name segments, in pattern order
+  std::vector<std::pair<std::string, std::string>> params;
+  // Index of the reactor thread handling the request, below
+  // ServerOptions::threads
+  size_t reactor = 0;
+
+  // Case-insensitive; "" when absent
+  std::string_view header(std::string_view name) const;
+  std::string_view param(std::string_view name) const;
+};
+
+struct ServerResponse {
+  int status = 200;
+  std::string contentType = "text/plain; charset=utf-8";
+  std::vector<std::pair<std::string, std::string>> headers;
+  std::string body;
+};
+
+using ServerHandler = std::function<void(const ServerRequest&, ServerResponse&)>;
+
+// Radix tree of route patterns. Static text is stored compressed, sharing
+// prefixes, so matching walks the path once; a segment ":name" matches one
+// path segment and a trailing "*name" the rest of the path. Static text
+// wins over a parameter, and a parameter over a catch-all, whatever the
+// order routes were added in.
+class Router {
+public:
+  Router();
+  ~Router();
+  Router(Router&&) noexcept;
+  Router& operator=(Router&&) noexcept;
+
+  // method "*" matches any method. Fails if the pattern is malformed or
+  // gives a parameter another name than an existing route at its position.
+  Result<bool> add(const std::string& method, const std::string& pattern, ServerHandler handler);
+
+  enum class Match { Found, NoRoute, WrongMethod };
+  // Fills params and handler on Found. allowed lists the methods of the
+  // route on WrongMethod, for the Allow header.
+  Match match(std::string_view method, std::string_view path,
+              std::vector<std::pair<std::string, std::string>>& params, const ServerHandler*& handler,
+              std::string* allowed = nullptr) const;
+
+private:
+  struct Node;
+  std::unique_ptr<Node> root;
+};
+
+struct ServerOptions {
+  // 0 picks a free port; HTTPServer::port() says which
+  int port = 0;
+  std::string host = "127.0.0.1";
+  // Reactor threads, each with its own epoll set and listening socket;
+  // 0 means one per core
+  size_t threads = 0;
+  size_t maxHeaderBytes = 16 * 1024;
+  size_t maxBodyBytes = 8 * 1024 * 1024;
+  // Keep-alive connections quiet for this long are closed
+  std::chrono::milliseconds idleTimeout{60000};
+};
+
+struct ServerStats {
+  uint64_t connectionsAccepted = 0;
+  uint64_t requests = 0;
+  size_t activeConnections = 0;
+};
+
+// Embedded HTTP/1.1 server. Each reactor thread accepts on its own
+// SO_REUSEPORT socket, so the kernel spreads connections over the cores,
+// and serves them from an edge-triggered epoll set without locks. Requests
+// on a keep-alive connection may be pipelined: everything read is parsed
+// and answered in order, and the responses go out with one writev, the
+// headers and each body as separate buffers so bodies are never copied.
+//
+// Handlers run on the reactor thread that read the request, so a slow one
+// holds up that reactor's other connections. Linux only; start() fails
+// elsewhere. Routes must be added before start().
+class HTTPServer {
+public:
+  explicit HTTPServer(ServerOptions options = ServerOptions());
+  // Stops the server if it is running
+  ~HTTPServer();
+
+  HTTPServer(const HTTPServer&) = delete;
+  HTTPServer& operator=(const HTTPServer&) = delete;
+
+  Result<bool> route(const std::string& method, const std::string& pattern, ServerHandler handler);
+
+  // Binds and starts the reactors; returns the port listened on
+  Result<int> start();
+  // Closes every connection and joins the reactors
+  void stop();
+  // Blocks until stop() is called, from another thread or a handler, then
+  // finishes stopping. stop() from a handler only asks the reactors to
+  // quit, since a reactor cannot join itself; wait() or the destructor
+  // completes it.
+  void wait();
+
+  bool running() const { return Running.load(); }
+  int port() const { return Port; }
+  size_t threads() const;
+  ServerStats stats() const;
+
+private:
+  struct Reactor;
+
+  ServerOptions Options;
+  Router Routes;
+  std::vector<std::unique_ptr<Reactor>> Reactors;
+  std::atomic<bool> Running{false};
+  int Port = 0;
+  // Serializes start() and stop(); StopRequested wakes wait()
+  std::mutex Lifecycle;
+  std::mutex StopMutex;
+  std::condition_variable StopSignal;
+  bool StopRequested = false;
+
+  void requestStop();
+};
+
+}
+}
+
+#endif
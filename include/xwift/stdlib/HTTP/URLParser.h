@@ -1,7 +1,10 @@
 #ifndef XWIFT_HTTP_URLPARSER_H
 #define XWIFT_HTTP_URLPARSER_H
 
+#include <cstddef>
+#include <iterator>
 #include <string>
+#include <string_view>
 #include <map>
 
 namespace xwift {
@@ -22,15 +25,93 @@ struct URL {
     bool isValid() const;
 };
 
+// One name=value pair of a query string, still percent-encoded. A pair
+// without '=' has an empty Value.
+struct QueryParam {
+    std::string_view Key;
+    std::string_view Value;
+};
+
+// Steps through the pairs of a query string as they are asked for, without
+// copying or decoding it. Empty pairs, as in "a=1&&b=2", are skipped.
+class QueryParamIterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = QueryParam;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const QueryParam*;
+    using reference = const QueryParam&;
+
+    QueryParamIterator() = default;
+    explicit QueryParamIterator(std::string_view query) : Rest(query), AtEnd(false) { advance(); }
+
+    reference operator*() const { return Current; }
+    pointer operator->() const { return &Current; }
+    QueryParamIterator& operator++() { advance(); return *this; }
+    QueryParamIterator operator++(int) { QueryParamIterator old = *this; advance(); return old; }
+
+    bool operator==(const QueryParamIterator& other) const {
+        return AtEnd == other.AtEnd && (AtEnd || Current.Key.data() == other.Current.Key.data());
+    }
+    bool operator!=(const QueryParamIterator& other) const { return !(*this == other); }
+
+private:
+    void advance();
+
+    std::string_view Rest;
+    QueryParam Current;
+    bool AtEnd = true;
+};
+
+struct QueryParamRange {
+    std::string_view Query;
+
+    QueryParamIterator begin() const { return QueryParamIterator(Query); }
+    QueryParamIterator end() const { return QueryParamIterator(); }
+};
+
+// A URL taken apart in place: every component is a view into the string
+// it was parsed from, which has to outlive it. Nothing is allocated, copied
+// or decoded, so checking and splitting many URLs costs one pass over each.
+struct URLView {
+    std::string_view Scheme;
+    std::string_view Host;
+    // The explicit port, else 80 or 443 for http and https, else 0
+    int Port = 0;
+    std::string_view Path;
+    std::string_view Query;
+    std::string_view Fragment;
+
+    bool isValid() const { return !Host.empty(); }
+    // Offset of a component from the start of source, the string parsed
+    static size_t offsetOf(std::string_view component, std::string_view source) {
+        return static_cast<size_t>(component.data() - source.data());
+    }
+    QueryParamRange queryParams() const { return QueryParamRange{Query}; }
+};
+
 class URLParser {
 public:
     static URL parse(const std::string& url);
     
-private:
-    static void parseQuery(const std::string& query, std::map<std::string, std::string>& params);
-    static std::string decodeURIComponent(const std::string& str);
+    // scheme://host[:port][/path][?query][#fragment], as parse accepts;
+    // anything else gives a view that is not valid
+    static URLView parseView(std::string_view url);
 };
 
+// Percent-encoding after RFC 3986: every byte but the unreserved
+// characters A-Z a-z 0-9 - . _ ~ becomes %XX. Runs that need no escaping
+// are found 16 or 32 bytes at a time with SSE2 or AVX2 when the CPU has
+// them, and byte by byte elsewhere.
+std::string percentEncode(std::string_view text);
+void percentEncode(std::string_view text, std::string& out);
+
+// Undoes percentEncode, and turns '+' into a space when plusAsSpace, as
+// form bodies and query strings need. A '%' not followed by two hex digits
+// is kept as it is.
+std::string percentDecode(std::string_view text, bool plusAsSpace = false);
+void percentDecode(std::string_view text, std::string& out, bool plusAsSpace = false);
+
 }
 }
 
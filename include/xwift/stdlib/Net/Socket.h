@@ -0,0 +1,228 @@
+#ifndef XWIFT_STDLIB_NET_SOCKET_H
+#define XWIFT_STDLIB_NET_SOCKET_H
+
+#include "xwift/Basic/Result.h"
+#include "xwift/stdlib/Concurrency/EventLoop.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+namespace xwift {
+namespace net {
+
+// A numeric address and port, as a socket is bound or connected to or a
+// datagram came from. Host names are resolved when an endpoint is used.
+struct Endpoint {
+    std::string host;
+    int port = 0;
+};
+
+struct Datagram {
+    std::string data;
+    Endpoint peer;
+};
+
+// Bytes read from a stream and not yet handed out, taken whole, by line or
+// by length-prefixed frame. Taking from the front only moves an offset; the
+// taken bytes are dropped once they are most of the buffer, so reading many
+// small messages stays linear.
+class StreamBuffer {
+public:
+    // A frame announcing more than this, or a line running longer without
+    // its newline, is refused rather than buffered
+    static constexpr size_t MaxFrameBytes = 64 * 1024 * 1024;
+
+    void append(const char* data, size_t size);
+    size_t size() const { return Data.size() - Start; }
+    bool empty() const { return size() == 0; }
+
+    // Up to max of the buffered bytes
+    std::string take(size_t max);
+    // The next line without its "\n" or "\r\n", once its newline is in
+    std::optional<std::string> takeLine();
+    // The next frame, a 4-byte big-endian length and then that many bytes,
+    // once all of it is in. Sets tooLarge instead for a length above
+    // MaxFrameBytes.
+    std::optional<std::string> takeFrame(bool& tooLarge);
+    // The length prefix to send before a frame of length bytes
+    static std::string framePrefix(size_t length);
+
+private:
+    void consume(size_t count);
+
+    std::string Data;
+    size_t Start = 0;
+};
+
+// A connected TCP socket, non-blocking and serviced by an EventLoop with
+// TCP_NODELAY set. Reads and writes may be started from any thread; each
+// kind completes on the loop thread in the order it was started, so the
+// callbacks must not block. All reads share one StreamBuffer, so a line
+// read after a raw read starts where the raw read stopped. Writes queued
+// while the socket is busy go out together in one sendmsg.
+class TCPStream : public std::enable_shared_from_this<TCPStream> {
+public:
+    // nullopt once the peer has closed and everything before it was read
+    using ReadCallback = std::function<void(Result<std::optional<std::string>>)>;
+    using WriteCallback = std::function<void(Result<size_t>)>;
+    using ConnectCallback = std::function<void(Result<std::shared_ptr<TCPStream>>)>;
+
+    // Resolves host on the calling thread, then connects on the loop
+    static void connect(EventLoop& loop, const std::string& host, int port, ConnectCallback done);
+
+    // Takes over fd, which must be connected and non-blocking
+    TCPStream(EventLoop& loop, int fd, Endpoint peer);
+    ~TCPStream();
+
+    TCPStream(const TCPStream&) = delete;
+    TCPStream& operator=(const TCPStream&) = delete;
+
+    // Whatever is buffered or arrives next, at most maxBytes
+    void read(size_t maxBytes, ReadCallback done);
+    void readLine(ReadCallback done);
+    void readFrame(ReadCallback done);
+    // done gets data's size once all of it is with the kernel
+    void write(std::string data, WriteCallback done);
+    void writeFrame(const std::string& payload, WriteCallback done);
+    // Fails the reads and writes still queued and closes the socket
+    void close();
+
+    const Endpoint& peer() const { return Peer; }
+    int localPort() const;
+
+private:
+    enum class Framing { Raw, Line, Frame };
+    struct PendingRead {
+        Framing How;
+        size_t MaxBytes;
+        ReadCallback Done;
+    };
+    struct PendingWrite {
+        std::string Data;
+        size_t Offset;
+        WriteCallback Done;
+    };
+
+    // Loop thread only
+    void pump();
+    void deliver();
+    void readSome();
+    void flush();
+    void fail(const Error& error);
+
+    EventLoop* Loop;
+    int Fd;
+    Endpoint Peer;
+    // Loop thread only
+    StreamBuffer Buffer;
+    std::deque<PendingRead> Readers;
+    std::deque<PendingWrite> Writers;
+    uint32_t Watched = 0;
+    bool AtEnd = false;
+    bool Closed = false;
+};
+
+// A listening TCP socket. Connections are accepted on the loop as accept()
+// asks for them; those already queued by the kernel are taken at once.
+class TCPListener : public std::enable_shared_from_this<TCPListener> {
+public:
+    using AcceptCallback = std::function<void(Result<std::shared_ptr<TCPStream>>)>;
+
+    // Binds and listens before returning. Port 0 picks a free port, which
+    // localPort() then tells.
+    static Result<std::shared_ptr<TCPListener>> listen(EventLoop& loop, const std::string& host, int port,
+                                                       int backlog = 128);
+
+    TCPListener(EventLoop& loop, int fd) : Loop(&loop), Fd(fd) {}
+    ~TCPListener();
+
+    TCPListener(const TCPListener&) = delete;
+    TCPListener& operator=(const TCPListener&) = delete;
+
+    void accept(AcceptCallback done);
+    // Fails the accepts still queued and stops listening
+    void close();
+
+    int localPort() const;
+
+private:
+    // Loop thread only
+    void pump();
+
+    EventLoop* Loop;
+    int Fd;
+    // Loop thread only
+    std::deque<AcceptCallback> Acceptors;
+    bool Watching = false;
+    bool Closed = false;
+};
+
+// A bound UDP socket. Sending never waits: a datagram the kernel has no
+// room for fails. Batches go out with one sendmmsg and come in with one
+// recvmmsg, so a burst of small datagrams costs a system call, not one
+// each.
+class UDPSocket : public std::enable_shared_from_this<UDPSocket> {
+public:
+    using ReceiveCallback = std::function<void(Result<std::vector<Datagram>>)>;
+
+    // At most this many datagrams are taken by one receive
+    static constexpr size_t MaxBatch = 16;
+    // Longer datagrams are cut to this
+    static constexpr size_t MaxDatagramBytes = 65536;
+
+    // The address family follows host, so "::1" gives an IPv6 socket
+    static Result<std::shared_ptr<UDPSocket>> bind(EventLoop& loop, const std::string& host, int port);
+
+    UDPSocket(EventLoop& loop, int fd, int family) : Loop(&loop), Fd(fd), Family(family) {}
+    ~UDPSocket();
+
+    UDPSocket(const UDPSocket&) = delete;
+    UDPSocket& operator=(const UDPSocket&) = delete;
+
+    // May be called from any thread
+    Result<size_t> sendTo(const std::string& data, const Endpoint& to);
+    // Returns how many of the datagrams were sent, from the first; fewer
+    // than all when the kernel's buffer fills
+    Result<size_t> sendBatch(const std::vector<Datagram>& datagrams);
+    // Waits for at least one datagram, then hands over up to max of those
+    // that have arrived
+    void receive(size_t max, ReceiveCallback done);
+    // Fails the receives still queued and closes the socket
+    void close();
+
+    int localPort() const;
+
+private:
+    struct PendingReceive {
+        size_t Max;
+        ReceiveCallback Done;
+    };
+
+    // Loop thread only
+    void pump();
+
+    EventLoop* Loop;
+    // Sends and localPort run on any thread while close runs on the loop;
+    // they hold this shared and close holds it alone, so a send in flight
+    // never reaches a descriptor number that was closed and reused
+    mutable std::shared_mutex FdMutex;
+    int Fd;
+    int Family;
+    // Loop thread only
+    std::deque<PendingReceive> Receivers;
+    // MaxBatch slots of MaxDatagramBytes, allocated on the first receive
+    std::vector<char> Slots;
+    bool Watching = false;
+    bool Closed = false;
+};
+
+}
+}
+
+#endif
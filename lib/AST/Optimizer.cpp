@@ -21,6 +21,38 @@ void Optimizer::optimize(Program* program) {
     OptimizationPasses++;
 }
 
+void Optimizer::applyProfile(Program* program, const TypeProfile& profile) {
+    if (!program) {
+        return;
+    }
+    
+    // Only binary operators are sites. Call sites need no profile: the
+    // interpreter's inline cache fills on a site's first call.
+    auto sites = TypeProfile::numberSites(program);
+    for (size_t id = 1; id < sites.size(); id++) {
+        const TypeProfile::Site* site = profile.lookup(static_cast<uint32_t>(id));
+        if (!site || site->Count < TypeProfile::HotThreshold) {
+            continue;
+        }
+        
+        if (auto binary = dynamic_cast<BinaryExpr*>(sites[id])) {
+            bool arithmetic = binary->Op == "+" || binary->Op == "-" ||
+                              binary->Op == "*" || binary->Op == "/";
+            bool comparison = binary->Op == "==" || binary->Op == "!=" ||
+                              binary->Op == "<" || binary->Op == ">" ||
+                              binary->Op == "<=" || binary->Op == ">=";
+            if (!arithmetic && !comparison) {
+                continue;
+            }
+            if (site->LHSKinds == TypeProfile::KindInt && site->RHSKinds == TypeProfile::KindInt) {
+                binary->SpeculatedKind = Expr::EvalKind::Int64;
+            } else if (site->LHSKinds == TypeProfile::KindDouble && site->RHSKinds == TypeProfile::KindDouble) {
+                binary->SpeculatedKind = Expr::EvalKind::Double;
+            }
+        }
+    }
+}
+
 void Optimizer::optimizeDecl(Decl* decl) {
     if (!decl) {
         return;
@@ -66,6 +98,9 @@ void Optimizer::optimizeStmt(Stmt* stmt) {
         optimizeExpr(forStmt->Step.get());
         optimizeStmt(forStmt->Body.get());
         loopOptimization(forStmt);
+    } else if (auto groupStmt = dynamic_cast<TaskGroupStmt*>(stmt)) {
+        optimizeExpr(groupStmt->Timeout.get());
+        optimizeStmt(groupStmt->Body.get());
     } else if (auto block = dynamic_cast<BlockStmt*>(stmt)) {
         for (auto& s : block->Statements) {
             optimizeStmt(s.get());
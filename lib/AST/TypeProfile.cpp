@@ -0,0 +1,226 @@
+#include "xwift/AST/TypeProfile.h"
+#include "xwift/AST/Nodes.h"
+#include <fstream>
+#include <sstream>
+
+namespace xwift {
+
+namespace {
+
+class SiteNumberer {
+public:
+    std::vector<Stmt*> Sites{nullptr};
+
+    uint32_t assign(Stmt* site) {
+        Sites.push_back(site);
+        return static_cast<uint32_t>(Sites.size() - 1);
+    }
+
+    void walkDecl(Decl* decl) {
+        if (!decl) {
+            return;
+        }
+
+        if (auto func = dynamic_cast<FuncDecl*>(decl)) {
+            walkStmt(func->Body.get());
+        } else if (auto var = dynamic_cast<VarDeclStmt*>(decl)) {
+            walkExpr(var->Init.get());
+        } else if (auto cls = dynamic_cast<ClassDecl*>(decl)) {
+            for (auto& member : cls->Members) {
+                walkDecl(member.get());
+            }
+        } else if (auto st = dynamic_cast<StructDecl*>(decl)) {
+            for (auto& member : st->Members) {
+                walkDecl(member.get());
+            }
+        } else if (auto prop = dynamic_cast<PropertyDecl*>(decl)) {
+            walkExpr(prop->Initializer.get());
+        } else if (auto method = dynamic_cast<MethodDecl*>(decl)) {
+            walkStmt(method->Body.get());
+        } else if (auto ctor = dynamic_cast<ConstructorDecl*>(decl)) {
+            walkStmt(ctor->Body.get());
+        }
+    }
+
+    void walkStmt(Stmt* stmt) {
+        if (!stmt) {
+            return;
+        }
+
+        if (auto decl = dynamic_cast<Decl*>(stmt)) {
+            walkDecl(decl);
+        } else if (auto expr = dynamic_cast<Expr*>(stmt)) {
+            walkExpr(expr);
+        } else if (auto ret = dynamic_cast<ReturnStmt*>(stmt)) {
+            walkExpr(ret->Value.get());
+        } else if (auto ifStmt = dynamic_cast<IfStmt*>(stmt)) {
+            walkExpr(ifStmt->Condition.get());
+            walkStmt(ifStmt->ThenBranch.get());
+            walkStmt(ifStmt->ElseBranch.get());
+        } else if (auto ifLet = dynamic_cast<IfLetStmt*>(stmt)) {
+            walkExpr(ifLet->OptionalExpr.get());
+            walkStmt(ifLet->ThenBranch.get());
+            walkStmt(ifLet->ElseBranch.get());
+        } else if (auto guard = dynamic_cast<GuardStmt*>(stmt)) {
+            walkExpr(guard->OptionalExpr.get());
+            walkStmt(guard->ElseBranch.get());
+        } else if (auto whileStmt = dynamic_cast<WhileStmt*>(stmt)) {
+            walkExpr(whileStmt->Condition.get());
+            walkStmt(whileStmt->Body.get());
+        } else if (auto forStmt = dynamic_cast<ForStmt*>(stmt)) {
+            walkExpr(forStmt->Start.get());
+            walkExpr(forStmt->End.get());
+            walkExpr(forStmt->Step.get());
+            walkStmt(forStmt->Body.get());
+        } else if (auto groupStmt = dynamic_cast<TaskGroupStmt*>(stmt)) {
+            walkExpr(groupStmt->Timeout.get());
+            walkStmt(groupStmt->Body.get());
+        } else if (auto switchStmt = dynamic_cast<SwitchStmt*>(stmt)) {
+            walkExpr(switchStmt->Condition.get());
+            for (auto& casePair : switchStmt->Cases) {
+                for (auto& pattern : casePair.first) {
+                    walkExpr(pattern.get());
+                }
+                walkStmt(casePair.second.get());
+            }
+        } else if (auto block = dynamic_cast<BlockStmt*>(stmt)) {
+            for (auto& s : block->Statements) {
+                walkStmt(s.get());
+            }
+        }
+    }
+
+    void walkExpr(Expr* expr) {
+        if (!expr) {
+            return;
+        }
+
+        if (auto binary = dynamic_cast<BinaryExpr*>(expr)) {
+            binary->ProfileSite = assign(binary);
+            walkExpr(binary->LHS.get());
+            walkExpr(binary->RHS.get());
+        } else if (auto call = dynamic_cast<CallExpr*>(expr)) {
+            for (auto& arg : call->Args) {
+                walkExpr(arg.get());
+            }
+        } else if (auto member = dynamic_cast<MemberAccessExpr*>(expr)) {
+            walkExpr(member->Object.get());
+        } else if (auto assignExpr = dynamic_cast<AssignExpr*>(expr)) {
+            walkExpr(assignExpr->Target.get());
+            walkExpr(assignExpr->Value.get());
+        } else if (auto arr = dynamic_cast<ArrayLiteralExpr*>(expr)) {
+            for (auto& elem : arr->Elements) {
+                walkExpr(elem.get());
+            }
+        } else if (auto arrIdx = dynamic_cast<ArrayIndexExpr*>(expr)) {
+            walkExpr(arrIdx->Array.get());
+            walkExpr(arrIdx->Index.get());
+        } else if (auto unwrap = dynamic_cast<OptionalUnwrapExpr*>(expr)) {
+            walkExpr(unwrap->Target.get());
+        } else if (auto chain = dynamic_cast<OptionalChainExpr*>(expr)) {
+            walkExpr(chain->Target.get());
+            for (auto& arg : chain->CallArgs) {
+                walkExpr(arg.get());
+            }
+        } else if (auto ctorCall = dynamic_cast<ConstructorCallExpr*>(expr)) {
+            for (auto& arg : ctorCall->Args) {
+                walkExpr(arg.get());
+            }
+        }
+    }
+};
+
+}
+
+std::vector<Stmt*> TypeProfile::numberSites(Program* program) {
+    SiteNumberer numberer;
+    if (program) {
+        for (auto& decl : program->Declarations) {
+            numberer.walkDecl(decl.get());
+        }
+    }
+    return std::move(numberer.Sites);
+}
+
+uint64_t TypeProfile::hashSource(const std::string& source) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : source) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+std::string TypeProfile::pathFor(const std::string& sourceFile) {
+    std::string base = sourceFile;
+    size_t dot = base.find_last_of('.');
+    size_t slash = base.find_last_of("/\\");
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+        base = base.substr(0, dot);
+    }
+    return base + ".xwprofile";
+}
+
+void TypeProfile::reset(size_t siteCount) {
+    Sites.assign(siteCount, Site());
+}
+
+// Format: a "xwprofile <version> <source hash> <site count>" header, then
+// one "<id> <count> <lhs kinds> <rhs kinds>" line per site that was hit. A header mismatch discards the whole file.
+bool TypeProfile::load(const std::string& path, uint64_t sourceHash) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    std::string magic;
+    unsigned version = 0;
+    uint64_t hash = 0;
+    size_t siteCount = 0;
+    if (!(file >> magic >> version >> hash >> siteCount) || magic != "xwprofile" ||
+        version != FormatVersion || hash != sourceHash || siteCount != Sites.size()) {
+        return false;
+    }
+
+    std::string line;
+    std::getline(file, line);
+    while (std::getline(file, line)) {
+        std::istringstream iss(line);
+        uint32_t id = 0;
+        unsigned lhs = 0, rhs = 0;
+        Site site;
+        if (!(iss >> id >> site.Count >> lhs >> rhs)) {
+            continue;
+        }
+        if (id == 0 || id >= Sites.size()) {
+            continue;
+        }
+        site.LHSKinds = static_cast<uint16_t>(lhs);
+        site.RHSKinds = static_cast<uint16_t>(rhs);
+        Sites[id] = site;
+    }
+
+    return true;
+}
+
+bool TypeProfile::save(const std::string& path, uint64_t sourceHash) const {
+    std::ofstream file(path, std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    file << "xwprofile " << FormatVersion << " " << sourceHash << " " << Sites.size() << "\n";
+    for (size_t id = 1; id < Sites.size(); id++) {
+        const Site& site = Sites[id];
+        if (site.Count == 0) {
+            continue;
+        }
+        file << id << " " << site.Count << " "
+             << static_cast<unsigned>(site.LHSKinds) << " "
+             << static_cast<unsigned>(site.RHSKinds) << "\n";
+    }
+
+    return file.good();
+}
+
+}
@@ -0,0 +1,28 @@
+#include "xwift/Basic/StringInterner.h"
+
+namespace xwift {
+
+StringInterner& StringInterner::getInstance() {
+  static StringInterner instance;
+  return instance;
+}
+
+const std::string* StringInterner::intern(const std::string& str) {
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = strings.find(str);
+    if (it != strings.end()) {
+      return &*it;
+    }
+  }
+  std::unique_lock<std::shared_mutex> lock(mutex);
+  // unordered_set nodes never move, so element addresses survive rehashing
+  return &*strings.insert(str).first;
+}
+
+size_t StringInterner::size() const {
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  return strings.size();
+}
+
+}
@@ -0,0 +1,112 @@
+#include "xwift/Interpreter/Isolate.h"
+#include "xwift/Interpreter/Interpreter.h"
+#include "xwift/AST/Optimizer.h"
+#include "xwift/Sema/Sema.h"
+#include <sstream>
+
+namespace xwift {
+
+IsolateResult Isolate::run(const std::string& source) {
+  IsolateResult result;
+  std::ostringstream output;
+  std::ostringstream diagnostics;
+
+  try {
+    Lexer lexer(source);
+    SyntaxParser parser(lexer);
+    auto program = parser.parseProgram();
+
+    DiagnosticEngine diag;
+    diag.setOutput(diagnostics);
+    diag.setFilename(Name);
+    diag.setSourceCode(source);
+
+    Sema sema(diag);
+    sema.setFilename(Name);
+    if (sema.visit(program.get()) && !diag.hasErrors()) {
+      Optimizer optimizer;
+      optimizer.optimize(program.get());
+
+      Interpreter interpreter(diag);
+      interpreter.setFilename(Name);
+      interpreter.setOutput(output);
+      interpreter.run(program.get());
+
+      result.Success = !diag.hasErrors();
+    }
+  } catch (const DiagnosticError& e) {
+    diagnostics << Name << ":" << e.Line << ":" << e.Column << ": error: " << e.Message << "\n";
+  } catch (const std::exception& e) {
+    diagnostics << Name << ":1:1: error: " << e.what() << "\n";
+  }
+
+  result.Output = output.str();
+  result.Diagnostics = diagnostics.str();
+  return result;
+}
+
+IsolatePool::IsolatePool(size_t threadCount) {
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (size_t i = 0; i < threadCount; i++) {
+    Workers.emplace_back(&IsolatePool::workerLoop, this);
+  }
+}
+
+IsolatePool::~IsolatePool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    Stopping = true;
+  }
+  condition.notify_all();
+  for (auto& worker : Workers) {
+    worker.join();
+  }
+}
+
+std::future<IsolateResult> IsolatePool::submit(const std::string& source,
+                                               const std::string& name) {
+  auto task = std::make_shared<std::packaged_task<IsolateResult()>>(
+    [source, name]() { return Isolate(name).run(source); });
+  auto future = task->get_future();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    Jobs.push([task]() { (*task)(); });
+  }
+  condition.notify_one();
+  return future;
+}
+
+std::vector<IsolateResult> IsolatePool::runAll(const std::vector<std::string>& sources) {
+  std::vector<std::future<IsolateResult>> futures;
+  futures.reserve(sources.size());
+  for (size_t i = 0; i < sources.size(); i++) {
+    futures.push_back(submit(sources[i], "<isolate " + std::to_string(i) + ">"));
+  }
+
+  std::vector<IsolateResult> results;
+  results.reserve(futures.size());
+  for (auto& future : futures) {
+    results.push_back(future.get());
+  }
+  return results;
+}
+
+void IsolatePool::workerLoop() {
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      condition.wait(lock, [this] { return Stopping || !Jobs.empty(); });
+      if (Jobs.empty()) {
+        return;
+      }
+      job = std::move(Jobs.front());
+      Jobs.pop();
+    }
+    job();
+  }
+}
+
+}
@@ -2,21 +2,12 @@
 
 namespace xwift {
 
-std::unordered_map<std::string, TokenKind> Lexer::Keywords;
-std::unordered_map<std::string, TokenKind> Lexer::Operators;
-bool Lexer::IsInitialized = false;
-
 Lexer::Lexer(const StringRef& buffer) 
   : Buffer(buffer), CurrentIndex(0), BufferStart(0), BufferEnd(buffer.size()),
-    CurLine(1), CurCol(1), hasPeeked(false) {
-  if (!IsInitialized) {
-    initKeywords();
-    IsInitialized = true;
-  }
-}
+    CurLine(1), CurCol(1), hasPeeked(false) {}
 
-void Lexer::initKeywords() {
-  Keywords = {
+const std::unordered_map<std::string, TokenKind>& Lexer::getKeywords() {
+  static const std::unordered_map<std::string, TokenKind> Keywords = {
     {"func", TokenKind::kw_func},
     {"var", TokenKind::kw_var},
     {"let", TokenKind::kw_let},
@@ -92,6 +83,7 @@ void Lexer::initKeywords() {
     {"get", TokenKind::kw_get},
     {"set", TokenKind::kw_set},
     {"actor", TokenKind::kw_actor},
+    {"taskGroup", TokenKind::kw_taskGroup},
     {"nonisolated", TokenKind::kw_nonisolated},
     {"isolated", TokenKind::kw_isolated},
     {"macro", TokenKind::kw_macro},
@@ -99,8 +91,11 @@ void Lexer::initKeywords() {
     {"alias", TokenKind::kw_alias},
     {"each", TokenKind::kw_each},
   };
-  
-  Operators = {
+  return Keywords;
+}
+
+const std::unordered_map<std::string, TokenKind>& Lexer::getOperators() {
+  static const std::unordered_map<std::string, TokenKind> Operators = {
     {"+", TokenKind::op_plus},
     {"-", TokenKind::op_minus},
     {"*", TokenKind::op_star},
@@ -126,6 +121,7 @@ void Lexer::initKeywords() {
     {"??", TokenKind::op_dot_question},
     {"!", TokenKind::op_bang},
   };
+  return Operators;
 }
 
 char Lexer::peekChar() const {
@@ -215,12 +211,15 @@ Token Lexer::lexIdentifier() {
   SourceLocation loc = getCurLocation();
   loc.Col -= (CurrentIndex - start);
   
-  auto it = Keywords.find(text);
-  if (it != Keywords.end()) {
+  const auto& keywords = getKeywords();
+  auto it = keywords.find(text);
+  if (it != keywords.end()) {
     return Token(it->second, loc, CurrentIndex - start, text);
   }
   
-  return Token(TokenKind::Identifier, loc, CurrentIndex - start, text);
+  Token token(TokenKind::Identifier, loc, CurrentIndex - start, text);
+  token.Name = Atom(token.Text);
+  return token;
 }
 
 Token Lexer::lexNumber() {
@@ -364,8 +363,9 @@ Token Lexer::lexOperator() {
   loc.Col -= (CurrentIndex - start);
   StringRef text = Buffer.substr(start, CurrentIndex - start);
   
-  auto it = Operators.find(text);
-  if (it != Operators.end()) {
+  const auto& operators = getOperators();
+  auto it = operators.find(text);
+  if (it != operators.end()) {
     return Token(it->second, loc, CurrentIndex - start, text);
   }
   
@@ -253,6 +253,10 @@ void Logger::log(LogLevel lvl, const std::string& message,
   entry.function = function;
   entry.timestamp = std::chrono::system_clock::now();
   
+  write(entry);
+}
+
+void Logger::write(const LogEntry& entry) {
   std::lock_guard<std::mutex> lock(mutex);
   for (auto& appender : appenders) {
     appender->append(entry);
@@ -310,7 +314,8 @@ std::string Logger::levelToString(LogLevel lvl) const {
 }
 
 bool Logger::shouldLog(LogLevel lvl) const {
-  return lvl >= level && level != LogLevel::Off;
+  LogLevel current = level.load(std::memory_order_relaxed);
+  return lvl >= current && current != LogLevel::Off;
 }
 
 }
@@ -46,17 +46,17 @@ std::unique_ptr<Decl> SyntaxParser::parseImportDeclaration() {
 std::unique_ptr<FuncDecl> SyntaxParser::parseFunctionDeclaration() {
   consume(TokenKind::kw_func);
   
-  std::string name = CurrentToken.Text;
+  Atom name = CurrentToken.Name;
   expect(TokenKind::Identifier);
   
   expect(TokenKind::punct_l_paren);
   
-  std::vector<std::pair<std::string, std::string>> params;
+  std::vector<std::pair<Atom, std::string>> params;
   while (!CurrentToken.is(TokenKind::punct_r_paren)) {
     if (!params.empty()) {
       consume(TokenKind::punct_comma);
     }
-    std::string paramName = CurrentToken.Text;
+    Atom paramName = CurrentToken.Name;
     expect(TokenKind::Identifier);
     std::string paramType = "Any";
     if (CurrentToken.is(TokenKind::punct_colon)) {
@@ -113,7 +113,7 @@ std::unique_ptr<VarDeclStmt> SyntaxParser::parseVariableDeclaration() {
   bool isMutable = CurrentToken.is(TokenKind::kw_var);
   advance();
   
-  std::string name = CurrentToken.Text;
+  Atom name = CurrentToken.Name;
   expect(TokenKind::Identifier);
   
   std::string type;
@@ -161,6 +161,10 @@ std::unique_ptr<Stmt> SyntaxParser::parseStatement() {
     return parseForStatement();
   }
   
+  if (CurrentToken.is(TokenKind::kw_taskGroup)) {
+    return parseTaskGroupStatement();
+  }
+  
   if (CurrentToken.is(TokenKind::kw_switch)) {
     return parseSwitchStatement();
   }
@@ -203,7 +207,7 @@ std::unique_ptr<Stmt> SyntaxParser::parseIfLetStatement() {
   consume(TokenKind::kw_if);
   consume(TokenKind::kw_let);
   
-  std::string varName = CurrentToken.Text;
+  Atom varName = CurrentToken.Name;
   expect(TokenKind::Identifier);
   
   consume(TokenKind::punct_eq);
@@ -226,7 +230,7 @@ std::unique_ptr<Stmt> SyntaxParser::parseGuardStatement() {
   consume(TokenKind::kw_guard);
   consume(TokenKind::kw_let);
   
-  std::string varName = CurrentToken.Text;
+  Atom varName = CurrentToken.Name;
   expect(TokenKind::Identifier);
   
   consume(TokenKind::punct_eq);
@@ -250,13 +254,28 @@ std::unique_ptr<Stmt> SyntaxParser::parseWhileStatement() {
   return std::make_unique<WhileStmt>(std::move(cond), std::move(body));
 }
 
+std::unique_ptr<Stmt> SyntaxParser::parseTaskGroupStatement() {
+  consume(TokenKind::kw_taskGroup);
+  
+  ExprPtr timeout;
+  if (CurrentToken.is(TokenKind::punct_l_paren)) {
+    advance();
+    timeout = parseExpression();
+    expect(TokenKind::punct_r_paren);
+  }
+  
+  auto body = parseBlock();
+  
+  return std::make_unique<TaskGroupStmt>(std::move(timeout), std::move(body));
+}
+
 std::unique_ptr<Stmt> SyntaxParser::parseForStatement() {
   consume(TokenKind::kw_for);
   expect(TokenKind::punct_l_paren);
   
-  std::string varName;
+  Atom varName;
   if (CurrentToken.is(TokenKind::Identifier)) {
-    varName = CurrentToken.Text;
+    varName = CurrentToken.Name;
     advance();
   }
   
@@ -394,7 +413,7 @@ std::unique_ptr<Expr> SyntaxParser::parsePrimaryExpression() {
   }
   
   if (CurrentToken.is(TokenKind::Identifier)) {
-    std::string name = CurrentToken.Text;
+    Atom name = CurrentToken.Name;
     auto loc = CurrentToken.Loc;
     advance();
     
@@ -433,7 +452,25 @@ std::unique_ptr<Expr> SyntaxParser::parsePrimaryExpression() {
     advance();
     return std::make_unique<NilLiteralExpr>(loc);
   }
-  
+
+  if (CurrentToken.is(TokenKind::kw_async)) {
+    auto loc = CurrentToken.Loc;
+    advance();
+    return std::make_unique<AsyncExpr>(parsePostfixExpression(), loc);
+  }
+
+  if (CurrentToken.is(TokenKind::kw_actor)) {
+    auto loc = CurrentToken.Loc;
+    advance();
+    return std::make_unique<ActorExpr>(parsePostfixExpression(), loc);
+  }
+
+  if (CurrentToken.is(TokenKind::kw_await)) {
+    auto loc = CurrentToken.Loc;
+    advance();
+    return std::make_unique<AwaitExpr>(parsePostfixExpression(), loc);
+  }
+
   return nullptr;
 }
 
@@ -488,7 +525,7 @@ std::unique_ptr<Expr> SyntaxParser::parsePostfixExpression() {
     else if (CurrentToken.is(TokenKind::punct_question_dot)) {
       auto loc = CurrentToken.Loc;
       advance();
-      std::string memberName = CurrentToken.Text;
+      Atom memberName = CurrentToken.Name;
       expect(TokenKind::Identifier);
       
       std::vector<std::unique_ptr<Expr>> callArgs;
@@ -506,6 +543,13 @@ std::unique_ptr<Expr> SyntaxParser::parsePostfixExpression() {
       expr = std::make_unique<OptionalChainExpr>(std::move(expr), memberName, 
                                                   std::move(callArgs), loc);
     }
+    else if (CurrentToken.is(TokenKind::punct_dot)) {
+      auto loc = CurrentToken.Loc;
+      advance();
+      Atom memberName = CurrentToken.Name;
+      expect(TokenKind::Identifier);
+      expr = std::make_unique<MemberAccessExpr>(std::move(expr), memberName, loc);
+    }
     else {
       break;
     }
@@ -520,7 +564,7 @@ std::unique_ptr<Expr> SyntaxParser::parseOptionalChain() {
   while (CurrentToken.is(TokenKind::punct_question_dot)) {
     auto loc = CurrentToken.Loc;
     advance();
-    std::string memberName = CurrentToken.Text;
+    Atom memberName = CurrentToken.Name;
     expect(TokenKind::Identifier);
     
     std::vector<std::unique_ptr<Expr>> callArgs;
@@ -560,7 +604,7 @@ std::shared_ptr<Type> SyntaxParser::parseType() {
 }
 
 int SyntaxParser::getPrecedence(const std::string& op) {
-  static std::map<std::string, int> prec = {
+  static const std::map<std::string, int> prec = {
     {"||", 10},
     {"&&", 20},
     {"==", 30}, {"!=", 30},
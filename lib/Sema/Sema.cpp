@@ -26,6 +26,22 @@ void Sema::initBuiltinFunctions() {
   BuiltinFunctions.insert("httpPut");
   BuiltinFunctions.insert("httpDelete");
   BuiltinFunctions.insert("httpStatusCode");
+  BuiltinFunctions.insert("httpIsSuccess");
+  BuiltinFunctions.insert("httpGetHeader");
+  BuiltinFunctions.insert("httpRequest");
+  BuiltinFunctions.insert("httpCacheStats");
+  BuiltinFunctions.insert("httpHostStats");
+  BuiltinFunctions.insert("httpDownload");
+  BuiltinFunctions.insert("httpUpload");
+  BuiltinFunctions.insert("httpPostMultipart");
+  BuiltinFunctions.insert("httpServer");
+  BuiltinFunctions.insert("httpRoute");
+  BuiltinFunctions.insert("httpResponse");
+  BuiltinFunctions.insert("httpServerStart");
+  BuiltinFunctions.insert("httpServerWait");
+  BuiltinFunctions.insert("httpServerStop");
+  BuiltinFunctions.insert("httpGetAll");
+  BuiltinFunctions.insert("httpBatch");
   BuiltinFunctions.insert("urlEncode");
   BuiltinFunctions.insert("urlDecode");
   BuiltinFunctions.insert("jsonParse");
@@ -49,7 +65,43 @@ void Sema::initBuiltinFunctions() {
   BuiltinFunctions.insert("hasInput");
   BuiltinFunctions.insert("getKey");
   BuiltinFunctions.insert("sleepMs");
+  BuiltinFunctions.insert("sleepAsync");
+  BuiltinFunctions.insert("readFileAsync");
+  BuiltinFunctions.insert("readLineAsync");
+  BuiltinFunctions.insert("httpGetAsync");
+  BuiltinFunctions.insert("httpPostAsync");
+  BuiltinFunctions.insert("tcpConnect");
+  BuiltinFunctions.insert("tcpConnectAsync");
+  BuiltinFunctions.insert("tcpListen");
+  BuiltinFunctions.insert("tcpAccept");
+  BuiltinFunctions.insert("tcpAcceptAsync");
+  BuiltinFunctions.insert("socketSend");
+  BuiltinFunctions.insert("socketSendFrame");
+  BuiltinFunctions.insert("socketRecv");
+  BuiltinFunctions.insert("socketRecvAsync");
+  BuiltinFunctions.insert("socketReadLine");
+  BuiltinFunctions.insert("socketReadLineAsync");
+  BuiltinFunctions.insert("socketReadFrame");
+  BuiltinFunctions.insert("socketReadFrameAsync");
+  BuiltinFunctions.insert("socketPort");
+  BuiltinFunctions.insert("socketClose");
+  BuiltinFunctions.insert("udpBind");
+  BuiltinFunctions.insert("udpSendTo");
+  BuiltinFunctions.insert("udpSendBatch");
+  BuiltinFunctions.insert("udpRecvBatch");
+  BuiltinFunctions.insert("udpRecvBatchAsync");
   BuiltinFunctions.insert("randomInt");
+  BuiltinFunctions.insert("send");
+  BuiltinFunctions.insert("channel");
+  BuiltinFunctions.insert("trySend");
+  BuiltinFunctions.insert("receive");
+  BuiltinFunctions.insert("receiveAsync");
+  BuiltinFunctions.insert("tryReceive");
+  BuiltinFunctions.insert("close");
+  BuiltinFunctions.insert("select");
+  BuiltinFunctions.insert("pipeline");
+  BuiltinFunctions.insert("isCancelled");
+  BuiltinFunctions.insert("cancelGroup");
   BuiltinFunctions.insert("insert");
   BuiltinFunctions.insert("contains");
   BuiltinFunctions.insert("removeFirst");
@@ -62,6 +114,9 @@ void Sema::initBuiltinFunctions() {
   BuiltinFunctions.insert("map");
   BuiltinFunctions.insert("filter");
   BuiltinFunctions.insert("reduce");
+  BuiltinFunctions.insert("parallelMap");
+  BuiltinFunctions.insert("parallelFilter");
+  BuiltinFunctions.insert("parallelReduce");
   BuiltinFunctions.insert("sum");
   BuiltinFunctions.insert("average");
   BuiltinFunctions.insert("max");
@@ -440,6 +495,22 @@ bool Sema::visit(Expr* expr) {
     return visit(optChain);
   }
   
+  if (auto member = dynamic_cast<MemberAccessExpr*>(expr)) {
+    return visit(member);
+  }
+  
+  if (auto asyncExpr = dynamic_cast<AsyncExpr*>(expr)) {
+    return visit(asyncExpr);
+  }
+  
+  if (auto awaitExpr = dynamic_cast<AwaitExpr*>(expr)) {
+    return visit(awaitExpr);
+  }
+  
+  if (auto actorExpr = dynamic_cast<ActorExpr*>(expr)) {
+    return visit(actorExpr);
+  }
+  
   return true;
 }
 
@@ -472,6 +543,10 @@ bool Sema::visit(Stmt* stmt) {
     return visit(forStmt);
   }
   
+  if (auto groupStmt = dynamic_cast<TaskGroupStmt*>(stmt)) {
+    return visit(groupStmt);
+  }
+  
   if (auto switchStmt = dynamic_cast<SwitchStmt*>(stmt)) {
     return visit(switchStmt);
   }
@@ -562,6 +637,28 @@ bool Sema::visit(WhileStmt* whileStmt) {
   return true;
 }
 
+bool Sema::visit(TaskGroupStmt* groupStmt) {
+  if (!groupStmt) {
+    return false;
+  }
+  
+  if (groupStmt->Timeout) {
+    visit(groupStmt->Timeout.get());
+    
+    auto timeoutType = getExprType(groupStmt->Timeout.get());
+    if (timeoutType) {
+      auto intType = std::make_shared<BuiltinType>(BuiltinType::Int);
+      if (!isTypeCompatible(timeoutType, intType)) {
+        Diags.report(diag::typeMismatch("Int", timeoutType->Name, SourceLocation(), currentFilename));
+      }
+    }
+  }
+  
+  visit(groupStmt->Body.get());
+  
+  return true;
+}
+
 bool Sema::visit(ForStmt* forStmt) {
   if (!forStmt) {
     return false;
@@ -688,6 +785,168 @@ bool Sema::visit(CallExpr* call) {
         return false;
       }
       call->ExprType = std::make_shared<BuiltinType>(BuiltinType::Int64);
+    } else if (call->Callee == "send") {
+      if (call->Args.size() != 2) {
+        Diags.report(diag::wrongArgCount("send", 2, call->Args.size(), SourceLocation(), currentFilename));
+        return false;
+      }
+      call->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
+    } else if (call->Callee == "sleepAsync" || call->Callee == "readFileAsync" ||
+               call->Callee == "httpGetAsync") {
+      if (call->Args.size() != 1) {
+        Diags.report(diag::wrongArgCount(call->Callee, 1, call->Args.size(), SourceLocation(), currentFilename));
+        return false;
+      }
+      call->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
+    } else if (call->Callee == "httpPostAsync") {
+      if (call->Args.size() != 2) {
+        Diags.report(diag::wrongArgCount("httpPostAsync", 2, call->Args.size(), SourceLocation(), currentFilename));
+        return false;
+      }
+      call->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
+    } else if (call->Callee == "tcpAccept" || call->Callee == "tcpAcceptAsync" ||
+               call->Callee == "socketReadLine" || call->Callee == "socketReadLineAsync" ||
+               call->Callee == "socketReadFrame" || call->Callee == "socketReadFrameAsync" ||
+               call->Callee == "socketPort" || call->Callee == "socketClose") {
+      if (call->Args.size() != 1) {
+        Diags.report(diag::wrongArgCount(call->Callee, 1, call->Args.size(), SourceLocation(), currentFilename));
+        return false;
+      }
+      call->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
+    } else if (call->Callee == "tcpConnect" || call->Callee == "tcpConnectAsync" ||
+               call->Callee == "tcpListen" || call->Callee == "udpBind" ||
+               call->Callee == "socketSend" || call->Callee == "socketSendFrame" ||
+               call->Callee == "socketRecv" || call->Callee == "socketRecvAsync" ||
+               call->Callee == "udpRecvBatch" || call->Callee == "udpRecvBatchAsync") {
+      if (call->Args.size() != 2) {
+        Diags.report(diag::wrongArgCount(call->Callee, 2, call->Args.size(), SourceLocation(), currentFilename));
+        return false;
+      }
+      call->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
+    } else if (call->Callee == "udpSendTo" || call->Callee == "udpSendBatch") {
+      if (call->Args.size() != 4) {
+        Diags.report(diag::wrongArgCount(call->Callee, 4, call->Args.size(), SourceLocation(), currentFilename));
+        return false;
+      }
+      call->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
+    } else if (call->Callee == "httpRequest") {
+      // The body and headers are optional
+      if (call->Args.size() < 2 || call->Args.size() > 4) {
+        size_t expected = call->Args.size() < 2 ? 2 : 4;
+        Diags.report(diag::wrongArgCount("httpRequest", expected, call->Args.size(), SourceLocation(), currentFilename));
+        return false;
+      }
+      call->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
+    } else if (call->Callee == "httpDownload") {
+      if (call->Args.size() != 2) {
+        Diags.report(diag::wrongArgCount("httpDownload", 2, call->Args.size(), SourceLocation(), currentFilename));
+        return false;
+      }
+      call->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
+    } else if (call->Callee == "httpUpload") {
+      if (call->Args.size() != 3) {
+        Diags.report(diag::wrongArgCount("httpUpload", 3, call->Args.size(), SourceLocation(), currentFilename));
+        return false;
+      }
+      call->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
+    } else if (call->Callee == "httpPostMultipart") {
+      if (call->Args.size() != 3) {
+        Diags.report(diag::wrongArgCount("httpPostMultipart", 3, call->Args.size(), SourceLocation(), currentFilename));
+        return false;
+      }
+      call->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
+    } else if (call->Callee == "httpServer") {
+      if (call->Args.size() != 1) {
+        Diags.report(diag::wrongArgCount("httpServer", 1, call->Args.size(), SourceLocation(), currentFilename));
+        return false;
+      }
+      call->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
+    } else if (call->Callee == "httpRoute") {
+      if (call->Args.size() != 4) {
+        Diags.report(diag::wrongArgCount("httpRoute", 4, call->Args.size(), SourceLocation(), currentFilename));
+        return false;
+      }
+      call->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
+    } else if (call->Callee == "httpResponse") {
+      // The headers are optional
+      if (call->Args.size() < 2 || call->Args.size() > 3) {
+        size_t expected = call->Args.size() < 2 ? 2 : 3;
+        Diags.report(diag::wrongArgCount("httpResponse", expected, call->Args.size(), SourceLocation(), currentFilename));
+        return false;
+      }
+      call->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
+    } else if (call->Callee == "httpServerStart") {
+      if (call->Args.size() != 1) {
+        Diags.report(diag::wrongArgCount("httpServerStart", 1, call->Args.size(), SourceLocation(), currentFilename));
+        return false;
+      }
+      call->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
+    } else if (call->Callee == "httpServerWait") {
+      if (call->Args.size() != 1) {
+        Diags.report(diag::wrongArgCount("httpServerWait", 1, call->Args.size(), SourceLocation(), currentFilename));
+        return false;
+      }
+      call->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
+    } else if (call->Callee == "httpServerStop") {
+      if (call->Args.size() != 1) {
+        Diags.report(diag::wrongArgCount("httpServerStop", 1, call->Args.size(), SourceLocation(), currentFilename));
+        return false;
+      }
+      call->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
+    } else if (call->Callee == "httpHostStats") {
+      if (!call->Args.empty()) {
+        Diags.report(diag::wrongArgCount("httpHostStats", 0, call->Args.size(), SourceLocation(), currentFilename));
+        return false;
+      }
+      call->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
+    } else if (call->Callee == "httpCacheStats") {
+      if (!call->Args.empty()) {
+        Diags.report(diag::wrongArgCount("httpCacheStats", 0, call->Args.size(), SourceLocation(), currentFilename));
+        return false;
+      }
+      call->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
+    } else if (call->Callee == "httpIsSuccess") {
+      if (call->Args.size() != 1) {
+        Diags.report(diag::wrongArgCount("httpIsSuccess", 1, call->Args.size(), SourceLocation(), currentFilename));
+        return false;
+      }
+      call->ExprType = std::make_shared<BuiltinType>(BuiltinType::Bool);
+    } else if (call->Callee == "httpGetHeader") {
+      if (call->Args.size() != 2) {
+        Diags.report(diag::wrongArgCount("httpGetHeader", 2, call->Args.size(), SourceLocation(), currentFilename));
+        return false;
+      }
+      call->ExprType = std::make_shared<BuiltinType>(BuiltinType::String);
+    } else if (call->Callee == "httpGetAll" || call->Callee == "httpBatch") {
+      // The concurrency cap is optional
+      if (call->Args.empty() || call->Args.size() > 2) {
+        size_t expected = call->Args.empty() ? 1 : 2;
+        Diags.report(diag::wrongArgCount(call->Callee, expected, call->Args.size(), SourceLocation(), currentFilename));
+        return false;
+      }
+      call->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
+    } else if (call->Callee == "trySend") {
+      if (call->Args.size() != 2) {
+        Diags.report(diag::wrongArgCount("trySend", 2, call->Args.size(), SourceLocation(), currentFilename));
+        return false;
+      }
+      call->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
+    } else if (call->Callee == "receive" || call->Callee == "receiveAsync" ||
+               call->Callee == "tryReceive" || call->Callee == "close" ||
+               call->Callee == "select") {
+      if (call->Args.size() != 1) {
+        Diags.report(diag::wrongArgCount(call->Callee, 1, call->Args.size(), SourceLocation(), currentFilename));
+        return false;
+      }
+      call->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
+    } else if (call->Callee == "parallelMap" || call->Callee == "parallelFilter" ||
+               call->Callee == "parallelReduce") {
+      size_t expected = call->Callee == "parallelReduce" ? 3 : 2;
+      if (call->Args.size() != expected) {
+        Diags.report(diag::wrongArgCount(call->Callee, expected, call->Args.size(), SourceLocation(), currentFilename));
+        return false;
+      }
+      call->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
     } else {
       call->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
     }
@@ -734,7 +993,8 @@ bool Sema::visit(BinaryExpr* binary) {
   auto lhsType = getExprType(binary->LHS.get());
   auto rhsType = getExprType(binary->RHS.get());
   
-  if (binary->Op == "+" || binary->Op == "-" || binary->Op == "*" || binary->Op == "/") {
+  if (binary->Op == "+" || binary->Op == "-" || binary->Op == "*" || binary->Op == "/" ||
+      binary->Op == "%") {
     if (lhsType && rhsType) {
       if (lhsType->Name == "Bool" || rhsType->Name == "Bool") {
         Diags.report(diag::arithmeticOnBool(SourceLocation(), currentFilename));
@@ -1021,6 +1281,82 @@ bool Sema::visit(OptionalChainExpr* expr) {
   return true;
 }
 
+bool Sema::visit(AsyncExpr* expr) {
+  if (!expr) {
+    return false;
+  }
+  
+  if (!dynamic_cast<CallExpr*>(expr->Call.get())) {
+    Diags.report(diag::invalidOperation("'async' must be applied to a function call",
+                                        expr->Loc, currentFilename));
+    return false;
+  }
+  
+  if (!visit(expr->Call.get())) {
+    return false;
+  }
+  
+  expr->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
+  
+  return true;
+}
+
+bool Sema::visit(AwaitExpr* expr) {
+  if (!expr) {
+    return false;
+  }
+  
+  if (!visit(expr->Task.get())) {
+    return false;
+  }
+  
+  // The task's result type is only known once it completes
+  expr->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
+  
+  return true;
+}
+
+bool Sema::visit(MemberAccessExpr* expr) {
+  if (!expr) {
+    return false;
+  }
+  
+  if (!visit(expr->Object.get())) {
+    return false;
+  }
+  
+  // Properties are looked up on the instance at run time
+  expr->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
+  return true;
+}
+
+bool Sema::visit(ActorExpr* expr) {
+  if (!expr) {
+    return false;
+  }
+  
+  auto call = dynamic_cast<CallExpr*>(expr->Call.get());
+  if (!call || isBuiltinFunction(call->Callee)) {
+    Diags.report(diag::invalidOperation("'actor' must be applied to a call of a user function",
+                                        expr->Loc, currentFilename));
+    return false;
+  }
+  if (call->Args.size() != 1) {
+    Diags.report(diag::wrongArgCount(call->Callee, 1, call->Args.size(), expr->Loc, currentFilename));
+    return false;
+  }
+  
+  // Only the initial state is evaluated here; the function itself runs
+  // once per message with (state, message)
+  if (!visit(call->Args[0].get())) {
+    return false;
+  }
+  
+  expr->ExprType = std::make_shared<BuiltinType>(BuiltinType::Any);
+  
+  return true;
+}
+
 bool Sema::visit(IfLetStmt* stmt) {
   if (!stmt) {
     return false;
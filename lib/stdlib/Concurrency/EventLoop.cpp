@@ -0,0 +1,537 @@
+#include "xwift/stdlib/Concurrency/EventLoop.h"
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <fstream>
+#include <future>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#endif
+
+#ifdef _WIN32
+#include <iostream>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace xwift {
+
+// Everything the loop thread touches. The thread holds its own reference,
+// so when the last owner lets go from inside a callback the state outlives
+// the EventLoop until run() returns.
+struct EventLoop::Core : std::enable_shared_from_this<Core> {
+    ~Core();
+
+    void start();
+    void stop();
+    void run();
+    void post(Callback callback);
+    // Applies change now on the loop thread, else queues it
+    void submit(Callback change);
+    void wake();
+    void drainPosted();
+    void runExpiredTimers();
+    void armTimer();
+    void applyWatch(int fd, uint32_t events, IoCallback callback);
+    void applyUnwatch(int fd);
+    void dispatch(int fd, uint32_t events);
+
+    bool onLoopThread() const { return std::this_thread::get_id() == ThreadId.load(); }
+
+    struct Watch {
+        uint32_t Events;
+        std::shared_ptr<IoCallback> Callback;
+    };
+
+    std::once_flag Started;
+    std::thread Thread;
+    std::atomic<std::thread::id> ThreadId{};
+    std::atomic<bool> Stopping{false};
+
+    std::mutex PostMutex;
+    std::vector<Callback> Posted;
+    bool WakePending = false;
+    std::atomic<TimerId> NextTimer{1};
+    std::atomic<size_t> Pending{0};
+
+    // Loop thread only
+    std::map<std::pair<Clock::time_point, TimerId>, Callback> Timers;
+    std::unordered_map<TimerId, Clock::time_point> TimerDeadlines;
+    std::unordered_map<int, Watch> Watches;
+    std::optional<Clock::time_point> ArmedFor;
+
+    int PollFd = -1;
+    int TimerFd = -1;
+    int WakeFd = -1;
+#ifndef __linux__
+    std::condition_variable WakeCondition;
+#endif
+};
+
+EventLoop::EventLoop() : State(std::make_shared<Core>()) {}
+
+EventLoop::~EventLoop() {
+    State->stop();
+}
+
+void EventLoop::post(Callback callback) {
+    State->post(std::move(callback));
+}
+
+void EventLoop::runSync(const Callback& callback) {
+    if (State->onLoopThread()) {
+        callback();
+        return;
+    }
+    std::promise<void> done;
+    State->post([&] {
+        callback();
+        done.set_value();
+    });
+    done.get_future().wait();
+}
+
+EventLoop::TimerId EventLoop::addTimer(Clock::duration delay, Callback callback) {
+    Core* core = State.get();
+    TimerId id = core->NextTimer.fetch_add(1);
+    Clock::time_point deadline = Clock::now() + delay;
+    core->Pending.fetch_add(1, std::memory_order_relaxed);
+    core->submit([core, id, deadline, callback = std::move(callback)]() mutable {
+        core->Timers.emplace(std::make_pair(deadline, id), std::move(callback));
+        core->TimerDeadlines[id] = deadline;
+    });
+    return id;
+}
+
+void EventLoop::cancelTimer(TimerId id) {
+    Core* core = State.get();
+    core->submit([core, id] {
+        auto it = core->TimerDeadlines.find(id);
+        if (it == core->TimerDeadlines.end()) {
+            return;
+        }
+        core->Timers.erase(std::make_pair(it->second, id));
+        core->TimerDeadlines.erase(it);
+        core->Pending.fetch_sub(1, std::memory_order_relaxed);
+    });
+}
+
+void EventLoop::watch(int fd, uint32_t events, IoCallback callback) {
+    Core* core = State.get();
+    core->submit([core, fd, events, callback = std::move(callback)]() mutable {
+        core->applyWatch(fd, events, std::move(callback));
+    });
+}
+
+void EventLoop::unwatch(int fd) {
+    Core* core = State.get();
+    core->submit([core, fd] { core->applyUnwatch(fd); });
+}
+
+bool EventLoop::onLoopThread() const {
+    return State->onLoopThread();
+}
+
+size_t EventLoop::pendingCount() const {
+    return State->Pending.load(std::memory_order_relaxed);
+}
+
+EventLoop::Core::~Core() {
+#ifdef __linux__
+    for (int fd : {PollFd, TimerFd, WakeFd}) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+#endif
+}
+
+void EventLoop::Core::start() {
+    std::call_once(Started, [this] {
+#ifdef __linux__
+        PollFd = epoll_create1(EPOLL_CLOEXEC);
+        TimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        WakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        for (int fd : {TimerFd, WakeFd}) {
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = fd;
+            epoll_ctl(PollFd, EPOLL_CTL_ADD, fd, &event);
+        }
+#endif
+        Thread = std::thread([self = shared_from_this()] { self->run(); });
+    });
+}
+
+void EventLoop::Core::stop() {
+    if (!Thread.joinable()) {
+        return;
+    }
+    Stopping.store(true);
+    wake();
+    if (onLoopThread()) {
+        // The last owner let go from one of the loop's own callbacks. The
+        // thread still holds this state and frees it once the callback
+        // returns and run() sees Stopping.
+        Thread.detach();
+    } else {
+        Thread.join();
+    }
+}
+
+void EventLoop::Core::post(Callback callback) {
+    start();
+    bool needWake = false;
+    {
+        std::lock_guard<std::mutex> lock(PostMutex);
+        Posted.push_back(std::move(callback));
+        if (!WakePending) {
+            WakePending = true;
+            needWake = true;
+        }
+    }
+    if (needWake) {
+        wake();
+    }
+}
+
+void EventLoop::Core::submit(Callback change) {
+    if (onLoopThread()) {
+        change();
+    } else {
+        post(std::move(change));
+    }
+}
+
+void EventLoop::Core::applyWatch(int fd, uint32_t events, IoCallback callback) {
+#ifdef __linux__
+    epoll_event event{};
+    event.events = ((events & Readable) ? static_cast<uint32_t>(EPOLLIN) : 0u) |
+                   ((events & Writable) ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+    event.data.fd = fd;
+    auto it = Watches.find(fd);
+    int op = it == Watches.end() ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    if (epoll_ctl(PollFd, op, fd, &event) == 0) {
+        if (it == Watches.end()) {
+            Pending.fetch_add(1, std::memory_order_relaxed);
+        }
+        Watches[fd] = Watch{events, std::make_shared<IoCallback>(std::move(callback))};
+        return;
+    }
+#endif
+    callback(Failed);
+}
+
+void EventLoop::Core::applyUnwatch(int fd) {
+    auto it = Watches.find(fd);
+    if (it == Watches.end()) {
+        return;
+    }
+#ifdef __linux__
+    epoll_ctl(PollFd, EPOLL_CTL_DEL, fd, nullptr);
+#endif
+    Watches.erase(it);
+    Pending.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void EventLoop::Core::wake() {
+#ifdef __linux__
+    if (WakeFd >= 0) {
+        uint64_t one = 1;
+        ssize_t written = write(WakeFd, &one, sizeof(one));
+        (void)written;
+    }
+#else
+    { std::lock_guard<std::mutex> lock(PostMutex); }
+    WakeCondition.notify_one();
+#endif
+}
+
+void EventLoop::Core::drainPosted() {
+    std::vector<Callback> posted;
+    {
+        std::lock_guard<std::mutex> lock(PostMutex);
+        posted.swap(Posted);
+        WakePending = false;
+    }
+    for (auto& callback : posted) {
+        // The loop may have been dropped by the callback before this one
+        if (Stopping.load()) {
+            return;
+        }
+        callback();
+    }
+}
+
+void EventLoop::Core::runExpiredTimers() {
+    auto now = Clock::now();
+    while (!Timers.empty() && Timers.begin()->first.first <= now && !Stopping.load()) {
+        auto node = Timers.extract(Timers.begin());
+        TimerDeadlines.erase(node.key().second);
+        Pending.fetch_sub(1, std::memory_order_relaxed);
+        node.mapped()();
+    }
+}
+
+void EventLoop::Core::armTimer() {
+    std::optional<Clock::time_point> earliest;
+    if (!Timers.empty()) {
+        earliest = Timers.begin()->first.first;
+    }
+    if (earliest == ArmedFor) {
+        return;
+    }
+    ArmedFor = earliest;
+#ifdef __linux__
+    // steady_clock is CLOCK_MONOTONIC, so deadlines go to the timerfd as
+    // absolute times unchanged. An all-zero value would disarm it instead.
+    itimerspec spec{};
+    if (earliest) {
+        auto since = std::max(earliest->time_since_epoch(), Clock::duration(1));
+        auto seconds = std::chrono::duration_cast<std::chrono::seconds>(since);
+        spec.it_value.tv_sec = seconds.count();
+        spec.it_value.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(since - seconds).count();
+    }
+    timerfd_settime(TimerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+#endif
+}
+
+void EventLoop::Core::dispatch(int fd, uint32_t events) {
+    // Looked up per event: an earlier callback in this batch may have
+    // unwatched fd
+    auto it = Watches.find(fd);
+    if (it == Watches.end()) {
+        return;
+    }
+    auto callback = it->second.Callback;
+    (*callback)(events);
+}
+
+void EventLoop::Core::run() {
+    ThreadId.store(std::this_thread::get_id());
+    while (!Stopping.load()) {
+        drainPosted();
+        runExpiredTimers();
+        armTimer();
+
+#ifdef __linux__
+        epoll_event events[64];
+        int count = epoll_wait(PollFd, events, 64, -1);
+        if (count < 0) {
+            continue;
+        }
+        for (int i = 0; i < count && !Stopping.load(); i++) {
+            int fd = events[i].data.fd;
+            uint64_t drained;
+            if (fd == WakeFd || fd == TimerFd) {
+                ssize_t got = read(fd, &drained, sizeof(drained));
+                (void)got;
+                if (fd == TimerFd) {
+                    ArmedFor.reset();
+                }
+                continue;
+            }
+            uint32_t ready = 0;
+            // A hangup is reported as readable so the reader sees end of input
+            if (events[i].events & (EPOLLIN | EPOLLHUP)) {
+                ready |= Readable;
+            }
+            if (events[i].events & EPOLLOUT) {
+                ready |= Writable;
+            }
+            if (events[i].events & EPOLLERR) {
+                ready |= Failed;
+            }
+            dispatch(fd, ready);
+        }
+#else
+        std::unique_lock<std::mutex> lock(PostMutex);
+        auto ready = [this] { return !Posted.empty() || Stopping.load(); };
+        if (ArmedFor) {
+            WakeCondition.wait_until(lock, *ArmedFor, ready);
+            ArmedFor.reset();
+        } else {
+            WakeCondition.wait(lock, ready);
+        }
+#endif
+    }
+}
+
+namespace {
+
+constexpr size_t ReadChunk = 256 * 1024;
+
+#ifndef _WIN32
+struct FileRead {
+    int Fd;
+    std::string Data;
+    std::function<void(std::optional<std::string>)> Done;
+
+    // Reads what is available without blocking; true once at end of file
+    bool readAvailable(size_t limit, bool& failed) {
+        size_t start = Data.size();
+        while (Data.size() - start < limit) {
+            char buffer[16384];
+            ssize_t got = read(Fd, buffer, sizeof(buffer));
+            if (got > 0) {
+                Data.append(buffer, static_cast<size_t>(got));
+            } else if (got == 0) {
+                return true;
+            } else if (errno == EINTR) {
+                continue;
+            } else {
+                failed = errno != EAGAIN && errno != EWOULDBLOCK;
+                return failed;
+            }
+        }
+        return false;
+    }
+
+    void finish(bool failed) {
+        close(Fd);
+        if (failed) {
+            Done(std::nullopt);
+        } else {
+            Done(std::move(Data));
+        }
+    }
+};
+
+void readChunks(EventLoop& loop, std::shared_ptr<FileRead> file) {
+    bool failed = false;
+    if (file->readAvailable(ReadChunk, failed)) {
+        file->finish(failed);
+        return;
+    }
+    loop.post([&loop, file] { readChunks(loop, file); });
+}
+#endif
+
+}
+
+void readFileAsync(EventLoop& loop, const std::string& path,
+                   std::function<void(std::optional<std::string>)> done) {
+    loop.post([&loop, path, done = std::move(done)]() mutable {
+#ifdef _WIN32
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            done(std::nullopt);
+            return;
+        }
+        std::ostringstream contents;
+        contents << in.rdbuf();
+        done(contents.str());
+#else
+        int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) {
+            done(std::nullopt);
+            return;
+        }
+        auto file = std::make_shared<FileRead>(FileRead{fd, {}, std::move(done)});
+        struct stat info;
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+            file->Data.reserve(static_cast<size_t>(info.st_size));
+            readChunks(loop, file);
+            return;
+        }
+        loop.watch(fd, EventLoop::Readable, [&loop, file](uint32_t events) {
+            if (events & EventLoop::Failed) {
+                readChunks(loop, file);
+                return;
+            }
+            bool failed = false;
+            if (file->readAvailable(ReadChunk, failed)) {
+                loop.unwatch(file->Fd);
+                file->finish(failed);
+            }
+        });
+#endif
+    });
+}
+
+void LineReader::readLine(LineCallback done) {
+    Loop->post([self = shared_from_this(), done = std::move(done)]() mutable {
+        self->Readers.push_back(std::move(done));
+        self->pump();
+    });
+}
+
+void LineReader::pump() {
+    deliver();
+    if (Readers.empty() || AtEnd) {
+        if (Watching) {
+            Loop->unwatch(Fd);
+            Watching = false;
+        }
+        return;
+    }
+    if (!Pollable) {
+        readSome();
+        Loop->post([self = shared_from_this()] { self->pump(); });
+        return;
+    }
+    if (!Watching) {
+        Watching = true;
+        Loop->watch(Fd, EventLoop::Readable, [self = shared_from_this()](uint32_t events) {
+            if (events & EventLoop::Failed) {
+                self->Pollable = false;
+                self->Watching = false;
+            } else {
+                self->readSome();
+            }
+            self->pump();
+        });
+    }
+}
+
+void LineReader::deliver() {
+    while (!Readers.empty()) {
+        size_t newline = Buffer.find('\n');
+        std::optional<std::string> line;
+        if (newline != std::string::npos) {
+            line = Buffer.substr(0, newline);
+            Buffer.erase(0, newline + 1);
+        } else if (AtEnd) {
+            // A last line without a newline still counts
+            if (!Buffer.empty()) {
+                line = std::move(Buffer);
+                Buffer.clear();
+            }
+        } else {
+            return;
+        }
+        LineCallback reader = std::move(Readers.front());
+        Readers.pop_front();
+        reader(std::move(line));
+    }
+}
+
+void LineReader::readSome() {
+#ifdef _WIN32
+    char buffer[4096];
+    std::cin.read(buffer, sizeof(buffer));
+    Buffer.append(buffer, static_cast<size_t>(std::cin.gcount()));
+    AtEnd = std::cin.eof() || std::cin.fail();
+#else
+    char buffer[4096];
+    ssize_t got = read(Fd, buffer, sizeof(buffer));
+    if (got > 0) {
+        Buffer.append(buffer, static_cast<size_t>(got));
+    } else if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        AtEnd = true;
+    }
+#endif
+}
+
+}
@@ -0,0 +1,241 @@
+#include "xwift/stdlib/Concurrency/Scheduler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+namespace xwift {
+
+thread_local Scheduler* Scheduler::CurrentScheduler = nullptr;
+thread_local size_t Scheduler::CurrentWorker = 0;
+
+Scheduler& Scheduler::getInstance() {
+    static Scheduler instance(defaultWorkerCount());
+    return instance;
+}
+
+size_t Scheduler::defaultWorkerCount() {
+    if (const char* env = std::getenv("XWIFT_WORKERS")) {
+        char* end = nullptr;
+        long count = std::strtol(env, &end, 10);
+        if (end != env && *end == '\0' && count > 0) {
+            return static_cast<size_t>(count);
+        }
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+Scheduler::Scheduler(size_t workerCount) {
+    workerCount = std::max<size_t>(1, workerCount);
+    for (size_t i = 0; i < workerCount; i++) {
+        auto worker = std::make_unique<Worker>();
+        worker->Rng.seed(static_cast<unsigned>(i * 7919 + 1));
+        Workers.push_back(std::move(worker));
+    }
+    // Start threads only once every deque exists, since workers steal from
+    // each other immediately
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < workerCount; i++) {
+        Threads.emplace_back(&Scheduler::threadMain, this, i);
+    }
+}
+
+Scheduler::~Scheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Stopping = true;
+    }
+    condition.notify_all();
+    spareCondition.notify_all();
+    // A job still draining may block in place and start one more thread, so
+    // keep joining until none are left
+    while (true) {
+        std::vector<std::thread> threads;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            threads.swap(Threads);
+        }
+        if (threads.empty()) {
+            break;
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+    for (Job* job : Injected) {
+        delete job;
+    }
+}
+
+void Scheduler::spawn(Job job) {
+    Job* heapJob = new Job(std::move(job));
+    if (!onWorkerThread()) {
+        inject(heapJob);
+        return;
+    }
+
+    Queued.fetch_add(1);
+    Workers[CurrentWorker]->Deque.push(heapJob);
+    // Pairs with the Sleeping increment in workerLoop: either this load sees
+    // the sleeper, or the sleeper's predicate sees the new job
+    if (Sleeping.load() > 0) {
+        { std::lock_guard<std::mutex> lock(mutex); }
+        condition.notify_one();
+    }
+}
+
+void Scheduler::spawnFair(Job job) {
+    inject(new Job(std::move(job)));
+}
+
+void Scheduler::inject(Job* job) {
+    Queued.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Injected.push_back(job);
+    }
+    if (Sleeping.load() > 0) {
+        condition.notify_one();
+    }
+}
+
+void Scheduler::waitUntil(const std::function<bool()>& done) {
+    if (!onWorkerThread()) {
+        auto delay = std::chrono::microseconds(10);
+        while (!done()) {
+            std::this_thread::sleep_for(delay);
+            delay = std::min(delay * 2, std::chrono::microseconds(1000));
+        }
+        return;
+    }
+
+    unsigned idle = 0;
+    while (!done()) {
+        if (!onWorkerThread()) {
+            // A job run from here gave this thread's slot away
+            waitUntil(done);
+            return;
+        }
+        if (Job* job = findJob(CurrentWorker, Workers[CurrentWorker]->Rng)) {
+            runJob(job);
+            idle = 0;
+        } else if (++idle < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+}
+
+void Scheduler::blockInPlace(const std::function<void()>& wait) {
+    if (onWorkerThread()) {
+        size_t index = CurrentWorker;
+        CurrentScheduler = nullptr;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (IdleSpares > 0) {
+            IdleSpares--;
+            FreeSlots.push_back(index);
+            spareCondition.notify_one();
+        } else {
+            Threads.emplace_back(&Scheduler::threadMain, this, index);
+        }
+    }
+    wait();
+}
+
+void Scheduler::threadMain(size_t index) {
+    while (true) {
+        workerLoop(index);
+        if (onWorkerThread()) {
+            // The pool is stopping
+            return;
+        }
+        // The slot went to another thread in blockInPlace; wait to be handed
+        // one back
+        std::unique_lock<std::mutex> lock(mutex);
+        IdleSpares++;
+        spareCondition.wait(lock, [this] { return Stopping || !FreeSlots.empty(); });
+        if (FreeSlots.empty()) {
+            IdleSpares--;
+            return;
+        }
+        index = FreeSlots.front();
+        FreeSlots.pop_front();
+    }
+}
+
+Scheduler::Job* Scheduler::findJob(size_t self, std::mt19937& rng) {
+    Job* job = nullptr;
+    if (Workers[self]->Deque.pop(job)) {
+        return job;
+    }
+
+    if (Queued.load(std::memory_order_relaxed) == 0) {
+        return nullptr;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!Injected.empty()) {
+            job = Injected.front();
+            Injected.pop_front();
+            return job;
+        }
+    }
+
+    size_t count = Workers.size();
+    if (count < 2) {
+        return nullptr;
+    }
+    size_t start = std::uniform_int_distribution<size_t>(0, count - 1)(rng);
+    for (size_t i = 0; i < count; i++) {
+        size_t victim = (start + i) % count;
+        if (victim != self && Workers[victim]->Deque.steal(job)) {
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+void Scheduler::runJob(Job* job) {
+    Queued.fetch_sub(1, std::memory_order_relaxed);
+    std::unique_ptr<Job> owned(job);
+    (*owned)();
+}
+
+void Scheduler::workerLoop(size_t index) {
+    CurrentScheduler = this;
+    CurrentWorker = index;
+    Worker& self = *Workers[index];
+
+    while (true) {
+        if (Job* job = findJob(index, self.Rng)) {
+            runJob(job);
+            if (!onWorkerThread()) {
+                return;
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        Sleeping.fetch_add(1);
+        condition.wait(lock, [this] { return Stopping || Queued.load() > 0; });
+        Sleeping.fetch_sub(1);
+        if (Stopping && Queued.load() == 0) {
+            return;
+        }
+        lock.unlock();
+
+        // Queued still counts a job between another worker taking it and
+        // starting it; back off instead of spinning on that window
+        if (Job* job = findJob(index, self.Rng)) {
+            runJob(job);
+            if (!onWorkerThread()) {
+                return;
+            }
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+}
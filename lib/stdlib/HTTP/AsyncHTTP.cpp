@@ -0,0 +1,492 @@
+#include "xwift/stdlib/HTTP/AsyncHTTP.h"
+#include "xwift/stdlib/HTTP/CurlBackend.h"
+#include "xwift/stdlib/HTTP/HTTPMetrics.h"
+#include "xwift/Basic/Error.h"
+#include <curl/curl.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace xwift {
+namespace http {
+
+struct AsyncHTTPClient::Transfer {
+  RequestId id = 0;
+  CURL* easy = nullptr;
+  std::string body;
+  std::string upload;
+  std::map<std::string, std::string> headers;
+  struct curl_slist* headerList = nullptr;
+  Completion done;
+  // Streaming, as described by Request
+  std::function<bool(const char*, size_t)> onBodyChunk;
+  std::function<void(const TransferProgress&)> onProgress;
+  uint64_t streamed = 0;
+  std::FILE* uploadFile = nullptr;
+  std::string uploadPath;
+  // Kept alive until the transfer finishes; read in place of uploadFile
+  std::shared_ptr<BodySource> source;
+  std::string url;
+
+  bool readsBody() const { return uploadFile || source; }
+};
+
+// Owns the multi handle. Everything but the in-flight counter is touched
+// only on the loop thread.
+struct AsyncHTTPClient::Driver {
+  EventLoop& loop;
+  CURLM* multi = nullptr;
+  std::unordered_map<CURL*, std::unique_ptr<Transfer>> transfers;
+  // The handles of transfers started by request(), for cancel()
+  std::unordered_map<RequestId, CURL*> handles;
+  std::unordered_set<curl_socket_t> sockets;
+  EventLoop::TimerId timer = 0;
+  bool timerSet = false;
+  bool stopping = false;
+  std::atomic<size_t> inFlight{0};
+  std::atomic<bool> used{false};
+  std::atomic<RequestId> nextId{1};
+
+  explicit Driver(EventLoop& eventLoop) : loop(eventLoop) {}
+
+  void ensureMulti() {
+    if (multi) {
+      return;
+    }
+    static std::once_flag globalInit;
+    std::call_once(globalInit, [] { curl_global_init(CURL_GLOBAL_DEFAULT); });
+    multi = curl_multi_init();
+    curl_multi_setopt(multi, CURLMOPT_SOCKETFUNCTION, SocketCallback);
+    curl_multi_setopt(multi, CURLMOPT_SOCKETDATA, this);
+    curl_multi_setopt(multi, CURLMOPT_TIMERFUNCTION, TimerCallback);
+    curl_multi_setopt(multi, CURLMOPT_TIMERDATA, this);
+  }
+
+  static int SocketCallback(CURL*, curl_socket_t socket, int what, void* userp, void*) {
+    auto* self = static_cast<Driver*>(userp);
+    if (what == CURL_POLL_REMOVE) {
+      self->sockets.erase(socket);
+      self->loop.unwatch(socket);
+      return 0;
+    }
+    uint32_t events = 0;
+    if (what == CURL_POLL_IN || what == CURL_POLL_INOUT) {
+      events |= EventLoop::Readable;
+    }
+    if (what == CURL_POLL_OUT || what == CURL_POLL_INOUT) {
+      events |= EventLoop::Writable;
+    }
+    self->sockets.insert(socket);
+    self->loop.watch(socket, events, [self, socket](uint32_t ready) {
+      int flags = 0;
+      if (ready & EventLoop::Readable) {
+        flags |= CURL_CSELECT_IN;
+      }
+      if (ready & EventLoop::Writable) {
+        flags |= CURL_CSELECT_OUT;
+      }
+      if (ready & EventLoop::Failed) {
+        flags |= CURL_CSELECT_ERR;
+      }
+      self->action(socket, flags);
+    });
+    return 0;
+  }
+
+  static int TimerCallback(CURLM*, long timeoutMs, void* userp) {
+    auto* self = static_cast<Driver*>(userp);
+    if (self->timerSet) {
+      self->loop.cancelTimer(self->timer);
+      self->timerSet = false;
+    }
+    if (timeoutMs >= 0) {
+      self->timerSet = true;
+      self->timer = self->loop.addTimer(std::chrono::milliseconds(timeoutMs), [self] {
+        self->timerSet = false;
+        self->action(CURL_SOCKET_TIMEOUT, 0);
+      });
+    }
+    return 0;
+  }
+
+  void action(curl_socket_t socket, int flags) {
+    int running = 0;
+    curl_multi_socket_action(multi, socket, flags, &running);
+    collectFinished();
+  }
+
+  static size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
+    size_t totalSize = size * nmemb;
+    auto* transfer = static_cast<Transfer*>(userp);
+    if (transfer->onBodyChunk) {
+      if (!transfer->onBodyChunk(static_cast<const char*>(contents), totalSize)) {
+        return 0;
+      }
+      transfer->streamed += totalSize;
+      return totalSize;
+    }
+    transfer->body.append(static_cast<char*>(contents), totalSize);
+    return totalSize;
+  }
+
+  static size_t ReadCallback(char* buffer, size_t size, size_t nitems, void* userp) {
+    std::FILE* file = static_cast<Transfer*>(userp)->uploadFile;
+    size_t read = std::fread(buffer, 1, size * nitems, file);
+    return std::ferror(file) ? CURL_READFUNC_ABORT : read;
+  }
+
+  static int ProgressCallback(void* userp, curl_off_t downloadTotal, curl_off_t downloaded,
+                              curl_off_t uploadTotal, curl_off_t uploaded) {
+    TransferProgress progress;
+    progress.downloaded = static_cast<uint64_t>(downloaded);
+    progress.downloadTotal = static_cast<uint64_t>(downloadTotal);
+    progress.uploaded = static_cast<uint64_t>(uploaded);
+    progress.uploadTotal = static_cast<uint64_t>(uploadTotal);
+    static_cast<Transfer*>(userp)->onProgress(progress);
+    return 0;
+  }
+
+  // Same header parsing as the blocking curl backend
+  static size_t HeaderCallback(char* buffer, size_t size, size_t nitems, void* userdata) {
+    size_t totalSize = size * nitems;
+    auto* headersMap = static_cast<std::map<std::string, std::string>*>(userdata);
+    std::string header(buffer, totalSize);
+    size_t colonPos = header.find(':');
+    if (colonPos != std::string::npos) {
+      std::string key = header.substr(0, colonPos);
+      size_t start = header.find_first_not_of(" \t", colonPos + 1);
+      std::string value = start == std::string::npos ? "" : header.substr(start);
+      while (!value.empty() && (value.back() == '\r' || value.back() == '\n')) {
+        value.pop_back();
+      }
+      if (!key.empty()) {
+        (*headersMap)[key] = value;
+      }
+    }
+    return totalSize;
+  }
+
+  void start(Request request, int timeoutMs, Completion done, RequestId id = 0) {
+    if (request.timeoutMs > 0) {
+      timeoutMs = request.timeoutMs;
+    }
+    const std::string& method = request.method;
+    const std::string& url = request.url;
+    auto transfer = std::make_unique<Transfer>();
+    transfer->id = id;
+    transfer->done = std::move(done);
+    transfer->upload = std::move(request.body);
+    transfer->onBodyChunk = std::move(request.onBodyChunk);
+    transfer->onProgress = std::move(request.onProgress);
+    transfer->uploadPath = std::move(request.uploadFile);
+    transfer->source = std::move(request.bodySource);
+    transfer->url = request.url;
+    if (stopping) {
+      // Queued batch requests the shutdown would otherwise start
+      finish(std::move(transfer), Result<Response>::err(Error::network("Request cancelled")));
+      return;
+    }
+    curl_off_t uploadSize = 0;
+    if (transfer->source) {
+      if (!transfer->source->rewind()) {
+        finish(std::move(transfer), Result<Response>::err(Error::io("Cannot read request body")));
+        return;
+      }
+      uploadSize = static_cast<curl_off_t>(transfer->source->size());
+    } else if (!transfer->uploadPath.empty()) {
+      std::error_code error;
+      uploadSize = static_cast<curl_off_t>(std::filesystem::file_size(transfer->uploadPath, error));
+      transfer->uploadFile = error ? nullptr : std::fopen(transfer->uploadPath.c_str(), "rb");
+      if (!transfer->uploadFile) {
+        std::string path = transfer->uploadPath;
+        finish(std::move(transfer), Result<Response>::err(Error::io("Cannot open upload file: " + path)));
+        return;
+      }
+    }
+    bool hasBody = transfer->readsBody() || !transfer->upload.empty();
+    ensureMulti();
+    CURL* curl = curl_easy_init();
+    if (!curl) {
+      finish(std::move(transfer), Result<Response>::err(Error::network("Failed to initialize CURL")));
+      return;
+    }
+    transfer->easy = curl;
+
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, transfer.get());
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &transfer->headers);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, static_cast<long>(timeoutMs > 0 ? timeoutMs : DefaultTimeoutMs));
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, ContentEncodings);
+    if (transfer->onProgress) {
+      curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+      curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, ProgressCallback);
+      curl_easy_setopt(curl, CURLOPT_XFERINFODATA, transfer.get());
+    }
+    if (transfer->uploadFile) {
+      curl_easy_setopt(curl, CURLOPT_READFUNCTION, ReadCallback);
+      curl_easy_setopt(curl, CURLOPT_READDATA, transfer.get());
+    } else if (transfer->source) {
+      setBodySource(curl, transfer->source.get());
+    }
+
+    if (method == "GET") {
+      curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+    } else if (transfer->readsBody() && method == "POST") {
+      curl_easy_setopt(curl, CURLOPT_POST, 1L);
+      curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, uploadSize);
+    } else if (transfer->readsBody() && method != "HEAD") {
+      curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
+      curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, uploadSize);
+      if (method != "PUT") {
+        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method.c_str());
+      }
+    } else if (method == "POST" || method == "PUT") {
+      if (method == "PUT") {
+        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
+      } else {
+        curl_easy_setopt(curl, CURLOPT_POST, 1L);
+      }
+      curl_easy_setopt(curl, CURLOPT_POSTFIELDS, transfer->upload.c_str());
+      curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, static_cast<long>(transfer->upload.size()));
+    } else if (method == "HEAD") {
+      curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    } else {
+      curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method.c_str());
+    }
+    for (const auto& header : request.headers) {
+      std::string line = header.first + ": " + header.second;
+      transfer->headerList = curl_slist_append(transfer->headerList, line.c_str());
+    }
+    if (hasBody && !request.headers.count("Content-Type")) {
+      transfer->headerList = curl_slist_append(transfer->headerList,
+                                               "Content-Type: application/x-www-form-urlencoded");
+    }
+    if (transfer->readsBody()) {
+      // Send the body straight away rather than waiting on 100 Continue
+      transfer->headerList = curl_slist_append(transfer->headerList, "Expect:");
+    }
+    if (transfer->headerList) {
+      curl_easy_setopt(curl, CURLOPT_HTTPHEADER, transfer->headerList);
+    }
+
+    if (id != 0) {
+      handles[id] = curl;
+    }
+    transfers[curl] = std::move(transfer);
+    // Adding the handle makes curl ask for a zero timeout, which starts it
+    curl_multi_add_handle(multi, curl);
+  }
+
+  // A requestAll in progress. Only the loop thread touches it.
+  struct Batch {
+    std::vector<Request> requests;
+    std::vector<std::optional<Result<Response>>> results;
+    size_t maxConcurrent = 1;
+    int timeoutMs = 0;
+    size_t next = 0;
+    size_t remaining = 0;
+    BatchCompletion done;
+  };
+  
+  // Starts requests of batch until maxConcurrent are running. Each one
+  // that finishes starts the next, so the batch keeps the cap until the
+  // queue runs dry.
+  void startBatch(const std::shared_ptr<Batch>& batch) {
+    size_t running = batch->next - (batch->requests.size() - batch->remaining);
+    while (running < batch->maxConcurrent && batch->next < batch->requests.size()) {
+      size_t index = batch->next++;
+      running++;
+      start(std::move(batch->requests[index]), batch->timeoutMs, [this, batch, index](Result<Response> result) {
+        batch->results[index].emplace(std::move(result));
+        if (--batch->remaining == 0) {
+          std::vector<Result<Response>> results;
+          results.reserve(batch->results.size());
+          for (auto& slot : batch->results) {
+            results.push_back(std::move(*slot));
+          }
+          batch->done(std::move(results));
+          return;
+        }
+        startBatch(batch);
+      });
+    }
+  }
+  
+  void collectFinished() {
+    int queued = 0;
+    while (CURLMsg* message = curl_multi_info_read(multi, &queued)) {
+      if (message->msg != CURLMSG_DONE) {
+        continue;
+      }
+      CURL* curl = message->easy_handle;
+      CURLcode code = message->data.result;
+      auto it = transfers.find(curl);
+      if (it == transfers.end()) {
+        continue;
+      }
+      std::unique_ptr<Transfer> transfer = std::move(it->second);
+      transfers.erase(it);
+      Result<Response> result = toResult(code, *transfer);
+      if (result.is_ok()) {
+        HTTPMetrics::shared().record(transfer->url, result.unwrap());
+      } else {
+        HTTPMetrics::shared().recordFailure(transfer->url);
+      }
+      finish(std::move(transfer), std::move(result));
+    }
+  }
+
+  static Result<Response> toResult(CURLcode code, Transfer& transfer) {
+    if (code == CURLE_OPERATION_TIMEDOUT) {
+      return Result<Response>::err(Error::network("Request timeout"));
+    } else if (code == CURLE_URL_MALFORMAT) {
+      return Result<Response>::err(Error::network("Invalid URL"));
+    } else if (code == CURLE_SSL_CONNECT_ERROR) {
+      return Result<Response>::err(Error::network("SSL connection failed"));
+    } else if (code == CURLE_WRITE_ERROR && transfer.onBodyChunk) {
+      return Result<Response>::err(Error::network("Download aborted"));
+    } else if (code == CURLE_READ_ERROR || code == CURLE_ABORTED_BY_CALLBACK) {
+      return Result<Response>::err(Error::io(transfer.source ? std::string("Failed to read request body")
+                                                             : "Failed to read upload file: " + transfer.uploadPath));
+    } else if (code != CURLE_OK) {
+      return Result<Response>::err(Error::network("Request failed"));
+    }
+    Response response;
+    long statusCode = 0;
+    curl_easy_getinfo(transfer.easy, CURLINFO_RESPONSE_CODE, &statusCode);
+    readTransferInfo(transfer.easy, transfer.readsBody(), response);
+    response.statusCode = static_cast<int>(statusCode);
+    response.body = std::move(transfer.body);
+    response.headers = std::move(transfer.headers);
+    response.streamedBytes = transfer.streamed;
+    return Result<Response>::ok(response);
+  }
+
+  void cancel(RequestId id) {
+    auto handle = handles.find(id);
+    if (handle == handles.end()) {
+      return;
+    }
+    auto it = transfers.find(handle->second);
+    std::unique_ptr<Transfer> transfer = std::move(it->second);
+    transfers.erase(it);
+    finish(std::move(transfer), Result<Response>::err(Error::network("Request cancelled")));
+  }
+
+  void finish(std::unique_ptr<Transfer> transfer, Result<Response> result) {
+    if (transfer->id != 0) {
+      handles.erase(transfer->id);
+    }
+    if (transfer->easy) {
+      curl_multi_remove_handle(multi, transfer->easy);
+      curl_easy_cleanup(transfer->easy);
+    }
+    if (transfer->headerList) {
+      curl_slist_free_all(transfer->headerList);
+    }
+    if (transfer->uploadFile) {
+      std::fclose(transfer->uploadFile);
+    }
+    inFlight.fetch_sub(1);
+    transfer->done(std::move(result));
+  }
+
+  void shutdown() {
+    stopping = true;
+    while (!transfers.empty()) {
+      auto it = transfers.begin();
+      std::unique_ptr<Transfer> transfer = std::move(it->second);
+      transfers.erase(it);
+      finish(std::move(transfer), Result<Response>::err(Error::network("Request cancelled")));
+    }
+    if (timerSet) {
+      loop.cancelTimer(timer);
+      timerSet = false;
+    }
+    for (curl_socket_t socket : sockets) {
+      loop.unwatch(socket);
+    }
+    sockets.clear();
+    if (multi) {
+      curl_multi_cleanup(multi);
+      multi = nullptr;
+    }
+  }
+};
+
+AsyncHTTPClient::AsyncHTTPClient(EventLoop& loop) : driver(std::make_unique<Driver>(loop)) {}
+
+AsyncHTTPClient::~AsyncHTTPClient() {
+  // A client that never sent anything has nothing on the loop to undo
+  if (driver->used.load()) {
+    Driver* self = driver.get();
+    driver->loop.runSync([self] { self->shutdown(); });
+  }
+}
+
+AsyncHTTPClient::RequestId AsyncHTTPClient::request(const std::string& method, const std::string& url,
+                                                    const std::string& body, int timeoutMs, Completion done) {
+  Request request;
+  request.method = method;
+  request.url = url;
+  request.body = body;
+  return this->request(std::move(request), timeoutMs, std::move(done));
+}
+
+AsyncHTTPClient::RequestId AsyncHTTPClient::request(Request request, int timeoutMs, Completion done) {
+  driver->used.store(true);
+  driver->inFlight.fetch_add(1);
+  RequestId id = driver->nextId.fetch_add(1);
+  Driver* self = driver.get();
+  driver->loop.post([self, request = std::move(request), timeoutMs, done = std::move(done), id]() mutable {
+    self->start(std::move(request), timeoutMs, std::move(done), id);
+  });
+  return id;
+}
+
+void AsyncHTTPClient::cancel(RequestId id) {
+  // Posted after the request's own start, so it finds the transfer unless
+  // it has finished
+  Driver* self = driver.get();
+  driver->loop.post([self, id]() { self->cancel(id); });
+}
+
+void AsyncHTTPClient::requestAll(std::vector<Request> requests, size_t maxConcurrent, int timeoutMs,
+                                 BatchCompletion done) {
+  auto batch = std::make_shared<Driver::Batch>();
+  batch->results.resize(requests.size());
+  batch->remaining = requests.size();
+  batch->requests = std::move(requests);
+  batch->maxConcurrent = std::max<size_t>(1, maxConcurrent);
+  batch->timeoutMs = timeoutMs;
+  batch->done = std::move(done);
+  driver->used.store(true);
+  driver->inFlight.fetch_add(batch->requests.size());
+  Driver* self = driver.get();
+  driver->loop.post([self, batch]() {
+    if (batch->requests.empty()) {
+      batch->done({});
+      return;
+    }
+    self->startBatch(batch);
+  });
+}
+
+size_t AsyncHTTPClient::inFlight() const {
+  return driver->inFlight.load();
+}
+
+}
+}
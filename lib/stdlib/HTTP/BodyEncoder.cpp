@@ -1,4 +1,9 @@
 #include "xwift/stdlib/HTTP/BodyEncoder.h"
+#include "xwift/stdlib/HTTP/URLParser.h"
+#include <zlib.h>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
 #include <sstream>
 #include <random>
 #include <iomanip>
@@ -11,18 +16,18 @@ std::string BodyEncoder::encodeJSON(const std::string& json) {
 }
 
 std::string BodyEncoder::encodeFormURLEncoded(const std::map<std::string, std::string>& params) {
-    std::ostringstream oss;
-    bool first = true;
+    std::string body;
     
     for (const auto& pair : params) {
-        if (!first) {
-            oss << "&";
+        if (!body.empty()) {
+            body += '&';
         }
-        first = false;
-        oss << urlEncode(pair.first) << "=" << urlEncode(pair.second);
+        percentEncode(pair.first, body);
+        body += '=';
+        percentEncode(pair.second, body);
     }
     
-    return oss.str();
+    return body;
 }
 
 std::string BodyEncoder::encodeMultipartFormData(const std::map<std::string, std::string>& fields, const std::string& boundary) {
@@ -39,6 +44,23 @@ std::string BodyEncoder::encodeMultipartFormData(const std::map<std::string, std
     return oss.str();
 }
 
+std::string BodyEncoder::encodeGzip(const std::string& body) {
+    z_stream stream{};
+    // 16 on top of the window bits asks zlib for a gzip header and trailer
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return "";
+    }
+    std::string out(deflateBound(&stream, body.size()), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(body.data()));
+    stream.avail_in = static_cast<uInt>(body.size());
+    stream.next_out = reinterpret_cast<Bytef*>(out.data());
+    stream.avail_out = static_cast<uInt>(out.size());
+    deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return out;
+}
+
 std::string BodyEncoder::getContentTypeString(ContentType type) {
     switch (type) {
         case ContentType::JSON:
@@ -69,26 +91,182 @@ std::string BodyEncoder::generateBoundary() {
     return oss.str();
 }
 
+// A name or filename inside the quotes of Content-Disposition, escaped as
+// browsers do so it cannot end the quotes or the header line
+static std::string quotedDispositionValue(const std::string& value) {
+    std::string out;
+    out.reserve(value.size());
+    for (char c : value) {
+        if (c == '"') {
+            out += "%22";
+        } else if (c == '\r') {
+            out += "%0D";
+        } else if (c == '\n') {
+            out += "%0A";
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+MultipartBody::MultipartBody(std::string boundary)
+    : Boundary(std::move(boundary)), Closing("--" + Boundary + "--\r\n") {}
+
+MultipartBody::~MultipartBody() {
+    if (File) {
+        std::fclose(File);
+    }
+}
+
+void MultipartBody::appendText(const std::string& text) {
+    // Neighbouring text is merged, so read() only switches between text and
+    // files
+    if (Segments.empty() || !Segments.back().Path.empty()) {
+        Segments.emplace_back();
+    }
+    Segments.back().Text += text;
+}
+
+void MultipartBody::addField(const std::string& name, const std::string& value) {
+    appendText("--" + Boundary + "\r\nContent-Disposition: form-data; name=\"" +
+               quotedDispositionValue(name) + "\"\r\n\r\n" + value + "\r\n");
+}
+
+Result<bool> MultipartBody::addFile(const std::string& name, const std::string& path,
+                                    const std::string& filename, const std::string& contentType) {
+    std::error_code error;
+    if (!std::filesystem::is_regular_file(path, error)) {
+        return Result<bool>::err(Error::io("Cannot open upload file: " + path));
+    }
+    uint64_t fileSize = std::filesystem::file_size(path, error);
+    if (error) {
+        return Result<bool>::err(Error::io("Cannot open upload file: " + path));
+    }
+    std::string shownName = filename.empty() ? std::filesystem::path(path).filename().string() : filename;
+    appendText("--" + Boundary + "\r\nContent-Disposition: form-data; name=\"" +
+               quotedDispositionValue(name) + "\"; filename=\"" + quotedDispositionValue(shownName) +
+               "\"\r\nContent-Type: " + contentType + "\r\n\r\n");
+    Segment file;
+    file.Path = path;
+    file.FileSize = fileSize;
+    Segments.push_back(std::move(file));
+    appendText("\r\n");
+    return Result<bool>::ok(true);
+}
+
+std::string MultipartBody::contentType() const {
+    return "multipart/form-data; boundary=" + Boundary;
+}
+
+uint64_t MultipartBody::size() const {
+    uint64_t total = Closing.size();
+    for (const Segment& segment : Segments) {
+        total += segment.Path.empty() ? segment.Text.size() : segment.FileSize;
+    }
+    return total;
+}
+
+std::ptrdiff_t MultipartBody::read(char* buffer, size_t capacity) {
+    size_t filled = 0;
+    while (filled < capacity && Index <= Segments.size()) {
+        const Segment* segment = Index < Segments.size() ? &Segments[Index] : nullptr;
+        if (!segment || segment->Path.empty()) {
+            const std::string& text = segment ? segment->Text : Closing;
+            size_t count = std::min(capacity - filled, static_cast<size_t>(text.size() - Offset));
+            std::memcpy(buffer + filled, text.data() + Offset, count);
+            filled += count;
+            Offset += count;
+            if (Offset == text.size()) {
+                Index++;
+                Offset = 0;
+            }
+            continue;
+        }
+        
+        // Files are opened as they are reached, so one is open at a time
+        if (!File) {
+            File = std::fopen(segment->Path.c_str(), "rb");
+            if (!File) {
+                return -1;
+            }
+        }
+        size_t wanted = static_cast<size_t>(std::min<uint64_t>(capacity - filled, segment->FileSize - Offset));
+        size_t count = std::fread(buffer + filled, 1, wanted, File);
+        if (count < wanted) {
+            return -1;
+        }
+        filled += count;
+        Offset += count;
+        if (Offset == segment->FileSize) {
+            std::fclose(File);
+            File = nullptr;
+            Index++;
+            Offset = 0;
+        }
+    }
+    return static_cast<std::ptrdiff_t>(filled);
+}
+
+bool MultipartBody::rewind() {
+    if (File) {
+        std::fclose(File);
+        File = nullptr;
+    }
+    Index = 0;
+    Offset = 0;
+    return true;
+}
+
 std::string BodyDecoder::decodeJSON(const std::string& body) {
     return body;
 }
 
 std::map<std::string, std::string> BodyDecoder::decodeFormURLEncoded(const std::string& body) {
     std::map<std::string, std::string> result;
-    std::istringstream iss(body);
-    std::string pair;
     
-    while (std::getline(iss, pair, '&')) {
-        size_t pos = pair.find('=');
-        if (pos != std::string::npos) {
-            std::string key = urlDecode(pair.substr(0, pos));
-            std::string value = urlDecode(pair.substr(pos + 1));
-            result[key] = value;
-        }
+    for (const QueryParam& pair : QueryParamRange{body}) {
+        result[percentDecode(pair.Key, true)] = percentDecode(pair.Value, true);
     }
     
     return result;
 }
 
+// windowBits selects the wrapper: 15 + 32 takes gzip or zlib, -15 raw deflate
+static std::optional<std::string> inflateBody(const std::string& body, int windowBits) {
+    z_stream stream{};
+    if (inflateInit2(&stream, windowBits) != Z_OK) {
+        return std::nullopt;
+    }
+    std::string out;
+    char buffer[16384];
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(body.data()));
+    stream.avail_in = static_cast<uInt>(body.size());
+    int status = Z_OK;
+    while (status == Z_OK) {
+        stream.next_out = reinterpret_cast<Bytef*>(buffer);
+        stream.avail_out = sizeof(buffer);
+        status = inflate(&stream, Z_NO_FLUSH);
+        out.append(buffer, sizeof(buffer) - stream.avail_out);
+    }
+    inflateEnd(&stream);
+    if (status != Z_STREAM_END) {
+        return std::nullopt;
+    }
+    return out;
+}
+
+std::optional<std::string> BodyDecoder::decodeContentEncoding(const std::string& body, const std::string& encoding) {
+    if (encoding == "gzip" || encoding == "x-gzip") {
+        return inflateBody(body, 15 + 32);
+    }
+    if (encoding == "deflate") {
+        // Meant to be zlib-wrapped, though some servers send raw deflate
+        std::optional<std::string> wrapped = inflateBody(body, 15 + 32);
+        return wrapped ? wrapped : inflateBody(body, -15);
+    }
+    return std::nullopt;
+}
+
 }
 }
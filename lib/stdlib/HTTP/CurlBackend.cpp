@@ -1,169 +1,681 @@
-#include "xwift/stdlib/HTTP/HTTPPlugin.h"
+#include "xwift/stdlib/HTTP/CurlBackend.h"
+#include "xwift/stdlib/HTTP/AsyncHTTP.h"
+#include "xwift/stdlib/HTTP/HTTPMetrics.h"
 #include "xwift/Basic/Error.h"
 #include <curl/curl.h>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <future>
+#include <mutex>
 #include <sstream>
 #include <cstring>
+#include <unordered_map>
+#include <vector>
 
 namespace xwift {
 namespace http {
 
-class CurlHTTPBackend : public IHTTPBackend {
-public:
-  CurlHTTPBackend() : timeout(30000) {
-    curl_global_init(CURL_GLOBAL_DEFAULT);
+namespace {
+
+// scheme://host:port of url, the unit handles are pooled by
+std::string hostKey(const std::string& url) {
+  size_t start = url.find("://");
+  start = start == std::string::npos ? 0 : start + 3;
+  return url.substr(0, url.find_first_of("/?#", start));
+}
+
+bool readEnvironment(const char* name, long& value) {
+  const char* env = std::getenv(name);
+  if (!env) {
+    return false;
   }
-  
-  ~CurlHTTPBackend() override {
-    curl_global_cleanup();
+  char* end = nullptr;
+  long parsed = std::strtol(env, &end, 10);
+  if (end == env || *end != '\0' || parsed < 0) {
+    return false;
   }
-  
-  Result<Response> get(const std::string& url) override {
-    return sendRequest("GET", url);
+  value = parsed;
+  return true;
+}
+
+}
+
+CurlPoolOptions CurlPoolOptions::fromEnvironment() {
+  CurlPoolOptions options;
+  long value = 0;
+  if (readEnvironment("XWIFT_HTTP_MAX_CONNECTIONS_PER_HOST", value) && value > 0) {
+    options.maxConnectionsPerHost = static_cast<size_t>(value);
   }
-  
-  Result<Response> post(const std::string& url, const std::string& data) override {
-    return sendRequest("POST", url, data);
+  if (readEnvironment("XWIFT_HTTP_IDLE_TIMEOUT_MS", value)) {
+    options.idleTimeout = std::chrono::milliseconds(value);
   }
-  
-  Result<Response> put(const std::string& url, const std::string& data) override {
-    return sendRequest("PUT", url, data);
+  return options;
+}
+
+// Easy handles kept per host between requests. A handle keeps its own
+// connection cache, so taking one that last talked to the same host reuses
+// its open connection. DNS and TLS sessions live in the share and are
+// reused by every handle. The connection cache is deliberately not shared:
+// libcurl does not support sharing connections between threads that run
+// transfers at the same time.
+struct CurlHTTPBackend::Pool {
+  using Clock = std::chrono::steady_clock;
+
+  struct IdleHandle {
+    CURL* easy;
+    Clock::time_point since;
+  };
+
+  struct Host {
+    // Most recently used last, so the handle most likely to still have a
+    // live connection is taken first
+    std::vector<IdleHandle> idle;
+    size_t active = 0;
+  };
+
+  CURLSH* share = nullptr;
+  std::mutex shareLocks[CURL_LOCK_DATA_LAST];
+
+  mutable std::mutex mutex;
+  std::condition_variable released;
+  std::unordered_map<std::string, Host> hosts;
+  CurlPoolOptions options;
+  CurlPoolStats stats;
+  Clock::time_point lastSweep = Clock::now();
+
+  explicit Pool(const CurlPoolOptions& poolOptions) : options(poolOptions) {
+    share = curl_share_init();
+    curl_share_setopt(share, CURLSHOPT_LOCKFUNC, LockCallback);
+    curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, UnlockCallback);
+    curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
   }
-  
-  Result<Response> deleteRequest(const std::string& url) override {
-    return sendRequest("DELETE", url);
+
+  ~Pool() {
+    for (auto& entry : hosts) {
+      for (IdleHandle& handle : entry.second.idle) {
+        curl_easy_cleanup(handle.easy);
+      }
+    }
+    curl_share_cleanup(share);
   }
-  
-  void setHeader(const std::string& key, const std::string& value) override {
-    headers[key] = value;
+
+  static void LockCallback(CURL*, curl_lock_data data, curl_lock_access, void* userp) {
+    static_cast<Pool*>(userp)->shareLocks[data].lock();
   }
-  
-  void setTimeout(int milliseconds) override {
-    timeout = milliseconds;
+
+  static void UnlockCallback(CURL*, curl_lock_data data, void* userp) {
+    static_cast<Pool*>(userp)->shareLocks[data].unlock();
   }
-  
-  std::string getName() const override {
-    return "Curl";
+
+  // A handle for a request to host, reset if it comes from the pool. Waits
+  // until deadline while the host already has maxConnectionsPerHost
+  // requests running.
+  Result<CURL*> acquire(const std::string& host, Clock::time_point deadline) {
+    std::unique_lock<std::mutex> lock(mutex);
+    // Looked up afresh after every wait, since release() drops hosts that
+    // have nothing left
+    bool free = released.wait_until(lock, deadline, [&] {
+      return hosts[host].active < options.maxConnectionsPerHost;
+    });
+    if (!free) {
+      return Result<CURL*>::err(Error::network("Request timeout"));
+    }
+    Host& entry = hosts[host];
+    dropExpired(entry, Clock::now());
+    entry.active++;
+    if (!entry.idle.empty()) {
+      CURL* easy = entry.idle.back().easy;
+      entry.idle.pop_back();
+      stats.handlesReused++;
+      lock.unlock();
+      // Clears the options but keeps the connection and caches
+      curl_easy_reset(easy);
+      curl_easy_setopt(easy, CURLOPT_SHARE, share);
+      return Result<CURL*>::ok(easy);
+    }
+    stats.handlesCreated++;
+    lock.unlock();
+
+    CURL* easy = curl_easy_init();
+    if (!easy) {
+      release(host, nullptr, 0);
+      return Result<CURL*>::err(Error::network("Failed to initialize CURL"));
+    }
+    curl_easy_setopt(easy, CURLOPT_SHARE, share);
+    return Result<CURL*>::ok(easy);
   }
-  
-  std::string getVersion() const override {
-    return "1.0.0";
+
+  // Hands easy back after a request to host, along with how many TCP
+  // connections it opened. A null easy only gives back the host slot.
+  void release(const std::string& host, CURL* easy, long connections) {
+    std::vector<CURL*> expired;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stats.connectionsOpened += static_cast<uint64_t>(connections);
+      Host& entry = hosts[host];
+      entry.active--;
+      Clock::time_point now = Clock::now();
+      if (easy) {
+        if (options.idleTimeout.count() > 0 && entry.idle.size() < options.maxConnectionsPerHost) {
+          entry.idle.push_back({easy, now});
+        } else {
+          expired.push_back(easy);
+        }
+      }
+      if (entry.active == 0 && entry.idle.empty()) {
+        hosts.erase(host);
+      }
+      // Hosts nobody asks for again are swept once per idle timeout
+      if (now - lastSweep >= options.idleTimeout) {
+        lastSweep = now;
+        for (auto it = hosts.begin(); it != hosts.end();) {
+          dropExpired(it->second, now, &expired);
+          if (it->second.active == 0 && it->second.idle.empty()) {
+            it = hosts.erase(it);
+          } else {
+            ++it;
+          }
+        }
+      }
+    }
+    released.notify_all();
+    for (CURL* handle : expired) {
+      curl_easy_cleanup(handle);
+    }
   }
-  
-private:
-  int timeout;
-  std::map<std::string, std::string> headers;
-  
-  static size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
-    size_t totalSize = size * nmemb;
-    std::string* response = static_cast<std::string*>(userp);
-    response->append(static_cast<char*>(contents), totalSize);
-    return totalSize;
+
+  // Drops idle handles older than the idle timeout, or beyond the per-host
+  // limit, closing them now or handing them to closeLater
+  void dropExpired(Host& entry, Clock::time_point now, std::vector<CURL*>* closeLater = nullptr) {
+    auto keep = entry.idle.begin();
+    size_t excess = entry.idle.size() > options.maxConnectionsPerHost
+                      ? entry.idle.size() - options.maxConnectionsPerHost
+                      : 0;
+    for (size_t i = 0; i < entry.idle.size(); i++) {
+      IdleHandle& handle = entry.idle[i];
+      if (i < excess || now - handle.since >= options.idleTimeout) {
+        if (closeLater) {
+          closeLater->push_back(handle.easy);
+        } else {
+          curl_easy_cleanup(handle.easy);
+        }
+      } else {
+        *keep++ = handle;
+      }
+    }
+    entry.idle.erase(keep, entry.idle.end());
   }
+};
+
+// The loop batches run on, and the client driving them
+struct CurlHTTPBackend::Async {
+  EventLoop loop;
+  AsyncHTTPClient client{loop};
+};
+
+CurlHTTPBackend::CurlHTTPBackend() : CurlHTTPBackend(CurlPoolOptions::fromEnvironment()) {}
+
+CurlHTTPBackend::CurlHTTPBackend(CurlPoolOptions options) : timeout(30000) {
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+  pool = std::make_unique<Pool>(options);
+}
+
+CurlHTTPBackend::~CurlHTTPBackend() {
+  async.reset();
+  pool.reset();
+  curl_global_cleanup();
+}
+
+Result<Response> CurlHTTPBackend::get(const std::string& url) {
+  Request request;
+  request.url = url;
+  return sendRequest(request);
+}
+
+Result<Response> CurlHTTPBackend::post(const std::string& url, const std::string& data) {
+  Request request;
+  request.method = "POST";
+  request.url = url;
+  request.body = data;
+  return sendRequest(request);
+}
+
+Result<Response> CurlHTTPBackend::put(const std::string& url, const std::string& data) {
+  Request request;
+  request.method = "PUT";
+  request.url = url;
+  request.body = data;
+  return sendRequest(request);
+}
+
+Result<Response> CurlHTTPBackend::deleteRequest(const std::string& url) {
+  Request request;
+  request.method = "DELETE";
+  request.url = url;
+  return sendRequest(request);
+}
+
+Result<Response> CurlHTTPBackend::send(const Request& request) {
+  return sendRequest(request);
+}
+
+CurlHTTPBackend::Async& CurlHTTPBackend::startAsync() {
+  std::call_once(asyncStarted, [this] { async = std::make_unique<Async>(); });
+  return *async;
+}
+
+std::vector<Result<Response>> CurlHTTPBackend::sendAll(const std::vector<Request>& requests,
+                                                       size_t maxConcurrent) {
+  Async& shared = startAsync();
+  std::vector<Request> batch;
+  batch.reserve(requests.size());
+  for (const Request& request : requests) {
+    batch.push_back(withHeaders(request));
+  }
+  std::promise<std::vector<Result<Response>>> finished;
+  shared.client.requestAll(std::move(batch), maxConcurrent, timeout.load(),
+                           [&finished](std::vector<Result<Response>> results) {
+                             finished.set_value(std::move(results));
+                           });
+  return finished.get_future().get();
+}
+
+Result<Response> CurlHTTPBackend::sendHedged(const Request& request, int delayMs, HedgeOutcome& outcome) {
+  // Shared with the callbacks, which outlive this call when the losing copy
+  // is still being cancelled. Only the loop thread touches it once started.
+  struct Race {
+    std::promise<Result<Response>> winner;
+    bool settled = false;
+    bool hedgePending = true;
+    bool hedged = false;
+    bool hedgeWon = false;
+    int outstanding = 0;
+    EventLoop::TimerId timer = 0;
+    AsyncHTTPClient::RequestId copies[2] = {0, 0};
+  };
+  Async& shared = startAsync();
+  auto race = std::make_shared<Race>();
+  auto sent = std::make_shared<const Request>(withHeaders(request));
+  int fallbackMs = timeout.load();
   
-  static size_t HeaderCallback(char* buffer, size_t size, size_t nitems, void* userdata) {
-    size_t totalSize = size * nitems;
-    std::map<std::string, std::string>* headersMap = static_cast<std::map<std::string, std::string>*>(userdata);
-    
-    std::string header(buffer, totalSize);
-    size_t colonPos = header.find(':');
-    if (colonPos != std::string::npos) {
-      std::string key = header.substr(0, colonPos);
-      std::string value = header.substr(colonPos + 1);
-      
-      while (!value.empty() && (value[0] == ' ' || value[0] == '\t' || value[0] == '\r' || value[0] == '\n')) {
-        value = value.substr(1);
-      }
-      while (!value.empty() && (value.back() == '\r' || value.back() == '\n')) {
-        value.pop_back();
-      }
-      
-      if (!key.empty()) {
-        (*headersMap)[key] = value;
+  auto settle = [race, &shared](Result<Response> result, int copy) {
+    race->outstanding--;
+    // A failure waits for the other copy, if one is still out
+    if (race->settled || (result.is_error() && race->outstanding > 0)) {
+      return;
+    }
+    race->settled = true;
+    if (race->hedgePending) {
+      shared.loop.cancelTimer(race->timer);
+      race->hedgePending = false;
+    }
+    if (race->outstanding > 0) {
+      shared.client.cancel(race->copies[1 - copy]);
+    }
+    race->hedgeWon = copy == 1;
+    race->winner.set_value(std::move(result));
+  };
+  auto send = [race, sent, fallbackMs, settle, &shared](int copy) {
+    race->outstanding++;
+    race->copies[copy] = shared.client.request(*sent, fallbackMs, [settle, copy](Result<Response> result) {
+      settle(std::move(result), copy);
+    });
+  };
+  
+  std::future<Result<Response>> answer = race->winner.get_future();
+  shared.loop.post([race, send, delayMs, &shared]() {
+    send(0);
+    race->timer = shared.loop.addTimer(std::chrono::milliseconds(delayMs), [race, send]() {
+      race->hedgePending = false;
+      if (race->settled) {
+        return;
       }
+      race->hedged = true;
+      send(1);
+    });
+  });
+  Result<Response> result = answer.get();
+  outcome.hedged = race->hedged;
+  outcome.hedgeWon = race->hedgeWon;
+  return result;
+}
+
+Request CurlHTTPBackend::withHeaders(const Request& request) const {
+  // The request's own headers win over the backend's
+  Request merged = request;
+  std::lock_guard<std::mutex> lock(pool->mutex);
+  merged.headers.insert(headers.begin(), headers.end());
+  return merged;
+}
+
+void CurlHTTPBackend::setHeader(const std::string& key, const std::string& value) {
+  std::lock_guard<std::mutex> lock(pool->mutex);
+  headers[key] = value;
+}
+
+void CurlHTTPBackend::setTimeout(int milliseconds) {
+  timeout = milliseconds;
+}
+
+void CurlHTTPBackend::setPoolOptions(const CurlPoolOptions& options) {
+  std::lock_guard<std::mutex> lock(pool->mutex);
+  pool->options = options;
+}
+
+CurlPoolStats CurlHTTPBackend::poolStats() const {
+  std::lock_guard<std::mutex> lock(pool->mutex);
+  CurlPoolStats stats = pool->stats;
+  stats.idleHandles = 0;
+  for (const auto& entry : pool->hosts) {
+    stats.idleHandles += entry.second.idle.size();
+  }
+  return stats;
+}
+
+namespace {
+
+// Where a response body goes: collected into body, or handed to onChunk
+struct BodySink {
+  std::string body;
+  const std::function<bool(const char*, size_t)>* onChunk = nullptr;
+  uint64_t streamed = 0;
+};
+
+}
+
+static size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
+  size_t totalSize = size * nmemb;
+  auto* sink = static_cast<BodySink*>(userp);
+  if (sink->onChunk) {
+    if (!(*sink->onChunk)(static_cast<const char*>(contents), totalSize)) {
+      // Anything short of totalSize makes curl abort with CURLE_WRITE_ERROR
+      return 0;
     }
-    
+    sink->streamed += totalSize;
     return totalSize;
   }
-  
-  Result<Response> sendRequest(const std::string& method, const std::string& url, const std::string& data = "") {
-    Response response;
-    response.statusCode = 0;
-    response.error = HTTPError::None;
-    
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-      return Result<Response>::err(Error::network("Failed to initialize CURL"));
-    }
-    
-    std::string responseBody;
-    std::map<std::string, std::string> responseHeaders;
-    
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &responseBody);
-    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
-    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &responseHeaders);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeout);
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);
-    
-    if (method == "GET") {
-      curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
-    } else if (method == "POST") {
+  sink->body.append(static_cast<char*>(contents), totalSize);
+  return totalSize;
+}
+
+static size_t ReadCallback(char* buffer, size_t size, size_t nitems, void* userp) {
+  std::FILE* file = static_cast<std::FILE*>(userp);
+  size_t read = std::fread(buffer, 1, size * nitems, file);
+  return std::ferror(file) ? CURL_READFUNC_ABORT : read;
+}
+
+static size_t SourceReadCallback(char* buffer, size_t size, size_t nitems, void* userp) {
+  std::ptrdiff_t read = static_cast<BodySource*>(userp)->read(buffer, size * nitems);
+  return read < 0 ? CURL_READFUNC_ABORT : static_cast<size_t>(read);
+}
+
+// curl seeks only to resend the body from its start, after a redirect or an
+// authentication round
+static int SourceSeekCallback(void* userp, curl_off_t offset, int origin) {
+  if (offset != 0 || origin != SEEK_SET) {
+    return CURL_SEEKFUNC_CANTSEEK;
+  }
+  return static_cast<BodySource*>(userp)->rewind() ? CURL_SEEKFUNC_OK : CURL_SEEKFUNC_FAIL;
+}
+
+void setBodySource(void* handle, BodySource* source) {
+  CURL* curl = static_cast<CURL*>(handle);
+  curl_easy_setopt(curl, CURLOPT_READFUNCTION, SourceReadCallback);
+  curl_easy_setopt(curl, CURLOPT_READDATA, source);
+  curl_easy_setopt(curl, CURLOPT_SEEKFUNCTION, SourceSeekCallback);
+  curl_easy_setopt(curl, CURLOPT_SEEKDATA, source);
+}
+
+static int ProgressCallback(void* userp, curl_off_t downloadTotal, curl_off_t downloaded,
+                            curl_off_t uploadTotal, curl_off_t uploaded) {
+  auto* onProgress = static_cast<const std::function<void(const TransferProgress&)>*>(userp);
+  TransferProgress progress;
+  progress.downloaded = static_cast<uint64_t>(downloaded);
+  progress.downloadTotal = static_cast<uint64_t>(downloadTotal);
+  progress.uploaded = static_cast<uint64_t>(uploaded);
+  progress.uploadTotal = static_cast<uint64_t>(uploadTotal);
+  (*onProgress)(progress);
+  return 0;
+}
+
+static size_t HeaderCallback(char* buffer, size_t size, size_t nitems, void* userdata) {
+  size_t totalSize = size * nitems;
+  std::map<std::string, std::string>* headersMap = static_cast<std::map<std::string, std::string>*>(userdata);
+
+  std::string header(buffer, totalSize);
+  size_t colonPos = header.find(':');
+  if (colonPos != std::string::npos) {
+    std::string key = header.substr(0, colonPos);
+    std::string value = header.substr(colonPos + 1);
+
+    while (!value.empty() && (value[0] == ' ' || value[0] == '\t' || value[0] == '\r' || value[0] == '\n')) {
+      value = value.substr(1);
+    }
+    while (!value.empty() && (value.back() == '\r' || value.back() == '\n')) {
+      value.pop_back();
+    }
+
+    if (!key.empty()) {
+      (*headersMap)[key] = value;
+    }
+  }
+
+  return totalSize;
+}
+
+Result<Response> CurlHTTPBackend::sendRequest(const Request& request) {
+  const std::string& method = request.method;
+  const std::string& url = request.url;
+  const std::string& data = request.body;
+
+  Response response;
+  response.statusCode = 0;
+  response.error = HTTPError::None;
+
+  // Opened before taking a handle, so a missing file costs no connection
+  std::FILE* uploadFile = nullptr;
+  curl_off_t uploadSize = 0;
+  BodySource* source = request.bodySource.get();
+  if (source) {
+    // A source sent before is partway through or at its end
+    if (!source->rewind()) {
+      return Result<Response>::err(Error::io("Cannot read request body"));
+    }
+    uploadSize = static_cast<curl_off_t>(source->size());
+  } else if (!request.uploadFile.empty()) {
+    std::error_code error;
+    uploadSize = static_cast<curl_off_t>(std::filesystem::file_size(request.uploadFile, error));
+    uploadFile = error ? nullptr : std::fopen(request.uploadFile.c_str(), "rb");
+    if (!uploadFile) {
+      return Result<Response>::err(Error::io("Cannot open upload file: " + request.uploadFile));
+    }
+  }
+  bool readBody = uploadFile || source;
+  bool hasBody = readBody || !data.empty();
+
+  int timeoutMs = request.timeoutMs > 0 ? request.timeoutMs : timeout.load();
+  std::string host = hostKey(url);
+  auto acquired = pool->acquire(host, Pool::Clock::now() + std::chrono::milliseconds(timeoutMs));
+  if (acquired.is_error()) {
+    if (uploadFile) {
+      std::fclose(uploadFile);
+    }
+    return Result<Response>::err(acquired.error());
+  }
+  CURL* curl = acquired.unwrap();
+
+  BodySink sink;
+  sink.onChunk = request.onBodyChunk ? &request.onBodyChunk : nullptr;
+  std::map<std::string, std::string> responseHeaders;
+
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &sink);
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, &responseHeaders);
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, static_cast<long>(timeoutMs));
+  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+  // Advertises gzip and deflate; curl inflates the body chunk by chunk
+  // before WriteCallback sees it
+  curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, ContentEncodings);
+  if (request.onProgress) {
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, ProgressCallback);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &request.onProgress);
+  }
+
+  if (uploadFile) {
+    curl_easy_setopt(curl, CURLOPT_READFUNCTION, ReadCallback);
+    curl_easy_setopt(curl, CURLOPT_READDATA, uploadFile);
+  } else if (source) {
+    setBodySource(curl, source);
+  }
+
+  if (method == "GET") {
+    curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+  } else if (method == "HEAD") {
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+  } else if (readBody) {
+    // POST streams through the read callback like any other method, just
+    // with POST's own option so curl keeps its semantics
+    if (method == "POST") {
       curl_easy_setopt(curl, CURLOPT_POST, 1L);
+      curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, uploadSize);
+    } else {
+      curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
+      curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, uploadSize);
+      if (method != "PUT") {
+        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method.c_str());
+      }
+    }
+  } else if (method == "POST") {
+    curl_easy_setopt(curl, CURLOPT_POST, 1L);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data.c_str());
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, data.length());
+  } else if (method == "PUT") {
+    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data.c_str());
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, data.length());
+  } else {
+    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method.c_str());
+    if (!data.empty()) {
       curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data.c_str());
       curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, data.length());
-    } else if (method == "PUT") {
-      curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
-      curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data.c_str());
-      curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, data.length());
-    } else if (method == "DELETE") {
-      curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "DELETE");
-    }
-    
-    struct curl_slist* headerList = nullptr;
-    for (const auto& header : headers) {
-      std::string headerStr = header.first + ": " + header.second;
-      headerList = curl_slist_append(headerList, headerStr.c_str());
     }
-    
-    if (!data.empty()) {
-      headerList = curl_slist_append(headerList, "Content-Type: application/x-www-form-urlencoded");
-    }
-    
-    if (headerList) {
-      curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headerList);
-    }
-    
-    CURLcode res = curl_easy_perform(curl);
-    
-    if (res != CURLE_OK) {
-      if (res == CURLE_OPERATION_TIMEDOUT) {
-        return Result<Response>::err(Error::network("Request timeout"));
-      } else if (res == CURLE_URL_MALFORMAT) {
-        return Result<Response>::err(Error::network("Invalid URL"));
-      } else if (res == CURLE_SSL_CONNECT_ERROR) {
-        return Result<Response>::err(Error::network("SSL connection failed"));
-      } else {
-        return Result<Response>::err(Error::network("Request failed"));
-      }
+  }
+
+  // The request's own headers win over the backend's
+  std::map<std::string, std::string> requestHeaders = request.headers;
+  {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    requestHeaders.insert(headers.begin(), headers.end());
+  }
+
+  struct curl_slist* headerList = nullptr;
+  for (const auto& header : requestHeaders) {
+    std::string headerStr = header.first + ": " + header.second;
+    headerList = curl_slist_append(headerList, headerStr.c_str());
+  }
+
+  if (hasBody && requestHeaders.find("Content-Type") == requestHeaders.end()) {
+    headerList = curl_slist_append(headerList, "Content-Type: application/x-www-form-urlencoded");
+  }
+  if (readBody) {
+    // Send the body straight away rather than waiting on 100 Continue
+    headerList = curl_slist_append(headerList, "Expect:");
+  }
+
+  if (headerList) {
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headerList);
+  }
+
+  CURLcode res = curl_easy_perform(curl);
+
+  long statusCode = 0;
+  long connections = 0;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &statusCode);
+  curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connections);
+  readTransferInfo(curl, readBody, response);
+  if (headerList) {
+    curl_slist_free_all(headerList);
+  }
+  if (uploadFile) {
+    std::fclose(uploadFile);
+  }
+  // A failed transfer leaves the handle usable; curl drops a broken
+  // connection itself
+  pool->release(host, curl, connections);
+
+  if (res != CURLE_OK) {
+    HTTPMetrics::shared().recordFailure(url);
+    if (res == CURLE_OPERATION_TIMEDOUT) {
+      return Result<Response>::err(Error::network("Request timeout"));
+    } else if (res == CURLE_URL_MALFORMAT) {
+      return Result<Response>::err(Error::network("Invalid URL"));
+    } else if (res == CURLE_SSL_CONNECT_ERROR) {
+      return Result<Response>::err(Error::network("SSL connection failed"));
+    } else if (res == CURLE_WRITE_ERROR && sink.onChunk) {
+      return Result<Response>::err(Error::network("Download aborted"));
+    } else if (res == CURLE_READ_ERROR || res == CURLE_ABORTED_BY_CALLBACK) {
+      return Result<Response>::err(Error::io(source ? std::string("Failed to read request body")
+                                                    : "Failed to read upload file: " + request.uploadFile));
     } else {
-      long statusCode;
-      curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &statusCode);
-      response.statusCode = static_cast<int>(statusCode);
-      response.body = responseBody;
-      response.headers = responseHeaders;
-    }
-    
-    if (headerList) {
-      curl_slist_free_all(headerList);
+      return Result<Response>::err(Error::network("Request failed"));
     }
-    
-    curl_easy_cleanup(curl);
-    return Result<Response>::ok(response);
   }
-};
+
+  response.statusCode = static_cast<int>(statusCode);
+  response.body = std::move(sink.body);
+  response.streamedBytes = sink.streamed;
+  response.headers = std::move(responseHeaders);
+  HTTPMetrics::shared().record(url, response);
+  return Result<Response>::ok(response);
+}
+
+void readTransferInfo(void* handle, bool bodyFromFile, Response& response) {
+  CURL* curl = static_cast<CURL*>(handle);
+  curl_off_t nameLookup = 0, connect = 0, appConnect = 0, preTransfer = 0, startTransfer = 0, total = 0;
+  curl_off_t uploaded = 0, downloaded = 0;
+  long requestSize = 0, headerSize = 0;
+  curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &nameLookup);
+  curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+  curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &appConnect);
+  curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME_T, &preTransfer);
+  curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &startTransfer);
+  curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+  curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD_T, &uploaded);
+  curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &downloaded);
+  curl_easy_getinfo(curl, CURLINFO_REQUEST_SIZE, &requestSize);
+  curl_easy_getinfo(curl, CURLINFO_HEADER_SIZE, &headerSize);
+
+  // curl reports each phase as microseconds since the transfer started
+  auto between = [](curl_off_t from, curl_off_t to) {
+    return to > from ? static_cast<double>(to - from) / 1000.0 : 0.0;
+  };
+  response.totalTimeMs = static_cast<double>(total) / 1000.0;
+  response.timing.nameLookupMs = between(0, nameLookup);
+  response.timing.connectMs = connect > 0 ? between(nameLookup, connect) : 0;
+  response.timing.tlsMs = appConnect > 0 ? between(connect, appConnect) : 0;
+  response.timing.firstByteMs = between(preTransfer, startTransfer);
+
+  // REQUEST_SIZE includes a body from memory when curl sent it together
+  // with the headers, which it only does for bodies small enough that the
+  // total still exceeds the body alone
+  uint64_t sent = static_cast<uint64_t>(requestSize);
+  if (bodyFromFile || requestSize <= uploaded) {
+    sent += static_cast<uint64_t>(uploaded);
+  }
+  response.bytesSent = sent;
+  response.bytesReceived = static_cast<uint64_t>(headerSize) + static_cast<uint64_t>(downloaded);
+}
 
 }
 }
@@ -0,0 +1,718 @@
+#include "xwift/stdlib/HTTP/HTTPCache.h"
+#include <zlib.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+namespace xwift {
+namespace http {
+
+namespace {
+
+std::string lowercase(std::string text) {
+  std::transform(text.begin(), text.end(), text.begin(),
+                 [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  return text;
+}
+
+std::string trim(const std::string& text) {
+  size_t start = text.find_first_not_of(" \t");
+  if (start == std::string::npos) {
+    return "";
+  }
+  return text.substr(start, text.find_last_not_of(" \t") - start + 1);
+}
+
+// Servers differ in how they capitalize header names
+std::string findHeader(const std::map<std::string, std::string>& headers, const std::string& name) {
+  std::string wanted = lowercase(name);
+  for (const auto& header : headers) {
+    if (lowercase(header.first) == wanted) {
+      return header.second;
+    }
+  }
+  return "";
+}
+
+void setHeaderIgnoringCase(std::map<std::string, std::string>& headers, const std::string& name,
+                           const std::string& value) {
+  std::string wanted = lowercase(name);
+  for (auto it = headers.begin(); it != headers.end(); ++it) {
+    if (lowercase(it->first) == wanted) {
+      headers.erase(it);
+      break;
+    }
+  }
+  headers[name] = value;
+}
+
+struct CacheControl {
+  bool noStore = false;
+  bool noCache = false;
+  bool isPrivate = false;
+  std::optional<long long> maxAge;
+
+  static CacheControl parse(const std::string& value) {
+    CacheControl control;
+    std::istringstream directives(value);
+    std::string directive;
+    while (std::getline(directives, directive, ',')) {
+      directive = lowercase(trim(directive));
+      std::string name = trim(directive.substr(0, directive.find('=')));
+      if (name == "no-store") {
+        control.noStore = true;
+      } else if (name == "no-cache") {
+        control.noCache = true;
+      } else if (name == "private") {
+        control.isPrivate = true;
+      } else if (name == "max-age" && directive.find('=') != std::string::npos) {
+        std::string seconds = trim(directive.substr(directive.find('=') + 1));
+        seconds.erase(std::remove(seconds.begin(), seconds.end(), '"'), seconds.end());
+        char* end = nullptr;
+        long long parsed = std::strtoll(seconds.c_str(), &end, 10);
+        // An invalid max-age makes the response stale right away
+        control.maxAge = (end != seconds.c_str() && *end == '\0' && parsed > 0) ? parsed : 0;
+      }
+    }
+    return control;
+  }
+};
+
+// IMF-fixdate, the form RFC 7231 requires senders to use
+std::optional<std::time_t> parseHTTPDate(const std::string& text) {
+  std::tm parts{};
+  std::istringstream in(text);
+  in.imbue(std::locale::classic());
+  in >> std::get_time(&parts, "%a, %d %b %Y %H:%M:%S");
+  if (in.fail()) {
+    return std::nullopt;
+  }
+#ifdef _WIN32
+  return _mkgmtime(&parts);
+#else
+  return timegm(&parts);
+#endif
+}
+
+long long parseSeconds(const std::string& text) {
+  char* end = nullptr;
+  long long parsed = std::strtoll(text.c_str(), &end, 10);
+  return (end != text.c_str() && parsed > 0) ? parsed : 0;
+}
+
+std::optional<std::string> deflateBody(const std::string& body) {
+  uLongf size = compressBound(static_cast<uLong>(body.size()));
+  std::string out(size, '\0');
+  if (compress2(reinterpret_cast<Bytef*>(out.data()), &size,
+                reinterpret_cast<const Bytef*>(body.data()), static_cast<uLong>(body.size()),
+                Z_BEST_SPEED) != Z_OK) {
+    return std::nullopt;
+  }
+  out.resize(size);
+  return out;
+}
+
+std::optional<std::string> inflateBody(const std::string& data, size_t size) {
+  std::string out(size, '\0');
+  uLongf length = static_cast<uLongf>(size);
+  if (uncompress(reinterpret_cast<Bytef*>(out.data()), &length,
+                 reinterpret_cast<const Bytef*>(data.data()), static_cast<uLong>(data.size())) != Z_OK ||
+      length != size) {
+    return std::nullopt;
+  }
+  return out;
+}
+
+// A stored GET response. Times are wall-clock seconds so they mean the
+// same after a restart, for entries read back from disk.
+struct Entry {
+  std::string url;
+  int statusCode = 0;
+  std::map<std::string, std::string> headers;
+  // Deflated when compressed is set
+  std::string body;
+  size_t bodySize = 0;
+  bool compressed = false;
+  std::time_t storedAt = 0;
+  long long lifetime = 0;
+  long long initialAge = 0;
+  bool noCache = false;
+  // The request headers the response's Vary names, lowercased, with the
+  // values they went out with; a request sending others is a miss
+  std::map<std::string, std::string> varied;
+
+  long long age(std::time_t now) const {
+    return initialAge + std::max<long long>(0, static_cast<long long>(now - storedAt));
+  }
+
+  bool isFresh(std::time_t now) const { return !noCache && age(now) < lifetime; }
+
+  bool hasValidator() const {
+    return !findHeader(headers, "ETag").empty() || !findHeader(headers, "Last-Modified").empty();
+  }
+
+  size_t cost() const {
+    size_t total = sizeof(Entry) + url.size() + body.size();
+    for (const auto& header : headers) {
+      total += header.first.size() + header.second.size();
+    }
+    for (const auto& header : varied) {
+      total += header.first.size() + header.second.size();
+    }
+    return total;
+  }
+
+  // Freshness from the response headers, as received at now (RFC 7234
+  // 4.2.1 and 4.2.3)
+  void computeFreshness(std::time_t now) {
+    CacheControl control = CacheControl::parse(findHeader(headers, "Cache-Control"));
+    std::optional<std::time_t> date = parseHTTPDate(findHeader(headers, "Date"));
+    noCache = control.noCache || lowercase(findHeader(headers, "Pragma")) == "no-cache";
+    if (control.maxAge) {
+      lifetime = *control.maxAge;
+    } else if (auto expires = parseHTTPDate(findHeader(headers, "Expires"))) {
+      lifetime = static_cast<long long>(*expires - date.value_or(now));
+    } else {
+      lifetime = 0;
+    }
+    long long apparentAge = date ? std::max<long long>(0, static_cast<long long>(now - *date)) : 0;
+    initialAge = std::max(apparentAge, parseSeconds(findHeader(headers, "Age")));
+    storedAt = now;
+  }
+
+  Response toResponse(std::time_t now, const std::string& plainBody) const {
+    Response response;
+    response.statusCode = statusCode;
+    response.headers = headers;
+    setHeaderIgnoringCase(response.headers, "Age", std::to_string(age(now)));
+    response.body = plainBody;
+    return response;
+  }
+};
+
+// FNV-1a of the URL names its file; the URL is stored inside to rule out
+// collisions
+std::string fileNameFor(const std::string& url) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (unsigned char c : url) {
+    hash = (hash ^ c) * 1099511628211ULL;
+  }
+  std::ostringstream name;
+  name << std::hex << std::setw(16) << std::setfill('0') << hash << ".cache";
+  return name.str();
+}
+
+const char* const DiskMagic = "xwift-http-cache 2";
+
+bool writeEntry(const std::filesystem::path& path, const Entry& entry) {
+  // Named per thread, since two threads may store the same URL at once
+  std::filesystem::path temporary = path;
+  temporary += "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+  {
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      return false;
+    }
+    out << DiskMagic << '\n' << entry.url << '\n'
+        << entry.statusCode << ' ' << static_cast<long long>(entry.storedAt) << ' ' << entry.lifetime << ' '
+        << entry.initialAge << ' ' << entry.noCache << ' ' << entry.compressed << ' '
+        << entry.bodySize << ' ' << entry.body.size() << ' ' << entry.headers.size() << ' '
+        << entry.varied.size() << '\n';
+    for (const auto& header : entry.headers) {
+      out << header.first << '\n' << header.second << '\n';
+    }
+    for (const auto& header : entry.varied) {
+      out << header.first << '\n' << header.second << '\n';
+    }
+    out.write(entry.body.data(), static_cast<std::streamsize>(entry.body.size()));
+    if (!out) {
+      return false;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(temporary, path, error);
+  return !error;
+}
+
+std::optional<Entry> readEntry(const std::filesystem::path& path, const std::string& url) {
+  std::ifstream in(path, std::ios::binary);
+  std::string line;
+  if (!in || !std::getline(in, line) || line != DiskMagic || !std::getline(in, line) || line != url) {
+    return std::nullopt;
+  }
+  Entry entry;
+  entry.url = url;
+  long long storedAt = 0;
+  size_t storedLength = 0;
+  size_t headerCount = 0;
+  size_t variedCount = 0;
+  in >> entry.statusCode >> storedAt >> entry.lifetime >> entry.initialAge >> entry.noCache >>
+    entry.compressed >> entry.bodySize >> storedLength >> headerCount >> variedCount;
+  in.ignore(1);
+  entry.storedAt = static_cast<std::time_t>(storedAt);
+  for (size_t i = 0; i < headerCount + variedCount && in; i++) {
+    std::string name;
+    std::string value;
+    std::getline(in, name);
+    std::getline(in, value);
+    (i < headerCount ? entry.headers : entry.varied)[name] = value;
+  }
+  entry.body.resize(storedLength);
+  in.read(entry.body.data(), static_cast<std::streamsize>(storedLength));
+  if (!in) {
+    return std::nullopt;
+  }
+  return entry;
+}
+
+bool readEnvironment(const char* name, long long& value) {
+  const char* env = std::getenv(name);
+  if (!env) {
+    return false;
+  }
+  char* end = nullptr;
+  long long parsed = std::strtoll(env, &end, 10);
+  if (end == env || *end != '\0' || parsed < 0) {
+    return false;
+  }
+  value = parsed;
+  return true;
+}
+
+}
+
+HTTPCacheOptions HTTPCacheOptions::fromEnvironment() {
+  HTTPCacheOptions options;
+  long long value = 0;
+  if (readEnvironment("XWIFT_HTTP_CACHE_BYTES", value)) {
+    options.maxBytes = static_cast<size_t>(value);
+  }
+  if (const char* directory = std::getenv("XWIFT_HTTP_CACHE_DIR")) {
+    options.diskDirectory = directory;
+  }
+  return options;
+}
+
+// Entries in memory, most recently used first, with the disk store behind
+// them. Disk I/O happens outside the lock.
+struct CachingHTTPBackend::Store {
+  using List = std::list<Entry>;
+
+  HTTPCacheOptions options;
+  mutable std::mutex mutex;
+  List entries;
+  std::unordered_map<std::string, List::iterator> index;
+  size_t bytes = 0;
+  HTTPCacheStats stats;
+  // Set on the backend, so sent with every request that has none of its own
+  std::map<std::string, std::string> headers;
+
+  explicit Store(const HTTPCacheOptions& cacheOptions) : options(cacheOptions) {
+    if (!options.diskDirectory.empty()) {
+      std::error_code error;
+      std::filesystem::create_directories(options.diskDirectory, error);
+    }
+  }
+
+  // The value request goes out with for the header name, or empty
+  std::string sentHeader(const Request& request, const std::string& name) {
+    std::string value = findHeader(request.headers, name);
+    if (!value.empty()) {
+      return value;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    return findHeader(headers, name);
+  }
+
+  std::filesystem::path pathFor(const std::string& url) const {
+    return std::filesystem::path(options.diskDirectory) / fileNameFor(url);
+  }
+
+  std::optional<Entry> lookup(const std::string& url) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto it = index.find(url);
+      if (it != index.end()) {
+        entries.splice(entries.begin(), entries, it->second);
+        return *it->second;
+      }
+    }
+    if (options.diskDirectory.empty()) {
+      return std::nullopt;
+    }
+    std::optional<Entry> entry = readEntry(pathFor(url), url);
+    if (entry) {
+      std::lock_guard<std::mutex> lock(mutex);
+      keep(*entry);
+    }
+    return entry;
+  }
+
+  void insert(const Entry& entry) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      keep(entry);
+    }
+    if (!options.diskDirectory.empty()) {
+      writeEntry(pathFor(entry.url), entry);
+    }
+  }
+
+  void erase(const std::string& url) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      drop(url);
+    }
+    if (!options.diskDirectory.empty()) {
+      std::error_code error;
+      std::filesystem::remove(pathFor(url), error);
+    }
+  }
+
+  void clear() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      entries.clear();
+      index.clear();
+      bytes = 0;
+    }
+    if (!options.diskDirectory.empty()) {
+      std::error_code error;
+      for (const auto& file : std::filesystem::directory_iterator(options.diskDirectory, error)) {
+        if (file.path().extension() == ".cache") {
+          std::filesystem::remove(file.path(), error);
+        }
+      }
+    }
+  }
+
+  // Caller holds mutex
+  void keep(const Entry& entry) {
+    drop(entry.url);
+    if (entry.cost() > options.maxBytes) {
+      return;
+    }
+    entries.push_front(entry);
+    index[entry.url] = entries.begin();
+    bytes += entry.cost();
+    while (bytes > options.maxBytes) {
+      bytes -= entries.back().cost();
+      index.erase(entries.back().url);
+      entries.pop_back();
+    }
+  }
+
+  // Caller holds mutex
+  void drop(const std::string& url) {
+    auto it = index.find(url);
+    if (it != index.end()) {
+      bytes -= it->second->cost();
+      entries.erase(it->second);
+      index.erase(it);
+    }
+  }
+};
+
+CachingHTTPBackend::CachingHTTPBackend(std::shared_ptr<IHTTPBackend> innerBackend, HTTPCacheOptions options)
+  : inner(std::move(innerBackend)), store(std::make_unique<Store>(options)) {}
+
+CachingHTTPBackend::~CachingHTTPBackend() = default;
+
+Result<Response> CachingHTTPBackend::get(const std::string& url) {
+  Request request;
+  request.url = url;
+  return send(request);
+}
+
+Result<Response> CachingHTTPBackend::post(const std::string& url, const std::string& data) {
+  Request request;
+  request.method = "POST";
+  request.url = url;
+  request.body = data;
+  return send(request);
+}
+
+Result<Response> CachingHTTPBackend::put(const std::string& url, const std::string& data) {
+  Request request;
+  request.method = "PUT";
+  request.url = url;
+  request.body = data;
+  return send(request);
+}
+
+Result<Response> CachingHTTPBackend::deleteRequest(const std::string& url) {
+  Request request;
+  request.method = "DELETE";
+  request.url = url;
+  return send(request);
+}
+
+// What begin() worked out for a request the cache could not answer: the
+// request to send, and what complete() does with the response
+struct CachingHTTPBackend::Pending {
+  enum class Kind { PassThrough, Unsafe, Lookup };
+
+  Kind kind = Kind::PassThrough;
+  Request sent;
+  // The stale entry sent for revalidation, if any
+  std::optional<Entry> cached;
+};
+
+Result<Response> CachingHTTPBackend::send(const Request& request) {
+  Pending pending;
+  if (std::optional<Result<Response>> answered = begin(request, pending)) {
+    return std::move(*answered);
+  }
+  return complete(pending, inner->send(pending.sent));
+}
+
+Result<Response> CachingHTTPBackend::sendHedged(const Request& request, int delayMs, HedgeOutcome& outcome) {
+  Pending pending;
+  if (std::optional<Result<Response>> answered = begin(request, pending)) {
+    return std::move(*answered);
+  }
+  return complete(pending, inner->sendHedged(pending.sent, delayMs, outcome));
+}
+
+std::vector<Result<Response>> CachingHTTPBackend::sendAll(const std::vector<Request>& requests,
+                                                          size_t maxConcurrent) {
+  // Fresh hits are answered here; the rest go to the inner backend as one
+  // batch and are stored as they would be one by one
+  std::vector<std::optional<Result<Response>>> slots(requests.size());
+  std::vector<Pending> pending(requests.size());
+  std::vector<Request> sent;
+  std::vector<size_t> sentFrom;
+  for (size_t i = 0; i < requests.size(); i++) {
+    slots[i] = begin(requests[i], pending[i]);
+    if (!slots[i]) {
+      sent.push_back(std::move(pending[i].sent));
+      sentFrom.push_back(i);
+    }
+  }
+  std::vector<Result<Response>> fetched = inner->sendAll(sent, maxConcurrent);
+  for (size_t k = 0; k < fetched.size() && k < sentFrom.size(); k++) {
+    size_t i = sentFrom[k];
+    pending[i].sent = std::move(sent[k]);
+    slots[i] = complete(pending[i], std::move(fetched[k]));
+  }
+  std::vector<Result<Response>> results;
+  results.reserve(slots.size());
+  for (auto& slot : slots) {
+    results.push_back(std::move(*slot));
+  }
+  return results;
+}
+
+std::optional<Result<Response>> CachingHTTPBackend::begin(const Request& request, Pending& pending) {
+  pending.sent = request;
+  if (request.method == "HEAD" || request.method == "OPTIONS") {
+    return std::nullopt;
+  }
+  if (request.method != "GET") {
+    pending.kind = Pending::Kind::Unsafe;
+    return std::nullopt;
+  }
+
+  CacheControl asked = CacheControl::parse(findHeader(request.headers, "Cache-Control"));
+  if (asked.noStore || request.isStreaming()) {
+    // A streamed body never passes through here to be kept
+    return std::nullopt;
+  }
+  if (!store->sentHeader(request, "Authorization").empty() || !store->sentHeader(request, "Cookie").empty()) {
+    // What a server answers to credentials is for whoever sent them, and
+    // every client in the process shares this cache (RFC 7234 3.2)
+    return std::nullopt;
+  }
+  pending.kind = Pending::Kind::Lookup;
+
+  std::optional<Entry> cached = store->lookup(request.url);
+  if (cached) {
+    // One variant is kept per URL; a request that would have got another
+    // fetches it, and it takes the stored one's place (RFC 7234 4.1)
+    for (const auto& header : cached->varied) {
+      if (store->sentHeader(request, header.first) != header.second) {
+        cached.reset();
+        break;
+      }
+    }
+  }
+  std::time_t now = std::time(nullptr);
+  if (cached && !asked.noCache && cached->isFresh(now)) {
+    std::optional<std::string> body =
+      cached->compressed ? inflateBody(cached->body, cached->bodySize) : std::optional<std::string>(cached->body);
+    if (body) {
+      std::lock_guard<std::mutex> lock(store->mutex);
+      store->stats.hits++;
+      return Result<Response>::ok(cached->toResponse(now, *body));
+    }
+    store->erase(request.url);
+    cached.reset();
+  }
+
+  if (cached) {
+    std::string etag = findHeader(cached->headers, "ETag");
+    std::string lastModified = findHeader(cached->headers, "Last-Modified");
+    if (!etag.empty() && findHeader(pending.sent.headers, "If-None-Match").empty()) {
+      pending.sent.headers["If-None-Match"] = etag;
+    }
+    if (!lastModified.empty() && findHeader(pending.sent.headers, "If-Modified-Since").empty()) {
+      pending.sent.headers["If-Modified-Since"] = lastModified;
+    }
+  }
+  pending.cached = std::move(cached);
+  return std::nullopt;
+}
+
+Result<Response> CachingHTTPBackend::complete(Pending& pending, Result<Response> result) {
+  const Request& request = pending.sent;
+  if (pending.kind == Pending::Kind::PassThrough) {
+    return result;
+  }
+  if (pending.kind == Pending::Kind::Unsafe) {
+    // A successful unsafe request makes what is cached for its URL suspect
+    // (RFC 7234 4.4)
+    if (result.is_ok() && result.unwrap().statusCode < 400) {
+      store->erase(request.url);
+    }
+    return result;
+  }
+
+  std::optional<Entry>& cached = pending.cached;
+  std::time_t now = std::time(nullptr);
+  if (result.is_error()) {
+    std::lock_guard<std::mutex> lock(store->mutex);
+    store->stats.misses++;
+    return result;
+  }
+  Response& response = result.unwrap();
+
+  if (cached && response.statusCode == 304) {
+    // The stored body is still good; the 304's headers replace the stored
+    // ones, except those describing its own empty body (RFC 7234 4.3.4)
+    for (const auto& header : response.headers) {
+      if (lowercase(header.first) != "content-length") {
+        setHeaderIgnoringCase(cached->headers, header.first, header.second);
+      }
+    }
+    cached->computeFreshness(now);
+    std::optional<std::string> body =
+      cached->compressed ? inflateBody(cached->body, cached->bodySize) : std::optional<std::string>(cached->body);
+    if (body) {
+      store->insert(*cached);
+      {
+        std::lock_guard<std::mutex> lock(store->mutex);
+        store->stats.revalidations++;
+      }
+      Response revalidated = cached->toResponse(now, *body);
+      revalidated.totalTimeMs = response.totalTimeMs;
+      revalidated.timing = response.timing;
+      revalidated.bytesSent = response.bytesSent;
+      revalidated.bytesReceived = response.bytesReceived;
+      return Result<Response>::ok(revalidated);
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(store->mutex);
+    store->stats.misses++;
+  }
+
+  Entry entry;
+  entry.url = request.url;
+  entry.statusCode = response.statusCode;
+  entry.headers = response.headers;
+  entry.computeFreshness(now);
+  bool variesOnAnything = false;
+  std::istringstream vary(findHeader(response.headers, "Vary"));
+  std::string varyName;
+  while (std::getline(vary, varyName, ',')) {
+    varyName = lowercase(trim(varyName));
+    if (varyName == "*") {
+      variesOnAnything = true;
+    } else if (!varyName.empty()) {
+      entry.varied[varyName] = store->sentHeader(request, varyName);
+    }
+  }
+  CacheControl control = CacheControl::parse(findHeader(response.headers, "Cache-Control"));
+  bool storable = (response.statusCode == 200 || response.statusCode == 203) && !control.noStore &&
+                  !control.isPrivate && !variesOnAnything && (entry.lifetime > 0 || entry.hasValidator());
+  if (!storable) {
+    if (cached) {
+      store->erase(request.url);
+    }
+    return result;
+  }
+
+  entry.bodySize = response.body.size();
+  entry.body = response.body;
+  if (response.body.size() >= store->options.compressAbove) {
+    std::optional<std::string> deflated = deflateBody(response.body);
+    if (deflated && deflated->size() < response.body.size()) {
+      entry.body = std::move(*deflated);
+      entry.compressed = true;
+    }
+  }
+  store->insert(entry);
+  return result;
+}
+
+void CachingHTTPBackend::setHeader(const std::string& key, const std::string& value) {
+  {
+    std::lock_guard<std::mutex> lock(store->mutex);
+    setHeaderIgnoringCase(store->headers, key, value);
+  }
+  inner->setHeader(key, value);
+}
+
+void CachingHTTPBackend::setTimeout(int milliseconds) {
+  inner->setTimeout(milliseconds);
+}
+
+HTTPCacheStats CachingHTTPBackend::stats() const {
+  std::lock_guard<std::mutex> lock(store->mutex);
+  HTTPCacheStats stats = store->stats;
+  stats.entries = store->entries.size();
+  stats.bytes = store->bytes;
+  return stats;
+}
+
+void CachingHTTPBackend::clear() {
+  store->clear();
+}
+
+namespace {
+
+std::mutex sharedMutex;
+std::shared_ptr<CachingHTTPBackend> sharedCache;
+
+}
+
+std::shared_ptr<IHTTPBackend> CachingHTTPBackend::shared(std::shared_ptr<IHTTPBackend> inner) {
+  std::lock_guard<std::mutex> lock(sharedMutex);
+  if (!sharedCache || sharedCache->getInner() != inner) {
+    HTTPCacheOptions options = HTTPCacheOptions::fromEnvironment();
+    if (options.maxBytes == 0 && options.diskDirectory.empty()) {
+      return inner;
+    }
+    sharedCache = std::make_shared<CachingHTTPBackend>(std::move(inner), options);
+  }
+  return sharedCache;
+}
+
+HTTPCacheStats CachingHTTPBackend::sharedStats() {
+  std::lock_guard<std::mutex> lock(sharedMutex);
+  return sharedCache ? sharedCache->stats() : HTTPCacheStats();
+}
+
+}
+}
@@ -2,16 +2,91 @@
 #include "xwift/stdlib/HTTP/HTTPPlugin.h"
 #include "xwift/stdlib/HTTP/URLParser.h"
 #include "xwift/stdlib/HTTP/BodyEncoder.h"
+#include "xwift/stdlib/HTTP/HTTPCache.h"
+#ifndef _WIN32
+#include "xwift/stdlib/HTTP/CurlBackend.h"
+#endif
 #include "xwift/Plugin/Plugin.h"
 #include "xwift/Basic/Error.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
 #include <sstream>
 #include <iomanip>
 #include <map>
+#include <mutex>
+#include <random>
+#include <thread>
 
 namespace xwift {
 namespace http {
 
-HTTPClient::HTTPClient() {
+// Retry budget, latency samples and counters, shared by copies of a client
+struct HTTPClient::Resilience {
+  std::mutex mutex;
+  RetryPolicy retry;
+  HedgePolicy hedge;
+  double budget = RetryPolicy().budgetReserve;
+  // The most recent successful latencies, oldest overwritten first
+  std::vector<double> latencies;
+  size_t nextLatency = 0;
+  std::mt19937 random{std::random_device{}()};
+  HTTPClientMetrics counters;
+  
+  static constexpr size_t LatencyWindow = 512;
+  
+  void record(double milliseconds) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (latencies.size() < LatencyWindow) {
+      latencies.push_back(milliseconds);
+    } else {
+      latencies[nextLatency] = milliseconds;
+      nextLatency = (nextLatency + 1) % LatencyWindow;
+    }
+  }
+  
+  // Callers hold mutex
+  int hedgeDelayMs() const {
+    if (latencies.empty() || latencies.size() < hedge.minSamples) {
+      return hedge.initialDelayMs;
+    }
+    std::vector<double> sorted = latencies;
+    size_t rank = std::min(sorted.size() - 1, static_cast<size_t>(hedge.percentile * sorted.size()));
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    return std::max(hedge.minDelayMs, static_cast<int>(std::ceil(sorted[rank])));
+  }
+};
+
+namespace {
+
+bool isIdempotent(const std::string& method) {
+  return method == "GET" || method == "HEAD" || method == "PUT" || method == "DELETE" || method == "OPTIONS";
+}
+
+bool isRetryableStatus(int statusCode) {
+  return statusCode == 408 || statusCode == 429 || statusCode == 502 || statusCode == 503 || statusCode == 504;
+}
+
+// Retry-After in seconds, as milliseconds; 0 if absent or an HTTP-date
+int retryAfterMs(const Response& response) {
+  for (const auto& header : response.headers) {
+    if (header.first.size() == 11 &&
+        std::equal(header.first.begin(), header.first.end(), "retry-after", [](char a, char b) {
+          return std::tolower(static_cast<unsigned char>(a)) == b;
+        })) {
+      return std::atoi(header.second.c_str()) * 1000;
+    }
+  }
+  return 0;
+}
+
+}
+
+HTTPClient::HTTPClient() : resilience(std::make_shared<Resilience>()) {
   auto& pluginManager = plugin::PluginManager::getInstance();
   auto httpPlugin = dynamic_cast<HTTPPlugin*>(pluginManager.getPlugin("HTTP"));
   
@@ -25,6 +100,23 @@ HTTPClient::HTTPClient() {
       }
     }
   }
+  
+#ifndef _WIN32
+  // Without the plugin, every client in the process shares the curl
+  // backend linked into this library
+  if (!backend) {
+    static std::shared_ptr<IHTTPBackend> builtin = std::make_shared<CurlHTTPBackend>();
+    backend = builtin;
+  }
+#endif
+  
+  if (backend) {
+    backend = CachingHTTPBackend::shared(backend);
+  }
+  
+  if (const char* threshold = std::getenv("XWIFT_HTTP_COMPRESS_ABOVE")) {
+    compressAbove = static_cast<size_t>(std::strtoull(threshold, nullptr, 10));
+  }
 }
 
 HTTPClient::~HTTPClient() = default;
@@ -35,10 +127,9 @@ Result<Response> HTTPClient::get(const std::string& url) {
     return Result<Response>::err(Error::http("Invalid URL: " + url));
   }
   
-  if (backend) {
-    return backend->get(parsedUrl.toString());
-  }
-  return Result<Response>::err(Error::http("HTTP backend not initialized"));
+  Request request;
+  request.url = parsedUrl.toString();
+  return send(request);
 }
 
 Result<Response> HTTPClient::post(const std::string& url, const std::string& data) {
@@ -47,10 +138,11 @@ Result<Response> HTTPClient::post(const std::string& url, const std::string& dat
     return Result<Response>::err(Error::http("Invalid URL: " + url));
   }
   
-  if (backend) {
-    return backend->post(parsedUrl.toString(), data);
-  }
-  return Result<Response>::err(Error::http("HTTP backend not initialized"));
+  Request request;
+  request.method = "POST";
+  request.url = parsedUrl.toString();
+  request.body = data;
+  return send(request);
 }
 
 Result<Response> HTTPClient::postJSON(const std::string& url, const std::string& json) {
@@ -59,11 +151,18 @@ Result<Response> HTTPClient::postJSON(const std::string& url, const std::string&
     return Result<Response>::err(Error::http("Invalid URL: " + url));
   }
   
-  if (backend) {
-    setHeader("Content-Type", "application/json");
-    return backend->post(parsedUrl.toString(), json);
+  Request request;
+  request.method = "POST";
+  request.url = parsedUrl.toString();
+  request.headers["Content-Type"] = "application/json";
+  if (compressAbove > 0 && json.size() >= compressAbove) {
+    // JSON usually shrinks several times over, which large payloads feel
+    request.body = BodyEncoder::encodeGzip(json);
+    request.headers["Content-Encoding"] = "gzip";
+  } else {
+    request.body = json;
   }
-  return Result<Response>::err(Error::http("HTTP backend not initialized"));
+  return send(request);
 }
 
 Result<Response> HTTPClient::postForm(const std::string& url, const std::map<std::string, std::string>& params) {
@@ -72,27 +171,195 @@ Result<Response> HTTPClient::postForm(const std::string& url, const std::map<std
     return Result<Response>::err(Error::http("Invalid URL: " + url));
   }
   
-  std::string body = BodyEncoder::encodeFormURLEncoded(params);
+  Request request;
+  request.method = "POST";
+  request.url = parsedUrl.toString();
+  request.headers["Content-Type"] = "application/x-www-form-urlencoded";
+  request.body = BodyEncoder::encodeFormURLEncoded(params);
+  return send(request);
+}
+
+Result<Response> HTTPClient::put(const std::string& url, const std::string& data) {
+  Request request;
+  request.method = "PUT";
+  request.url = url;
+  request.body = data;
+  return send(request);
+}
+
+Result<Response> HTTPClient::deleteRequest(const std::string& url) {
+  Request request;
+  request.method = "DELETE";
+  request.url = url;
+  return send(request);
+}
+
+Result<Response> HTTPClient::send(const Request& request) {
+  URL parsedUrl = URLParser::parse(request.url);
+  if (!parsedUrl.isValid()) {
+    return Result<Response>::err(Error::http("Invalid URL: " + request.url));
+  }
   
-  if (backend) {
-    setHeader("Content-Type", "application/x-www-form-urlencoded");
-    return backend->post(parsedUrl.toString(), body);
+  // The timeout travels with the request; the backend is shared, so setting
+  // it there would change it for other clients' requests in flight
+  Request sent = request;
+  if (sent.timeoutMs <= 0) {
+    sent.timeoutMs = timeoutMs;
   }
-  return Result<Response>::err(Error::http("HTTP backend not initialized"));
+  return execute(sent, [this, &sent]() { return backend->send(sent); });
 }
 
-Result<Response> HTTPClient::put(const std::string& url, const std::string& data) {
-  if (backend) {
-    return backend->put(url, data);
+Result<Response> HTTPClient::execute(const Request& request, const std::function<Result<Response>()>& attempt) {
+  if (!backend) {
+    return Result<Response>::err(Error::http("HTTP backend not initialized"));
+  }
+  // A streamed body cannot be taken back once part of it was delivered
+  bool repeatable = isIdempotent(request.method) && !request.isStreaming();
+  RetryPolicy retry;
+  bool hedging = false;
+  {
+    std::lock_guard<std::mutex> lock(resilience->mutex);
+    resilience->counters.requests++;
+    resilience->budget = std::min(resilience->retry.budgetReserve,
+                                  resilience->budget + resilience->retry.budgetRatio);
+    retry = resilience->retry;
+    hedging = resilience->hedge.enabled && repeatable;
+  }
+  
+  for (int attempts = 1;; attempts++) {
+    auto started = std::chrono::steady_clock::now();
+    int hedgeDelay = 0;
+    if (hedging) {
+      std::lock_guard<std::mutex> lock(resilience->mutex);
+      hedgeDelay = resilience->hedgeDelayMs();
+    }
+    Result<Response> result = hedging ? hedged(request, hedgeDelay) : attempt();
+    bool failed = result.is_error() || isRetryableStatus(result.unwrap().statusCode);
+    if (!failed) {
+      resilience->record(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count());
+    }
+    if (!failed || !repeatable || attempts >= retry.maxAttempts) {
+      return result;
+    }
+    
+    int delayMs = 0;
+    {
+      std::lock_guard<std::mutex> lock(resilience->mutex);
+      if (resilience->budget < 1) {
+        resilience->counters.retriesDenied++;
+        return result;
+      }
+      resilience->budget -= 1;
+      resilience->counters.retries++;
+      // Full jitter (exponential backoff, drawn uniformly below the cap)
+      double cap = std::min<double>(retry.maxDelayMs, retry.baseDelayMs * std::ldexp(1.0, std::min(attempts - 1, 30)));
+      delayMs = static_cast<int>(std::uniform_real_distribution<double>(0, cap)(resilience->random));
+    }
+    if (result.is_ok()) {
+      delayMs = std::min(retry.maxDelayMs, std::max(delayMs, retryAfterMs(result.unwrap())));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
   }
-  return Result<Response>::err(Error::http("HTTP backend not initialized"));
 }
 
-Result<Response> HTTPClient::deleteRequest(const std::string& url) {
-  if (backend) {
-    return backend->deleteRequest(url);
+Result<Response> HTTPClient::hedged(const Request& request, int delayMs) {
+  HedgeOutcome outcome;
+  Result<Response> result = backend->sendHedged(request, delayMs, outcome);
+  std::lock_guard<std::mutex> lock(resilience->mutex);
+  resilience->counters.hedges += outcome.hedged ? 1 : 0;
+  resilience->counters.hedgeWins += outcome.hedgeWon ? 1 : 0;
+  return result;
+}
+
+void HTTPClient::setRetryPolicy(const RetryPolicy& policy) {
+  std::lock_guard<std::mutex> lock(resilience->mutex);
+  resilience->retry = policy;
+  resilience->budget = policy.budgetReserve;
+}
+
+void HTTPClient::setHedgePolicy(const HedgePolicy& policy) {
+  std::lock_guard<std::mutex> lock(resilience->mutex);
+  resilience->hedge = policy;
+}
+
+HTTPClientMetrics HTTPClient::metrics() const {
+  std::lock_guard<std::mutex> lock(resilience->mutex);
+  HTTPClientMetrics metrics = resilience->counters;
+  metrics.hedgeDelayMs = resilience->hedgeDelayMs();
+  return metrics;
+}
+
+Result<Response> HTTPClient::download(const std::string& url, const std::string& path,
+                                      std::function<void(const TransferProgress&)> onProgress) {
+  // Written next to path first, so a failed download or an error page
+  // leaves path as it was
+  std::string partial = path + ".part";
+  std::FILE* file = std::fopen(partial.c_str(), "wb");
+  if (!file) {
+    return Result<Response>::err(Error::io("Cannot open download file: " + path));
+  }
+  Request request;
+  request.url = url;
+  request.onBodyChunk = [file](const char* data, size_t size) {
+    return std::fwrite(data, 1, size, file) == size;
+  };
+  request.onProgress = std::move(onProgress);
+  Result<Response> result = send(request);
+  bool written = std::fclose(file) == 0;
+  std::error_code error;
+  if (result.is_ok() && written && result.unwrap().isSuccess()) {
+    std::filesystem::rename(partial, path, error);
+    if (!error) {
+      return result;
+    }
+  }
+  std::filesystem::remove(partial, error);
+  if (result.is_ok() && written && !result.unwrap().isSuccess()) {
+    return result;
+  }
+  if (result.is_ok()) {
+    return Result<Response>::err(Error::io("Cannot write download file: " + path));
+  }
+  return result;
+}
+
+Result<Response> HTTPClient::upload(const std::string& method, const std::string& url, const std::string& path) {
+  Request request;
+  request.method = method;
+  request.url = url;
+  request.uploadFile = path;
+  return send(request);
+}
+
+Result<Response> HTTPClient::postMultipart(const std::string& url, std::shared_ptr<MultipartBody> body) {
+  Request request;
+  request.method = "POST";
+  request.url = url;
+  request.headers["Content-Type"] = body->contentType();
+  request.bodySource = std::move(body);
+  return send(request);
+}
+
+std::vector<Result<Response>> HTTPClient::sendAll(const std::vector<Request>& requests, size_t maxConcurrent) {
+  if (!backend) {
+    return std::vector<Result<Response>>(requests.size(),
+                                         Result<Response>::err(Error::http("HTTP backend not initialized")));
   }
-  return Result<Response>::err(Error::http("HTTP backend not initialized"));
+  std::vector<Request> batch = requests;
+  for (auto& request : batch) {
+    if (request.timeoutMs <= 0) {
+      request.timeoutMs = timeoutMs;
+    }
+  }
+  return backend->sendAll(batch, maxConcurrent);
+}
+
+std::vector<Result<Response>> HTTPClient::getAll(const std::vector<std::string>& urls, size_t maxConcurrent) {
+  std::vector<Request> requests(urls.size());
+  for (size_t i = 0; i < urls.size(); i++) {
+    requests[i].url = urls[i];
+  }
+  return sendAll(requests, maxConcurrent);
 }
 
 void HTTPClient::setHeader(const std::string& key, const std::string& value) {
@@ -102,46 +369,15 @@ void HTTPClient::setHeader(const std::string& key, const std::string& value) {
 }
 
 void HTTPClient::setTimeout(int milliseconds) {
-  if (backend) {
-    backend->setTimeout(milliseconds);
-  }
+  timeoutMs = milliseconds;
 }
 
 std::string urlEncode(const std::string& str) {
-  std::ostringstream escaped;
-  escaped.fill('0');
-  escaped << std::hex;
-  
-  for (char c : str) {
-    if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
-      escaped << c;
-    } else {
-      escaped << std::uppercase;
-      escaped << '%' << std::setw(2) << int((unsigned char)c);
-      escaped << std::nouppercase;
-    }
-  }
-  
-  return escaped.str();
+  return percentEncode(str);
 }
 
 std::string urlDecode(const std::string& str) {
-  std::string result;
-  
-  for (size_t i = 0; i < str.length(); ++i) {
-    if (str[i] == '%' && i + 2 < str.length()) {
-      std::string hex = str.substr(i + 1, 2);
-      char c = static_cast<char>(std::stoi(hex, nullptr, 16));
-      result += c;
-      i += 2;
-    } else if (str[i] == '+') {
-      result += ' ';
-    } else {
-      result += str[i];
-    }
-  }
-  
-  return result;
+  return percentDecode(str, true);
 }
 
 }
@@ -0,0 +1,142 @@
+#include "xwift/stdlib/HTTP/HTTPMetrics.h"
+#include <algorithm>
+#include <cctype>
+
+namespace xwift {
+namespace http {
+
+void LatencyHistogram::record(double milliseconds) {
+  size_t bucket = std::lower_bound(Bounds.begin(), Bounds.end(), milliseconds) - Bounds.begin();
+  Buckets[bucket]++;
+  Count++;
+  SumMs += milliseconds;
+  MaxMs = std::max(MaxMs, milliseconds);
+}
+
+double LatencyHistogram::percentileMs(double p) const {
+  if (Count == 0) {
+    return 0;
+  }
+  double rank = std::clamp(p, 0.0, 1.0) * Count;
+  uint64_t below = 0;
+  for (size_t i = 0; i < BucketCount; i++) {
+    if (Buckets[i] == 0 || below + Buckets[i] < rank) {
+      below += Buckets[i];
+      continue;
+    }
+    double lower = i == 0 ? 0 : Bounds[i - 1];
+    double upper = i < Bounds.size() ? std::min(Bounds[i], MaxMs) : MaxMs;
+    double fraction = (rank - below) / Buckets[i];
+    return std::min(MaxMs, lower + (std::max(upper, lower) - lower) * fraction);
+  }
+  return MaxMs;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+  for (size_t i = 0; i < BucketCount; i++) {
+    Buckets[i] += other.Buckets[i];
+  }
+  Count += other.Count;
+  SumMs += other.SumMs;
+  MaxMs = std::max(MaxMs, other.MaxMs);
+}
+
+void HostMetrics::merge(const HostMetrics& other) {
+  requests += other.requests;
+  failures += other.failures;
+  newConnections += other.newConnections;
+  bytesSent += other.bytesSent;
+  bytesReceived += other.bytesReceived;
+  total.merge(other.total);
+  nameLookup.merge(other.nameLookup);
+  connect.merge(other.connect);
+  tls.merge(other.tls);
+  firstByte.merge(other.firstByte);
+}
+
+HTTPMetrics& HTTPMetrics::shared() {
+  static HTTPMetrics metrics;
+  return metrics;
+}
+
+void HTTPMetrics::record(const std::string& url, const Response& response) {
+  std::string host = hostOf(url);
+  std::lock_guard<std::mutex> lock(Mutex);
+  HostMetrics& metrics = touch(host);
+  metrics.requests++;
+  metrics.bytesSent += response.bytesSent;
+  metrics.bytesReceived += response.bytesReceived;
+  metrics.total.record(response.totalTimeMs);
+  metrics.firstByte.record(response.timing.firstByteMs);
+  if (response.timing.nameLookupMs > 0) {
+    metrics.nameLookup.record(response.timing.nameLookupMs);
+  }
+  if (response.timing.connectMs > 0) {
+    metrics.newConnections++;
+    metrics.connect.record(response.timing.connectMs);
+  }
+  if (response.timing.tlsMs > 0) {
+    metrics.tls.record(response.timing.tlsMs);
+  }
+}
+
+void HTTPMetrics::recordFailure(const std::string& url) {
+  std::string host = hostOf(url);
+  std::lock_guard<std::mutex> lock(Mutex);
+  touch(host).failures++;
+}
+
+HostMetrics& HTTPMetrics::touch(const std::string& host) {
+  auto it = Index.find(host);
+  if (it != Index.end()) {
+    Hosts.splice(Hosts.begin(), Hosts, it->second);
+    return it->second->second;
+  }
+  if (Hosts.size() >= MaxHosts && !Hosts.empty()) {
+    Others.merge(Hosts.back().second);
+    HasOthers = true;
+    Index.erase(Hosts.back().first);
+    Hosts.pop_back();
+  }
+  if (MaxHosts == 0) {
+    HasOthers = true;
+    return Others;
+  }
+  Hosts.emplace_front(host, HostMetrics());
+  Index[host] = Hosts.begin();
+  return Hosts.front().second;
+}
+
+std::map<std::string, HostMetrics> HTTPMetrics::snapshot() const {
+  std::lock_guard<std::mutex> lock(Mutex);
+  std::map<std::string, HostMetrics> hosts(Hosts.begin(), Hosts.end());
+  if (HasOthers) {
+    hosts[OtherHosts].merge(Others);
+  }
+  return hosts;
+}
+
+void HTTPMetrics::reset() {
+  std::lock_guard<std::mutex> lock(Mutex);
+  Hosts.clear();
+  Index.clear();
+  Others = HostMetrics();
+  HasOthers = false;
+}
+
+std::string HTTPMetrics::hostOf(const std::string& url) {
+  size_t start = url.find("://");
+  start = start == std::string::npos ? 0 : start + 3;
+  size_t end = url.find_first_of("/?#", start);
+  std::string authority = url.substr(start, end == std::string::npos ? std::string::npos : end - start);
+  size_t userinfo = authority.rfind('@');
+  if (userinfo != std::string::npos) {
+    authority.erase(0, userinfo + 1);
+  }
+  std::transform(authority.begin(), authority.end(), authority.begin(),
+                 [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  return authority;
+}
+
+}
+}
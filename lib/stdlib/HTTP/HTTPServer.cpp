@@ -0,0 +1,842 @@
+#include "xwift/stdlib/HTTP/HTTPServer.h"
+#include "xwift/Basic/Error.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <ctime>
+#include <thread>
+
+#ifdef __linux__
+#include <cerrno>
+#include <deque>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace xwift {
+namespace http {
+
+namespace {
+
+using Fields = std::vector<std::pair<std::string, std::string>>;
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+  return a.size() == b.size() &&
+         std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+           return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+         });
+}
+
+}
+
+std::string_view ServerRequest::header(std::string_view name) const {
+  for (const auto& [key, value] : headers) {
+    if (equalsIgnoreCase(key, name)) {
+      return value;
+    }
+  }
+  return {};
+}
+
+std::string_view ServerRequest::param(std::string_view name) const {
+  for (const auto& [key, value] : params) {
+    if (key == name) {
+      return value;
+    }
+  }
+  return {};
+}
+
+struct Router::Node {
+  enum class Kind { Static, Param, CatchAll };
+
+  Kind kind = Kind::Static;
+  // Static text, or the parameter's name
+  std::string text;
+  // Static children, each starting with a different character
+  std::vector<std::unique_ptr<Node>> children;
+  std::unique_ptr<Node> param;
+  std::unique_ptr<Node> catchAll;
+  // Routes ending here, by method
+  std::vector<std::pair<std::string, ServerHandler>> handlers;
+
+  // ':' and '*' only introduce a parameter at the start of a segment, so
+  // "/v1/items:batch" stays static text
+  Result<Node*> insert(std::string_view rest, bool segmentStart) {
+    if (rest.empty()) {
+      return this;
+    }
+    if (segmentStart && (rest[0] == ':' || rest[0] == '*')) {
+      bool isParam = rest[0] == ':';
+      size_t end = isParam ? std::min(rest.find('/'), rest.size()) : rest.size();
+      std::string name(rest.substr(1, end - 1));
+      if (name.empty()) {
+        return Result<Node*>::err(Error::runtime("Route parameter needs a name"));
+      }
+      if (!isParam && name.find('/') != std::string::npos) {
+        return Result<Node*>::err(Error::runtime("Catch-all *" + name.substr(0, name.find('/')) +
+                                                 " must end the pattern"));
+      }
+      std::unique_ptr<Node>& slot = isParam ? param : catchAll;
+      if (!slot) {
+        slot = std::make_unique<Node>();
+        slot->kind = isParam ? Kind::Param : Kind::CatchAll;
+        slot->text = name;
+      } else if (slot->text != name) {
+        return Result<Node*>::err(Error::runtime("Route parameter " + std::string(1, rest[0]) + name +
+                                                 " conflicts with " + std::string(1, rest[0]) + slot->text));
+      }
+      return slot->insert(rest.substr(end), false);
+    }
+
+    size_t end = 0;
+    bool atStart = segmentStart;
+    while (end < rest.size() && !(atStart && (rest[end] == ':' || rest[end] == '*'))) {
+      atStart = rest[end] == '/';
+      end++;
+    }
+    std::string_view run = rest.substr(0, end);
+    for (auto& child : children) {
+      if (child->text[0] != run[0]) {
+        continue;
+      }
+      size_t common = 0;
+      while (common < run.size() && common < child->text.size() && run[common] == child->text[common]) {
+        common++;
+      }
+      if (common < child->text.size()) {
+        auto split = std::make_unique<Node>();
+        split->text = child->text.substr(0, common);
+        child->text.erase(0, common);
+        split->children.push_back(std::move(child));
+        child = std::move(split);
+      }
+      return child->insert(rest.substr(common), rest[common - 1] == '/');
+    }
+    children.push_back(std::make_unique<Node>());
+    children.back()->text = std::string(run);
+    return children.back()->insert(rest.substr(end), run.back() == '/');
+  }
+
+  // Static text first, then a parameter, then a catch-all, backing out of
+  // a branch that does not lead to a route
+  const Node* match(std::string_view path, Fields& params) const {
+    if (path.empty()) {
+      if (!handlers.empty()) {
+        return this;
+      }
+      if (catchAll) {
+        params.emplace_back(catchAll->text, std::string());
+        return catchAll.get();
+      }
+      return nullptr;
+    }
+    for (const auto& child : children) {
+      if (child->text[0] != path[0]) {
+        continue;
+      }
+      if (path.substr(0, child->text.size()) == child->text) {
+        if (const Node* found = child->match(path.substr(child->text.size()), params)) {
+          return found;
+        }
+      }
+      break;
+    }
+    if (param && path[0] != '/') {
+      size_t end = std::min(path.find('/'), path.size());
+      params.emplace_back(param->text, std::string(path.substr(0, end)));
+      if (const Node* found = param->match(path.substr(end), params)) {
+        return found;
+      }
+      params.pop_back();
+    }
+    if (catchAll) {
+      params.emplace_back(catchAll->text, std::string(path));
+      return catchAll.get();
+    }
+    return nullptr;
+  }
+};
+
+Router::Router() : root(std::make_unique<Node>()) {}
+Router::~Router() = default;
+Router::Router(Router&&) noexcept = default;
+Router& Router::operator=(Router&&) noexcept = default;
+
+Result<bool> Router::add(const std::string& method, const std::string& pattern, ServerHandler handler) {
+  if (pattern.empty() || pattern[0] != '/') {
+    return Result<bool>::err(Error::runtime("Route pattern must start with '/': " + pattern));
+  }
+  std::string name = method;
+  std::transform(name.begin(), name.end(), name.begin(),
+                 [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+  auto node = root->insert(pattern, false);
+  if (node.is_error()) {
+    return Result<bool>::err(node.error());
+  }
+  for (const auto& entry : node.unwrap()->handlers) {
+    if (entry.first == name) {
+      return Result<bool>::err(Error::runtime("Route already defined: " + name + " " + pattern));
+    }
+  }
+  node.unwrap()->handlers.emplace_back(std::move(name), std::move(handler));
+  return true;
+}
+
+Router::Match Router::match(std::string_view method, std::string_view path, Fields& params,
+                            const ServerHandler*& handler, std::string* allowed) const {
+  params.clear();
+  const Node* node = root->match(path, params);
+  if (!node) {
+    return Match::NoRoute;
+  }
+  const ServerHandler* any = nullptr;
+  const ServerHandler* get = nullptr;
+  for (const auto& [name, candidate] : node->handlers) {
+    if (name == method) {
+      handler = &candidate;
+      return Match::Found;
+    }
+    if (name == "*") {
+      any = &candidate;
+    } else if (name == "GET") {
+      get = &candidate;
+    }
+  }
+  if (any || (get && method == "HEAD")) {
+    handler = any ? any : get;
+    return Match::Found;
+  }
+  if (allowed) {
+    allowed->clear();
+    for (const auto& entry : node->handlers) {
+      *allowed += (allowed->empty() ? "" : ", ") + entry.first;
+      if (entry.first == "GET") {
+        *allowed += ", HEAD";
+      }
+    }
+  }
+  return Match::WrongMethod;
+}
+
+namespace {
+
+const char* reasonPhrase(int status) {
+  switch (status) {
+  case 100: return "Continue";
+  case 200: return "OK";
+  case 201: return "Created";
+  case 202: return "Accepted";
+  case 204: return "No Content";
+  case 301: return "Moved Permanently";
+  case 302: return "Found";
+  case 304: return "Not Modified";
+  case 400: return "Bad Request";
+  case 401: return "Unauthorized";
+  case 403: return "Forbidden";
+  case 404: return "Not Found";
+  case 405: return "Method Not Allowed";
+  case 409: return "Conflict";
+  case 413: return "Content Too Large";
+  case 422: return "Unprocessable Content";
+  case 429: return "Too Many Requests";
+  case 431: return "Request Header Fields Too Large";
+  case 500: return "Internal Server Error";
+  case 501: return "Not Implemented";
+  case 503: return "Service Unavailable";
+  default: return status < 400 ? "OK" : "Error";
+  }
+}
+
+}
+
+#ifdef __linux__
+
+namespace {
+
+struct Connection {
+  int fd = -1;
+  // Bytes read but not yet parsed into a request
+  std::string input;
+  // Serialized responses waiting for the socket; the first outOffset bytes
+  // of the front one are already sent
+  std::deque<std::string> output;
+  size_t outOffset = 0;
+  bool continueSent = false;
+  bool closeAfterWrite = false;
+  std::chrono::steady_clock::time_point lastActive;
+};
+
+// Parses the head of one request, up to but excluding the blank line
+bool parseHead(std::string_view head, ServerRequest& request, bool& http10) {
+  size_t lineEnd = head.find("\r\n");
+  std::string_view line = head.substr(0, lineEnd);
+  size_t first = line.find(' ');
+  size_t last = line.rfind(' ');
+  if (first == std::string_view::npos || first == 0 || last == first) {
+    return false;
+  }
+  std::string_view version = line.substr(last + 1);
+  if (version == "HTTP/1.1") {
+    http10 = false;
+  } else if (version == "HTTP/1.0") {
+    http10 = true;
+  } else {
+    return false;
+  }
+  request.method.assign(line.substr(0, first));
+  std::string_view target = line.substr(first + 1, last - first - 1);
+  if (!target.empty() && target[0] != '/') {
+    // Absolute form, as sent to proxies
+    size_t scheme = target.find("://");
+    if (scheme == std::string_view::npos) {
+      return false;
+    }
+    size_t slash = target.find('/', scheme + 3);
+    target = slash == std::string_view::npos ? std::string_view("/") : target.substr(slash);
+  }
+  if (target.empty()) {
+    return false;
+  }
+  size_t question = target.find('?');
+  request.path.assign(target.substr(0, question));
+  request.query.assign(question == std::string_view::npos ? std::string_view() : target.substr(question + 1));
+
+  request.headers.clear();
+  while (lineEnd != std::string_view::npos) {
+    size_t start = lineEnd + 2;
+    lineEnd = head.find("\r\n", start);
+    line = head.substr(start, lineEnd == std::string_view::npos ? std::string_view::npos : lineEnd - start);
+    size_t colon = line.find(':');
+    if (colon == std::string_view::npos || colon == 0) {
+      return false;
+    }
+    std::string_view value = line.substr(colon + 1);
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+      value.remove_prefix(1);
+    }
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+      value.remove_suffix(1);
+    }
+    request.headers.emplace_back(std::string(line.substr(0, colon)), std::string(value));
+  }
+  return true;
+}
+
+bool containsToken(std::string_view list, std::string_view token) {
+  size_t start = 0;
+  while (start <= list.size()) {
+    size_t comma = std::min(list.find(',', start), list.size());
+    std::string_view item = list.substr(start, comma - start);
+    while (!item.empty() && item.front() == ' ') {
+      item.remove_prefix(1);
+    }
+    while (!item.empty() && item.back() == ' ') {
+      item.remove_suffix(1);
+    }
+    if (equalsIgnoreCase(item, token)) {
+      return true;
+    }
+    start = comma + 1;
+  }
+  return false;
+}
+
+// The server whose reactor runs on this thread. Set by the reactor itself
+// before it serves anything, so a handler always sees it, unlike the
+// reactor's std::thread, which start() only assigns once the thread runs.
+thread_local const HTTPServer* ServingServer = nullptr;
+
+}
+
+struct HTTPServer::Reactor {
+  HTTPServer* server = nullptr;
+  size_t index = 0;
+  int listenFd = -1;
+  int epollFd = -1;
+  int wakeFd = -1;
+  std::thread thread;
+  // Indexed by descriptor; descriptors are small and reused
+  std::vector<std::unique_ptr<Connection>> connections;
+  std::atomic<uint64_t> accepted{0};
+  std::atomic<uint64_t> requests{0};
+  std::atomic<size_t> active{0};
+  char buffer[64 * 1024];
+  std::string date;
+  std::time_t dateSecond = 0;
+
+  ~Reactor() {
+    for (int fd : {listenFd, epollFd, wakeFd}) {
+      if (fd >= 0) {
+        ::close(fd);
+      }
+    }
+  }
+
+  void run() {
+    ServingServer = server;
+    epoll_event events[256];
+    auto lastSweep = std::chrono::steady_clock::now();
+    bool stopping = false;
+    while (!stopping) {
+      int ready = epoll_wait(epollFd, events, 256, 1000);
+      if (ready < 0 && errno != EINTR) {
+        break;
+      }
+      for (int i = 0; i < ready; i++) {
+        int fd = events[i].data.fd;
+        if (fd == wakeFd) {
+          stopping = true;
+        } else if (fd == listenFd) {
+          acceptAll();
+        } else if (static_cast<size_t>(fd) < connections.size() && connections[fd]) {
+          service(*connections[fd], events[i].events);
+        }
+      }
+      auto now = std::chrono::steady_clock::now();
+      if (now - lastSweep >= std::chrono::seconds(1)) {
+        lastSweep = now;
+        for (auto& connection : connections) {
+          if (connection && now - connection->lastActive >= server->Options.idleTimeout) {
+            close(*connection);
+          }
+        }
+      }
+    }
+    for (auto& connection : connections) {
+      if (connection) {
+        close(*connection);
+      }
+    }
+  }
+
+  void acceptAll() {
+    while (true) {
+      int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd < 0) {
+        if (errno == EINTR || errno == ECONNABORTED) {
+          continue;
+        }
+        // EAGAIN once drained; out of descriptors leaves the rest queued
+        return;
+      }
+      int on = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+      epoll_event event{};
+      event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+      event.data.fd = fd;
+      if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        ::close(fd);
+        continue;
+      }
+      if (static_cast<size_t>(fd) >= connections.size()) {
+        connections.resize(fd + 1);
+      }
+      auto connection = std::make_unique<Connection>();
+      connection->fd = fd;
+      connection->lastActive = std::chrono::steady_clock::now();
+      connections[fd] = std::move(connection);
+      accepted++;
+      active++;
+    }
+  }
+
+  void close(Connection& connection) {
+    int fd = connection.fd;
+    ::close(fd);
+    connections[fd].reset();
+    active--;
+  }
+
+  void service(Connection& connection, uint32_t events) {
+    if (events & EPOLLERR) {
+      close(connection);
+      return;
+    }
+    bool peerClosed = false;
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+      // Edge-triggered: drain the socket or no further event comes
+      while (true) {
+        ssize_t count = ::read(connection.fd, buffer, sizeof(buffer));
+        if (count > 0) {
+          connection.input.append(buffer, count);
+          continue;
+        }
+        if (count == 0) {
+          peerClosed = true;
+        } else if (errno == EINTR) {
+          continue;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+          close(connection);
+          return;
+        }
+        break;
+      }
+      connection.lastActive = std::chrono::steady_clock::now();
+      process(connection);
+    }
+    if (peerClosed) {
+      connection.closeAfterWrite = true;
+    }
+    if (!flush(connection)) {
+      close(connection);
+    }
+  }
+
+  // Answers every complete request in the input, in order
+  void process(Connection& connection) {
+    const ServerOptions& options = server->Options;
+    size_t consumed = 0;
+    while (!connection.closeAfterWrite) {
+      std::string_view data(connection.input.data() + consumed, connection.input.size() - consumed);
+      if (data.empty()) {
+        break;
+      }
+      size_t headEnd = data.find("\r\n\r\n");
+      if (headEnd == std::string_view::npos || headEnd + 4 > options.maxHeaderBytes) {
+        if (data.size() > options.maxHeaderBytes) {
+          fail(connection, 431);
+        }
+        break;
+      }
+
+      ServerRequest request;
+      bool http10 = false;
+      if (!parseHead(data.substr(0, headEnd), request, http10)) {
+        fail(connection, 400);
+        break;
+      }
+      if (!request.header("Transfer-Encoding").empty()) {
+        fail(connection, 501);
+        break;
+      }
+      size_t length = 0;
+      bool badLength = false;
+      for (char c : request.header("Content-Length")) {
+        if (c < '0' || c > '9') {
+          badLength = true;
+          break;
+        }
+        if (length <= options.maxBodyBytes) {
+          length = length * 10 + (c - '0');
+        }
+      }
+      if (badLength) {
+        fail(connection, 400);
+        break;
+      }
+      if (length > options.maxBodyBytes) {
+        fail(connection, 413);
+        break;
+      }
+      if (data.size() < headEnd + 4 + length) {
+        if (!connection.continueSent && containsToken(request.header("Expect"), "100-continue")) {
+          connection.output.emplace_back("HTTP/1.1 100 Continue\r\n\r\n");
+          connection.continueSent = true;
+        }
+        break;
+      }
+      request.body.assign(data.substr(headEnd + 4, length));
+      consumed += headEnd + 4 + length;
+      connection.continueSent = false;
+
+      std::string_view connectionHeader = request.header("Connection");
+      bool keepAlive = http10 ? containsToken(connectionHeader, "keep-alive")
+                              : !containsToken(connectionHeader, "close");
+      request.reactor = index;
+      respond(connection, request, keepAlive, http10);
+      requests++;
+    }
+    connection.input.erase(0, consumed);
+  }
+
+  void respond(Connection& connection, ServerRequest& request, bool keepAlive, bool http10) {
+    ServerResponse response;
+    const ServerHandler* handler = nullptr;
+    std::string allowed;
+    switch (server->Routes.match(request.method, request.path, request.params, handler, &allowed)) {
+    case Router::Match::Found:
+      try {
+        (*handler)(request, response);
+      } catch (const std::exception&) {
+        response = ServerResponse();
+        response.status = 500;
+        response.body = "Internal Server Error\n";
+      }
+      break;
+    case Router::Match::NoRoute:
+      response.status = 404;
+      response.body = "Not Found\n";
+      break;
+    case Router::Match::WrongMethod:
+      response.status = 405;
+      response.headers.emplace_back("Allow", allowed);
+      response.body = "Method Not Allowed\n";
+      break;
+    }
+    queue(connection, response, request.method == "HEAD", keepAlive, http10);
+  }
+
+  // Error answers to requests that could not be read; the connection is
+  // closed because where the next request starts is unknown
+  void fail(Connection& connection, int status) {
+    ServerResponse response;
+    response.status = status;
+    response.body = std::string(reasonPhrase(status)) + "\n";
+    queue(connection, response, false, false, false);
+  }
+
+  void queue(Connection& connection, ServerResponse& response, bool headOnly, bool keepAlive, bool http10) {
+    std::string head;
+    head.reserve(256);
+    head += http10 ? "HTTP/1.0 " : "HTTP/1.1 ";
+    head += std::to_string(response.status);
+    head += ' ';
+    head += reasonPhrase(response.status);
+    head += "\r\nServer: xwift\r\nDate: ";
+    head += currentDate();
+    if (!response.contentType.empty()) {
+      head += "\r\nContent-Type: ";
+      head += response.contentType;
+    }
+    head += "\r\nContent-Length: ";
+    head += std::to_string(response.body.size());
+    if (!keepAlive) {
+      head += "\r\nConnection: close";
+    } else if (http10) {
+      head += "\r\nConnection: keep-alive";
+    }
+    for (const auto& [name, value] : response.headers) {
+      head += "\r\n";
+      head += name;
+      head += ": ";
+      head += value;
+    }
+    head += "\r\n\r\n";
+    connection.output.push_back(std::move(head));
+    if (!headOnly && !response.body.empty()) {
+      connection.output.push_back(std::move(response.body));
+    }
+    if (!keepAlive) {
+      connection.closeAfterWrite = true;
+    }
+  }
+
+  // Writes queued responses with as few system calls as the socket allows.
+  // Returns false when the connection should be closed.
+  bool flush(Connection& connection) {
+    while (!connection.output.empty()) {
+      iovec vectors[64];
+      int count = 0;
+      for (auto it = connection.output.begin(); it != connection.output.end() && count < 64; ++it, ++count) {
+        size_t skip = count == 0 ? connection.outOffset : 0;
+        vectors[count].iov_base = it->data() + skip;
+        vectors[count].iov_len = it->size() - skip;
+      }
+      msghdr message{};
+      message.msg_iov = vectors;
+      message.msg_iovlen = count;
+      ssize_t written = sendmsg(connection.fd, &message, MSG_NOSIGNAL);
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        // EAGAIN: EPOLLOUT fires once the peer catches up
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+      }
+      size_t remaining = static_cast<size_t>(written);
+      while (remaining > 0) {
+        size_t left = connection.output.front().size() - connection.outOffset;
+        if (remaining < left) {
+          connection.outOffset += remaining;
+          break;
+        }
+        remaining -= left;
+        connection.output.pop_front();
+        connection.outOffset = 0;
+      }
+    }
+    return !connection.closeAfterWrite;
+  }
+
+  const std::string& currentDate() {
+    std::time_t now = std::time(nullptr);
+    if (now != dateSecond) {
+      dateSecond = now;
+      std::tm utc{};
+      gmtime_r(&now, &utc);
+      char text[64];
+      size_t length = std::strftime(text, sizeof(text), "%a, %d %b %Y %H:%M:%S GMT", &utc);
+      date.assign(text, length);
+    }
+    return date;
+  }
+};
+
+namespace {
+
+Result<int> listenOn(const std::string& host, int port, int& fd) {
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+  addrinfo* addresses = nullptr;
+  std::string service = std::to_string(port);
+  if (getaddrinfo(host.empty() ? nullptr : host.c_str(), service.c_str(), &hints, &addresses) != 0 || !addresses) {
+    return Result<int>::err(Error::network("Cannot resolve listen address: " + host));
+  }
+  fd = socket(addresses->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  int on = 1;
+  bool ok = fd >= 0 && setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == 0 &&
+            setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) == 0 &&
+            bind(fd, addresses->ai_addr, addresses->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0;
+  int error = errno;
+  freeaddrinfo(addresses);
+  if (!ok) {
+    return Result<int>::err(Error::network("Cannot listen on " + host + ":" + service + ": " + std::strerror(error)));
+  }
+  sockaddr_storage bound{};
+  socklen_t length = sizeof(bound);
+  getsockname(fd, reinterpret_cast<sockaddr*>(&bound), &length);
+  return ntohs(bound.ss_family == AF_INET6 ? reinterpret_cast<sockaddr_in6*>(&bound)->sin6_port
+                                           : reinterpret_cast<sockaddr_in*>(&bound)->sin_port);
+}
+
+}
+
+#else
+
+struct HTTPServer::Reactor {};
+
+#endif
+
+HTTPServer::HTTPServer(ServerOptions options) : Options(std::move(options)) {
+  if (Options.threads == 0) {
+    Options.threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+}
+
+HTTPServer::~HTTPServer() {
+  stop();
+}
+
+Result<bool> HTTPServer::route(const std::string& method, const std::string& pattern, ServerHandler handler) {
+  if (Running) {
+    return Result<bool>::err(Error::runtime("Routes cannot be added while the server runs"));
+  }
+  return Routes.add(method, pattern, std::move(handler));
+}
+
+Result<int> HTTPServer::start() {
+#ifdef __linux__
+  std::lock_guard<std::mutex> lock(Lifecycle);
+  if (Running) {
+    return Port;
+  }
+  {
+    std::lock_guard<std::mutex> stopLock(StopMutex);
+    StopRequested = false;
+  }
+  std::vector<std::unique_ptr<Reactor>> reactors;
+  int port = Options.port;
+  for (size_t i = 0; i < Options.threads; i++) {
+    auto reactor = std::make_unique<Reactor>();
+    reactor->server = this;
+    reactor->index = i;
+    auto bound = listenOn(Options.host, port, reactor->listenFd);
+    if (bound.is_error()) {
+      return Result<int>::err(bound.error());
+    }
+    port = bound.unwrap();
+    reactor->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    reactor->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (reactor->epollFd < 0 || reactor->wakeFd < 0) {
+      return Result<int>::err(Error::network("Cannot create the server's event loop"));
+    }
+    for (int fd : {reactor->listenFd, reactor->wakeFd}) {
+      epoll_event event{};
+      event.events = EPOLLIN;
+      event.data.fd = fd;
+      epoll_ctl(reactor->epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+    reactors.push_back(std::move(reactor));
+  }
+  Reactors = std::move(reactors);
+  Port = port;
+  Running = true;
+  for (auto& reactor : Reactors) {
+    reactor->thread = std::thread([raw = reactor.get()] { raw->run(); });
+  }
+  return Port;
+#else
+  return Result<int>::err(Error::network("HTTPServer is only available on Linux"));
+#endif
+}
+
+void HTTPServer::requestStop() {
+  std::lock_guard<std::mutex> lock(StopMutex);
+  StopRequested = true;
+#ifdef __linux__
+  for (auto& reactor : Reactors) {
+    uint64_t one = 1;
+    [[maybe_unused]] ssize_t written = ::write(reactor->wakeFd, &one, sizeof(one));
+  }
+#endif
+  StopSignal.notify_all();
+}
+
+void HTTPServer::stop() {
+#ifdef __linux__
+  if (ServingServer == this) {
+    requestStop();
+    return;
+  }
+#endif
+  std::lock_guard<std::mutex> lock(Lifecycle);
+  if (!Running) {
+    return;
+  }
+  requestStop();
+#ifdef __linux__
+  for (auto& reactor : Reactors) {
+    if (reactor->thread.joinable()) {
+      reactor->thread.join();
+    }
+  }
+#endif
+  Reactors.clear();
+  Running = false;
+}
+
+void HTTPServer::wait() {
+  {
+    std::unique_lock<std::mutex> lock(StopMutex);
+    StopSignal.wait(lock, [this] { return StopRequested || !Running; });
+  }
+  stop();
+}
+
+size_t HTTPServer::threads() const {
+  return Options.threads;
+}
+
+ServerStats HTTPServer::stats() const {
+  ServerStats stats;
+#ifdef __linux__
+  for (const auto& reactor : Reactors) {
+    stats.connectionsAccepted += reactor->accepted;
+    stats.requests += reactor->requests;
+    stats.activeConnections += reactor->active;
+  }
+#endif
+  return stats;
+}
+
+}
+}
@@ -1,107 +1,384 @@
 #include "xwift/stdlib/HTTP/URLParser.h"
-#include <regex>
-#include <sstream>
-#include <iomanip>
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define XWIFT_URL_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// AVX2 is picked at run time, so a build for plain x86-64 still uses it on
+// CPUs that have it
+#if defined(XWIFT_URL_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#define XWIFT_URL_AVX2 1
+#include <immintrin.h>
+#endif
 
 namespace xwift {
 namespace http {
 
 std::string URL::toString() const {
-    std::ostringstream oss;
+    std::string result;
+    result.reserve(Protocol.size() + Host.size() + Path.size() + Query.size() + Fragment.size() + 16);
     
     if (!Protocol.empty()) {
-        oss << Protocol << "://";
+        result += Protocol;
+        result += "://";
     }
     
-    oss << Host;
+    result += Host;
     
     if (Port > 0) {
-        oss << ":" << Port;
+        result += ':';
+        result += std::to_string(Port);
     }
     
-    oss << Path;
+    result += Path;
     
     if (!Query.empty()) {
-        oss << "?" << Query;
+        result += '?';
+        result += Query;
     }
     
     if (!Fragment.empty()) {
-        oss << "#" << Fragment;
+        result += '#';
+        result += Fragment;
     }
     
-    return oss.str();
+    return result;
 }
 
 bool URL::isValid() const {
     return !Host.empty();
 }
 
-URL URLParser::parse(const std::string& url) {
-    URL result;
+void QueryParamIterator::advance() {
+    while (!Rest.empty()) {
+        size_t end = Rest.find('&');
+        std::string_view pair = Rest.substr(0, end);
+        Rest = end == std::string_view::npos ? std::string_view() : Rest.substr(end + 1);
+        if (pair.empty()) {
+            continue;
+        }
+        size_t equals = pair.find('=');
+        Current.Key = pair.substr(0, equals);
+        Current.Value = equals == std::string_view::npos ? pair.substr(pair.size()) : pair.substr(equals + 1);
+        return;
+    }
+    AtEnd = true;
+    Current = QueryParam();
+}
+
+URLView URLParser::parseView(std::string_view url) {
+    URLView result;
+    
+    size_t schemeEnd = url.find("://");
+    if (schemeEnd == std::string_view::npos || schemeEnd == 0 ||
+        url.substr(0, schemeEnd).find(':') != std::string_view::npos) {
+        return result;
+    }
     
-    std::regex urlRegex(R"(^([^:]+)://([^:/?#]+)(?::(\d+))?([^?#]*)(?:\?([^#]*))?(?:#(.*))?$)");
-    std::smatch match;
+    size_t hostStart = schemeEnd + 3;
+    size_t hostEnd = std::min(url.find_first_of(":/?#", hostStart), url.size());
+    if (hostEnd == hostStart) {
+        return result;
+    }
     
-    if (std::regex_match(url, match, urlRegex)) {
-        result.Protocol = match[1].str();
-        result.Host = match[2].str();
-        result.Path = match[4].str();
-        result.Query = match[5].str();
-        result.Fragment = match[6].str();
-        
-        if (match[3].matched) {
-            result.Port = std::stoi(match[3].str());
-        } else {
-            if (result.Protocol == "http") {
-                result.Port = 80;
-            } else if (result.Protocol == "https") {
-                result.Port = 443;
+    int port = 0;
+    size_t pathStart = hostEnd;
+    if (hostEnd < url.size() && url[hostEnd] == ':') {
+        pathStart = hostEnd + 1;
+        while (pathStart < url.size() && url[pathStart] >= '0' && url[pathStart] <= '9') {
+            port = port * 10 + (url[pathStart] - '0');
+            if (port > 65535) {
+                return result;
             }
+            pathStart++;
         }
-        
-        if (!result.Query.empty()) {
-            parseQuery(result.Query, result.QueryParams);
+        if (pathStart == hostEnd + 1 ||
+            (pathStart < url.size() && url[pathStart] != '/' && url[pathStart] != '?' && url[pathStart] != '#')) {
+            return result;
         }
     }
     
+    size_t pathEnd = std::min(url.find_first_of("?#", pathStart), url.size());
+    size_t fragmentStart = std::min(url.find('#', pathEnd), url.size());
+    
+    result.Scheme = url.substr(0, schemeEnd);
+    result.Host = url.substr(hostStart, hostEnd - hostStart);
+    result.Path = url.substr(pathStart, pathEnd - pathStart);
+    if (pathEnd < url.size() && url[pathEnd] == '?') {
+        result.Query = url.substr(pathEnd + 1, fragmentStart - pathEnd - 1);
+    }
+    if (fragmentStart < url.size()) {
+        result.Fragment = url.substr(fragmentStart + 1);
+    }
+    if (pathStart > hostEnd) {
+        result.Port = port;
+    } else if (result.Scheme == "http") {
+        result.Port = 80;
+    } else if (result.Scheme == "https") {
+        result.Port = 443;
+    }
+    
     return result;
 }
 
-void URLParser::parseQuery(const std::string& query, std::map<std::string, std::string>& params) {
-    std::istringstream iss(query);
-    std::string pair;
+URL URLParser::parse(const std::string& url) {
+    URL result;
+    URLView view = parseView(url);
+    if (!view.isValid()) {
+        return result;
+    }
     
-    while (std::getline(iss, pair, '&')) {
-        size_t pos = pair.find('=');
-        if (pos != std::string::npos) {
-            std::string key = pair.substr(0, pos);
-            std::string value = pair.substr(pos + 1);
-            params[decodeURIComponent(key)] = decodeURIComponent(value);
+    result.Protocol.assign(view.Scheme);
+    result.Host.assign(view.Host);
+    result.Port = view.Port;
+    result.Path.assign(view.Path);
+    result.Query.assign(view.Query);
+    result.Fragment.assign(view.Fragment);
+    for (const QueryParam& param : view.queryParams()) {
+        result.QueryParams[percentDecode(param.Key)] = percentDecode(param.Value);
+    }
+    
+    return result;
+}
+
+namespace {
+
+bool isUnreserved(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           c == '-' || c == '.' || c == '_' || c == '~';
+}
+
+int hexValue(unsigned char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+// Each kernel returns how many bytes at the start of text need no work:
+// unreserved ones for encoding, anything but '%' (and '+') for decoding. It
+// may stop short of the first byte that does once fewer than a vector's
+// worth are left; the scalar loop takes it from there.
+using RunScanner = size_t (*)(const char* text, size_t size, bool plusAsSpace);
+
+#if !defined(XWIFT_URL_SSE2)
+
+size_t scalarUnreservedRun(const char* text, size_t size, bool) {
+    size_t i = 0;
+    while (i < size && isUnreserved(static_cast<unsigned char>(text[i]))) {
+        i++;
+    }
+    return i;
+}
+
+size_t scalarLiteralRun(const char* text, size_t size, bool plusAsSpace) {
+    size_t i = 0;
+    while (i < size && text[i] != '%' && !(plusAsSpace && text[i] == '+')) {
+        i++;
+    }
+    return i;
+}
+
+#endif
+
+#if defined(XWIFT_URL_SSE2)
+
+size_t countTrailingZeros(uint32_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<size_t>(__builtin_ctz(mask));
+#else
+    size_t count = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
+// Bytes are compared as signed, so anything from 0x80 up is below every
+// range tested and never counts as unreserved
+__m128i unreservedMask(__m128i bytes) {
+    __m128i lower = _mm_or_si128(bytes, _mm_set1_epi8(0x20));
+    __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                  _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('0' - 1)),
+                                  _mm_cmplt_epi8(bytes, _mm_set1_epi8('9' + 1)));
+    __m128i marks = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('-')),
+                                              _mm_cmpeq_epi8(bytes, _mm_set1_epi8('.'))),
+                                 _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('_')),
+                                              _mm_cmpeq_epi8(bytes, _mm_set1_epi8('~'))));
+    return _mm_or_si128(_mm_or_si128(alpha, digit), marks);
+}
+
+size_t sse2UnreservedRun(const char* text, size_t size, bool) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        uint32_t ok = static_cast<uint32_t>(_mm_movemask_epi8(unreservedMask(bytes)));
+        if (ok != 0xFFFF) {
+            return i + countTrailingZeros(~ok);
+        }
+    }
+    return i;
+}
+
+size_t sse2LiteralRun(const char* text, size_t size, bool plusAsSpace) {
+    __m128i percent = _mm_set1_epi8('%');
+    // With plusAsSpace off, '+' is looked for as another '%'
+    __m128i plus = _mm_set1_epi8(plusAsSpace ? '+' : '%');
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        uint32_t special = static_cast<uint32_t>(
+            _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(bytes, percent), _mm_cmpeq_epi8(bytes, plus))));
+        if (special != 0) {
+            return i + countTrailingZeros(special);
+        }
+    }
+    return i;
+}
+
+#endif
+
+#if defined(XWIFT_URL_AVX2)
+
+__attribute__((target("avx2"))) size_t avx2UnreservedRun(const char* text, size_t size, bool plusAsSpace) {
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i));
+        __m256i lower = _mm256_or_si256(bytes, _mm256_set1_epi8(0x20));
+        __m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                                         _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+        __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8('0' - 1)),
+                                         _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), bytes));
+        __m256i marks = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('-')),
+                                                        _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('.'))),
+                                        _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('_')),
+                                                        _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('~'))));
+        uint32_t ok = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(alpha, digit), marks)));
+        if (ok != 0xFFFFFFFFu) {
+            return i + countTrailingZeros(~ok);
+        }
+    }
+    return i + sse2UnreservedRun(text + i, size - i, plusAsSpace);
+}
+
+__attribute__((target("avx2"))) size_t avx2LiteralRun(const char* text, size_t size, bool plusAsSpace) {
+    __m256i percent = _mm256_set1_epi8('%');
+    __m256i plus = _mm256_set1_epi8(plusAsSpace ? '+' : '%');
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i));
+        uint32_t special = static_cast<uint32_t>(_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(bytes, percent), _mm256_cmpeq_epi8(bytes, plus))));
+        if (special != 0) {
+            return i + countTrailingZeros(special);
+        }
+    }
+    return i + sse2LiteralRun(text + i, size - i, plusAsSpace);
+}
+
+bool hasAVX2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+
+#endif
+
+RunScanner unreservedScanner() {
+#if defined(XWIFT_URL_AVX2)
+    if (hasAVX2()) {
+        return avx2UnreservedRun;
+    }
+#endif
+#if defined(XWIFT_URL_SSE2)
+    return sse2UnreservedRun;
+#else
+    return scalarUnreservedRun;
+#endif
+}
+
+RunScanner literalScanner() {
+#if defined(XWIFT_URL_AVX2)
+    if (hasAVX2()) {
+        return avx2LiteralRun;
+    }
+#endif
+#if defined(XWIFT_URL_SSE2)
+    return sse2LiteralRun;
+#else
+    return scalarLiteralRun;
+#endif
+}
+
+}
+
+void percentEncode(std::string_view text, std::string& out) {
+    static const RunScanner scan = unreservedScanner();
+    static const char hex[] = "0123456789ABCDEF";
+    out.reserve(out.size() + text.size() + text.size() / 8);
+    size_t i = 0;
+    while (i < text.size()) {
+        size_t run = scan(text.data() + i, text.size() - i, false);
+        out.append(text.data() + i, run);
+        i += run;
+        if (i == text.size()) {
+            break;
+        }
+        unsigned char c = static_cast<unsigned char>(text[i++]);
+        if (isUnreserved(c)) {
+            out += static_cast<char>(c);
         } else {
-            params[decodeURIComponent(pair)] = "";
+            char escape[3] = {'%', hex[c >> 4], hex[c & 15]};
+            out.append(escape, 3);
         }
     }
 }
 
-std::string URLParser::decodeURIComponent(const std::string& str) {
-    std::string result;
-    char ch;
-    int i;
-    
-    for (i = 0; i < str.length(); i++) {
-        if (str[i] != '%') {
-            result += str[i];
+std::string percentEncode(std::string_view text) {
+    std::string out;
+    percentEncode(text, out);
+    return out;
+}
+
+void percentDecode(std::string_view text, std::string& out, bool plusAsSpace) {
+    static const RunScanner scan = literalScanner();
+    out.reserve(out.size() + text.size());
+    size_t i = 0;
+    while (i < text.size()) {
+        size_t run = scan(text.data() + i, text.size() - i, plusAsSpace);
+        out.append(text.data() + i, run);
+        i += run;
+        if (i == text.size()) {
+            break;
+        }
+        char c = text[i];
+        if (c == '+' && plusAsSpace) {
+            out += ' ';
+            i++;
+        } else if (c == '%' && i + 2 < text.size() &&
+                   hexValue(static_cast<unsigned char>(text[i + 1])) >= 0 &&
+                   hexValue(static_cast<unsigned char>(text[i + 2])) >= 0) {
+            out += static_cast<char>(hexValue(static_cast<unsigned char>(text[i + 1])) * 16 +
+                                     hexValue(static_cast<unsigned char>(text[i + 2])));
+            i += 3;
         } else {
-            if (i + 2 < str.length()) {
-                std::string hexStr = str.substr(i + 1, 2);
-                char ch = static_cast<char>(std::stoi(hexStr, nullptr, 16));
-                result += ch;
-                i += 2;
-            }
+            out += c;
+            i++;
         }
     }
-    
-    return result;
+}
+
+std::string percentDecode(std::string_view text, bool plusAsSpace) {
+    std::string out;
+    percentDecode(text, out, plusAsSpace);
+    return out;
 }
 
 }
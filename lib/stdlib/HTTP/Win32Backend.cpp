@@ -1,5 +1,8 @@
 #include "xwift/stdlib/HTTP/HTTPPlugin.h"
+#include "xwift/stdlib/HTTP/BodyEncoder.h"
 #include "xwift/Basic/Error.h"
+#include <algorithm>
+#include <cctype>
 #include <windows.h>
 #include <winhttp.h>
 
@@ -21,6 +24,11 @@ public:
     
     if (hSession) {
       WinHttpSetTimeouts(hSession, timeout, timeout, timeout, timeout);
+      // Ask for gzip and deflate bodies and have them inflated on the way in.
+      // Before Windows 8.1 WinHTTP cannot, and sendRequest does both itself.
+      DWORD decompression = WINHTTP_DECOMPRESSION_FLAG_ALL;
+      decompressing = WinHttpSetOption(hSession, WINHTTP_OPTION_DECOMPRESSION, &decompression,
+                                       sizeof(decompression)) != FALSE;
     }
   }
   
@@ -65,6 +73,14 @@ private:
   HINTERNET hConnect;
   int timeout;
   std::map<std::string, std::string> headers;
+  // WinHTTP negotiates and inflates compressed bodies itself
+  bool decompressing = false;
+  
+  static std::string lowercase(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return text;
+  }
   
   Result<Response> sendRequest(const std::string& method, const std::string& url, const std::string& data = "") {
     Response response;
@@ -133,14 +149,24 @@ private:
       int nameLen = MultiByteToWideChar(CP_UTF8, 0, header.first.c_str(), -1, NULL, 0);
       std::wstring wName(nameLen, 0);
       MultiByteToWideChar(CP_UTF8, 0, header.first.c_str(), -1, &wName[0], nameLen);
+      wName.resize(nameLen > 0 ? nameLen - 1 : 0);
       
       int valueLen = MultiByteToWideChar(CP_UTF8, 0, header.second.c_str(), -1, NULL, 0);
       std::wstring wValue(valueLen, 0);
       MultiByteToWideChar(CP_UTF8, 0, header.second.c_str(), -1, &wValue[0], valueLen);
+      wValue.resize(valueLen > 0 ? valueLen - 1 : 0);
       
       headersStr += wName + L": " + wValue + L"\r\n";
     }
     
+    bool acceptSet = std::any_of(headers.begin(), headers.end(), [](const auto& header) {
+      return lowercase(header.first) == "accept-encoding";
+    });
+    if (!decompressing && !acceptSet) {
+      std::string accepted = ContentEncodings;
+      headersStr += L"Accept-Encoding: " + std::wstring(accepted.begin(), accepted.end()) + L"\r\n";
+    }
+    
     if (!data.empty()) {
       headersStr += L"Content-Type: application/x-www-form-urlencoded\r\n";
       headersStr += L"Content-Length: " + std::to_wstring(data.length()) + L"\r\n";
@@ -220,10 +246,12 @@ private:
             int nameLen = WideCharToMultiByte(CP_UTF8, 0, name.c_str(), -1, NULL, 0, NULL, NULL);
             std::string nameUtf8(nameLen, 0);
             WideCharToMultiByte(CP_UTF8, 0, name.c_str(), -1, &nameUtf8[0], nameLen, NULL, NULL);
+            nameUtf8.resize(nameLen > 0 ? nameLen - 1 : 0);
             
             int valueLen = WideCharToMultiByte(CP_UTF8, 0, value.c_str(), -1, NULL, 0, NULL, NULL);
             std::string valueUtf8(valueLen, 0);
             WideCharToMultiByte(CP_UTF8, 0, value.c_str(), -1, &valueUtf8[0], valueLen, NULL, NULL);
+            valueUtf8.resize(valueLen > 0 ? valueLen - 1 : 0);
             
             response.headers[nameUtf8] = valueUtf8;
           }
@@ -240,14 +268,29 @@ private:
     while (WinHttpQueryDataAvailable(hRequest, &bytesAvailable) && bytesAvailable > 0) {
       std::vector<char> buffer(bytesAvailable + 1);
       if (WinHttpReadData(hRequest, buffer.data(), bytesAvailable, &bytesRead)) {
-        buffer[bytesRead] = '\0';
-        body += buffer.data();
+        body.append(buffer.data(), bytesRead);
       }
     }
     
-    response.body = body;
-    
     WinHttpCloseHandle(hRequest);
+    
+    // Inflated here when WinHTTP could not, as curl does for its backends:
+    // a body that does not decode is an error, not bytes to hand on
+    std::string encoding;
+    for (const auto& header : response.headers) {
+      if (lowercase(header.first) == "content-encoding") {
+        encoding = lowercase(header.second);
+      }
+    }
+    if (!decompressing && !acceptSet && !encoding.empty() && encoding != "identity") {
+      std::optional<std::string> decoded = BodyDecoder::decodeContentEncoding(body, encoding);
+      if (!decoded) {
+        return Result<Response>::err(Error::network("Cannot decode " + encoding + " response body"));
+      }
+      body = std::move(*decoded);
+    }
+    
+    response.body = body;
     return Result<Response>::ok(response);
   }
   
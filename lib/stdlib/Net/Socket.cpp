@@ -0,0 +1,768 @@
+#include "xwift/stdlib/Net/Socket.h"
+#include "xwift/Basic/Error.h"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <cerrno>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace xwift {
+namespace net {
+
+void StreamBuffer::append(const char* data, size_t size) {
+    // Moving the unread tail down costs no more than the bytes already
+    // taken, so each byte is copied a bounded number of times
+    if (Start > 0 && Start >= Data.size() - Start) {
+        Data.erase(0, Start);
+        Start = 0;
+    }
+    Data.append(data, size);
+}
+
+void StreamBuffer::consume(size_t count) {
+    Start += count;
+    if (Start == Data.size()) {
+        Data.clear();
+        Start = 0;
+    }
+}
+
+std::string StreamBuffer::take(size_t max) {
+    size_t count = std::min(max, size());
+    std::string out(Data, Start, count);
+    consume(count);
+    return out;
+}
+
+std::optional<std::string> StreamBuffer::takeLine() {
+    size_t newline = Data.find('\n', Start);
+    if (newline == std::string::npos) {
+        return std::nullopt;
+    }
+    size_t end = newline;
+    if (end > Start && Data[end - 1] == '\r') {
+        end--;
+    }
+    std::string line(Data, Start, end - Start);
+    consume(newline + 1 - Start);
+    return line;
+}
+
+std::optional<std::string> StreamBuffer::takeFrame(bool& tooLarge) {
+    tooLarge = false;
+    if (size() < 4) {
+        return std::nullopt;
+    }
+    const auto* prefix = reinterpret_cast<const unsigned char*>(Data.data() + Start);
+    size_t length = (size_t(prefix[0]) << 24) | (size_t(prefix[1]) << 16) | (size_t(prefix[2]) << 8) | prefix[3];
+    if (length > MaxFrameBytes) {
+        tooLarge = true;
+        return std::nullopt;
+    }
+    if (size() < 4 + length) {
+        return std::nullopt;
+    }
+    std::string frame(Data, Start + 4, length);
+    consume(4 + length);
+    return frame;
+}
+
+std::string StreamBuffer::framePrefix(size_t length) {
+    std::string prefix(4, '\0');
+    prefix[0] = static_cast<char>((length >> 24) & 0xff);
+    prefix[1] = static_cast<char>((length >> 16) & 0xff);
+    prefix[2] = static_cast<char>((length >> 8) & 0xff);
+    prefix[3] = static_cast<char>(length & 0xff);
+    return prefix;
+}
+
+#ifdef __linux__
+
+namespace {
+
+struct Address {
+    sockaddr_storage Storage{};
+    socklen_t Length = 0;
+
+    sockaddr* get() { return reinterpret_cast<sockaddr*>(&Storage); }
+    int family() const { return Storage.ss_family; }
+};
+
+// Numeric addresses are parsed here rather than by the resolver, which
+// matters when every datagram names its peer. family narrows the lookup
+// to the family of a socket that already exists.
+bool resolve(const std::string& host, int port, int family, Address& out) {
+    if (port < 0 || port > 65535) {
+        return false;
+    }
+    out = Address();
+    if (family != AF_INET6) {
+        auto* v4 = reinterpret_cast<sockaddr_in*>(&out.Storage);
+        if (inet_pton(AF_INET, host.c_str(), &v4->sin_addr) == 1) {
+            v4->sin_family = AF_INET;
+            v4->sin_port = htons(static_cast<uint16_t>(port));
+            out.Length = sizeof(sockaddr_in);
+            return true;
+        }
+    }
+    if (family != AF_INET) {
+        auto* v6 = reinterpret_cast<sockaddr_in6*>(&out.Storage);
+        if (inet_pton(AF_INET6, host.c_str(), &v6->sin6_addr) == 1) {
+            v6->sin6_family = AF_INET6;
+            v6->sin6_port = htons(static_cast<uint16_t>(port));
+            out.Length = sizeof(sockaddr_in6);
+            return true;
+        }
+    }
+    addrinfo hints{};
+    hints.ai_family = family;
+    hints.ai_flags = AI_NUMERICSERV;
+    addrinfo* found = nullptr;
+    std::string service = std::to_string(port);
+    if (getaddrinfo(host.c_str(), service.c_str(), &hints, &found) != 0 || !found) {
+        return false;
+    }
+    std::memcpy(&out.Storage, found->ai_addr, found->ai_addrlen);
+    out.Length = found->ai_addrlen;
+    freeaddrinfo(found);
+    return true;
+}
+
+Endpoint endpointOf(const sockaddr_storage& address) {
+    char text[INET6_ADDRSTRLEN] = "";
+    Endpoint endpoint;
+    if (address.ss_family == AF_INET6) {
+        const auto& v6 = reinterpret_cast<const sockaddr_in6&>(address);
+        inet_ntop(AF_INET6, &v6.sin6_addr, text, sizeof(text));
+        endpoint.port = ntohs(v6.sin6_port);
+    } else if (address.ss_family == AF_INET) {
+        const auto& v4 = reinterpret_cast<const sockaddr_in&>(address);
+        inet_ntop(AF_INET, &v4.sin_addr, text, sizeof(text));
+        endpoint.port = ntohs(v4.sin_port);
+    }
+    endpoint.host = text;
+    return endpoint;
+}
+
+int localPortOf(int fd) {
+    sockaddr_storage bound{};
+    socklen_t length = sizeof(bound);
+    if (fd < 0 || getsockname(fd, reinterpret_cast<sockaddr*>(&bound), &length) != 0) {
+        return 0;
+    }
+    return endpointOf(bound).port;
+}
+
+std::string describe(const std::string& host, int port) {
+    return host + ":" + std::to_string(port);
+}
+
+bool wouldBlock(int error) {
+    return error == EAGAIN || error == EWOULDBLOCK || error == EINTR;
+}
+
+}
+
+void TCPStream::connect(EventLoop& loop, const std::string& host, int port, ConnectCallback done) {
+    auto finish = [&loop, &done](Result<std::shared_ptr<TCPStream>> result) {
+        loop.post([done = std::move(done), result = std::move(result)]() { done(result); });
+    };
+    Address address;
+    if (!resolve(host, port, AF_UNSPEC, address)) {
+        finish(Result<std::shared_ptr<TCPStream>>::err(Error::network("Cannot resolve " + describe(host, port))));
+        return;
+    }
+    Endpoint peer = endpointOf(address.Storage);
+    int fd = socket(address.family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        finish(Result<std::shared_ptr<TCPStream>>::err(Error::network(std::string("Cannot create socket: ") +
+                                                                      std::strerror(errno))));
+        return;
+    }
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    if (::connect(fd, address.get(), address.Length) == 0) {
+        finish(Result<std::shared_ptr<TCPStream>>::ok(std::make_shared<TCPStream>(loop, fd, peer)));
+        return;
+    }
+    if (errno != EINPROGRESS) {
+        int error = errno;
+        ::close(fd);
+        finish(Result<std::shared_ptr<TCPStream>>::err(
+            Error::network("Cannot connect to " + describe(host, port) + ": " + std::strerror(error))));
+        return;
+    }
+    // The handshake is done when the socket turns writable; SO_ERROR says
+    // whether it worked
+    std::string target = describe(host, port);
+    loop.watch(fd, EventLoop::Writable, [&loop, fd, peer, target, done = std::move(done)](uint32_t) {
+        loop.unwatch(fd);
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0) {
+            error = errno;
+        }
+        if (error != 0) {
+            ::close(fd);
+            done(Result<std::shared_ptr<TCPStream>>::err(
+                Error::network("Cannot connect to " + target + ": " + std::strerror(error))));
+            return;
+        }
+        done(Result<std::shared_ptr<TCPStream>>::ok(std::make_shared<TCPStream>(loop, fd, peer)));
+    });
+}
+
+TCPStream::TCPStream(EventLoop& loop, int fd, Endpoint peer) : Loop(&loop), Fd(fd), Peer(std::move(peer)) {}
+
+TCPStream::~TCPStream() {
+    if (Fd >= 0) {
+        ::close(Fd);
+    }
+}
+
+void TCPStream::read(size_t maxBytes, ReadCallback done) {
+    Loop->post([self = shared_from_this(), maxBytes, done = std::move(done)]() mutable {
+        self->Readers.push_back(PendingRead{Framing::Raw, std::max<size_t>(1, maxBytes), std::move(done)});
+        self->pump();
+    });
+}
+
+void TCPStream::readLine(ReadCallback done) {
+    Loop->post([self = shared_from_this(), done = std::move(done)]() mutable {
+        self->Readers.push_back(PendingRead{Framing::Line, 0, std::move(done)});
+        self->pump();
+    });
+}
+
+void TCPStream::readFrame(ReadCallback done) {
+    Loop->post([self = shared_from_this(), done = std::move(done)]() mutable {
+        self->Readers.push_back(PendingRead{Framing::Frame, 0, std::move(done)});
+        self->pump();
+    });
+}
+
+void TCPStream::write(std::string data, WriteCallback done) {
+    Loop->post([self = shared_from_this(), data = std::move(data), done = std::move(done)]() mutable {
+        self->Writers.push_back(PendingWrite{std::move(data), 0, std::move(done)});
+        self->pump();
+    });
+}
+
+void TCPStream::writeFrame(const std::string& payload, WriteCallback done) {
+    if (payload.size() > StreamBuffer::MaxFrameBytes) {
+        Loop->post([done = std::move(done)]() { done(Result<size_t>::err(Error::network("Frame too long"))); });
+        return;
+    }
+    write(StreamBuffer::framePrefix(payload.size()) + payload, std::move(done));
+}
+
+void TCPStream::close() {
+    Loop->post([self = shared_from_this()]() { self->fail(Error::network("Socket is closed")); });
+}
+
+int TCPStream::localPort() const {
+    return localPortOf(Fd);
+}
+
+void TCPStream::pump() {
+    if (Closed) {
+        fail(Error::network("Socket is closed"));
+        return;
+    }
+    deliver();
+    flush();
+    if (Closed) {
+        return;
+    }
+    uint32_t wanted = (!Readers.empty() && !AtEnd ? static_cast<uint32_t>(EventLoop::Readable) : 0u) |
+                      (!Writers.empty() ? static_cast<uint32_t>(EventLoop::Writable) : 0u);
+    if (wanted == Watched) {
+        return;
+    }
+    Watched = wanted;
+    if (!wanted) {
+        Loop->unwatch(Fd);
+        return;
+    }
+    Loop->watch(Fd, wanted, [self = shared_from_this()](uint32_t events) {
+        if (self->Closed) {
+            return;
+        }
+        // An error is picked up by the read or write it breaks
+        if (events & (EventLoop::Readable | EventLoop::Failed)) {
+            self->readSome();
+        }
+        if (!self->Closed) {
+            self->pump();
+        }
+    });
+}
+
+void TCPStream::deliver() {
+    while (!Readers.empty() && !Closed) {
+        PendingRead& reader = Readers.front();
+        std::optional<std::string> message;
+        bool tooLarge = false;
+        switch (reader.How) {
+            case Framing::Raw:
+                if (!Buffer.empty()) {
+                    message = Buffer.take(reader.MaxBytes);
+                }
+                break;
+            case Framing::Line:
+                message = Buffer.takeLine();
+                if (!message && AtEnd && !Buffer.empty()) {
+                    // A last line without a newline still counts
+                    message = Buffer.take(Buffer.size());
+                }
+                tooLarge = !message && Buffer.size() > StreamBuffer::MaxFrameBytes;
+                break;
+            case Framing::Frame:
+                message = Buffer.takeFrame(tooLarge);
+                if (!message && !tooLarge && AtEnd && !Buffer.empty()) {
+                    fail(Error::network("Connection closed inside a frame"));
+                    return;
+                }
+                break;
+        }
+        if (tooLarge) {
+            fail(Error::network(reader.How == Framing::Line ? "Line too long" : "Frame too long"));
+            return;
+        }
+        if (!message && !AtEnd) {
+            return;
+        }
+        ReadCallback done = std::move(reader.Done);
+        Readers.pop_front();
+        done(Result<std::optional<std::string>>(std::move(message)));
+    }
+}
+
+void TCPStream::readSome() {
+    char buffer[65536];
+    ssize_t got = ::recv(Fd, buffer, sizeof(buffer), 0);
+    if (got > 0) {
+        Buffer.append(buffer, static_cast<size_t>(got));
+    } else if (got == 0) {
+        AtEnd = true;
+    } else if (!wouldBlock(errno)) {
+        fail(Error::network(std::string("Cannot read from ") + describe(Peer.host, Peer.port) + ": " +
+                            std::strerror(errno)));
+    }
+}
+
+void TCPStream::flush() {
+    constexpr size_t MaxParts = 64;
+    while (!Writers.empty() && !Closed) {
+        iovec parts[MaxParts];
+        size_t count = 0;
+        size_t requested = 0;
+        for (auto it = Writers.begin(); it != Writers.end() && count < MaxParts; ++it, ++count) {
+            parts[count].iov_base = it->Data.data() + it->Offset;
+            parts[count].iov_len = it->Data.size() - it->Offset;
+            requested += parts[count].iov_len;
+        }
+        msghdr message{};
+        message.msg_iov = parts;
+        message.msg_iovlen = count;
+        ssize_t sent = ::sendmsg(Fd, &message, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (!wouldBlock(errno)) {
+                fail(Error::network(std::string("Cannot write to ") + describe(Peer.host, Peer.port) + ": " +
+                                    std::strerror(errno)));
+            }
+            return;
+        }
+        // Writes that went out whole are done; the first one that did not
+        // keeps its place
+        size_t left = static_cast<size_t>(sent);
+        while (!Writers.empty()) {
+            PendingWrite& front = Writers.front();
+            size_t remaining = front.Data.size() - front.Offset;
+            if (remaining > left) {
+                front.Offset += left;
+                break;
+            }
+            left -= remaining;
+            WriteCallback done = std::move(front.Done);
+            size_t total = front.Data.size();
+            Writers.pop_front();
+            done(Result<size_t>::ok(total));
+        }
+        if (static_cast<size_t>(sent) < requested) {
+            return;
+        }
+    }
+}
+
+void TCPStream::fail(const Error& error) {
+    if (!Closed) {
+        Closed = true;
+        if (Watched) {
+            Loop->unwatch(Fd);
+            Watched = 0;
+        }
+        ::close(Fd);
+        Fd = -1;
+    }
+    std::deque<PendingRead> readers = std::move(Readers);
+    std::deque<PendingWrite> writers = std::move(Writers);
+    Readers.clear();
+    Writers.clear();
+    for (auto& reader : readers) {
+        reader.Done(Result<std::optional<std::string>>::err(error));
+    }
+    for (auto& writer : writers) {
+        writer.Done(Result<size_t>::err(error));
+    }
+}
+
+Result<std::shared_ptr<TCPListener>> TCPListener::listen(EventLoop& loop, const std::string& host, int port,
+                                                         int backlog) {
+    std::string bindHost = host.empty() ? "0.0.0.0" : host;
+    Address address;
+    if (!resolve(bindHost, port, AF_UNSPEC, address)) {
+        return Result<std::shared_ptr<TCPListener>>::err(Error::network("Cannot resolve " + describe(bindHost, port)));
+    }
+    int fd = socket(address.family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int on = 1;
+    bool ok = fd >= 0 && setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == 0 &&
+              ::bind(fd, address.get(), address.Length) == 0 && ::listen(fd, backlog) == 0;
+    if (!ok) {
+        int error = errno;
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return Result<std::shared_ptr<TCPListener>>::err(
+            Error::network("Cannot listen on " + describe(bindHost, port) + ": " + std::strerror(error)));
+    }
+    return Result<std::shared_ptr<TCPListener>>::ok(std::make_shared<TCPListener>(loop, fd));
+}
+
+TCPListener::~TCPListener() {
+    if (Fd >= 0) {
+        ::close(Fd);
+    }
+}
+
+void TCPListener::accept(AcceptCallback done) {
+    Loop->post([self = shared_from_this(), done = std::move(done)]() mutable {
+        self->Acceptors.push_back(std::move(done));
+        self->pump();
+    });
+}
+
+void TCPListener::close() {
+    Loop->post([self = shared_from_this()]() {
+        if (!self->Closed) {
+            self->Closed = true;
+            if (self->Watching) {
+                self->Loop->unwatch(self->Fd);
+                self->Watching = false;
+            }
+            ::close(self->Fd);
+            self->Fd = -1;
+        }
+        self->pump();
+    });
+}
+
+int TCPListener::localPort() const {
+    return localPortOf(Fd);
+}
+
+void TCPListener::pump() {
+    if (Closed) {
+        std::deque<AcceptCallback> acceptors = std::move(Acceptors);
+        Acceptors.clear();
+        for (auto& done : acceptors) {
+            done(Result<std::shared_ptr<TCPStream>>::err(Error::network("Listener is closed")));
+        }
+        return;
+    }
+    while (!Acceptors.empty()) {
+        sockaddr_storage peer{};
+        socklen_t length = sizeof(peer);
+        int fd = ::accept4(Fd, reinterpret_cast<sockaddr*>(&peer), &length, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (wouldBlock(errno)) {
+                break;
+            }
+            AcceptCallback done = std::move(Acceptors.front());
+            Acceptors.pop_front();
+            done(Result<std::shared_ptr<TCPStream>>::err(Error::network(std::string("Cannot accept: ") +
+                                                                        std::strerror(errno))));
+            continue;
+        }
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        AcceptCallback done = std::move(Acceptors.front());
+        Acceptors.pop_front();
+        done(Result<std::shared_ptr<TCPStream>>::ok(std::make_shared<TCPStream>(*Loop, fd, endpointOf(peer))));
+    }
+    bool wanted = !Acceptors.empty() && !Closed;
+    if (wanted == Watching) {
+        return;
+    }
+    Watching = wanted;
+    if (!wanted) {
+        Loop->unwatch(Fd);
+        return;
+    }
+    Loop->watch(Fd, EventLoop::Readable, [self = shared_from_this()](uint32_t) {
+        if (!self->Closed) {
+            self->pump();
+        }
+    });
+}
+
+Result<std::shared_ptr<UDPSocket>> UDPSocket::bind(EventLoop& loop, const std::string& host, int port) {
+    std::string bindHost = host.empty() ? "0.0.0.0" : host;
+    Address address;
+    if (!resolve(bindHost, port, AF_UNSPEC, address)) {
+        return Result<std::shared_ptr<UDPSocket>>::err(Error::network("Cannot resolve " + describe(bindHost, port)));
+    }
+    int fd = socket(address.family(), SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || ::bind(fd, address.get(), address.Length) != 0) {
+        int error = errno;
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return Result<std::shared_ptr<UDPSocket>>::err(
+            Error::network("Cannot bind " + describe(bindHost, port) + ": " + std::strerror(error)));
+    }
+    return Result<std::shared_ptr<UDPSocket>>::ok(std::make_shared<UDPSocket>(loop, fd, address.family()));
+}
+
+UDPSocket::~UDPSocket() {
+    if (Fd >= 0) {
+        ::close(Fd);
+    }
+}
+
+Result<size_t> UDPSocket::sendTo(const std::string& data, const Endpoint& to) {
+    Address address;
+    if (!resolve(to.host, to.port, Family, address)) {
+        return Result<size_t>::err(Error::network("Cannot resolve " + describe(to.host, to.port)));
+    }
+    std::shared_lock<std::shared_mutex> open(FdMutex);
+    if (Fd < 0) {
+        return Result<size_t>::err(Error::network("Socket is closed"));
+    }
+    ssize_t sent = ::sendto(Fd, data.data(), data.size(), 0, address.get(), address.Length);
+    if (sent < 0) {
+        return Result<size_t>::err(Error::network("Cannot send to " + describe(to.host, to.port) + ": " +
+                                                  std::strerror(errno)));
+    }
+    return Result<size_t>::ok(static_cast<size_t>(sent));
+}
+
+Result<size_t> UDPSocket::sendBatch(const std::vector<Datagram>& datagrams) {
+    // Every peer is resolved before anything is sent, so a bad one fails the
+    // batch as a whole. Runs to one peer, the usual case, resolve it once.
+    std::vector<Address> addresses(datagrams.size());
+    for (size_t i = 0; i < datagrams.size(); i++) {
+        const Endpoint& peer = datagrams[i].peer;
+        if (i > 0 && peer.port == datagrams[i - 1].peer.port && peer.host == datagrams[i - 1].peer.host) {
+            addresses[i] = addresses[i - 1];
+        } else if (!resolve(peer.host, peer.port, Family, addresses[i])) {
+            return Result<size_t>::err(Error::network("Cannot resolve " + describe(peer.host, peer.port)));
+        }
+    }
+    // The kernel takes at most UIO_MAXIOV messages per call
+    constexpr size_t MaxMessages = 1024;
+    std::vector<mmsghdr> messages(std::min(datagrams.size(), MaxMessages));
+    std::vector<iovec> parts(messages.size());
+    std::shared_lock<std::shared_mutex> open(FdMutex);
+    if (Fd < 0) {
+        return Result<size_t>::err(Error::network("Socket is closed"));
+    }
+    size_t sent = 0;
+    while (sent < datagrams.size()) {
+        size_t count = std::min(datagrams.size() - sent, MaxMessages);
+        for (size_t i = 0; i < count; i++) {
+            const Datagram& datagram = datagrams[sent + i];
+            parts[i].iov_base = const_cast<char*>(datagram.data.data());
+            parts[i].iov_len = datagram.data.size();
+            messages[i] = mmsghdr{};
+            messages[i].msg_hdr.msg_iov = &parts[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+            messages[i].msg_hdr.msg_name = addresses[sent + i].get();
+            messages[i].msg_hdr.msg_namelen = addresses[sent + i].Length;
+        }
+        int result = ::sendmmsg(Fd, messages.data(), static_cast<unsigned int>(count), 0);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (sent > 0 || wouldBlock(errno)) {
+                break;
+            }
+            return Result<size_t>::err(Error::network(std::string("Cannot send datagrams: ") + std::strerror(errno)));
+        }
+        sent += static_cast<size_t>(result);
+        if (static_cast<size_t>(result) < count) {
+            break;
+        }
+    }
+    return Result<size_t>::ok(sent);
+}
+
+void UDPSocket::receive(size_t max, ReceiveCallback done) {
+    Loop->post([self = shared_from_this(), max, done = std::move(done)]() mutable {
+        self->Receivers.push_back(PendingReceive{std::clamp<size_t>(max, 1, MaxBatch), std::move(done)});
+        self->pump();
+    });
+}
+
+void UDPSocket::close() {
+    Loop->post([self = shared_from_this()]() {
+        if (!self->Closed) {
+            self->Closed = true;
+            if (self->Watching) {
+                self->Loop->unwatch(self->Fd);
+                self->Watching = false;
+            }
+            std::unique_lock<std::shared_mutex> closing(self->FdMutex);
+            ::close(self->Fd);
+            self->Fd = -1;
+        }
+        self->pump();
+    });
+}
+
+int UDPSocket::localPort() const {
+    std::shared_lock<std::shared_mutex> open(FdMutex);
+    return Fd >= 0 ? localPortOf(Fd) : 0;
+}
+
+void UDPSocket::pump() {
+    if (Closed) {
+        std::deque<PendingReceive> receivers = std::move(Receivers);
+        Receivers.clear();
+        for (auto& receiver : receivers) {
+            receiver.Done(Result<std::vector<Datagram>>::err(Error::network("Socket is closed")));
+        }
+        return;
+    }
+    while (!Receivers.empty()) {
+        size_t count = Receivers.front().Max;
+        if (Slots.empty()) {
+            Slots.resize(MaxBatch * MaxDatagramBytes);
+        }
+        mmsghdr messages[MaxBatch] = {};
+        iovec parts[MaxBatch];
+        sockaddr_storage peers[MaxBatch];
+        for (size_t i = 0; i < count; i++) {
+            parts[i].iov_base = Slots.data() + i * MaxDatagramBytes;
+            parts[i].iov_len = MaxDatagramBytes;
+            messages[i].msg_hdr.msg_iov = &parts[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+            messages[i].msg_hdr.msg_name = &peers[i];
+            messages[i].msg_hdr.msg_namelen = sizeof(peers[i]);
+        }
+        // Takes what has arrived, up to count, without waiting for more
+        int got = ::recvmmsg(Fd, messages, static_cast<unsigned int>(count), MSG_DONTWAIT, nullptr);
+        if (got < 0) {
+            if (wouldBlock(errno)) {
+                break;
+            }
+            ReceiveCallback done = std::move(Receivers.front().Done);
+            Receivers.pop_front();
+            done(Result<std::vector<Datagram>>::err(Error::network(std::string("Cannot receive datagrams: ") +
+                                                                   std::strerror(errno))));
+            continue;
+        }
+        std::vector<Datagram> datagrams(static_cast<size_t>(got));
+        for (size_t i = 0; i < datagrams.size(); i++) {
+            datagrams[i].data.assign(Slots.data() + i * MaxDatagramBytes,
+                                     std::min<size_t>(messages[i].msg_len, MaxDatagramBytes));
+            datagrams[i].peer = endpointOf(peers[i]);
+        }
+        ReceiveCallback done = std::move(Receivers.front().Done);
+        Receivers.pop_front();
+        done(Result<std::vector<Datagram>>(std::move(datagrams)));
+    }
+    bool wanted = !Receivers.empty();
+    if (wanted == Watching) {
+        return;
+    }
+    Watching = wanted;
+    if (!wanted) {
+        Loop->unwatch(Fd);
+        return;
+    }
+    Loop->watch(Fd, EventLoop::Readable, [self = shared_from_this()](uint32_t) {
+        if (!self->Closed) {
+            self->pump();
+        }
+    });
+}
+
+#else
+
+// Sockets need the loop's epoll support; elsewhere nothing can be opened,
+// so the members below are never reached
+
+namespace {
+
+Error unsupported() {
+    return Error::network("Sockets are only available on Linux");
+}
+
+}
+
+void TCPStream::connect(EventLoop& loop, const std::string&, int, ConnectCallback done) {
+    loop.post([done = std::move(done)]() { done(Result<std::shared_ptr<TCPStream>>::err(unsupported())); });
+}
+
+TCPStream::TCPStream(EventLoop& loop, int fd, Endpoint peer) : Loop(&loop), Fd(fd), Peer(std::move(peer)) {}
+TCPStream::~TCPStream() = default;
+void TCPStream::read(size_t, ReadCallback) {}
+void TCPStream::readLine(ReadCallback) {}
+void TCPStream::readFrame(ReadCallback) {}
+void TCPStream::write(std::string, WriteCallback) {}
+void TCPStream::writeFrame(const std::string&, WriteCallback) {}
+void TCPStream::close() {}
+int TCPStream::localPort() const { return 0; }
+
+Result<std::shared_ptr<TCPListener>> TCPListener::listen(EventLoop&, const std::string&, int, int) {
+    return Result<std::shared_ptr<TCPListener>>::err(unsupported());
+}
+
+TCPListener::~TCPListener() = default;
+void TCPListener::accept(AcceptCallback) {}
+void TCPListener::close() {}
+int TCPListener::localPort() const { return 0; }
+
+Result<std::shared_ptr<UDPSocket>> UDPSocket::bind(EventLoop&, const std::string&, int) {
+    return Result<std::shared_ptr<UDPSocket>>::err(unsupported());
+}
+
+UDPSocket::~UDPSocket() = default;
+Result<size_t> UDPSocket::sendTo(const std::string&, const Endpoint&) { return Result<size_t>::err(unsupported()); }
+Result<size_t> UDPSocket::sendBatch(const std::vector<Datagram>&) { return Result<size_t>::err(unsupported()); }
+void UDPSocket::receive(size_t, ReceiveCallback) {}
+void UDPSocket::close() {}
+int UDPSocket::localPort() const { return 0; }
+
+#endif
+
+}
+}
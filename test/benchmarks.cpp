@@ -0,0 +1,450 @@
+// Timings that are too slow or too machine-dependent to assert on in
+// XWiftTests. Not run by ctest; run XWiftBenchmarks [name-filter] by hand.
+
+#include "xwift/Basic/StringCell.h"
+#include "xwift/Interpreter/Isolate.h"
+#include "xwift/stdlib/Concurrency/Async.h"
+#include "xwift/stdlib/Concurrency/Channel.h"
+#include "xwift/stdlib/Concurrency/Scheduler.h"
+#include "xwift/stdlib/HTTP/HTTPServer.h"
+#include "xwift/stdlib/HTTP/URLParser.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Appending to a cell that is handed over whole should cost the same per
+// byte at any length; a copy per append would make the second row 4x the
+// first.
+void stringAppend() {
+  for (size_t count : {250000, 1000000}) {
+    auto start = std::chrono::steady_clock::now();
+    xwift::StringCell built;
+    xwift::StringCell piece("x");
+    for (size_t i = 0; i < count; i++) {
+      built = xwift::StringCell::concat(std::move(built), piece);
+    }
+    double seconds = secondsSince(start);
+    std::cout << "  " << count << " appends: " << seconds << "s (" << seconds / count * 1e9
+              << " ns/append)\n";
+  }
+
+  std::string source =
+    "func main() -> Int {\n"
+    "    var s = \"\"\n"
+    "    var i = 0\n"
+    "    while (i < 15000) {\n"
+    "        s = s + \"0123456789\"\n"
+    "        i = i + 1\n"
+    "    }\n"
+    "    print(len(s))\n"
+    "    return 0\n"
+    "}\n";
+  auto start = std::chrono::steady_clock::now();
+  xwift::IsolateResult result = xwift::Isolate("append.xw").run(source);
+  std::cout << "  script s = s + piece, 15000 times: " << secondsSince(start) << "s ("
+            << (result.Success ? result.Output : "failed") << " bytes)\n";
+}
+
+std::string sumScript(int seed) {
+  return "func main() -> Int {\n"
+         "    var sum = 0\n"
+         "    var i = 0\n"
+         "    while (i < 5000) {\n"
+         "        sum = sum + i * " + std::to_string(seed) + "\n"
+         "        i = i + 1\n"
+         "    }\n"
+         "    print(sum)\n"
+         "    return 0\n"
+         "}\n";
+}
+
+// The same scripts on 1, 2, 4... threads; the speedup should track the
+// thread count up to the number of cores
+void isolateScaling() {
+  unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+  size_t scriptCount = cores * 16;
+  std::vector<std::string> sources;
+  for (size_t i = 0; i < scriptCount; i++) {
+    sources.push_back(sumScript(static_cast<int>(i % 7) + 1));
+  }
+  double baseline = 0;
+  for (unsigned threads = 1; threads <= cores; threads *= 2) {
+    xwift::IsolatePool pool(threads);
+    auto start = std::chrono::steady_clock::now();
+    pool.runAll(sources);
+    double seconds = secondsSince(start);
+    if (threads == 1) {
+      baseline = seconds;
+    }
+    std::cout << "  " << scriptCount << " scripts on " << threads << " threads: " << seconds
+              << "s (speedup " << (seconds > 0 ? baseline / seconds : 0) << "x)\n";
+  }
+}
+
+// Fork-join sum over 32 leaves, awaiting each half straight away or only
+// after computing the other half
+std::string forkJoinScript(bool parallel) {
+  return std::string("func work(seed: Int) -> Int {\n"
+         "    var sum = 0\n"
+         "    var i = 0\n"
+         "    while (i < 4000) {\n"
+         "        sum = sum + i * seed\n"
+         "        i = i + 1\n"
+         "    }\n"
+         "    return sum\n"
+         "}\n"
+         "func sumRange(lo: Int, hi: Int) -> Int {\n"
+         "    if (hi - lo == 1) {\n"
+         "        return work(lo)\n"
+         "    }\n"
+         "    var mid = (lo + hi) / 2\n") +
+         (parallel ? "    var left = async sumRange(lo, mid)\n"
+                     "    var right = sumRange(mid, hi)\n"
+                     "    return await left + right\n"
+                   : "    var left = await async sumRange(lo, mid)\n"
+                     "    var right = sumRange(mid, hi)\n"
+                     "    return left + right\n") +
+         "}\n"
+         "func main() -> Int {\n"
+         "    print(sumRange(1, 33))\n"
+         "    return 0\n"
+         "}\n";
+}
+
+// Set XWIFT_WORKERS to change the pool size
+void asyncFanOut() {
+  auto start = std::chrono::steady_clock::now();
+  xwift::Isolate("sequential.xw").run(forkJoinScript(false));
+  double sequential = secondsSince(start);
+  start = std::chrono::steady_clock::now();
+  xwift::Isolate("parallel.xw").run(forkJoinScript(true));
+  double parallel = secondsSince(start);
+  std::cout << "  32 tasks on " << xwift::Scheduler::getInstance().workerCount() << " workers: "
+            << parallel << "s, sequential " << sequential << "s (speedup "
+            << (parallel > 0 ? sequential / parallel : 0) << "x)\n";
+}
+
+// Many small tasks, where starting the task costs more than its body
+void asyncCalls() {
+  std::string source =
+    "func twice(n: Int) -> Int {\n"
+    "    return n * 2\n"
+    "}\n"
+    "func main() -> Int {\n"
+    "    var total = 0\n"
+    "    var i = 0\n"
+    "    while (i < 5000) {\n"
+    "        var task = async twice(i)\n"
+    "        total = total + await task\n"
+    "        i = i + 1\n"
+    "    }\n"
+    "    print(total)\n"
+    "    return 0\n"
+    "}\n";
+  auto start = std::chrono::steady_clock::now();
+  xwift::IsolateResult result = xwift::Isolate("calls.xw").run(source);
+  double seconds = secondsSince(start);
+  std::cout << "  5000 async calls awaited one by one: " << seconds << "s (" << seconds / 5000 * 1e6
+            << " us/call, " << (result.Success ? result.Output : "failed") << ")\n";
+}
+
+void actorMessages() {
+  const size_t actorCount = 100000;
+  const int rounds = 20;
+  std::vector<std::unique_ptr<xwift::Actor<int64_t>>> actors;
+  actors.reserve(actorCount);
+  for (size_t i = 0; i < actorCount; i++) {
+    actors.push_back(std::make_unique<xwift::Actor<int64_t>>(0));
+  }
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < rounds; round++) {
+    for (auto& actor : actors) {
+      xwift::Actor<int64_t>* target = actor.get();
+      target->send([target]() {
+        target->modifyState([](int64_t count) { return count + 1; });
+      });
+    }
+  }
+  for (auto& actor : actors) {
+    actor->waitIdle();
+  }
+  double seconds = secondsSince(start);
+  std::cout << "  " << actorCount * rounds << " messages to " << actorCount << " actors: " << seconds
+            << "s (" << (seconds > 0 ? actorCount * rounds / seconds : 0) << " msg/s)\n";
+}
+
+// Producers each send 1..n on one channel while consumers sum what they
+// receive
+int64_t channelRun(size_t producers, size_t consumers, int64_t perProducer) {
+  xwift::Channel<int64_t> channel(1024);
+  std::atomic<int64_t> total{0};
+  std::vector<std::thread> threads;
+  for (size_t p = 0; p < producers; p++) {
+    threads.emplace_back([&channel, perProducer]() {
+      for (int64_t i = 1; i <= perProducer; i++) {
+        channel.send(i);
+      }
+    });
+  }
+  for (size_t c = 0; c < consumers; c++) {
+    threads.emplace_back([&channel, &total]() {
+      int64_t sum = 0;
+      while (auto item = channel.receive()) {
+        sum += *item;
+      }
+      total += sum;
+    });
+  }
+  for (size_t p = 0; p < producers; p++) {
+    threads[p].join();
+  }
+  channel.close();
+  for (size_t c = producers; c < threads.size(); c++) {
+    threads[c].join();
+  }
+  return total.load();
+}
+
+void channelThroughput() {
+  const int64_t messages = 400000;
+  struct Shape { size_t Producers; size_t Consumers; const char* Name; };
+  for (Shape shape : {Shape{1, 1, "1:1"}, Shape{4, 1, "4:1"}, Shape{4, 4, "4:4"}}) {
+    auto start = std::chrono::steady_clock::now();
+    channelRun(shape.Producers, shape.Consumers, messages / static_cast<int64_t>(shape.Producers));
+    double seconds = secondsSince(start);
+    std::cout << "  " << shape.Name << ": " << messages << " messages in " << seconds << "s ("
+              << static_cast<int64_t>(messages / seconds) << " msg/s)\n";
+  }
+}
+
+// Resident set size in bytes and live thread count, read from /proc
+std::pair<size_t, size_t> processFootprint() {
+  size_t pages = 0;
+  size_t resident = 0;
+  std::ifstream("/proc/self/statm") >> pages >> resident;
+  size_t threads = 0;
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.rfind("Threads:", 0) == 0) {
+      threads = std::stoul(line.substr(8));
+    }
+  }
+  return {resident * static_cast<size_t>(sysconf(_SC_PAGESIZE)), threads};
+}
+
+// 100 batches of 1000 tasks, all parked on one channel at once; memory per
+// task is what a suspended coroutine frame costs
+void suspendedTasks() {
+  std::string source =
+    "func waiter(gate, started) -> Int {\n"
+    "    send(started, 1)\n"
+    "    return await receiveAsync(gate)\n"
+    "}\n"
+    "func batch(gate, ready, n: Int) -> Int {\n"
+    "    var started = channel(n)\n"
+    "    var i = 0\n"
+    "    while (i < n) {\n"
+    "        var task = async waiter(gate, started)\n"
+    "        i = i + 1\n"
+    "    }\n"
+    "    i = 0\n"
+    "    while (i < n) {\n"
+    "        var one = await receiveAsync(started)\n"
+    "        i = i + 1\n"
+    "    }\n"
+    "    send(ready, n)\n"
+    "    return 0\n"
+    "}\n"
+    "func main() -> Int {\n"
+    "    var gate = channel(1)\n"
+    "    var ready = channel(128)\n"
+    "    var i = 0\n"
+    "    while (i < 100) {\n"
+    "        var group = async batch(gate, ready, 1000)\n"
+    "        i = i + 1\n"
+    "    }\n"
+    "    var parked = 0\n"
+    "    i = 0\n"
+    "    while (i < 100) {\n"
+    "        parked = parked + receive(ready)\n"
+    "        i = i + 1\n"
+    "    }\n"
+    "    print(parked)\n"
+    "    close(gate)\n"
+    "    return 0\n"
+    "}\n";
+  auto baseline = processFootprint();
+  std::atomic<bool> running{true};
+  std::atomic<size_t> peakBytes{baseline.first};
+  std::atomic<size_t> peakThreads{baseline.second};
+  std::thread sampler([&]() {
+    while (running.load()) {
+      auto now = processFootprint();
+      peakBytes.store(std::max(peakBytes.load(), now.first));
+      peakThreads.store(std::max(peakThreads.load(), now.second));
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+  });
+  auto start = std::chrono::steady_clock::now();
+  xwift::IsolateResult result = xwift::Isolate("suspend.xw").run(source);
+  double seconds = secondsSince(start);
+  running = false;
+  sampler.join();
+  std::cout << "  " << (result.Success ? result.Output : "failed") << " suspended tasks in " << seconds
+            << "s, " << (peakBytes.load() - baseline.first) / 100000 << " bytes each, "
+            << peakThreads.load() << " threads\n";
+}
+
+// Query parsing over URLs shaped like an API's, then percent-coding a long
+// path that is mostly unreserved
+void urlParsing() {
+  std::vector<std::string> urls;
+  for (int i = 0; i < 1000; i++) {
+    urls.push_back("https://host" + std::to_string(i % 50) + ".example.com/articles/" + std::to_string(i) +
+                   "/comments?page=" + std::to_string(i % 7) + "&sort=newest&q=caf%C3%A9#top");
+  }
+  auto start = std::chrono::steady_clock::now();
+  size_t pairs = 0;
+  for (int round = 0; round < 200; round++) {
+    for (const auto& each : urls) {
+      for (const auto& param : xwift::http::URLParser::parseView(each).queryParams()) {
+        pairs += param.Value.size() > 0;
+      }
+    }
+  }
+  double parseSeconds = secondsSince(start);
+  
+  std::string path;
+  for (int i = 0; i < 4096; i++) {
+    path += i % 64 == 0 ? "/caf\xc3\xa9 " : "segment-";
+  }
+  start = std::chrono::steady_clock::now();
+  size_t codedBytes = 0;
+  for (int round = 0; round < 100; round++) {
+    codedBytes += xwift::http::percentDecode(xwift::http::percentEncode(path)).size();
+  }
+  double codeSeconds = secondsSince(start);
+  std::cout << "  " << static_cast<size_t>(200000 / parseSeconds) << " parses/s (" << pairs << " params), "
+            << static_cast<size_t>(codedBytes / codeSeconds / (1024 * 1024)) << " MB/s encoded and decoded\n";
+}
+
+// wrk-style plaintext load: each connection keeps one request in flight
+// for a second, over keep-alive
+void serverThroughput() {
+  xwift::http::HTTPServer server;
+  server.route("GET", "/plaintext", [](const xwift::http::ServerRequest&, xwift::http::ServerResponse& response) {
+    response.body = "Hello, World!";
+  });
+  auto port = server.start();
+  if (port.is_error()) {
+    std::cout << "  cannot start the server\n";
+    return;
+  }
+  const size_t connections = std::max<size_t>(4, server.threads() * 2);
+  const auto duration = std::chrono::milliseconds(1000);
+  const std::string request = "GET /plaintext HTTP/1.1\r\nHost: bench\r\n\r\n";
+  const std::string body = "Hello, World!";
+  std::vector<std::vector<double>> latencies(connections);
+  std::atomic<size_t> errors{0};
+  std::vector<std::thread> clients;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t c = 0; c < connections; c++) {
+    clients.emplace_back([&, c]() {
+      int fd = socket(AF_INET, SOCK_STREAM, 0);
+      sockaddr_in addr{};
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      addr.sin_port = htons(port.unwrap());
+      if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        errors++;
+        close(fd);
+        return;
+      }
+      char buffer[4096];
+      while (std::chrono::steady_clock::now() - start < duration) {
+        auto sent = std::chrono::steady_clock::now();
+        send(fd, request.data(), request.size(), 0);
+        std::string reply;
+        // Responses here are fixed-size, so the body's end is its last byte
+        while (reply.size() < body.size() || reply.compare(reply.size() - body.size(), body.size(), body) != 0) {
+          ssize_t count = recv(fd, buffer, sizeof(buffer), 0);
+          if (count <= 0) {
+            errors++;
+            close(fd);
+            return;
+          }
+          reply.append(buffer, count);
+        }
+        latencies[c].push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sent).count());
+      }
+      close(fd);
+    });
+  }
+  for (auto& client : clients) {
+    client.join();
+  }
+  double seconds = secondsSince(start);
+  server.stop();
+  
+  std::vector<double> all;
+  for (const auto& each : latencies) {
+    all.insert(all.end(), each.begin(), each.end());
+  }
+  if (all.empty()) {
+    std::cout << "  no requests answered, " << errors.load() << " errors\n";
+    return;
+  }
+  std::sort(all.begin(), all.end());
+  double perSecond = all.size() / seconds;
+  std::cout << "  " << static_cast<size_t>(perSecond) << " req/s over " << connections << " connections, p99 "
+            << all[all.size() * 99 / 100] << "ms, " << static_cast<size_t>(perSecond / server.threads())
+            << " req/s per core on " << server.threads() << ", " << errors.load() << " errors\n";
+}
+
+struct Benchmark {
+  const char* Name;
+  std::function<void()> Run;
+};
+
+}
+
+int main(int argc, char** argv) {
+  std::vector<Benchmark> benchmarks = {
+    {"StringAppend", stringAppend},
+    {"IsolateScaling", isolateScaling},
+    {"AsyncFanOut", asyncFanOut},
+    {"AsyncCalls", asyncCalls},
+    {"ActorMessages", actorMessages},
+    {"ChannelThroughput", channelThroughput},
+    {"SuspendedTasks", suspendedTasks},
+    {"URLParsing", urlParsing},
+    {"ServerThroughput", serverThroughput},
+  };
+  for (const auto& benchmark : benchmarks) {
+    if (argc > 1 && !std::strstr(benchmark.Name, argv[1])) {
+      continue;
+    }
+    std::cout << benchmark.Name << "\n";
+    benchmark.Run();
+  }
+  return 0;
+}
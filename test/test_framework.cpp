@@ -1,7 +1,41 @@
 #include "xwift/Testing/TestFramework.h"
 #include "xwift/stdlib/JSON/JSON.h"
 #include "xwift/Filesystem/Filesystem.h"
+#include "xwift/AST/Optimizer.h"
+#include "xwift/AST/TypeProfile.h"
+#include "xwift/Interpreter/Interpreter.h"
+#include "xwift/Interpreter/Isolate.h"
+#include "xwift/Lexer/Lexer.h"
+#include "xwift/Sema/Sema.h"
+#include "xwift/stdlib/Concurrency/Async.h"
+#include "xwift/stdlib/Concurrency/Channel.h"
+#include "xwift/stdlib/Concurrency/EventLoop.h"
+#include "xwift/stdlib/Concurrency/TaskGroup.h"
+#include "xwift/stdlib/HTTP/AsyncHTTP.h"
+#include "xwift/stdlib/HTTP/BodyEncoder.h"
+#include "xwift/stdlib/HTTP/CurlBackend.h"
+#include "xwift/stdlib/HTTP/HTTPCache.h"
+#include "xwift/stdlib/HTTP/HTTPClient.h"
+#include "xwift/stdlib/HTTP/HTTPMetrics.h"
+#include "xwift/stdlib/HTTP/HTTPServer.h"
+#include "xwift/stdlib/HTTP/URLParser.h"
+#include "xwift/stdlib/Net/Socket.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
 #include <fstream>
+#include <future>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 using namespace xwift::testing;
 
@@ -122,6 +156,2321 @@ XWIFT_TEST(FileSystem, InvalidPathHandling) {
   XWIFT_ASSERT_FALSE(isValid);
 }
 
+static std::string isolateScript(int seed) {
+  return "func main() -> Int {\n"
+         "    var sum = 0\n"
+         "    var i = 0\n"
+         "    while (i < 5000) {\n"
+         "        sum = sum + i * " + std::to_string(seed) + "\n"
+         "        i = i + 1\n"
+         "    }\n"
+         "    print(sum)\n"
+         "    return 0\n"
+         "}\n";
+}
+
+XWIFT_TEST(Isolate, CapturesOutputPerIsolate) {
+  xwift::Isolate isolate("capture.xw");
+  xwift::IsolateResult result = isolate.run(isolateScript(2));
+  
+  XWIFT_ASSERT_TRUE(result.Success);
+  XWIFT_ASSERT_EQ("24995000", result.Output);
+}
+
+XWIFT_TEST(Isolate, RecursionKeepsCallerLocals) {
+  // Each call binds its parameters and locals in its own scope, and the
+  // arguments are read before the callee's parameters shadow them
+  std::string source =
+    "func fib(n: Int) -> Int {\n"
+    "    if (n < 2) {\n"
+    "        return n\n"
+    "    }\n"
+    "    var a = fib(n - 1)\n"
+    "    var b = fib(n - 2)\n"
+    "    return a + b\n"
+    "}\n"
+    "func swap(a: Int, b: Int) -> Int {\n"
+    "    return a * 10 + b\n"
+    "}\n"
+    "func main() -> Int {\n"
+    "    var a = 1\n"
+    "    var b = 2\n"
+    "    print(fib(15))\n"
+    "    print(\" \")\n"
+    "    print(swap(b, a))\n"
+    "    return 0\n"
+    "}\n";
+  xwift::IsolateResult result = xwift::Isolate("scopes.xw").run(source);
+  XWIFT_ASSERT_TRUE(result.Success);
+  XWIFT_ASSERT_EQ("610 21", result.Output);
+}
+
+XWIFT_TEST(Isolate, ParallelStress) {
+  unsigned cores = std::max(2u, std::thread::hardware_concurrency());
+  size_t scriptCount = cores * 16;
+  std::vector<std::string> sources;
+  for (size_t i = 0; i < scriptCount; i++) {
+    sources.push_back(isolateScript(static_cast<int>(i % 7) + 1));
+  }
+  
+  // Each pool size must give every script its own output, in order
+  for (unsigned threads = 1; threads <= cores; threads *= 2) {
+    xwift::IsolatePool pool(threads);
+    auto results = pool.runAll(sources);
+    
+    XWIFT_ASSERT_EQ(scriptCount, results.size());
+    for (size_t i = 0; i < results.size(); i++) {
+      XWIFT_ASSERT_TRUE(results[i].Success);
+      XWIFT_ASSERT_EQ(std::to_string(12497500LL * (static_cast<long long>(i % 7) + 1)), results[i].Output);
+    }
+  }
+}
+
+XWIFT_TEST(Atom, LexerInternsIdentifiers) {
+  // Strings only become atoms explicitly, so a lookup can't take the
+  // interner's lock by accident
+  static_assert(!std::is_convertible_v<std::string, xwift::Atom>);
+  static_assert(!std::is_convertible_v<const char*, xwift::Atom>);
+
+  xwift::Lexer lexer("count = count + total");
+  xwift::Token first = lexer.nextToken();
+  lexer.nextToken();
+  xwift::Token second = lexer.nextToken();
+  lexer.nextToken();
+  xwift::Token third = lexer.nextToken();
+  XWIFT_ASSERT_TRUE(first.Name == second.Name);
+  XWIFT_ASSERT_TRUE(first.Name.get() == second.Name.get());
+  XWIFT_ASSERT_TRUE(first.Name == xwift::Atom("count"));
+  XWIFT_ASSERT_TRUE(first.Name != third.Name);
+
+  // Ordered by identity, which is consistent but not alphabetical
+  xwift::Atom a("alpha"), b("beta");
+  XWIFT_ASSERT_TRUE((a < b) != (b < a));
+  XWIFT_ASSERT_FALSE(a < xwift::Atom("alpha"));
+  XWIFT_ASSERT_EQ((a < b), (a.get() < b.get()));
+}
+
+XWIFT_TEST(StringCell, AppendsInPlaceOnlyWhenUnshared) {
+  using xwift::StringCell;
+  StringCell base = StringCell::concat(StringCell("ab"), StringCell("cd"));
+  StringCell copy = base;
+  StringCell longer = StringCell::concat(base, StringCell("ef"));
+  XWIFT_ASSERT_EQ(std::string("abcd"), base.str());
+  XWIFT_ASSERT_EQ(std::string("abcd"), copy.str());
+  XWIFT_ASSERT_EQ(std::string("abcdef"), longer.str());
+  StringCell doubled = StringCell::concat(base, base);
+  XWIFT_ASSERT_EQ(std::string("abcdabcd"), doubled.str());
+
+  // A cell handed over whole grows its own buffer, which moves only when
+  // its capacity runs out
+  StringCell built;
+  size_t moves = 0;
+  const char* data = nullptr;
+  for (int i = 0; i < 100000; i++) {
+    built = StringCell::concat(std::move(built), StringCell("x"));
+    if (built.str().data() != data) {
+      data = built.str().data();
+      moves++;
+    }
+  }
+  XWIFT_ASSERT_EQ(size_t(100000), built.size());
+  XWIFT_ASSERT_TRUE(moves < 64);
+}
+
+XWIFT_TEST(Interpreter, StringAppendLeavesCopiesAlone) {
+  std::string source =
+    "func main() -> Int {\n"
+    "    var s = \"\"\n"
+    "    var snapshot = \"\"\n"
+    "    var i = 0\n"
+    "    while (i < 5000) {\n"
+    "        if (i == 10) {\n"
+    "            snapshot = s\n"
+    "        }\n"
+    "        s = s + \"x\"\n"
+    "        i = i + 1\n"
+    "    }\n"
+    "    var t = s\n"
+    "    s = s + s\n"
+    "    print(len(snapshot))\n"
+    "    print(\" \")\n"
+    "    print(len(t))\n"
+    "    print(\" \")\n"
+    "    print(len(s))\n"
+    "    return 0\n"
+    "}\n";
+  xwift::IsolateResult result = xwift::Isolate("append.xw").run(source);
+  XWIFT_ASSERT_TRUE(result.Success);
+  XWIFT_ASSERT_EQ("10 5000 10000", result.Output);
+}
+
+XWIFT_TEST(ObjectHeap, CopyOnWriteNestedWritesAndCycles) {
+  using namespace xwift;
+  DiagnosticEngine diag;
+  Interpreter interpreter(diag);
+  ObjectHeap::Scope heapScope(interpreter.Heap);
+
+  auto field = [](const ObjectValue& object, const char* name) {
+    return object->Properties.at(Atom(name));
+  };
+
+  // Copies of a struct share one cell until one of them is written
+  ObjectValue inner("Inner", true);
+  inner.mutate()->Properties[Atom("c")] = Value(int64_t(1));
+  ObjectValue outer("Outer", true);
+  outer.mutate()->Properties[Atom("b")] = Value(inner);
+  ObjectValue snapshot = outer;
+  XWIFT_ASSERT_EQ(size_t(2), outer.get()->RefCount);
+  XWIFT_ASSERT_EQ(size_t(2), inner.get()->RefCount);
+
+  // func set(a) { a.b.c = 5; return a } reaches the b held by the
+  // parameter instead of writing into a temporary copy of it
+  auto target = std::make_unique<MemberAccessExpr>(
+    std::make_unique<MemberAccessExpr>(std::make_unique<IdentifierExpr>(Atom("a")), Atom("b")), Atom("c"));
+  auto body = std::make_unique<BlockStmt>();
+  body->addStmt(std::make_unique<AssignExpr>(std::move(target), std::make_unique<IntegerLiteralExpr>(5)));
+  body->addStmt(std::make_unique<ReturnStmt>(std::make_unique<IdentifierExpr>(Atom("a"))));
+  FuncDecl set(Atom("set"), "Outer", std::move(body));
+  set.addParam(Atom("a"), "Outer");
+  Value result = interpreter.callFunction(&set, {Value(outer)});
+
+  ObjectValue written = *result.get<ObjectValue>();
+  XWIFT_ASSERT_FALSE(written.isSameInstance(outer));
+  XWIFT_ASSERT_TRUE(*field(*field(written, "b").get<ObjectValue>(), "c").get<int64_t>() == 5);
+  XWIFT_ASSERT_TRUE(*field(*field(outer, "b").get<ObjectValue>(), "c").get<int64_t>() == 1);
+  XWIFT_ASSERT_TRUE(*field(inner, "c").get<int64_t>() == 1);
+  XWIFT_ASSERT_TRUE(outer.isSameInstance(snapshot));
+  XWIFT_ASSERT_EQ(size_t(2), outer.get()->RefCount);
+
+  // Class instances that only reference each other are reclaimed; a cycle
+  // still held from outside the heap is not
+  size_t before = interpreter.Heap.size();
+  {
+    ObjectValue first("Node");
+    ObjectValue second("Node");
+    first.mutate()->Properties[Atom("peer")] = Value(second);
+    second.mutate()->Properties[Atom("peer")] = Value(first);
+  }
+  ObjectValue kept("Node");
+  kept.mutate()->Properties[Atom("peer")] = Value(kept);
+  XWIFT_ASSERT_EQ(before + 3, interpreter.Heap.size());
+  XWIFT_ASSERT_EQ(size_t(2), interpreter.Heap.collectCycles());
+  XWIFT_ASSERT_EQ(before + 1, interpreter.Heap.size());
+  XWIFT_ASSERT_TRUE(field(kept, "peer").get<ObjectValue>()->isSameInstance(kept));
+}
+
+XWIFT_TEST(Interpreter, TypedArithmeticFallsBackForOtherOperators) {
+  // % has no unboxed form, so typed and untyped operands alike take the
+  // boxed path instead of evaluating to 0
+  std::string source =
+    "func mod(p, q) {\n"
+    "    return p % q\n"
+    "}\n"
+    "func main() -> Int {\n"
+    "    var a = 17\n"
+    "    var b = 5\n"
+    "    print(a % b)\n"
+    "    print(a % b + 1)\n"
+    "    print(mod(a, b))\n"
+    "    var n = 0\n"
+    "    var k = 0\n"
+    "    while (k < a % b + 2) {\n"
+    "        n = n + k % 2\n"
+    "        k = k + 1\n"
+    "    }\n"
+    "    print(n)\n"
+    "    print(a % 0)\n"
+    "    var x = 7.5\n"
+    "    print(x % 2.0)\n"
+    "    print(a * b - a / b)\n"
+    "    return 0\n"
+    "}\n";
+  xwift::IsolateResult result = xwift::Isolate("modulo.xw").run(source);
+  XWIFT_ASSERT_TRUE(result.Success);
+  XWIFT_ASSERT_EQ("232201.50000082", result.Output);
+}
+
+XWIFT_TEST(Interpreter, ProfileRoundTripAndCallCache) {
+  using xwift::TypeProfile;
+  std::string source =
+    "func add(a, b) -> Int {\n"
+    "    return a + b\n"
+    "}\n"
+    "func main() -> Int {\n"
+    "    var sum = 0\n"
+    "    var i = 0\n"
+    "    while (i < 100) {\n"
+    "        sum = add(sum, i)\n"
+    "        i = i + 1\n"
+    "    }\n"
+    "    print(sum)\n"
+    "    return 0\n"
+    "}\n";
+  std::string path = (std::filesystem::temp_directory_path() /
+    ("xwift-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) +
+     ".xwprofile")).string();
+  uint64_t hash = TypeProfile::hashSource(source);
+  // Runs source once, with profile recording and, if apply, specialized
+  // from it first
+  auto run = [&](TypeProfile& profile, bool apply, std::vector<xwift::Stmt*>& sites,
+                 std::unique_ptr<xwift::Program>& program, xwift::DiagnosticEngine& diag) {
+    xwift::Lexer lexer(source);
+    xwift::SyntaxParser parser(lexer);
+    program = parser.parseProgram();
+    xwift::Sema sema(diag);
+    XWIFT_ASSERT_TRUE(sema.visit(program.get()));
+    sites = TypeProfile::numberSites(program.get());
+    profile.reset(sites.size());
+    if (apply) {
+      XWIFT_ASSERT_TRUE(profile.load(path, hash));
+      xwift::Optimizer().applyProfile(program.get(), profile);
+    }
+  };
+  
+  TypeProfile recorded;
+  std::vector<xwift::Stmt*> sites;
+  std::unique_ptr<xwift::Program> program;
+  std::ostringstream output;
+  {
+    xwift::DiagnosticEngine diag;
+    run(recorded, false, sites, program, diag);
+    xwift::Interpreter interpreter(diag);
+    interpreter.setOutput(output);
+    interpreter.setProfile(&recorded);
+    interpreter.run(program.get());
+  }
+  XWIFT_ASSERT_EQ("4950", output.str());
+  XWIFT_ASSERT_TRUE(recorded.save(path, hash));
+  
+  // The reloaded profile matches only the same source, and specializes the
+  // hot untyped + for Int operands
+  TypeProfile stale;
+  stale.reset(sites.size());
+  XWIFT_ASSERT_FALSE(stale.load(path, hash + 1));
+  TypeProfile reloaded;
+  xwift::DiagnosticEngine diag;
+  run(reloaded, true, sites, program, diag);
+  // Only binary operators are profiled
+  xwift::BinaryExpr* sum = nullptr;
+  for (size_t id = 1; id < sites.size(); id++) {
+    XWIFT_ASSERT_EQ(recorded.lookup(id)->Count, reloaded.lookup(id)->Count);
+    auto binary = dynamic_cast<xwift::BinaryExpr*>(sites[id]);
+    XWIFT_ASSERT_TRUE(binary != nullptr);
+    if (binary && binary->Op == "+") {
+      sum = sum ? sum : binary;
+    }
+  }
+  XWIFT_ASSERT_TRUE(sum != nullptr);
+  XWIFT_ASSERT_TRUE(sum->SpeculatedKind == xwift::Expr::EvalKind::Int64);
+  
+  // main's body: var sum, var i, the loop whose body is sum = add(sum, i),
+  // then print(sum)
+  auto mainBody = dynamic_cast<xwift::BlockStmt*>(
+    dynamic_cast<xwift::FuncDecl*>(program->Declarations[1].get())->Body.get());
+  auto loop = dynamic_cast<xwift::WhileStmt*>(mainBody->Statements[2].get());
+  auto assign = dynamic_cast<xwift::AssignExpr*>(dynamic_cast<xwift::BlockStmt*>(loop->Body.get())->Statements[0].get());
+  auto addCall = dynamic_cast<xwift::CallExpr*>(assign->Value.get());
+  auto printCall = dynamic_cast<xwift::CallExpr*>(mainBody->Statements[3].get());
+  XWIFT_ASSERT_TRUE(addCall && printCall);
+  
+  // After a run every call site holds its target for the current function
+  // table: the user function, or nullptr for a builtin
+  output.str("");
+  xwift::Interpreter interpreter(diag);
+  interpreter.setOutput(output);
+  interpreter.run(program.get());
+  XWIFT_ASSERT_EQ("4950", output.str());
+  XWIFT_ASSERT_EQ(interpreter.FunctionEpoch, addCall->CachedEpoch.load());
+  XWIFT_ASSERT_TRUE(addCall->CachedTarget.load() == interpreter.UserFunctions[xwift::Atom("add")]);
+  XWIFT_ASSERT_EQ(interpreter.FunctionEpoch, printCall->CachedEpoch.load());
+  XWIFT_ASSERT_TRUE(printCall->CachedTarget.load() == nullptr);
+  std::filesystem::remove(path);
+}
+
+XWIFT_TEST(Scheduler, NestedSpawnRunsEveryJob) {
+  xwift::Scheduler scheduler(4);
+  std::atomic<int> ran{0};
+  std::atomic<int> pending{64 * 65};
+  
+  for (int i = 0; i < 64; i++) {
+    scheduler.spawn([&]() {
+      for (int j = 0; j < 64; j++) {
+        scheduler.spawn([&]() {
+          ran++;
+          pending--;
+        });
+      }
+      ran++;
+      pending--;
+    });
+  }
+  scheduler.waitUntil([&]() { return pending.load() == 0; });
+  
+  XWIFT_ASSERT_EQ(64 * 65, ran.load());
+}
+
+XWIFT_TEST(Scheduler, BlockingCallsReuseSpareThreads) {
+  // One blocking job at a time: the first starts a thread to take over its
+  // worker's slot, and every later one hands its slot to the thread left
+  // spare by the one before
+  {
+    xwift::Scheduler scheduler(2);
+    for (int i = 0; i < 50; i++) {
+      std::atomic<bool> done{false};
+      scheduler.spawn([&]() {
+        scheduler.blockInPlace([]() { std::this_thread::sleep_for(std::chrono::microseconds(200)); });
+        done = true;
+      });
+      scheduler.waitUntil([&]() { return done.load(); });
+    }
+    XWIFT_ASSERT_TRUE(scheduler.threadCount() <= 4);
+  }
+  
+  // Pools torn down while their jobs are still blocking join every thread
+  for (int i = 0; i < 20; i++) {
+    xwift::Scheduler scheduler(2);
+    for (int j = 0; j < 4; j++) {
+      scheduler.spawn([&]() {
+        scheduler.blockInPlace([]() { std::this_thread::sleep_for(std::chrono::milliseconds(1)); });
+      });
+    }
+  }
+}
+
+// Fork-join sum over [lo, hi): the left half runs as a task. In parallel
+// mode the caller computes the right half before awaiting it; otherwise it
+// awaits straight away, so the same tasks run one at a time.
+static std::string forkJoinScript(bool parallel) {
+  return std::string("func work(seed: Int) -> Int {\n"
+         "    var sum = 0\n"
+         "    var i = 0\n"
+         "    while (i < 4000) {\n"
+         "        sum = sum + i * seed\n"
+         "        i = i + 1\n"
+         "    }\n"
+         "    return sum\n"
+         "}\n"
+         "func sumRange(lo: Int, hi: Int) -> Int {\n"
+         "    if (hi - lo == 1) {\n"
+         "        return work(lo)\n"
+         "    }\n"
+         "    var mid = (lo + hi) / 2\n") +
+         (parallel ? "    var left = async sumRange(lo, mid)\n"
+                     "    var right = sumRange(mid, hi)\n"
+                     "    return await left + right\n"
+                   : "    var left = await async sumRange(lo, mid)\n"
+                     "    var right = sumRange(mid, hi)\n"
+                     "    return left + right\n") +
+         "}\n"
+         "func main() -> Int {\n"
+         "    print(sumRange(1, 33))\n"
+         "    return 0\n"
+         "}\n";
+}
+
+XWIFT_TEST(Scheduler, AsyncFanOutRunsConcurrently) {
+  // 7998000 * (1 + 2 + ... + 32)
+  const std::string expected = "4222944000";
+  
+  xwift::IsolateResult sequential = xwift::Isolate("sequential.xw").run(forkJoinScript(false));
+  xwift::IsolateResult parallel = xwift::Isolate("parallel.xw").run(forkJoinScript(true));
+  
+  XWIFT_ASSERT_TRUE(sequential.Success);
+  XWIFT_ASSERT_TRUE(parallel.Success);
+  XWIFT_ASSERT_EQ(expected, sequential.Output);
+  XWIFT_ASSERT_EQ(expected, parallel.Output);
+  
+  // Jobs spawned together run at the same time, one per worker: each one
+  // waits until all of them have started
+  const size_t workers = 4;
+  xwift::Scheduler scheduler(workers);
+  std::atomic<size_t> started{0};
+  std::atomic<size_t> overlapped{0};
+  std::atomic<size_t> finished{0};
+  for (size_t i = 0; i < workers; i++) {
+    scheduler.spawn([&]() {
+      started++;
+      auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+      while (started.load() < workers && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::yield();
+      }
+      if (started.load() == workers) {
+        overlapped++;
+      }
+      finished++;
+    });
+  }
+  scheduler.waitUntil([&]() { return finished.load() == workers; });
+  
+  XWIFT_ASSERT_EQ(workers, overlapped.load());
+}
+
+XWIFT_TEST(Scheduler, TaskForksAreReusedClean) {
+  using namespace xwift;
+  DiagnosticEngine diag;
+  Interpreter root(diag);
+  const std::shared_ptr<ForkPool>& pool = root.forkPool();
+  
+  auto fork = pool->acquire(root);
+  Interpreter* first = &fork->Child;
+  fork->Child.enterScope();
+  fork->Child.declareVariable(Atom("leftover"), Value(int64_t(1)));
+  pool->release(std::move(fork));
+  
+  // The next task gets the same fork back with nothing of the last one
+  auto again = pool->acquire(root);
+  XWIFT_ASSERT_TRUE(&again->Child == first);
+  XWIFT_ASSERT_TRUE(again->Child.ScopeStack.empty());
+  XWIFT_ASSERT_TRUE(again->Child.forkPool() == pool);
+  
+  // One that reported errors is dropped rather than reused
+  again->Diags.report(DiagLevel::Error, "failed");
+  pool->release(std::move(again));
+  auto fresh = pool->acquire(root);
+  XWIFT_ASSERT_TRUE(fresh->Diags.getDiagnostics().empty());
+}
+
+XWIFT_TEST(Actor, ManyActorsOnSharedPool) {
+  const size_t actorCount = 100000;
+  const int rounds = 20;
+  std::vector<std::unique_ptr<xwift::Actor<int64_t>>> actors;
+  actors.reserve(actorCount);
+  for (size_t i = 0; i < actorCount; i++) {
+    actors.push_back(std::make_unique<xwift::Actor<int64_t>>(0));
+  }
+  
+  for (int round = 0; round < rounds; round++) {
+    for (auto& actor : actors) {
+      xwift::Actor<int64_t>* target = actor.get();
+      target->send([target]() {
+        target->modifyState([](int64_t count) { return count + 1; });
+      });
+    }
+  }
+  for (auto& actor : actors) {
+    actor->waitIdle();
+  }
+  
+  for (auto& actor : actors) {
+    XWIFT_ASSERT_EQ(rounds, actor->getState());
+  }
+}
+
+XWIFT_TEST(Actor, ScriptActorFoldsMessages) {
+  std::string source =
+    "func tally(total: Int, amount: Int) -> Int {\n"
+    "    return total + amount\n"
+    "}\n"
+    "func main() -> Int {\n"
+    "    var counter = actor tally(100)\n"
+    "    var i = 0\n"
+    "    while (i < 50) {\n"
+    "        send(counter, i)\n"
+    "        i = i + 1\n"
+    "    }\n"
+    "    print(await counter)\n"
+    "    return 0\n"
+    "}\n";
+  xwift::IsolateResult result = xwift::Isolate("actor.xw").run(source);
+  
+  XWIFT_ASSERT_TRUE(result.Success);
+  XWIFT_ASSERT_EQ("1325", result.Output);
+}
+
+XWIFT_TEST(Actor, ObjectMessagesFromManyThreads) {
+  using namespace xwift;
+  DiagnosticEngine diag;
+  Interpreter root(diag);
+  
+  // func count(total, message) { return total + 1 }
+  auto body = std::make_unique<BlockStmt>();
+  body->addStmt(std::make_unique<ReturnStmt>(std::make_unique<BinaryExpr>(
+    "+", std::make_unique<IdentifierExpr>(Atom("total")), std::make_unique<IntegerLiteralExpr>(1))));
+  FuncDecl count(Atom("count"), "Int", std::move(body));
+  count.addParam(Atom("total"), "Int");
+  count.addParam(Atom("message"), "Message");
+  
+  const int senders = 4;
+  const int perSender = 2000;
+  {
+    ScriptActor actor(root, &count, Value(int64_t(0)));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < senders; t++) {
+      threads.emplace_back([&actor, t]() {
+        ObjectHeap heap;
+        ObjectHeap::Scope heapScope(heap);
+        for (int i = 0; i < perSender; i++) {
+          ObjectValue payload("Payload", true);
+          payload.mutate()->Properties[Atom("index")] = Value(int64_t(i));
+          ObjectValue message("Message", true);
+          message.mutate()->Properties[Atom("sender")] = Value(int64_t(t));
+          message.mutate()->Properties[Atom("payload")] = Value(payload);
+          actor.send(Value(message));
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    
+    Value total = actor.await(diag);
+    XWIFT_ASSERT_TRUE(total.get<int64_t>() && *total.get<int64_t>() == senders * perSender);
+  }
+  XWIFT_ASSERT_TRUE(diag.getDiagnostics().empty());
+}
+
+XWIFT_TEST(Parallel, CollectionBuiltinsKeepOrder) {
+  std::string source =
+    "func square(x: Int) -> Int {\n"
+    "    return x * x\n"
+    "}\n"
+    "func isLarge(x: Int) -> Bool {\n"
+    "    return x > 10000\n"
+    "}\n"
+    "func add(a: Int, b: Int) -> Int {\n"
+    "    return a + b\n"
+    "}\n"
+    "func main() -> Int {\n"
+    "    var squares = parallelMap(range(1, 201), \"square\")\n"
+    "    var large = parallelFilter(squares, \"isLarge\")\n"
+    "    print(squares[0])\n"
+    "    print(squares[199])\n"
+    "    print(len(large))\n"
+    "    print(large[1])\n"
+    "    print(parallelReduce(squares, \"add\", 0))\n"
+    "    return 0\n"
+    "}\n";
+  xwift::IsolateResult result = xwift::Isolate("parallel.xw").run(source);
+  
+  XWIFT_ASSERT_TRUE(result.Success);
+  XWIFT_ASSERT_EQ("140000100104042686700", result.Output);
+}
+
+XWIFT_TEST(TaskGroup, FailureCancelsSiblings) {
+  // One worker per child, since the children block until cancelled
+  xwift::Scheduler pool(5);
+  std::atomic<int> started{0};
+  std::atomic<int> stopped{0};
+  bool threw = false;
+  {
+    xwift::TaskGroup<int> group(nullptr, pool);
+    for (int i = 0; i < 4; i++) {
+      group.spawn([&started, &stopped](const xwift::CancellationToken& token) {
+        started++;
+        while (!token.isCancelled()) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        stopped++;
+        return 0;
+      });
+    }
+    group.spawn([&started](const xwift::CancellationToken&) -> int {
+      while (started.load() < 4) {
+        std::this_thread::yield();
+      }
+      throw std::runtime_error("boom");
+    });
+    
+    try {
+      group.awaitAll();
+    } catch (const std::runtime_error& e) {
+      threw = std::string(e.what()) == "boom";
+    }
+  }
+  
+  XWIFT_ASSERT_TRUE(threw);
+  XWIFT_ASSERT_EQ(4, stopped.load());
+}
+
+XWIFT_TEST(TaskGroup, ScriptDeadlineAndFirstWins) {
+  std::string source =
+    "func spin(n: Int) -> Int {\n"
+    "    var i = 0\n"
+    "    while (true) {\n"
+    "        sleepMs(2)\n"
+    "        i = i + 1\n"
+    "    }\n"
+    "    return i\n"
+    "}\n"
+    "func fast() -> Int {\n"
+    "    sleepMs(5)\n"
+    "    cancelGroup()\n"
+    "    return 1\n"
+    "}\n"
+    "func slow() -> Int {\n"
+    "    sleepMs(60000)\n"
+    "    return 2\n"
+    "}\n"
+    "func main() -> Int {\n"
+    "    taskGroup (50) {\n"
+    "        var a = async spin(1)\n"
+    "        var b = async spin(2)\n"
+    "    }\n"
+    "    print(\"deadline\")\n"
+    "    taskGroup {\n"
+    "        var winner = async fast()\n"
+    "        var loser = async slow()\n"
+    "        print(await winner)\n"
+    "        print(await loser)\n"
+    "    }\n"
+    "    return 0\n"
+    "}\n";
+  auto start = std::chrono::steady_clock::now();
+  xwift::IsolateResult result = xwift::Isolate("group.xw").run(source);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  
+  XWIFT_ASSERT_TRUE(result.Success);
+  XWIFT_ASSERT_EQ("deadline1", result.Output);
+  XWIFT_ASSERT_TRUE(seconds < 5.0);
+}
+
+// Moves items from producers to consumers on dedicated threads and returns
+// the sum the consumers saw
+static int64_t channelRun(size_t producers, size_t consumers, int64_t perProducer) {
+  xwift::Channel<int64_t> channel(1024);
+  std::atomic<int64_t> total{0};
+  std::vector<std::thread> threads;
+  for (size_t p = 0; p < producers; p++) {
+    threads.emplace_back([&channel, perProducer]() {
+      for (int64_t i = 1; i <= perProducer; i++) {
+        channel.send(i);
+      }
+    });
+  }
+  for (size_t c = 0; c < consumers; c++) {
+    threads.emplace_back([&channel, &total]() {
+      int64_t sum = 0;
+      while (auto item = channel.receive()) {
+        sum += *item;
+      }
+      total += sum;
+    });
+  }
+  for (size_t p = 0; p < producers; p++) {
+    threads[p].join();
+  }
+  channel.close();
+  for (size_t c = producers; c < threads.size(); c++) {
+    threads[c].join();
+  }
+  return total.load();
+}
+
+XWIFT_TEST(Channel, ProducersAndConsumersDeliverEverything) {
+  const int64_t messages = 40000;
+  struct Shape { size_t Producers; size_t Consumers; };
+  for (Shape shape : {Shape{1, 1}, Shape{4, 1}, Shape{4, 4}}) {
+    int64_t perProducer = messages / static_cast<int64_t>(shape.Producers);
+    int64_t total = channelRun(shape.Producers, shape.Consumers, perProducer);
+    XWIFT_ASSERT_EQ(static_cast<int64_t>(shape.Producers) * perProducer * (perProducer + 1) / 2, total);
+  }
+}
+
+XWIFT_TEST(Channel, ConcurrentSendsStopAtCapacity) {
+  // A capacity of 3 sits in a ring of 4, so only the capacity check keeps
+  // the fourth send out
+  for (int round = 0; round < 200; round++) {
+    xwift::Channel<int> channel(3);
+    std::atomic<int> accepted{0};
+    std::vector<std::thread> senders;
+    for (int t = 0; t < 4; t++) {
+      senders.emplace_back([&channel, &accepted, t]() {
+        int item = t;
+        if (channel.trySend(item) == xwift::ChannelStatus::Ok) {
+          accepted++;
+        }
+      });
+    }
+    for (auto& sender : senders) {
+      sender.join();
+    }
+    XWIFT_ASSERT_EQ(3, accepted.load());
+    XWIFT_ASSERT_EQ(size_t(3), channel.size());
+  }
+}
+
+XWIFT_TEST(Channel, PipelineKeepsOrder) {
+  std::vector<int> input;
+  for (int i = 0; i < 1000; i++) {
+    input.push_back(i);
+  }
+  auto output = xwift::Pipeline<int>(8)
+    .stage([](int x) { return x * 2; })
+    .stage([](int x) { return x + 1; })
+    .run(input);
+  
+  XWIFT_ASSERT_EQ(size_t(1000), output.size());
+  XWIFT_ASSERT_EQ(1, output.front());
+  XWIFT_ASSERT_EQ(1999, output.back());
+}
+
+XWIFT_TEST(Channel, ScriptSelectAndPipeline) {
+  std::string source =
+    "func produce(ch, base: Int, n: Int) -> Int {\n"
+    "    var i = 0\n"
+    "    while (i < n) {\n"
+    "        send(ch, base + i)\n"
+    "        i = i + 1\n"
+    "    }\n"
+    "    close(ch)\n"
+    "    return 0\n"
+    "}\n"
+    "func double(x: Int) -> Int {\n"
+    "    return x * 2\n"
+    "}\n"
+    "func inc(x: Int) -> Int {\n"
+    "    return x + 1\n"
+    "}\n"
+    "func main() -> Int {\n"
+    "    var a = channel(4)\n"
+    "    var b = channel(4)\n"
+    "    var pa = async produce(a, 0, 50)\n"
+    "    var pb = async produce(b, 1000, 50)\n"
+    "    var total = 0\n"
+    "    var count = 0\n"
+    "    var live = true\n"
+    "    while (live) {\n"
+    "        var ready = select([a, b])\n"
+    "        if (ready[0] < 0) {\n"
+    "            live = false\n"
+    "        } else {\n"
+    "            total = total + ready[1]\n"
+    "            count = count + 1\n"
+    "        }\n"
+    "    }\n"
+    "    print(count)\n"
+    "    print(total)\n"
+    "    var out = pipeline(range(0, 10), [\"double\", \"inc\"], 2)\n"
+    "    print(out[0])\n"
+    "    print(out[9])\n"
+    "    return 0\n"
+    "}\n";
+  xwift::IsolateResult result = xwift::Isolate("channel.xw").run(source);
+  
+  XWIFT_ASSERT_TRUE(result.Success);
+  XWIFT_ASSERT_EQ("10052450119", result.Output);
+}
+
+XWIFT_TEST(EventLoop, TimersFireOnceAndNotEarly) {
+  xwift::EventLoop loop;
+  const size_t count = 1000;
+  using Clock = xwift::EventLoop::Clock;
+  std::vector<bool> early;
+  std::atomic<bool> cancelledFired{false};
+  std::promise<void> done;
+  for (size_t i = 0; i < count; i++) {
+    auto delay = std::chrono::milliseconds((i * 7919) % 50);
+    auto due = Clock::now() + delay;
+    loop.addTimer(delay, [&, due]() {
+      early.push_back(Clock::now() < due);
+      if (early.size() == count) {
+        done.set_value();
+      }
+    });
+  }
+  auto cancelled = loop.addTimer(std::chrono::milliseconds(20), [&]() { cancelledFired = true; });
+  loop.cancelTimer(cancelled);
+  done.get_future().wait();
+  // Past the cancelled timer's deadline
+  std::this_thread::sleep_for(std::chrono::milliseconds(40));
+  loop.runSync([]() {});
+  
+  XWIFT_ASSERT_EQ(count, early.size());
+  XWIFT_ASSERT_TRUE(std::find(early.begin(), early.end(), true) == early.end());
+  XWIFT_ASSERT_TRUE(!cancelledFired.load());
+  XWIFT_ASSERT_EQ(size_t(0), loop.pendingCount());
+}
+
+XWIFT_TEST(EventLoop, LastOwnerDropsLoopFromItsOwnCallback) {
+  std::atomic<int> laterRan{0};
+  for (int i = 0; i < 50; i++) {
+    auto loop = std::make_shared<xwift::EventLoop>();
+    std::promise<void> queued;
+    std::promise<void> dropped;
+    loop->addTimer(std::chrono::hours(1), []() {});
+    loop->post([&loop, &queued, &dropped]() {
+      queued.get_future().wait();
+      loop.reset();
+      dropped.set_value();
+    });
+    // Queued behind the callback that drops the loop, so it never runs
+    loop->post([&laterRan]() { laterRan++; });
+    queued.set_value();
+    dropped.get_future().wait();
+  }
+  // The detached loop threads finish on their own state
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  
+  XWIFT_ASSERT_EQ(0, laterRan.load());
+}
+
+XWIFT_TEST(EventLoop, LinesFromPipe) {
+  xwift::EventLoop loop;
+  int fds[2];
+  XWIFT_ASSERT_EQ(0, pipe(fds));
+  auto reader = std::make_shared<xwift::LineReader>(loop, fds[0]);
+  std::vector<std::future<std::optional<std::string>>> lines;
+  for (int i = 0; i < 4; i++) {
+    auto promise = std::make_shared<std::promise<std::optional<std::string>>>();
+    lines.push_back(promise->get_future());
+    reader->readLine([promise](std::optional<std::string> line) { promise->set_value(line); });
+  }
+  // Readers queued before any data arrives are served in order
+  std::string data = "first\nsecond\nlast";
+  XWIFT_ASSERT_EQ(static_cast<ssize_t>(data.size()), write(fds[1], data.data(), data.size()));
+  close(fds[1]);
+  
+  XWIFT_ASSERT_EQ(std::string("first"), lines[0].get().value_or(""));
+  XWIFT_ASSERT_EQ(std::string("second"), lines[1].get().value_or(""));
+  XWIFT_ASSERT_EQ(std::string("last"), lines[2].get().value_or(""));
+  XWIFT_ASSERT_TRUE(!lines[3].get().has_value());
+  loop.runSync([]() {});
+  close(fds[0]);
+}
+
+XWIFT_TEST(EventLoop, ScriptOverlapsThousandsOfOperations) {
+  auto path = std::filesystem::temp_directory_path() / "xwift_event_loop_test.txt";
+  {
+    std::ofstream out(path);
+    out << "contents";
+  }
+  // Each level starts a sleep and only awaits it once every deeper level
+  // has started its own, so all of them are in flight together
+  std::string source =
+    "func fanOut(n: Int) -> Int {\n"
+    "    if (n == 0) {\n"
+    "        return 0\n"
+    "    }\n"
+    "    var pending = sleepAsync(200)\n"
+    "    var rest = fanOut(n - 1)\n"
+    "    var slept = await pending\n"
+    "    return rest + 1\n"
+    "}\n"
+    "func main() -> Int {\n"
+    "    var file = readFileAsync(\"" + path.string() + "\")\n"
+    "    print(fanOut(2000))\n"
+    "    print(await file)\n"
+    "    return 0\n"
+    "}\n";
+  auto start = std::chrono::steady_clock::now();
+  xwift::IsolateResult result = xwift::Isolate("io.xw").run(source);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::filesystem::remove(path);
+  
+  XWIFT_ASSERT_TRUE(result.Success);
+  XWIFT_ASSERT_EQ("2000contents", result.Output);
+  // 2000 sleeps of 200ms back to back would take 400s
+  XWIFT_ASSERT_TRUE(seconds < 5.0);
+}
+
+// Resident set size in bytes and live thread count, read from /proc
+static std::pair<size_t, size_t> processFootprint() {
+  size_t pages = 0;
+  size_t resident = 0;
+  std::ifstream("/proc/self/statm") >> pages >> resident;
+  size_t threads = 0;
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.rfind("Threads:", 0) == 0) {
+      threads = std::stoul(line.substr(8));
+    }
+  }
+  return {resident * static_cast<size_t>(sysconf(_SC_PAGESIZE)), threads};
+}
+
+XWIFT_TEST(Coroutine, ThousandsOfSuspendedTasks) {
+  // Every waiter reports in and then suspends on the gate; the gate is only
+  // closed once all of them have reported, so they are all parked at once
+  std::string source =
+    "func waiter(gate, started) -> Int {\n"
+    "    send(started, 1)\n"
+    "    return await receiveAsync(gate)\n"
+    "}\n"
+    "func batch(gate, ready, n: Int) -> Int {\n"
+    "    var started = channel(n)\n"
+    "    var i = 0\n"
+    "    while (i < n) {\n"
+    "        var task = async waiter(gate, started)\n"
+    "        i = i + 1\n"
+    "    }\n"
+    "    i = 0\n"
+    "    while (i < n) {\n"
+    "        var one = await receiveAsync(started)\n"
+    "        i = i + 1\n"
+    "    }\n"
+    "    send(ready, n)\n"
+    "    return 0\n"
+    "}\n"
+    "func main() -> Int {\n"
+    "    var gate = channel(1)\n"
+    "    var ready = channel(128)\n"
+    "    var i = 0\n"
+    "    while (i < 10) {\n"
+    "        var group = async batch(gate, ready, 500)\n"
+    "        i = i + 1\n"
+    "    }\n"
+    "    var parked = 0\n"
+    "    i = 0\n"
+    "    while (i < 10) {\n"
+    "        parked = parked + receive(ready)\n"
+    "        i = i + 1\n"
+    "    }\n"
+    "    print(parked)\n"
+    "    close(gate)\n"
+    "    return 0\n"
+    "}\n";
+  
+  auto baseline = processFootprint();
+  std::atomic<bool> running{true};
+  std::atomic<size_t> peakThreads{baseline.second};
+  std::thread sampler([&]() {
+    while (running.load()) {
+      peakThreads.store(std::max(peakThreads.load(), processFootprint().second));
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+  });
+  xwift::IsolateResult result = xwift::Isolate("suspend.xw").run(source);
+  running = false;
+  sampler.join();
+  
+  XWIFT_ASSERT_TRUE(result.Success);
+  XWIFT_ASSERT_EQ("5000", result.Output);
+  // A thread per parked task would mean thousands of stacks; the pool grows
+  // by a handful at most
+  XWIFT_ASSERT_TRUE(peakThreads.load() < baseline.second + 64);
+}
+
+XWIFT_TEST(Coroutine, SuspensionGuessesAreNotCached) {
+  // ping's body is being worked out when pong calls it back, so that call
+  // is first guessed never to suspend; pong's await then shows it does
+  std::string source =
+    "func ping(n: Int) -> Int {\n"
+    "    if (n > 0) {\n"
+    "        return pong(n - 1)\n"
+    "    }\n"
+    "    return 0\n"
+    "}\n"
+    "func pong(n: Int) -> Int {\n"
+    "    var back = ping(n)\n"
+    "    var task = async ping(0)\n"
+    "    return back + await task\n"
+    "}\n"
+    "func main() -> Int {\n"
+    "    var task = async ping(3)\n"
+    "    print(await task)\n"
+    "    return 0\n"
+    "}\n";
+  xwift::DiagnosticEngine diag;
+  xwift::Lexer lexer(source);
+  xwift::SyntaxParser parser(lexer);
+  // Sema wants functions declared before use, which mutual recursion
+  // cannot do, so the program goes straight to the interpreter
+  auto program = parser.parseProgram();
+  std::ostringstream output;
+  xwift::Interpreter interpreter(diag);
+  interpreter.setOutput(output);
+  interpreter.run(program.get());
+  XWIFT_ASSERT_EQ("0", output.str());
+  
+  xwift::Stmt* back = nullptr;
+  for (auto& decl : program->getDecls()) {
+    auto* func = dynamic_cast<xwift::FuncDecl*>(decl.get());
+    if (func && func->Name == xwift::Atom("pong")) {
+      back = static_cast<xwift::BlockStmt*>(func->Body.get())->Statements[0].get();
+    }
+  }
+  XWIFT_ASSERT_TRUE(back != nullptr);
+  XWIFT_ASSERT_TRUE(back->Suspends.load() != xwift::Stmt::Suspension::Never);
+}
+
+// Keep-alive HTTP/1.1 server on a loopback port for the HTTP tests. Every
+// request gets 200 with its own path as the body, after a pause of N ms for
+// paths under /delay/N; paths under /length/ also get the length of the
+// request body appended, and paths under /inflate/ the body itself, gunzipped
+// if need be, and paths under /headers/ the request's header lines. Paths
+// under /gzip/ are answered gzipped to clients that accept it. Paths under
+// /private/ are fresh for a minute but private, and those under /vary/ are
+// fresh for a minute, vary on X-Lang and have its value appended, and those
+// under /missing/ get 404 with the path as the body. The first K requests for a path under /flaky/K/ get 503, and the first
+// request for one under /slow-first/N/ waits N ms. accepted() counts the
+// connections clients opened.
+class LocalHTTPServer {
+public:
+  LocalHTTPServer() {
+    ListenFd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(ListenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    listen(ListenFd, 128);
+    socklen_t length = sizeof(addr);
+    getsockname(ListenFd, reinterpret_cast<sockaddr*>(&addr), &length);
+    Port = ntohs(addr.sin_port);
+    Acceptor = std::thread([this]() { acceptLoop(); });
+  }
+  
+  ~LocalHTTPServer() {
+    Stopping = true;
+    shutdown(ListenFd, SHUT_RDWR);
+    Acceptor.join();
+    close(ListenFd);
+    std::lock_guard<std::mutex> lock(Mutex);
+    for (int fd : Clients) {
+      shutdown(fd, SHUT_RDWR);
+    }
+    for (auto& thread : Servers) {
+      thread.join();
+    }
+    for (int fd : Clients) {
+      close(fd);
+    }
+  }
+  
+  // host:port, as HTTPMetrics keys it
+  std::string host() const {
+    return "127.0.0.1:" + std::to_string(Port);
+  }
+  
+  std::string url(const std::string& path = "/") const {
+    return "http://127.0.0.1:" + std::to_string(Port) + path;
+  }
+  
+  size_t accepted() const { return Accepted.load(); }
+  size_t served() const { return Served.load(); }
+  
+private:
+  void acceptLoop() {
+    while (!Stopping) {
+      int fd = accept(ListenFd, nullptr, nullptr);
+      if (fd < 0) {
+        continue;
+      }
+      Accepted++;
+      std::lock_guard<std::mutex> lock(Mutex);
+      Clients.push_back(fd);
+      Servers.emplace_back([this, fd]() { serve(fd); });
+    }
+  }
+  
+  // Answers requests on fd until the client hangs up
+  void serve(int fd) {
+    std::string buffer;
+    char chunk[4096];
+    auto fill = [&]() {
+      ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+      if (n > 0) {
+        buffer.append(chunk, static_cast<size_t>(n));
+      }
+      return n > 0;
+    };
+    while (true) {
+      size_t headerEnd;
+      while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+        if (!fill()) return;
+      }
+      size_t bodyLength = 0;
+      size_t field = buffer.find("Content-Length:");
+      if (field != std::string::npos && field < headerEnd) {
+        bodyLength = std::stoul(buffer.substr(field + 15));
+      }
+      while (buffer.size() < headerEnd + 4 + bodyLength) {
+        if (!fill()) return;
+      }
+      size_t pathStart = buffer.find(' ') + 1;
+      std::string path = buffer.substr(pathStart, buffer.find(' ', pathStart) - pathStart);
+      std::string head = buffer.substr(0, headerEnd);
+      std::string requestBody = buffer.substr(headerEnd + 4, bodyLength);
+      buffer.erase(0, headerEnd + 4 + bodyLength);
+      size_t hits = 0;
+      {
+        std::lock_guard<std::mutex> lock(Mutex);
+        hits = ++Hits[path];
+      }
+      if (path.rfind("/delay/", 0) == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(std::stoi(path.substr(7))));
+      } else if (path.rfind("/slow-first/", 0) == 0 && hits == 1) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(std::stoi(path.substr(12))));
+      }
+      std::string extra;
+      if (path.rfind("/max-age/", 0) == 0) {
+        extra += "Cache-Control: max-age=" + std::to_string(std::stoi(path.substr(9))) + "\r\n";
+      } else if (path.rfind("/no-store/", 0) == 0) {
+        extra += "Cache-Control: no-store\r\n";
+      } else if (path.rfind("/etag/", 0) == 0) {
+        extra += "ETag: \"v1\"\r\n";
+      } else if (path.rfind("/private/", 0) == 0) {
+        extra += "Cache-Control: private, max-age=60\r\n";
+      } else if (path.rfind("/vary/", 0) == 0) {
+        extra += "Cache-Control: max-age=60\r\nVary: X-Lang\r\n";
+      }
+      std::string body = path;
+      if (path.rfind("/vary/", 0) == 0 && head.find("X-Lang: ") != std::string::npos) {
+        size_t value = head.find("X-Lang: ") + 8;
+        body += head.substr(value, head.find("\r\n", value) - value);
+      }
+      if (path.rfind("/length/", 0) == 0) {
+        body += std::to_string(bodyLength);
+      }
+      while (path.find("/pad") != std::string::npos && body.size() < 65536) {
+        body += path;
+      }
+      if (path.rfind("/headers/", 0) == 0) {
+        body += head.substr(head.find("\r\n"));
+      }
+      if (path.rfind("/inflate/", 0) == 0) {
+        bool gzipped = head.find("Content-Encoding: gzip") != std::string::npos;
+        extra += std::string("X-Request-Encoding: ") + (gzipped ? "gzip" : "identity") + "\r\n";
+        body += gzipped ? xwift::http::BodyDecoder::decodeContentEncoding(requestBody, "gzip").value_or("?")
+                        : requestBody;
+      }
+      if (path.rfind("/gzip/", 0) == 0 && head.find("Accept-Encoding: gzip") != std::string::npos) {
+        extra += "Content-Encoding: gzip\r\n";
+        body = xwift::http::BodyEncoder::encodeGzip(body);
+      }
+      std::string reply;
+      if (path.rfind("/etag/", 0) == 0 && head.find("If-None-Match: \"v1\"") != std::string::npos) {
+        reply = "HTTP/1.1 304 Not Modified\r\n" + extra + "Connection: keep-alive\r\n\r\n";
+      } else if (path.rfind("/missing/", 0) == 0) {
+        reply = "HTTP/1.1 404 Not Found\r\nContent-Length: " + std::to_string(body.size()) +
+                "\r\nConnection: keep-alive\r\n\r\n" + body;
+      } else if (path.rfind("/flaky/", 0) == 0 && hits <= std::stoul(path.substr(7))) {
+        reply = "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 0\r\nContent-Length: 0\r\n"
+                "Connection: keep-alive\r\n\r\n";
+      } else {
+        reply = "HTTP/1.1 200 OK\r\n" + extra + "Content-Length: " + std::to_string(body.size()) +
+                "\r\nConnection: keep-alive\r\n\r\n" + body;
+      }
+      Served++;
+      send(fd, reply.data(), reply.size(), MSG_NOSIGNAL);
+    }
+  }
+  
+  int ListenFd = -1;
+  int Port = 0;
+  std::atomic<bool> Stopping{false};
+  std::atomic<size_t> Accepted{0};
+  std::atomic<size_t> Served{0};
+  std::thread Acceptor;
+  std::mutex Mutex;
+  std::map<std::string, size_t> Hits;
+  std::vector<int> Clients;
+  std::vector<std::thread> Servers;
+};
+
+XWIFT_TEST(HTTP, PooledBackendReusesConnections) {
+  const int requests = 200;
+  auto runRequests = [&](xwift::http::CurlHTTPBackend& backend, const LocalHTTPServer& server) {
+    bool allOk = true;
+    for (int i = 0; i < requests; i++) {
+      auto response = backend.get(server.url());
+      allOk = allOk && response.is_ok() && response.unwrap().body == "/";
+    }
+    XWIFT_ASSERT_TRUE(allOk);
+  };
+  
+  // Keeping nothing idle gives every request a fresh handle, as before
+  // pooling
+  LocalHTTPServer freshServer;
+  xwift::http::CurlPoolOptions fresh;
+  fresh.idleTimeout = std::chrono::milliseconds(0);
+  xwift::http::CurlHTTPBackend freshBackend(fresh);
+  runRequests(freshBackend, freshServer);
+  
+  LocalHTTPServer pooledServer;
+  xwift::http::CurlHTTPBackend pooledBackend{xwift::http::CurlPoolOptions()};
+  runRequests(pooledBackend, pooledServer);
+  auto stats = pooledBackend.poolStats();
+  
+  XWIFT_ASSERT_EQ(requests, freshServer.accepted());
+  XWIFT_ASSERT_EQ(1, pooledServer.accepted());
+  XWIFT_ASSERT_EQ(1, stats.handlesCreated);
+  XWIFT_ASSERT_EQ(requests - 1, stats.handlesReused);
+  XWIFT_ASSERT_EQ(1, stats.connectionsOpened);
+  XWIFT_ASSERT_EQ(1, stats.idleHandles);
+}
+
+XWIFT_TEST(HTTP, PoolLimitsHostsAndExpiresIdleHandles) {
+  LocalHTTPServer server;
+  xwift::http::CurlPoolOptions options;
+  options.maxConnectionsPerHost = 2;
+  options.idleTimeout = std::chrono::milliseconds(100);
+  xwift::http::CurlHTTPBackend backend(options);
+  
+  std::atomic<int> succeeded{0};
+  std::vector<std::thread> clients;
+  for (int t = 0; t < 8; t++) {
+    clients.emplace_back([&]() {
+      for (int i = 0; i < 20; i++) {
+        if (backend.get(server.url()).is_ok()) {
+          succeeded++;
+        }
+      }
+    });
+  }
+  for (auto& client : clients) {
+    client.join();
+  }
+  XWIFT_ASSERT_EQ(160, succeeded.load());
+  XWIFT_ASSERT_TRUE(server.accepted() <= 2);
+  XWIFT_ASSERT_TRUE(backend.poolStats().idleHandles <= 2);
+  
+  // Past the idle timeout the pooled handles are closed, not reused
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  size_t before = server.accepted();
+  XWIFT_ASSERT_TRUE(backend.get(server.url()).is_ok());
+  XWIFT_ASSERT_EQ(before + 1, server.accepted());
+}
+
+XWIFT_TEST(HTTP, ClientTimeoutsStayPerClient) {
+  LocalHTTPServer server;
+  // Both clients go through the one backend the process shares
+  xwift::http::HTTPClient hasty;
+  hasty.setTimeout(50);
+  xwift::http::HTTPClient patient;
+  patient.setTimeout(5000);
+  
+  std::atomic<int> hastyFailed{0};
+  std::atomic<int> patientServed{0};
+  std::thread hastyThread([&]() {
+    for (int i = 0; i < 10; i++) {
+      if (hasty.get(server.url("/delay/300/hasty/" + std::to_string(i))).is_error()) {
+        hastyFailed++;
+      }
+    }
+  });
+  std::thread patientThread([&]() {
+    for (int i = 0; i < 5; i++) {
+      auto response = patient.get(server.url("/delay/150/patient/" + std::to_string(i)));
+      if (response.is_ok() && response.unwrap().statusCode == 200) {
+        patientServed++;
+      }
+    }
+  });
+  hastyThread.join();
+  patientThread.join();
+  
+  XWIFT_ASSERT_EQ(10, hastyFailed.load());
+  XWIFT_ASSERT_EQ(5, patientServed.load());
+}
+
+XWIFT_TEST(HTTP, BatchTakesAsLongAsSlowestRequest) {
+  LocalHTTPServer server;
+  std::vector<xwift::http::Request> requests(20);
+  for (size_t i = 0; i < requests.size(); i++) {
+    requests[i].url = server.url("/delay/200/" + std::to_string(i));
+  }
+  // Nothing listens on port 1, so this one fails on its own
+  requests[7].url = "http://127.0.0.1:1/";
+  
+  xwift::http::HTTPClient client;
+  auto start = std::chrono::steady_clock::now();
+  auto results = client.sendAll(requests, 32);
+  double allAtOnce = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  
+  XWIFT_ASSERT_EQ(20, results.size());
+  bool inOrder = true;
+  for (size_t i = 0; i < results.size(); i++) {
+    if (i == 7) {
+      XWIFT_ASSERT_TRUE(results[i].is_error());
+      continue;
+    }
+    inOrder = inOrder && results[i].is_ok() && results[i].unwrap().body == "/delay/200/" + std::to_string(i);
+  }
+  XWIFT_ASSERT_TRUE(inOrder);
+  // One after another they would take 3.8s
+  XWIFT_ASSERT_TRUE(allAtOnce < 1000);
+  
+  // Four at a time takes five rounds
+  requests[7].url = server.url("/delay/200/7");
+  start = std::chrono::steady_clock::now();
+  results = client.sendAll(requests, 4);
+  double capped = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  XWIFT_ASSERT_TRUE(capped >= 1000);
+}
+
+XWIFT_TEST(HTTP, BatchesShareTheBackendsHeadersAndCache) {
+  LocalHTTPServer server;
+  auto backend = std::make_shared<xwift::http::CurlHTTPBackend>();
+  backend->setHeader("X-Batch", "backend");
+  xwift::http::CachingHTTPBackend cache(backend, xwift::http::HTTPCacheOptions());
+  cache.get(server.url("/max-age/60/warm"));
+  
+  std::vector<xwift::http::Request> requests(3);
+  requests[0].url = server.url("/max-age/60/warm");
+  requests[1].url = server.url("/headers/a");
+  requests[2].url = server.url("/headers/b");
+  requests[2].headers["X-Batch"] = "own";
+  for (int round = 0; round < 2; round++) {
+    auto results = cache.sendAll(requests, 8);
+    XWIFT_ASSERT_EQ(3, results.size());
+    XWIFT_ASSERT_TRUE(results[0].is_ok() && results[1].is_ok() && results[2].is_ok());
+    XWIFT_ASSERT_EQ("/max-age/60/warm", results[0].unwrap().body);
+    // The backend's headers go out under the request's own
+    XWIFT_ASSERT_TRUE(results[1].unwrap().body.find("X-Batch: backend") != std::string::npos);
+    XWIFT_ASSERT_TRUE(results[2].unwrap().body.find("X-Batch: own") != std::string::npos);
+    XWIFT_ASSERT_TRUE(results[2].unwrap().body.find("X-Batch: backend") == std::string::npos);
+  }
+  // The cached URL was answered without reaching the server, both rounds,
+  // and what did reach it was counted per host like any other request
+  XWIFT_ASSERT_EQ(5, static_cast<int>(server.served()));
+  XWIFT_ASSERT_EQ(2, static_cast<int>(cache.stats().hits));
+  auto hosts = xwift::http::HTTPMetrics::shared().snapshot();
+  XWIFT_ASSERT_EQ(5, static_cast<int>(hosts[server.host()].requests));
+}
+
+XWIFT_TEST(HTTP, ScriptBatchBuiltins) {
+  LocalHTTPServer server;
+  std::string source =
+    "func main() -> Int {\n"
+    "    var bodies = httpGetAll([\"" + server.url("/a") + "\", \"" + server.url("/b") + "\"])\n"
+    "    print(bodies[0])\n"
+    "    print(bodies[1])\n"
+    "    var results = httpBatch([\"GET\", \"" + server.url("/c") + "\", \"\",\n"
+    "                             \"POST\", \"" + server.url("/d") + "\", \"x=1\",\n"
+    "                             \"GET\", \"http://127.0.0.1:1/\", \"\"], 2)\n"
+    "    var first = results[0]\n"
+    "    var second = results[1]\n"
+    "    var third = results[2]\n"
+    "    print(first[0])\n"
+    "    print(second[1])\n"
+    "    print(third[0])\n"
+    "    var failure = third[2]\n"
+    "    print(failure != \"\")\n"
+    "    return 0\n"
+    "}\n";
+  xwift::IsolateResult result = xwift::Isolate("batch.xw").run(source);
+  
+  XWIFT_ASSERT_TRUE(result.Success);
+  XWIFT_ASSERT_EQ("/a/b200/d0true", result.Output);
+}
+
+XWIFT_TEST(HTTP, ScriptResponseObjects) {
+  LocalHTTPServer server;
+  std::string source =
+    "func main() -> Int {\n"
+    "    var response = httpRequest(\"POST\", \"" + server.url("/echo") + "\", \"x=1\", [\"X-Trace\", \"7\"])\n"
+    "    print(response.status)\n"
+    "    print(response.body)\n"
+    "    print(response.ok)\n"
+    "    print(httpStatusCode(response))\n"
+    "    print(httpIsSuccess(response))\n"
+    "    print(httpGetHeader(response, \"content-length\"))\n"
+    "    var failed = httpRequest(\"GET\", \"http://127.0.0.1:1/\")\n"
+    "    print(failed.status)\n"
+    "    print(failed.error != \"\")\n"
+    "    return 0\n"
+    "}\n";
+  xwift::IsolateResult result = xwift::Isolate("response.xw").run(source);
+  
+  XWIFT_ASSERT_TRUE(result.Success);
+  XWIFT_ASSERT_EQ("200/echotrue200true5-1true", result.Output);
+  // Status, success and header were all read off the one response
+  XWIFT_ASSERT_EQ(1, static_cast<int>(server.served()));
+}
+
+XWIFT_TEST(HTTP, CacheServesFreshAndRevalidatesStale) {
+  LocalHTTPServer server;
+  std::filesystem::path directory = std::filesystem::temp_directory_path() /
+    ("xwift-http-cache-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+  xwift::http::HTTPCacheOptions options;
+  options.diskDirectory = directory.string();
+  auto backend = std::make_shared<xwift::http::CurlHTTPBackend>();
+  xwift::http::CachingHTTPBackend cache(backend, options);
+  
+  // Fresh for a minute, so the second read never reaches the server
+  std::string fresh = server.url("/max-age/60/pad");
+  auto first = cache.get(fresh);
+  auto second = cache.get(fresh);
+  XWIFT_ASSERT_TRUE(first.is_ok() && second.is_ok());
+  XWIFT_ASSERT_TRUE(first.unwrap().body.size() >= 65536 && second.unwrap().body == first.unwrap().body);
+  XWIFT_ASSERT_EQ(1, static_cast<int>(server.served()));
+  // The 64KB body is kept deflated
+  XWIFT_ASSERT_TRUE(cache.stats().bytes < 8192);
+  
+  // Stale but validated: the server answers 304 and the stored body is
+  // handed out again
+  std::string validated = server.url("/etag/a");
+  cache.get(validated);
+  auto revalidated = cache.get(validated);
+  XWIFT_ASSERT_TRUE(revalidated.is_ok());
+  XWIFT_ASSERT_EQ(200, revalidated.unwrap().statusCode);
+  XWIFT_ASSERT_EQ("/etag/a", revalidated.unwrap().body);
+  XWIFT_ASSERT_EQ(3, static_cast<int>(server.served()));
+  
+  cache.get(server.url("/no-store/b"));
+  cache.get(server.url("/no-store/b"));
+  XWIFT_ASSERT_EQ(5, static_cast<int>(server.served()));
+  
+  // A POST to the URL makes the cached copy suspect
+  cache.post(fresh, "x=1");
+  cache.get(fresh);
+  XWIFT_ASSERT_EQ(7, static_cast<int>(server.served()));
+  
+  xwift::http::HTTPCacheStats stats = cache.stats();
+  XWIFT_ASSERT_EQ(1, static_cast<int>(stats.hits));
+  XWIFT_ASSERT_EQ(1, static_cast<int>(stats.revalidations));
+  XWIFT_ASSERT_EQ(5, static_cast<int>(stats.misses));
+  XWIFT_ASSERT_EQ(2, static_cast<int>(stats.entries));
+  
+  // A cache on the same directory starts out warm
+  xwift::http::CachingHTTPBackend restarted(backend, options);
+  auto fromDisk = restarted.get(fresh);
+  XWIFT_ASSERT_TRUE(fromDisk.is_ok() && fromDisk.unwrap().body == first.unwrap().body);
+  XWIFT_ASSERT_EQ(7, static_cast<int>(server.served()));
+  XWIFT_ASSERT_EQ(1, static_cast<int>(restarted.stats().hits));
+  
+  cache.clear();
+  std::filesystem::remove_all(directory);
+}
+
+XWIFT_TEST(HTTP, CacheKeepsNothingMeantForOneClient) {
+  LocalHTTPServer server;
+  auto backend = std::make_shared<xwift::http::CurlHTTPBackend>();
+  xwift::http::CachingHTTPBackend cache(backend, xwift::http::HTTPCacheOptions());
+  auto fetch = [&](const std::string& path, const std::map<std::string, std::string>& headers) {
+    xwift::http::Request request;
+    request.url = server.url(path);
+    request.headers = headers;
+    auto result = cache.send(request);
+    return result.is_ok() ? result.unwrap().body : std::string("failed");
+  };
+  
+  // Fresh for a minute, but only for the client holding the credentials
+  XWIFT_ASSERT_EQ("/max-age/60/alice", fetch("/max-age/60/alice", {{"Authorization", "Bearer alice"}}));
+  XWIFT_ASSERT_EQ("/max-age/60/alice", fetch("/max-age/60/alice", {{"Authorization", "Bearer bob"}}));
+  fetch("/max-age/60/session", {{"Cookie", "id=1"}});
+  fetch("/max-age/60/session", {{"Cookie", "id=1"}});
+  XWIFT_ASSERT_EQ(4, static_cast<int>(server.served()));
+  XWIFT_ASSERT_EQ(0, static_cast<int>(cache.stats().entries));
+  
+  fetch("/private/a", {});
+  fetch("/private/a", {});
+  XWIFT_ASSERT_EQ(6, static_cast<int>(server.served()));
+  
+  // Each language is its own variant; the one kept is the last fetched
+  XWIFT_ASSERT_EQ("/vary/aen", fetch("/vary/a", {{"X-Lang", "en"}}));
+  XWIFT_ASSERT_EQ("/vary/aen", fetch("/vary/a", {{"x-lang", "en"}}));
+  XWIFT_ASSERT_EQ("/vary/afr", fetch("/vary/a", {{"X-Lang", "fr"}}));
+  XWIFT_ASSERT_EQ("/vary/afr", fetch("/vary/a", {{"X-Lang", "fr"}}));
+  XWIFT_ASSERT_EQ("/vary/a", fetch("/vary/a", {}));
+  XWIFT_ASSERT_EQ(9, static_cast<int>(server.served()));
+  XWIFT_ASSERT_EQ(2, static_cast<int>(cache.stats().hits));
+  
+  // Credentials set on the backend go out with every request
+  fetch("/max-age/60/shared", {});
+  cache.setHeader("Cookie", "id=2");
+  fetch("/max-age/60/shared", {});
+  XWIFT_ASSERT_EQ(11, static_cast<int>(server.served()));
+}
+
+XWIFT_TEST(HTTP, ScriptCacheStats) {
+  LocalHTTPServer server;
+  std::string source =
+    "func main() -> Int {\n"
+    "    var before = httpCacheStats()\n"
+    "    var first = httpGet(\"" + server.url("/max-age/60/script") + "\")\n"
+    "    var second = httpGet(\"" + server.url("/max-age/60/script") + "\")\n"
+    "    var after = httpCacheStats()\n"
+    "    print(second)\n"
+    "    print(after.hits - before.hits)\n"
+    "    print(after.misses - before.misses)\n"
+    "    return 0\n"
+    "}\n";
+  xwift::IsolateResult result = xwift::Isolate("cache.xw").run(source);
+  
+  XWIFT_ASSERT_TRUE(result.Success);
+  XWIFT_ASSERT_EQ("/max-age/60/script11", result.Output);
+  XWIFT_ASSERT_EQ(1, static_cast<int>(server.served()));
+}
+
+XWIFT_TEST(HTTP, StreamsBodiesThroughFiles) {
+  LocalHTTPServer server;
+  std::filesystem::path directory = std::filesystem::temp_directory_path() /
+    ("xwift-http-stream-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+  std::filesystem::create_directories(directory);
+  std::string saved = (directory / "download.bin").string();
+  
+  // The body goes to the file as it arrives and never into the response
+  xwift::http::HTTPClient client;
+  size_t progressCalls = 0;
+  auto downloaded = client.download(server.url("/stream/pad"), saved,
+                                    [&](const xwift::http::TransferProgress&) { progressCalls++; });
+  XWIFT_ASSERT_TRUE(downloaded.is_ok());
+  XWIFT_ASSERT_TRUE(downloaded.unwrap().body.empty());
+  XWIFT_ASSERT_EQ(200, downloaded.unwrap().statusCode);
+  uint64_t size = std::filesystem::file_size(saved);
+  XWIFT_ASSERT_TRUE(size >= 65536);
+  XWIFT_ASSERT_EQ(size, downloaded.unwrap().streamedBytes);
+  XWIFT_ASSERT_TRUE(progressCalls > 0);
+  XWIFT_ASSERT_FALSE(std::filesystem::exists(saved + ".part"));
+  
+  // An error page is handed back and never replaces what was downloaded
+  auto missing = client.download(server.url("/missing/pad"), saved);
+  XWIFT_ASSERT_TRUE(missing.is_ok());
+  XWIFT_ASSERT_EQ(404, missing.unwrap().statusCode);
+  XWIFT_ASSERT_EQ(size, std::filesystem::file_size(saved));
+  XWIFT_ASSERT_FALSE(std::filesystem::exists(saved + ".part"));
+  
+  // The file is read as it is sent, by the blocking and the async backend
+  auto uploaded = client.upload("PUT", server.url("/length/"), saved);
+  XWIFT_ASSERT_TRUE(uploaded.is_ok());
+  XWIFT_ASSERT_EQ("/length/" + std::to_string(size), uploaded.unwrap().body);
+  xwift::http::Request posted;
+  posted.method = "POST";
+  posted.url = server.url("/length/");
+  posted.uploadFile = saved;
+  auto batch = client.sendAll({posted});
+  XWIFT_ASSERT_TRUE(batch[0].is_ok());
+  XWIFT_ASSERT_EQ("/length/" + std::to_string(size), batch[0].unwrap().body);
+  
+  // A chunk callback returning false stops the transfer
+  xwift::http::Request aborted;
+  aborted.url = server.url("/abort/pad");
+  aborted.onBodyChunk = [](const char*, size_t) { return false; };
+  XWIFT_ASSERT_TRUE(client.send(aborted).is_error());
+  XWIFT_ASSERT_TRUE(client.upload("PUT", server.url("/"), (directory / "missing").string()).is_error());
+  
+  std::string source =
+    "func main() -> Int {\n"
+    "    var response = httpDownload(\"" + server.url("/script/pad") + "\", \"" + saved + "\")\n"
+    "    print(response.status)\n"
+    "    print(response.body)\n"
+    "    print(response.bytes > 65535)\n"
+    "    var sent = httpUpload(\"POST\", \"" + server.url("/length/") + "\", \"" + saved + "\")\n"
+    "    print(sent.body == \"/length/\" + toString(response.bytes))\n"
+    "    return 0\n"
+    "}\n";
+  xwift::IsolateResult result = xwift::Isolate("stream.xw").run(source);
+  
+  XWIFT_ASSERT_TRUE(result.Success);
+  XWIFT_ASSERT_EQ("200truetrue", result.Output);
+  
+  std::filesystem::remove_all(directory);
+}
+
+XWIFT_TEST(HTTP, NegotiatesCompressedBodies) {
+  LocalHTTPServer server;
+  std::string plain = "/gzip/pad";
+  while (plain.size() < 65536) {
+    plain += "/gzip/pad";
+  }
+  std::string packed = xwift::http::BodyEncoder::encodeGzip(plain);
+  XWIFT_ASSERT_TRUE(packed.size() * 10 < plain.size());
+  XWIFT_ASSERT_EQ(plain, xwift::http::BodyDecoder::decodeContentEncoding(packed, "gzip").value_or(""));
+  XWIFT_ASSERT_FALSE(xwift::http::BodyDecoder::decodeContentEncoding(plain, "gzip").has_value());
+  
+  // Both curl paths ask for gzip and hand back the body inflated
+  xwift::http::CurlHTTPBackend backend;
+  auto blocking = backend.get(server.url("/gzip/pad"));
+  XWIFT_ASSERT_TRUE(blocking.is_ok());
+  XWIFT_ASSERT_EQ("gzip", blocking.unwrap().getHeader("Content-Encoding"));
+  XWIFT_ASSERT_EQ(plain, blocking.unwrap().body);
+  xwift::http::HTTPClient client;
+  auto batch = client.getAll({server.url("/gzip/pad")});
+  XWIFT_ASSERT_TRUE(batch[0].is_ok());
+  XWIFT_ASSERT_EQ(plain, batch[0].unwrap().body);
+  
+  // Request bodies are gzipped from the threshold up
+  client.setCompressRequestsAbove(1024);
+  std::string small = "{\"id\":1}";
+  std::string large = "[" + std::string(4096, '1') + "]";
+  auto sentSmall = client.postJSON(server.url("/inflate/"), small);
+  auto sentLarge = client.postJSON(server.url("/inflate/"), large);
+  XWIFT_ASSERT_TRUE(sentSmall.is_ok() && sentLarge.is_ok());
+  XWIFT_ASSERT_EQ("identity", sentSmall.unwrap().getHeader("X-Request-Encoding"));
+  XWIFT_ASSERT_EQ("/inflate/" + small, sentSmall.unwrap().body);
+  XWIFT_ASSERT_EQ("gzip", sentLarge.unwrap().getHeader("X-Request-Encoding"));
+  XWIFT_ASSERT_EQ("/inflate/" + large, sentLarge.unwrap().body);
+}
+
+XWIFT_TEST(HTTP, RetriesAndHedgesSlowRequests) {
+  LocalHTTPServer server;
+  xwift::http::HTTPClient client;
+  xwift::http::RetryPolicy retry;
+  retry.maxAttempts = 3;
+  retry.baseDelayMs = 5;
+  client.setRetryPolicy(retry);
+  
+  // Two 503s, then the third attempt gets through
+  auto recovered = client.get(server.url("/flaky/2/a"));
+  XWIFT_ASSERT_TRUE(recovered.is_ok());
+  XWIFT_ASSERT_EQ(200, recovered.unwrap().statusCode);
+  XWIFT_ASSERT_EQ(2, static_cast<int>(client.metrics().retries));
+  // POST is not idempotent, so it is never sent twice
+  auto posted = client.post(server.url("/flaky/1/b"), "x=1");
+  XWIFT_ASSERT_TRUE(posted.is_ok());
+  XWIFT_ASSERT_EQ(503, posted.unwrap().statusCode);
+  XWIFT_ASSERT_EQ(2, static_cast<int>(client.metrics().retries));
+  
+  // An empty budget stops retries however many attempts are allowed
+  retry.maxAttempts = 10;
+  retry.budgetRatio = 0;
+  retry.budgetReserve = 2;
+  client.setRetryPolicy(retry);
+  auto exhausted = client.get(server.url("/flaky/9/c"));
+  XWIFT_ASSERT_TRUE(exhausted.is_ok());
+  XWIFT_ASSERT_EQ(503, exhausted.unwrap().statusCode);
+  xwift::http::HTTPClientMetrics metrics = client.metrics();
+  XWIFT_ASSERT_EQ(4, static_cast<int>(metrics.retries));
+  XWIFT_ASSERT_EQ(1, static_cast<int>(metrics.retriesDenied));
+  XWIFT_ASSERT_EQ(3, static_cast<int>(metrics.requests));
+  
+  // Once fast requests set the percentile, a slow one is hedged long
+  // before it would have answered
+  xwift::http::HTTPClient hedging;
+  xwift::http::HedgePolicy hedge;
+  hedge.enabled = true;
+  hedge.initialDelayMs = 1000;
+  hedge.minDelayMs = 5;
+  hedge.minSamples = 5;
+  hedging.setHedgePolicy(hedge);
+  for (int i = 0; i < 5; i++) {
+    XWIFT_ASSERT_TRUE(hedging.get(server.url("/warm/" + std::to_string(i))).is_ok());
+  }
+  int hedgeDelay = hedging.metrics().hedgeDelayMs;
+  XWIFT_ASSERT_TRUE(hedgeDelay < 200);
+  auto started = std::chrono::steady_clock::now();
+  auto raced = hedging.get(server.url("/slow-first/800/d"));
+  double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+  XWIFT_ASSERT_TRUE(raced.is_ok());
+  XWIFT_ASSERT_EQ("/slow-first/800/d", raced.unwrap().body);
+  XWIFT_ASSERT_TRUE(elapsed < 500);
+  XWIFT_ASSERT_TRUE(hedging.metrics().hedges >= 1);
+  XWIFT_ASSERT_TRUE(hedging.metrics().hedgeWins >= 1);
+}
+
+XWIFT_TEST(HTTP, CancelsOneAsyncRequest) {
+  LocalHTTPServer server;
+  xwift::EventLoop loop;
+  xwift::http::AsyncHTTPClient client(loop);
+  std::promise<xwift::Result<xwift::http::Response>> slowDone;
+  std::promise<xwift::Result<xwift::http::Response>> fastDone;
+  auto started = std::chrono::steady_clock::now();
+  auto slow = client.request("GET", server.url("/delay/2000/slow"), "", 0,
+                             [&](xwift::Result<xwift::http::Response> result) {
+                               slowDone.set_value(std::move(result));
+                             });
+  auto fast = client.request("GET", server.url("/delay/50/fast"), "", 0,
+                             [&](xwift::Result<xwift::http::Response> result) {
+                               fastDone.set_value(std::move(result));
+                             });
+  XWIFT_ASSERT_TRUE(slow != fast);
+  client.cancel(slow);
+  auto cancelled = slowDone.get_future().get();
+  auto answered = fastDone.get_future().get();
+  double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+  
+  XWIFT_ASSERT_TRUE(cancelled.is_error());
+  XWIFT_ASSERT_TRUE(answered.is_ok());
+  XWIFT_ASSERT_EQ("/delay/50/fast", answered.unwrap().body);
+  XWIFT_ASSERT_TRUE(elapsed < 1000);
+  // Cancelling what has already completed does nothing
+  client.cancel(fast);
+  loop.runSync([] {});
+  XWIFT_ASSERT_EQ(0, static_cast<int>(client.inFlight()));
+}
+
+XWIFT_TEST(HTTP, RecordsTimingsPerHost) {
+  xwift::http::LatencyHistogram histogram;
+  for (int ms = 1; ms <= 100; ms++) {
+    histogram.record(ms);
+  }
+  XWIFT_ASSERT_EQ(100, static_cast<int>(histogram.count()));
+  XWIFT_ASSERT_EQ(50, static_cast<int>(histogram.percentileMs(0.5)));
+  XWIFT_ASSERT_EQ(99, static_cast<int>(histogram.percentileMs(0.99)));
+  XWIFT_ASSERT_EQ(100, static_cast<int>(histogram.maxMs()));
+  
+  LocalHTTPServer server;
+  xwift::http::CurlHTTPBackend backend;
+  auto first = backend.get(server.url("/timed"));
+  auto second = backend.get(server.url("/timed"));
+  auto posted = backend.post(server.url("/timed"), std::string(1000, 'x'));
+  auto compressed = backend.get(server.url("/gzip/pad"));
+  XWIFT_ASSERT_TRUE(first.is_ok() && second.is_ok() && posted.is_ok() && compressed.is_ok());
+  
+  // Only the first request paid for a connection; every one waited on the
+  // server and none of the phases outlasts the whole
+  const xwift::http::Response& opened = first.unwrap();
+  XWIFT_ASSERT_TRUE(opened.timing.connectMs > 0);
+  XWIFT_ASSERT_TRUE(second.unwrap().timing.connectMs == 0);
+  XWIFT_ASSERT_TRUE(opened.timing.firstByteMs > 0);
+  XWIFT_ASSERT_TRUE(opened.timing.nameLookupMs + opened.timing.connectMs + opened.timing.firstByteMs <=
+                    opened.totalTimeMs);
+  XWIFT_ASSERT_TRUE(posted.unwrap().bytesSent > 1000 && posted.unwrap().bytesSent < 1500);
+  XWIFT_ASSERT_TRUE(opened.bytesReceived > opened.body.size());
+  // Counted as it came off the wire, before inflating
+  XWIFT_ASSERT_TRUE(compressed.unwrap().bytesReceived < compressed.unwrap().body.size() / 4);
+  
+  auto hosts = xwift::http::HTTPMetrics::shared().snapshot();
+  XWIFT_ASSERT_TRUE(hosts.count(server.host()) == 1);
+  const xwift::http::HostMetrics& metrics = hosts[server.host()];
+  XWIFT_ASSERT_EQ(4, static_cast<int>(metrics.requests));
+  XWIFT_ASSERT_EQ(1, static_cast<int>(metrics.newConnections));
+  XWIFT_ASSERT_EQ(4, static_cast<int>(metrics.total.count()));
+  XWIFT_ASSERT_EQ(1, static_cast<int>(metrics.connect.count()));
+  XWIFT_ASSERT_TRUE(metrics.bytesSent > 1000);
+  
+  std::string source =
+    "func main() -> Int {\n"
+    "    var response = httpRequest(\"GET\", \"" + server.url("/script") + "\")\n"
+    "    print(response.bytesReceived > 0)\n"
+    "    print(response.firstByteMs != 0.0)\n"
+    "    var hosts = httpHostStats()\n"
+    "    var i = 0\n"
+    "    while (i < len(hosts)) {\n"
+    "        var stats = hosts[i]\n"
+    "        if (stats.host == \"" + server.host() + "\") {\n"
+    "            print(stats.requests)\n"
+    "            print(stats.p95Ms != 0.0)\n"
+    "        }\n"
+    "        i = i + 1\n"
+    "    }\n"
+    "    return 0\n"
+    "}\n";
+  xwift::IsolateResult result = xwift::Isolate("timing.xw").run(source);
+  
+  XWIFT_ASSERT_TRUE(result.Success);
+  XWIFT_ASSERT_EQ("truetrue5true", result.Output);
+}
+
+XWIFT_TEST(HTTP, FoldsLeastRecentHostsTogether) {
+  xwift::http::HTTPMetrics metrics(2);
+  xwift::http::Response response;
+  response.totalTimeMs = 4;
+  metrics.record("http://a.test/", response);
+  metrics.record("http://b.test/", response);
+  metrics.record("http://a.test/x", response);
+  // b.test was used least recently, so c.test takes its place, and a.test
+  // kept in use stays while c.test makes way for d.test
+  metrics.recordFailure("http://c.test/");
+  metrics.record("http://a.test/y", response);
+  response.totalTimeMs = 40;
+  metrics.record("http://d.test/", response);
+  
+  auto hosts = metrics.snapshot();
+  XWIFT_ASSERT_EQ(3, hosts.size());
+  XWIFT_ASSERT_EQ(3, static_cast<int>(hosts["a.test"].requests));
+  XWIFT_ASSERT_EQ(1, static_cast<int>(hosts["d.test"].requests));
+  const xwift::http::HostMetrics& others = hosts[xwift::http::HTTPMetrics::OtherHosts];
+  XWIFT_ASSERT_EQ(1, static_cast<int>(others.requests));
+  XWIFT_ASSERT_EQ(1, static_cast<int>(others.failures));
+  XWIFT_ASSERT_EQ(4, static_cast<int>(others.total.maxMs()));
+  
+  metrics.reset();
+  XWIFT_ASSERT_TRUE(metrics.snapshot().empty());
+}
+
+XWIFT_TEST(HTTP, ParsesURLsInPlaceAndPercentCodesInBlocks) {
+  using xwift::http::URLParser;
+  std::string text = "https://example.com:8443/a/b?x=1&y=%20z&&flag#frag";
+  xwift::http::URLView url = URLParser::parseView(text);
+  XWIFT_ASSERT_TRUE(url.isValid());
+  XWIFT_ASSERT_EQ("https", std::string(url.Scheme));
+  XWIFT_ASSERT_EQ("example.com", std::string(url.Host));
+  XWIFT_ASSERT_EQ(8443, url.Port);
+  XWIFT_ASSERT_EQ("/a/b", std::string(url.Path));
+  XWIFT_ASSERT_EQ("frag", std::string(url.Fragment));
+  // Views into text rather than copies
+  XWIFT_ASSERT_EQ(8, static_cast<int>(xwift::http::URLView::offsetOf(url.Host, text)));
+  XWIFT_ASSERT_TRUE(url.Query.data() == text.data() + text.find('?') + 1);
+  std::vector<std::pair<std::string, std::string>> params;
+  for (const auto& param : url.queryParams()) {
+    params.emplace_back(param.Key, param.Value);
+  }
+  XWIFT_ASSERT_EQ(3, static_cast<int>(params.size()));
+  XWIFT_ASSERT_EQ("%20z", params[1].second);
+  XWIFT_ASSERT_EQ("flag", params[2].first);
+  XWIFT_ASSERT_EQ(443, URLParser::parseView("https://example.com").Port);
+  XWIFT_ASSERT_EQ(" z", URLParser::parse(text).QueryParams["y"]);
+  XWIFT_ASSERT_EQ("https://example.com:8443/a/b?x=1&y=%20z&&flag#frag", URLParser::parse(text).toString());
+  for (const char* bad : {"example.com/x", "http://:80/", "http://h:abc/", "http://h:99999/", "ht:tp://h/"}) {
+    XWIFT_ASSERT_FALSE(URLParser::parseView(bad).isValid());
+  }
+  
+  // Every length up to a few vectors, so runs start and end at each offset
+  // within a block, against a byte-at-a-time reference
+  auto reference = [](const std::string& raw) {
+    static const char hex[] = "0123456789ABCDEF";
+    std::string out;
+    for (unsigned char c : raw) {
+      if (std::isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~') {
+        out += static_cast<char>(c);
+      } else {
+        out += '%';
+        out += hex[c >> 4];
+        out += hex[c & 15];
+      }
+    }
+    return out;
+  };
+  const std::string alphabet = "abcXYZ019-._~ /?&=+%\x7f\x80\xff";
+  for (size_t length = 0; length < 100; length++) {
+    for (size_t seed = 0; seed < 4; seed++) {
+      std::string raw;
+      for (size_t i = 0; i < length; i++) {
+        // Mostly unreserved, with the odd byte that needs escaping
+        raw += (i * 7 + seed * 13) % 11 == 0 ? alphabet[13 + (i + seed) % 10] : alphabet[(i + seed) % 13];
+      }
+      std::string encoded = xwift::http::percentEncode(raw);
+      XWIFT_ASSERT_EQ(reference(raw), encoded);
+      XWIFT_ASSERT_EQ(raw, xwift::http::percentDecode(encoded));
+    }
+  }
+  XWIFT_ASSERT_EQ("a b+c", xwift::http::percentDecode("a+b%2Bc", true));
+  XWIFT_ASSERT_EQ("a+b", xwift::http::percentDecode("a+b"));
+  XWIFT_ASSERT_EQ("100% %zz %4", xwift::http::percentDecode("100% %zz %4"));
+  
+  std::string path;
+  for (int i = 0; i < 128; i++) {
+    path += i % 16 == 0 ? "/caf\xc3\xa9 " : "segment-";
+  }
+  XWIFT_ASSERT_EQ(path, xwift::http::percentDecode(xwift::http::percentEncode(path)));
+}
+
+XWIFT_TEST(HTTP, ServerRoutesThroughRadixTree) {
+  using xwift::http::Router;
+  Router router;
+  std::string hit;
+  auto route = [&](const std::string& method, const std::string& pattern) {
+    return router.add(method, pattern, [&hit, pattern](const xwift::http::ServerRequest&,
+                                                       xwift::http::ServerResponse&) { hit = pattern; });
+  };
+  XWIFT_ASSERT_TRUE(route("GET", "/users/:id").is_ok());
+  XWIFT_ASSERT_TRUE(route("GET", "/users/me").is_ok());
+  XWIFT_ASSERT_TRUE(route("GET", "/users/:id/posts/:post").is_ok());
+  XWIFT_ASSERT_TRUE(route("GET", "/static/*file").is_ok());
+  XWIFT_ASSERT_TRUE(route("POST", "/users").is_ok());
+  XWIFT_ASSERT_TRUE(route("*", "/v1/items:batch").is_ok());
+  XWIFT_ASSERT_TRUE(route("GET", "/users/:name").is_error());
+  XWIFT_ASSERT_TRUE(route("GET", "/users/me").is_error());
+  XWIFT_ASSERT_TRUE(route("GET", "/files/*path/more").is_error());
+  XWIFT_ASSERT_TRUE(route("GET", "relative").is_error());
+  
+  std::vector<std::pair<std::string, std::string>> params;
+  const xwift::http::ServerHandler* handler = nullptr;
+  auto find = [&](const char* method, const char* path) {
+    hit.clear();
+    auto match = router.match(method, path, params, handler);
+    if (match == Router::Match::Found) {
+      xwift::http::ServerResponse response;
+      (*handler)(xwift::http::ServerRequest(), response);
+    }
+    return match;
+  };
+  
+  // Static text beats a parameter whichever was added first
+  XWIFT_ASSERT_TRUE(find("GET", "/users/me") == Router::Match::Found);
+  XWIFT_ASSERT_EQ("/users/me", hit);
+  XWIFT_ASSERT_TRUE(params.empty());
+  XWIFT_ASSERT_TRUE(find("GET", "/users/42") == Router::Match::Found);
+  XWIFT_ASSERT_EQ("/users/:id", hit);
+  XWIFT_ASSERT_EQ("42", params[0].second);
+  // "me" is only static for the route that ends there
+  XWIFT_ASSERT_TRUE(find("GET", "/users/me/posts/7") == Router::Match::Found);
+  XWIFT_ASSERT_EQ("/users/:id/posts/:post", hit);
+  XWIFT_ASSERT_EQ("me", params[0].second);
+  XWIFT_ASSERT_EQ("post", params[1].first);
+  XWIFT_ASSERT_TRUE(find("HEAD", "/static/css/site.css") == Router::Match::Found);
+  XWIFT_ASSERT_EQ("css/site.css", params[0].second);
+  XWIFT_ASSERT_TRUE(find("DELETE", "/v1/items:batch") == Router::Match::Found);
+  XWIFT_ASSERT_TRUE(find("GET", "/users/") == Router::Match::NoRoute);
+  XWIFT_ASSERT_TRUE(find("GET", "/nowhere") == Router::Match::NoRoute);
+  std::string allowed;
+  XWIFT_ASSERT_TRUE(router.match("GET", "/users", params, handler, &allowed) == Router::Match::WrongMethod);
+  XWIFT_ASSERT_EQ("POST", allowed);
+}
+
+// Sends raw bytes to 127.0.0.1:port and returns everything the server
+// writes back until it closes the connection
+static std::string exchangeRaw(int port, const std::string& request) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  std::string reply;
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+    send(fd, request.data(), request.size(), 0);
+    char buffer[4096];
+    ssize_t count;
+    while ((count = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+      reply.append(buffer, count);
+    }
+  }
+  close(fd);
+  return reply;
+}
+
+XWIFT_TEST(HTTP, ServerKeepsAliveAndPipelines) {
+  xwift::http::ServerOptions options;
+  options.threads = 2;
+  xwift::http::HTTPServer server(options);
+  server.route("GET", "/hello/:name", [](const xwift::http::ServerRequest& request,
+                                         xwift::http::ServerResponse& response) {
+    response.body = "hi " + std::string(request.param("name"));
+  });
+  server.route("POST", "/echo", [](const xwift::http::ServerRequest& request,
+                                   xwift::http::ServerResponse& response) {
+    response.status = 201;
+    response.headers.emplace_back("X-Length", std::to_string(request.body.size()));
+    response.body = request.body;
+  });
+  server.route("GET", "/fail", [](const xwift::http::ServerRequest&, xwift::http::ServerResponse&) {
+    throw std::runtime_error("handler bug");
+  });
+  auto port = server.start();
+  XWIFT_ASSERT_TRUE(port.is_ok());
+  XWIFT_ASSERT_TRUE(port.unwrap() > 0);
+  
+  // Four requests in one write come back in order on the one connection,
+  // and the server closes it after the one that asks
+  std::string reply = exchangeRaw(port.unwrap(),
+    "GET /hello/ann HTTP/1.1\r\nHost: x\r\n\r\n"
+    "POST /echo HTTP/1.1\r\nHost: x\r\nContent-Length: 5\r\n\r\nabcde"
+    "HEAD /hello/bob HTTP/1.1\r\nHost: x\r\n\r\n"
+    "DELETE /echo HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n"
+    "GET /hello/never HTTP/1.1\r\nHost: x\r\n\r\n");
+  size_t first = reply.find("HTTP/1.1 200 OK");
+  size_t second = reply.find("HTTP/1.1 201 Created");
+  size_t third = reply.find("HTTP/1.1 200 OK", second);
+  size_t fourth = reply.find("HTTP/1.1 405 Method Not Allowed");
+  XWIFT_ASSERT_TRUE(first == 0 && first < second && second < third && third < fourth);
+  XWIFT_ASSERT_TRUE(reply.find("hi ann") < second);
+  XWIFT_ASSERT_TRUE(reply.find("X-Length: 5\r\n\r\nabcde") != std::string::npos);
+  // HEAD gets the length of the body it does not get
+  XWIFT_ASSERT_TRUE(reply.find("Content-Length: 6\r\n") != std::string::npos);
+  XWIFT_ASSERT_TRUE(reply.find("hi bob") == std::string::npos);
+  XWIFT_ASSERT_TRUE(reply.find("Allow: POST") > fourth);
+  XWIFT_ASSERT_TRUE(reply.find("never") == std::string::npos);
+  
+  XWIFT_ASSERT_TRUE(exchangeRaw(port.unwrap(), "GET /fail HTTP/1.0\r\n\r\n").find("HTTP/1.0 500") == 0);
+  XWIFT_ASSERT_TRUE(exchangeRaw(port.unwrap(), "GET /x HTTP/1.0\r\n\r\n").find("HTTP/1.0 404") == 0);
+  XWIFT_ASSERT_TRUE(exchangeRaw(port.unwrap(), "NONSENSE\r\n\r\n").find("HTTP/1.1 400") == 0);
+  XWIFT_ASSERT_TRUE(exchangeRaw(port.unwrap(), "POST /echo HTTP/1.1\r\nContent-Length: 99999999999\r\n\r\n")
+                      .find("HTTP/1.1 413") == 0);
+  
+  // curl asks for 100-continue before large bodies and keeps the
+  // connection for the next request
+  xwift::http::CurlHTTPBackend backend;
+  std::string url = "http://127.0.0.1:" + std::to_string(port.unwrap());
+  auto posted = backend.post(url + "/echo", std::string(200000, 'x'));
+  auto fetched = backend.get(url + "/hello/curl");
+  XWIFT_ASSERT_TRUE(posted.is_ok() && fetched.is_ok());
+  XWIFT_ASSERT_EQ(201, posted.unwrap().statusCode);
+  XWIFT_ASSERT_EQ(200000, static_cast<int>(posted.unwrap().body.size()));
+  XWIFT_ASSERT_EQ("hi curl", fetched.unwrap().body);
+  
+  xwift::http::ServerStats stats = server.stats();
+  XWIFT_ASSERT_EQ(6, static_cast<int>(stats.connectionsAccepted));
+  XWIFT_ASSERT_EQ(8, static_cast<int>(stats.requests));
+  server.stop();
+  XWIFT_ASSERT_FALSE(server.running());
+}
+
+XWIFT_TEST(HTTP, ScriptServerHandlers) {
+  // A port nothing listens on, for the script to take
+  int probe = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  bind(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+  socklen_t length = sizeof(addr);
+  getsockname(probe, reinterpret_cast<sockaddr*>(&addr), &length);
+  int port = ntohs(addr.sin_port);
+  close(probe);
+  
+  std::string source =
+    "func hello(request) -> String {\n"
+    "    var params = request.params\n"
+    "    return \"hi \" + params[1]\n"
+    "}\n"
+    "func create(request) {\n"
+    "    return httpResponse(201, request.method + \" \" + request.body, [\"Location\", \"/items/9\"])\n"
+    "}\n"
+    "func quit(request) -> String {\n"
+    "    httpServerStop(request.server)\n"
+    "    return \"bye\"\n"
+    "}\n"
+    "func main() -> Int {\n"
+    "    var server = httpServer(" + std::to_string(port) + ")\n"
+    "    print(httpRoute(server, \"GET\", \"/hello/:name\", \"hello\"))\n"
+    "    print(httpRoute(server, \"POST\", \"/items\", \"create\"))\n"
+    "    print(httpRoute(server, \"GET\", \"/quit\", \"quit\"))\n"
+    "    print(httpServerStart(server))\n"
+    "    httpServerWait(server)\n"
+    "    print(\"stopped\")\n"
+    "    return 0\n"
+    "}\n";
+  auto running = std::async(std::launch::async, [&source]() {
+    return xwift::Isolate("server.xw").run(source);
+  });
+  
+  std::string url = "http://127.0.0.1:" + std::to_string(port);
+  xwift::http::CurlHTTPBackend backend;
+  auto hello = backend.get(url + "/hello/bob");
+  for (int i = 0; i < 100 && hello.is_error(); i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    hello = backend.get(url + "/hello/bob");
+  }
+  XWIFT_ASSERT_TRUE(hello.is_ok());
+  XWIFT_ASSERT_EQ("hi bob", hello.unwrap().body);
+  auto created = backend.post(url + "/items", "x=1");
+  XWIFT_ASSERT_TRUE(created.is_ok());
+  XWIFT_ASSERT_EQ(201, created.unwrap().statusCode);
+  XWIFT_ASSERT_EQ("POST x=1", created.unwrap().body);
+  XWIFT_ASSERT_EQ("/items/9", created.unwrap().getHeader("Location"));
+  auto quit = backend.get(url + "/quit");
+  XWIFT_ASSERT_TRUE(quit.is_ok());
+  XWIFT_ASSERT_EQ("bye", quit.unwrap().body);
+  
+  xwift::IsolateResult result = running.get();
+  XWIFT_ASSERT_TRUE(result.Success);
+  XWIFT_ASSERT_EQ("truetruetrue" + std::to_string(port) + "stopped", result.Output);
+}
+
+XWIFT_TEST(HTTP, StreamsMultipartBodies) {
+  using xwift::http::MultipartBody;
+  std::filesystem::path directory = std::filesystem::temp_directory_path() /
+    ("xwift-multipart-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+  std::filesystem::create_directories(directory);
+  std::string path = (directory / "data.bin").string();
+  std::string contents;
+  for (size_t i = 0; i < 3 * 1024 * 1024; i++) {
+    contents += static_cast<char>('a' + i % 26);
+  }
+  std::ofstream(path, std::ios::binary) << contents;
+  auto drain = [](MultipartBody& body, size_t chunk) {
+    std::string out;
+    std::vector<char> buffer(chunk);
+    std::ptrdiff_t read;
+    while ((read = body.read(buffer.data(), buffer.size())) > 0) {
+      out.append(buffer.data(), static_cast<size_t>(read));
+    }
+    return read == 0 ? out : std::string("error");
+  };
+  
+  // Fields alone come out as encodeMultipartFormData writes them
+  MultipartBody fields("B0UND");
+  fields.addField("a", "1");
+  fields.addField("b", "two");
+  std::string encoded = xwift::http::BodyEncoder::encodeMultipartFormData({{"a", "1"}, {"b", "two"}}, "B0UND");
+  XWIFT_ASSERT_EQ(encoded, drain(fields, 5));
+  XWIFT_ASSERT_EQ(encoded.size(), fields.size());
+  XWIFT_ASSERT_EQ("multipart/form-data; boundary=B0UND", fields.contentType());
+  
+  // A file part is read in chunks however they fall across the parts, and
+  // the size is known before any of it is read
+  auto body = std::make_shared<MultipartBody>("B0UND");
+  body->addField("note", "hi");
+  XWIFT_ASSERT_TRUE(body->addFile("upload", path).is_ok());
+  XWIFT_ASSERT_TRUE(body->addFile("upload", (directory / "missing").string()).is_error());
+  std::string expected =
+    "--B0UND\r\nContent-Disposition: form-data; name=\"note\"\r\n\r\nhi\r\n"
+    "--B0UND\r\nContent-Disposition: form-data; name=\"upload\"; filename=\"data.bin\"\r\n"
+    "Content-Type: application/octet-stream\r\n\r\n" + contents + "\r\n--B0UND--\r\n";
+  XWIFT_ASSERT_EQ(expected.size(), body->size());
+  XWIFT_ASSERT_TRUE(expected == drain(*body, 4093));
+  XWIFT_ASSERT_TRUE(body->rewind());
+  XWIFT_ASSERT_TRUE(expected == drain(*body, 65536));
+  
+  // The server sees Content-Length and the whole body, from the blocking
+  // and the async backend alike
+  xwift::http::HTTPServer server;
+  server.route("POST", "/echo", [](const xwift::http::ServerRequest& request,
+                                   xwift::http::ServerResponse& response) {
+    response.headers.emplace_back("X-Type", std::string(request.header("Content-Type")));
+    response.headers.emplace_back("X-Length", std::string(request.header("Content-Length")));
+    response.body = request.body;
+  });
+  auto port = server.start();
+  XWIFT_ASSERT_TRUE(port.is_ok());
+  std::string url = "http://127.0.0.1:" + std::to_string(port.unwrap()) + "/echo";
+  xwift::http::HTTPClient client;
+  auto posted = client.postMultipart(url, body);
+  XWIFT_ASSERT_TRUE(posted.is_ok());
+  XWIFT_ASSERT_EQ(200, posted.unwrap().statusCode);
+  XWIFT_ASSERT_TRUE(expected == posted.unwrap().body);
+  XWIFT_ASSERT_EQ(body->contentType(), posted.unwrap().getHeader("X-Type"));
+  XWIFT_ASSERT_EQ(std::to_string(expected.size()), posted.unwrap().getHeader("X-Length"));
+  xwift::http::Request batched;
+  batched.method = "POST";
+  batched.url = url;
+  batched.headers["Content-Type"] = body->contentType();
+  batched.bodySource = body;
+  auto batch = client.sendAll({batched});
+  XWIFT_ASSERT_TRUE(batch[0].is_ok());
+  XWIFT_ASSERT_TRUE(expected == batch[0].unwrap().body);
+  
+  // A file cut short after it was added fails the upload instead of
+  // sending fewer bytes than promised
+  std::filesystem::resize_file(path, 1000);
+  XWIFT_ASSERT_TRUE(client.postMultipart(url, body).is_error());
+  
+  std::string source =
+    "func main() -> Int {\n"
+    "    var response = httpPostMultipart(\"" + url + "\", [\"name\", \"ann\"], [\"upload\", \"" + path + "\"])\n"
+    "    print(response.status)\n"
+    "    print(len(response.body) > 1000)\n"
+    "    return 0\n"
+    "}\n";
+  xwift::IsolateResult result = xwift::Isolate("multipart.xw").run(source);
+  XWIFT_ASSERT_TRUE(result.Success);
+  XWIFT_ASSERT_EQ("200true", result.Output);
+  
+  server.stop();
+  std::filesystem::remove_all(directory);
+}
+
+XWIFT_TEST(Net, LoopbackStreamsAndDatagrams) {
+  using namespace xwift::net;
+  
+  // Lines and frames are taken only once all of them has arrived, however
+  // the bytes were split
+  StreamBuffer buffer;
+  std::string frame = StreamBuffer::framePrefix(5) + "hello";
+  buffer.append("one\r\ntw", 7);
+  buffer.append("o\n", 2);
+  buffer.append(frame.data(), 6);
+  XWIFT_ASSERT_EQ("one", buffer.takeLine().value_or("-"));
+  XWIFT_ASSERT_EQ("two", buffer.takeLine().value_or("-"));
+  bool tooLarge = false;
+  XWIFT_ASSERT_FALSE(buffer.takeFrame(tooLarge).has_value());
+  buffer.append(frame.data() + 6, frame.size() - 6);
+  XWIFT_ASSERT_EQ("hello", buffer.takeFrame(tooLarge).value_or("-"));
+  XWIFT_ASSERT_TRUE(buffer.empty());
+  std::string huge = StreamBuffer::framePrefix(StreamBuffer::MaxFrameBytes + 1);
+  buffer.append(huge.data(), huge.size());
+  XWIFT_ASSERT_FALSE(buffer.takeFrame(tooLarge).has_value());
+  XWIFT_ASSERT_TRUE(tooLarge);
+  
+  xwift::EventLoop loop;
+  auto listener = TCPListener::listen(loop, "127.0.0.1", 0);
+  XWIFT_ASSERT_TRUE(listener.is_ok());
+  int port = listener.unwrap()->localPort();
+  XWIFT_ASSERT_TRUE(port > 0);
+  
+  std::promise<std::shared_ptr<TCPStream>> accepted;
+  listener.unwrap()->accept([&accepted](xwift::Result<std::shared_ptr<TCPStream>> result) {
+    accepted.set_value(result.is_ok() ? result.unwrap() : nullptr);
+  });
+  std::promise<std::shared_ptr<TCPStream>> connected;
+  TCPStream::connect(loop, "127.0.0.1", port, [&connected](xwift::Result<std::shared_ptr<TCPStream>> result) {
+    connected.set_value(result.is_ok() ? result.unwrap() : nullptr);
+  });
+  auto client = connected.get_future().get();
+  auto server = accepted.get_future().get();
+  XWIFT_ASSERT_TRUE(client != nullptr);
+  XWIFT_ASSERT_TRUE(server != nullptr);
+  XWIFT_ASSERT_EQ(port, client->peer().port);
+  
+  // Writes queued together arrive in order, and reads of different kinds
+  // share what has been buffered
+  std::string big(3 * 1024 * 1024, 'x');
+  std::atomic<size_t> written{0};
+  auto count = [&written](xwift::Result<size_t> result) {
+    if (result.is_ok()) {
+      written += result.unwrap();
+    }
+  };
+  client->write("first line\nsecond", count);
+  client->write(" line\r\n", count);
+  client->writeFrame(big, count);
+  client->writeFrame("", count);
+  std::promise<void> flushed;
+  client->write("tail", [&](xwift::Result<size_t> result) {
+    count(std::move(result));
+    flushed.set_value();
+  });
+  std::vector<std::promise<std::optional<std::string>>> reads(6);
+  auto collect = [&reads](size_t i) {
+    return [&reads, i](xwift::Result<std::optional<std::string>> result) {
+      reads[i].set_value(result.is_ok() ? result.unwrap() : std::optional<std::string>("error"));
+    };
+  };
+  server->readLine(collect(0));
+  server->readLine(collect(1));
+  server->readFrame(collect(2));
+  server->readFrame(collect(3));
+  XWIFT_ASSERT_EQ("first line", reads[0].get_future().get().value_or("-"));
+  XWIFT_ASSERT_EQ("second line", reads[1].get_future().get().value_or("-"));
+  XWIFT_ASSERT_TRUE(big == reads[2].get_future().get().value_or("-"));
+  XWIFT_ASSERT_EQ("", reads[3].get_future().get().value_or("-"));
+  flushed.get_future().get();
+  client->close();
+  server->readLine(collect(4));
+  server->read(16, collect(5));
+  // A last line without its newline still comes out, then the end
+  XWIFT_ASSERT_EQ("tail", reads[4].get_future().get().value_or("-"));
+  XWIFT_ASSERT_FALSE(reads[5].get_future().get().has_value());
+  XWIFT_ASSERT_EQ(17u + 7u + 4u + big.size() + 4u + 4u, written.load());
+  server->close();
+  listener.unwrap()->close();
+  
+  // A batch of datagrams goes out in one call and comes back with its
+  // sender, at most as many per receive as asked for
+  auto receiver = UDPSocket::bind(loop, "127.0.0.1", 0);
+  auto sender = UDPSocket::bind(loop, "127.0.0.1", 0);
+  XWIFT_ASSERT_TRUE(receiver.is_ok());
+  XWIFT_ASSERT_TRUE(sender.is_ok());
+  Endpoint to{"127.0.0.1", receiver.unwrap()->localPort()};
+  std::vector<Datagram> batch;
+  for (int i = 0; i < 20; i++) {
+    batch.push_back(Datagram{"datagram " + std::to_string(i), to});
+  }
+  auto sent = sender.unwrap()->sendBatch(batch);
+  XWIFT_ASSERT_TRUE(sent.is_ok());
+  XWIFT_ASSERT_EQ(20u, sent.unwrap());
+  std::vector<Datagram> got;
+  while (got.size() < batch.size()) {
+    std::promise<std::vector<Datagram>> received;
+    receiver.unwrap()->receive(8, [&received](xwift::Result<std::vector<Datagram>> result) {
+      received.set_value(result.is_ok() ? result.unwrap() : std::vector<Datagram>());
+    });
+    auto some = received.get_future().get();
+    XWIFT_ASSERT_TRUE(!some.empty() && some.size() <= 8);
+    got.insert(got.end(), some.begin(), some.end());
+  }
+  XWIFT_ASSERT_EQ("datagram 0", got[0].data);
+  XWIFT_ASSERT_EQ("datagram 19", got[19].data);
+  XWIFT_ASSERT_EQ(sender.unwrap()->localPort(), got[19].peer.port);
+  XWIFT_ASSERT_TRUE(UDPSocket::bind(loop, "no such host.invalid", 0).is_error());
+  receiver.unwrap()->close();
+  sender.unwrap()->close();
+  
+  std::string source =
+    "func main() -> Int {\n"
+    "    var listener = tcpListen(\"127.0.0.1\", 0)\n"
+    "    var client = tcpConnect(\"127.0.0.1\", socketPort(listener))\n"
+    "    var server = tcpAccept(listener)\n"
+    "    socketSend(client, \"ping\\npong\\n\")\n"
+    "    socketSendFrame(server, \"framed\")\n"
+    "    print(socketReadLine(server))\n"
+    "    var line = socketReadLineAsync(server)\n"
+    "    print(await line)\n"
+    "    print(socketReadFrame(client))\n"
+    "    socketClose(client)\n"
+    "    print(socketReadLine(server) == nil)\n"
+    "    print(tcpConnect(\"127.0.0.1\", 0))\n"
+    "    var udp = udpBind(\"127.0.0.1\", 0)\n"
+    "    print(udpSendBatch(udp, \"127.0.0.1\", socketPort(udp), [\"a\", \"b\", \"c\"]))\n"
+    "    var datagrams = udpRecvBatch(udp, 16)\n"
+    "    var first = datagrams[0]\n"
+    "    print(first.data)\n"
+    "    var pending = udpRecvBatchAsync(udp, 16)\n"
+    "    udpSendTo(udp, \"127.0.0.1\", socketPort(udp), \"d\")\n"
+    "    var later = await pending\n"
+    "    var last = later[0]\n"
+    "    print(last.data)\n"
+    "    print(socketClose(udp))\n"
+    "    print(socketClose(udp))\n"
+    "    return 0\n"
+    "}\n";
+  xwift::IsolateResult result = xwift::Isolate("sockets.xw").run(source);
+  XWIFT_ASSERT_TRUE(result.Success);
+  XWIFT_ASSERT_EQ("pingpongframedtrue-13adtruefalse", result.Output);
+}
+
 int main() {
   auto& runner = TestRunner::getInstance();
   runner.runAll();
@@ -2,6 +2,7 @@
 #include "xwift/Basic/Diagnostic.h"
 #include "xwift/Sema/Sema.h"
 #include "xwift/AST/Optimizer.h"
+#include "xwift/AST/TypeProfile.h"
 #include <iostream>
 #include <memory>
 #include <string>
@@ -61,7 +62,8 @@ public:
         std::cout << "error: please specify a file to run" << std::endl;
         return 1;
       }
-      return runFile(args[1]);
+      bool useProfile = args.size() > 2 && args[2] == "--profile";
+      return runFile(args[1], useProfile);
     } else if (action == "--check") {
       if (args.size() < 2) {
         std::cout << "error: please specify a file to check" << std::endl;
@@ -80,7 +82,7 @@ public:
     return 0;
   }
   
-  int runFile(const std::string& filename) {
+  int runFile(const std::string& filename, bool useProfile = false) {
     std::ifstream file(filename);
     if (!file.is_open()) {
       std::cout << "error: cannot open file '" << filename << "'" << std::endl;
@@ -116,6 +118,17 @@ public:
       Interpreter interpreter(diag);
       interpreter.setFilename(filename);
       
+      TypeProfile profile;
+      std::string profilePath = TypeProfile::pathFor(filename);
+      uint64_t sourceHash = TypeProfile::hashSource(source);
+      if (useProfile) {
+        profile.reset(TypeProfile::numberSites(program.get()).size());
+        if (profile.load(profilePath, sourceHash)) {
+          optimizer.applyProfile(program.get(), profile);
+        }
+        interpreter.setProfile(&profile);
+      }
+      
       fs::path filePath(filename);
       std::string basePath = filePath.parent_path().string();
       if (basePath.empty()) {
@@ -123,6 +136,10 @@ public:
       }
       interpreter.run(program.get(), basePath);
       
+      if (useProfile) {
+        profile.save(profilePath, sourceHash);
+      }
+      
       if (diag.hasErrors()) {
         return 1;
       }
@@ -214,10 +231,13 @@ public:
     std::cout << "  -h, --help      Display available options\n";
     std::cout << "  --test-lexer    Test lexer with source code\n";
     std::cout << "  run <file>      Run a .xw source file\n";
+    std::cout << "  run <file> --profile\n";
+    std::cout << "                  Run with type feedback from <file>.xwprofile\n";
     std::cout << "  --check <file>  Check a .xw source file for errors\n";
     std::cout << "\nExamples:\n";
     std::cout << "  xwift hello.xw       Run hello.xw\n";
     std::cout << "  xwift run hello.xw   Run hello.xw\n";
+    std::cout << "  xwift run hello.xw --profile  Run hello.xw and update hello.xwprofile\n";
     std::cout << "  xwift --check hello.xw  Check hello.xw for errors\n";
   }
 };